@@ -25,6 +25,8 @@
  *  SUCH DAMAGE.
  */
 
+#include <algorithm>
+
 #include "components/MainbusComponent.h"
 #include "GXemul.h"
 
@@ -33,6 +35,7 @@ MainbusComponent::MainbusComponent()
 	: Component("mainbus", "mainbus")
 	, m_memoryMapFailed(false)
 	, m_memoryMapValid(false)
+	, m_lastHitEntry(0)
 	, m_currentAddressDataBus(NULL)
 {
 }
@@ -66,6 +69,7 @@ void MainbusComponent::FlushCachedStateForComponent()
 	m_memoryMap.clear();
 	m_memoryMapValid = false;
 	m_memoryMapFailed = false;
+	m_lastHitEntry = 0;
 
 	m_currentAddressDataBus = NULL;
 	
@@ -108,6 +112,7 @@ bool MainbusComponent::MakeSureMemoryMapExists(GXemul* gxemul)
 
 		MemoryMapEntry mmEntry;
 		mmEntry.addressDataBus = bus;
+		mmEntry.component = children[i];
 		mmEntry.addrMul = 1;
 		mmEntry.base = 0;
 
@@ -137,41 +142,70 @@ bool MainbusComponent::MakeSureMemoryMapExists(GXemul* gxemul)
 		if (mmEntry.size == 0)
 			continue;
 
-		// Check for overlaps against the already existing mappings.
-		//
-		// (Note: Current implementation results in O(n^2) time,
-		// but if the number of memory-mapped immediate childs are
-		// few, then this should not be a big problem.)
-		for (size_t j=0; j<m_memoryMap.size(); ++j) {
-			if (mmEntry.base+mmEntry.size <= m_memoryMap[j].base)
-				continue;
-
-			if (mmEntry.base >= m_memoryMap[j].base +
-			    m_memoryMap[j].size)
-				continue;
-		
-			// There is overlap!
-			if (gxemul != NULL)
-				gxemul->GetUI()->ShowDebugMessage(this,
-				    "Error: the base and/or size of " +
-				    children[i]->GenerateShortestPossiblePath() +
-				    " conflicts with another memory mapped "
-				    "component on this bus.\n");
-
-			m_memoryMap.clear();
-			m_memoryMapValid = false;
-			m_memoryMapFailed = true;
-			return false;
-		}
-
-		// Finally add the new mapping entry.
 		m_memoryMap.push_back(mmEntry);
 	}
 
+	// Sort the map by base address. Overlaps can then be detected by
+	// comparing each entry to the one before it, and lookups can use
+	// binary search.
+	std::stable_sort(m_memoryMap.begin(), m_memoryMap.end());
+
+	for (size_t i=1; i<m_memoryMap.size(); ++i) {
+		const MemoryMapEntry& prev = m_memoryMap[i-1];
+		if (m_memoryMap[i].base - prev.base >= prev.size)
+			continue;
+
+		// There is overlap!
+		if (gxemul != NULL)
+			gxemul->GetUI()->ShowDebugMessage(this,
+			    "Error: the base and/or size of " +
+			    m_memoryMap[i].component->
+			    GenerateShortestPossiblePath() +
+			    " conflicts with another memory mapped "
+			    "component on this bus.\n");
+
+		m_memoryMap.clear();
+		m_memoryMapValid = false;
+		m_memoryMapFailed = true;
+		return false;
+	}
+
 	return true;
 }
 
 
+const MainbusComponent::MemoryMapEntry*
+MainbusComponent::LookupMemoryMapEntry(uint64_t address)
+{
+	// Most accesses hit the same entry as the previous access.
+	if (m_lastHitEntry < m_memoryMap.size()) {
+		const MemoryMapEntry& mmEntry = m_memoryMap[m_lastHitEntry];
+		if (address - mmEntry.base < mmEntry.size)
+			return &mmEntry;
+	}
+
+	// Binary search for the last entry with base <= address:
+	size_t lo = 0, hi = m_memoryMap.size();
+	while (lo < hi) {
+		size_t mid = (lo + hi) / 2;
+		if (m_memoryMap[mid].base <= address)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if (lo == 0)
+		return NULL;
+
+	const MemoryMapEntry& mmEntry = m_memoryMap[lo - 1];
+	if (address - mmEntry.base >= mmEntry.size)
+		return NULL;
+
+	m_lastHitEntry = lo - 1;
+	return &mmEntry;
+}
+
+
 AddressDataBus* MainbusComponent::AsAddressDataBus()
 {
 	return this;
@@ -187,31 +221,41 @@ void MainbusComponent::AddressSelect(uint64_t address)
 	if (!m_memoryMapValid)
 		return;
 
-	// Note: This is a linear O(n) scan of the list of memory-mapped
-	// components. For small n, this should be ok.
-	//
-	// In practice, my hope is that the bulk of all memory access will be
-	// using direct-mapped pages anyway, so this should not be that much
-	// of a problem.
-
-	for (size_t i=0; i<m_memoryMap.size(); ++i) {
-		MemoryMapEntry& mmEntry = m_memoryMap[i];
-
-		// If this memory map entry contains the address we wish to
-		// select, then...
-		if (address >= mmEntry.base &&
-		    address < mmEntry.base + mmEntry.size) {
-			// ... tell the corresponding component which address
-			// within it we wish to select.
-			m_currentAddressDataBus = mmEntry.addressDataBus;
-			m_currentAddressDataBus->AddressSelect(
-			    (address - mmEntry.base) / mmEntry.addrMul);
-			break;
-		}
+	const MemoryMapEntry* mmEntry = LookupMemoryMapEntry(address);
+
+	// If a memory map entry contains the address we wish to select,
+	// then tell the corresponding component which address within it
+	// we wish to select.
+	if (mmEntry != NULL) {
+		m_currentAddressDataBus = mmEntry->addressDataBus;
+		m_currentAddressDataBus->AddressSelect(
+		    (address - mmEntry->base) / mmEntry->addrMul);
 	}
 }
 
 
+uint8_t* MainbusComponent::LookupHostMemory(uint64_t address,
+	uint64_t& length, bool writable)
+{
+	if (!MakeSureMemoryMapExists())
+		return NULL;
+
+	const MemoryMapEntry* mmEntry = LookupMemoryMapEntry(address);
+	if (mmEntry == NULL || mmEntry->addrMul != 1)
+		return NULL;
+
+	uint64_t offset = address - mmEntry->base;
+	uint8_t* host = mmEntry->addressDataBus->LookupHostMemory(offset,
+	    length, writable);
+
+	// Don't let the caller access memory beyond the end of the range.
+	if (host != NULL && length > mmEntry->size - offset)
+		length = mmEntry->size - offset;
+
+	return host;
+}
+
+
 bool MainbusComponent::ReadData(uint8_t& data, Endianness endianness)
 {
 	if (!MakeSureMemoryMapExists())
@@ -444,6 +488,84 @@ static void Test_MainbusComponent_Multiple_NonOverlapping()
 	}
 }
 
+static void Test_MainbusComponent_Multiple_Unsorted()
+{
+	refcount_ptr<Component> mainbus =
+	    ComponentFactory::CreateComponent("mainbus");
+
+	// Add RAM components in non-ascending address order, with a hole
+	// between some of them.
+	const char* bases[] = { "0x5000", "0x1000", "0x4000", "0x0000", "0x2000" };
+	for (size_t i = 0; i < sizeof(bases) / sizeof(bases[0]); ++i) {
+		refcount_ptr<Component> ram =
+		    ComponentFactory::CreateComponent("ram");
+		mainbus->AddChild(ram);
+		ram->SetVariableValue("memoryMappedSize", "0x1000");
+		ram->SetVariableValue("memoryMappedBase", bases[i]);
+	}
+
+	AddressDataBus* bus = mainbus->AsAddressDataBus();
+
+	for (uint64_t addr = 0; addr < 0x6000; addr += 0x800) {
+		uint8_t data = addr >> 8;
+		bus->AddressSelect(addr);
+		bool success = bus->WriteData(data);
+		UnitTest::Assert("write should fail only in the hole",
+		    success, addr < 0x3000 || addr >= 0x4000);
+	}
+
+	// Read back in reverse order, to not only hit the last used entry.
+	for (int i = 11; i >= 0; --i) {
+		uint64_t addr = i * 0x800;
+		uint8_t data = 0xff;
+		bus->AddressSelect(addr);
+		bus->ReadData(data);
+		if (addr < 0x3000 || addr >= 0x4000)
+			UnitTest::Assert("memory wasn't written to correctly?",
+			    data, addr >> 8);
+	}
+}
+
+static void Test_MainbusComponent_LookupHostMemory()
+{
+	refcount_ptr<Component> mainbus =
+	    ComponentFactory::CreateComponent("mainbus");
+	refcount_ptr<Component> ram0 =
+	    ComponentFactory::CreateComponent("ram");
+
+	mainbus->AddChild(ram0);
+	ram0->SetVariableValue("memoryMappedSize", "0x10000");
+	ram0->SetVariableValue("memoryMappedBase", "0x1000");
+
+	AddressDataBus* bus = mainbus->AsAddressDataBus();
+
+	uint64_t length = 0;
+	UnitTest::Assert("unwritten RAM should not be returned for reading",
+	    bus->LookupHostMemory(0x1010, length, false) == NULL);
+
+	uint8_t* host = bus->LookupHostMemory(0x1010, length, true);
+	UnitTest::Assert("RAM should be returned for writing", host != NULL);
+	UnitTest::Assert("length should stop at the end of the range",
+	    length, 0x10000 - 0x10);
+
+	host[0] = 0x12;
+	host[1] = 0x34;
+
+	uint16_t data = 0;
+	bus->AddressSelect(0x1010);
+	bus->ReadData(data, BigEndian);
+	UnitTest::Assert("host memory and ReadData disagree", data, 0x1234);
+
+	UnitTest::Assert("unmapped address should return NULL",
+	    bus->LookupHostMemory(0x800, length, false) == NULL);
+
+	ram0->SetVariableValue("writeProtect", "true");
+	UnitTest::Assert("write protected RAM should not be writable",
+	    bus->LookupHostMemory(0x1010, length, true) == NULL);
+	UnitTest::Assert("write protected RAM should still be readable",
+	    bus->LookupHostMemory(0x1010, length, false) == host);
+}
+
 static void Test_MainbusComponent_Simple_With_AddrMul()
 {
 	refcount_ptr<Component> mainbus =
@@ -551,7 +673,9 @@ UNITTESTS(MainbusComponent)
 	UNITTEST(Test_MainbusComponent_Simple);
 	UNITTEST(Test_MainbusComponent_Remapping);
 	UNITTEST(Test_MainbusComponent_Multiple_NonOverlapping);
+	UNITTEST(Test_MainbusComponent_Multiple_Unsorted);
 	UNITTEST(Test_MainbusComponent_Simple_With_AddrMul);
+	UNITTEST(Test_MainbusComponent_LookupHostMemory);
 
 	// TODO: Write outside of mapped space
 	// TODO: Write PARTIALLY outside of mapped space!!! e.g. 64-bit
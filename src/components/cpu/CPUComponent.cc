@@ -26,6 +26,7 @@
  */
 
 #include <assert.h>
+#include <string.h>
 #include <iomanip>
 
 #include "AddressDataBus.h"
@@ -51,6 +52,10 @@ CPUComponent::CPUComponent(const string& className, const string& cpuArchitectur
 	, m_functionCallTraceDepth(0)
 	, m_nrOfTracedFunctionCalls(0)
 	, m_addressDataBus(NULL)
+	, m_hostMemory(NULL)
+	, m_hostMemoryPaddr(0)
+	, m_hostMemoryLength(0)
+	, m_hostMemoryWritable(false)
 {
 	AddVariable("architecture", &m_cpuArchitecture);
 	AddVariable("pc", &m_pc);
@@ -82,6 +87,7 @@ CPUComponent * CPUComponent::AsCPUComponent()
 void CPUComponent::ResetState()
 {
 	m_hasUsedUnassemble = false;
+	m_hostMemory = NULL;
 	m_exceptionOrAbortInDelaySlot = false;
 	m_inDelaySlot = false;
 	m_delaySlotTarget = 0;
@@ -434,6 +440,7 @@ AddressDataBus * CPUComponent::AsAddressDataBus()
 void CPUComponent::FlushCachedStateForComponent()
 {
 	m_addressDataBus = NULL;
+	m_hostMemory = NULL;
 
 	Component::FlushCachedStateForComponent();
 }
@@ -509,6 +516,39 @@ void CPUComponent::ShowRegisters(GXemul* gxemul, const vector<string>& arguments
 }
 
 
+uint8_t* CPUComponent::DirectHostMemory(uint64_t paddr, size_t len,
+	bool writable)
+{
+	uint64_t offset = paddr - m_hostMemoryPaddr;
+	if (m_hostMemory != NULL && offset < m_hostMemoryLength &&
+	    m_hostMemoryLength - offset >= len &&
+	    (m_hostMemoryWritable || !writable))
+		return m_hostMemory + offset;
+
+	// Ask the bus for host memory starting at the beginning of the
+	// page, so that later accesses within the same page also hit. If the
+	// page is not entirely in one range, try the address itself.
+	uint64_t base = paddr & ~(uint64_t)0xfff;
+	uint64_t length = 0;
+	uint8_t* host = m_addressDataBus->LookupHostMemory(base, length,
+	    writable);
+	if (host == NULL || length < paddr - base + len) {
+		base = paddr;
+		host = m_addressDataBus->LookupHostMemory(base, length,
+		    writable);
+		if (host == NULL || length < len)
+			return NULL;
+	}
+
+	m_hostMemory = host;
+	m_hostMemoryPaddr = base;
+	m_hostMemoryLength = length;
+	m_hostMemoryWritable = writable;
+
+	return m_hostMemory + (paddr - base);
+}
+
+
 void CPUComponent::AddressSelect(uint64_t address)
 {
 	m_addressSelect = address;
@@ -524,6 +564,12 @@ bool CPUComponent::ReadData(uint8_t& data, Endianness endianness)
 	bool writable;
 	VirtualToPhysical(m_addressSelect, paddr, writable);
 
+	uint8_t* host = DirectHostMemory(paddr, sizeof(data), false);
+	if (host != NULL) {
+		data = *host;
+		return true;
+	}
+
 	m_addressDataBus->AddressSelect(paddr);
 	return m_addressDataBus->ReadData(data, endianness);
 }
@@ -540,6 +586,17 @@ bool CPUComponent::ReadData(uint16_t& data, Endianness endianness)
 	bool writable;
 	VirtualToPhysical(m_addressSelect, paddr, writable);
 
+	uint8_t* host = DirectHostMemory(paddr, sizeof(data), false);
+	if (host != NULL) {
+		uint16_t d;
+		memcpy(&d, host, sizeof(d));
+		if (endianness == BigEndian)
+			data = BE16_TO_HOST(d);
+		else
+			data = LE16_TO_HOST(d);
+		return true;
+	}
+
 	m_addressDataBus->AddressSelect(paddr);
 	return m_addressDataBus->ReadData(data, endianness);
 }
@@ -556,6 +613,17 @@ bool CPUComponent::ReadData(uint32_t& data, Endianness endianness)
 	bool writable;
 	VirtualToPhysical(m_addressSelect, paddr, writable);
 
+	uint8_t* host = DirectHostMemory(paddr, sizeof(data), false);
+	if (host != NULL) {
+		uint32_t d;
+		memcpy(&d, host, sizeof(d));
+		if (endianness == BigEndian)
+			data = BE32_TO_HOST(d);
+		else
+			data = LE32_TO_HOST(d);
+		return true;
+	}
+
 	m_addressDataBus->AddressSelect(paddr);
 	return m_addressDataBus->ReadData(data, endianness);
 }
@@ -572,6 +640,17 @@ bool CPUComponent::ReadData(uint64_t& data, Endianness endianness)
 	bool writable;
 	VirtualToPhysical(m_addressSelect, paddr, writable);
 
+	uint8_t* host = DirectHostMemory(paddr, sizeof(data), false);
+	if (host != NULL) {
+		uint64_t d;
+		memcpy(&d, host, sizeof(d));
+		if (endianness == BigEndian)
+			data = BE64_TO_HOST(d);
+		else
+			data = LE64_TO_HOST(d);
+		return true;
+	}
+
 	m_addressDataBus->AddressSelect(paddr);
 	return m_addressDataBus->ReadData(data, endianness);
 }
@@ -586,6 +665,12 @@ bool CPUComponent::WriteData(const uint8_t& data, Endianness endianness)
 	bool writable;
 	VirtualToPhysical(m_addressSelect, paddr, writable);
 
+	uint8_t* host = DirectHostMemory(paddr, sizeof(data), true);
+	if (host != NULL) {
+		*host = data;
+		return true;
+	}
+
 	m_addressDataBus->AddressSelect(paddr);
 	return m_addressDataBus->WriteData(data, endianness);
 }
@@ -602,6 +687,17 @@ bool CPUComponent::WriteData(const uint16_t& data, Endianness endianness)
 	bool writable;
 	VirtualToPhysical(m_addressSelect, paddr, writable);
 
+	uint8_t* host = DirectHostMemory(paddr, sizeof(data), true);
+	if (host != NULL) {
+		uint16_t d;
+		if (endianness == BigEndian)
+			d = BE16_TO_HOST(data);
+		else
+			d = LE16_TO_HOST(data);
+		memcpy(host, &d, sizeof(d));
+		return true;
+	}
+
 	m_addressDataBus->AddressSelect(paddr);
 	return m_addressDataBus->WriteData(data, endianness);
 }
@@ -618,6 +714,17 @@ bool CPUComponent::WriteData(const uint32_t& data, Endianness endianness)
 	bool writable;
 	VirtualToPhysical(m_addressSelect, paddr, writable);
 
+	uint8_t* host = DirectHostMemory(paddr, sizeof(data), true);
+	if (host != NULL) {
+		uint32_t d;
+		if (endianness == BigEndian)
+			d = BE32_TO_HOST(data);
+		else
+			d = LE32_TO_HOST(data);
+		memcpy(host, &d, sizeof(d));
+		return true;
+	}
+
 	m_addressDataBus->AddressSelect(paddr);
 	return m_addressDataBus->WriteData(data, endianness);
 }
@@ -634,6 +741,17 @@ bool CPUComponent::WriteData(const uint64_t& data, Endianness endianness)
 	bool writable;
 	VirtualToPhysical(m_addressSelect, paddr, writable);
 
+	uint8_t* host = DirectHostMemory(paddr, sizeof(data), true);
+	if (host != NULL) {
+		uint64_t d;
+		if (endianness == BigEndian)
+			d = BE64_TO_HOST(data);
+		else
+			d = LE64_TO_HOST(data);
+		memcpy(host, &d, sizeof(d));
+		return true;
+	}
+
 	m_addressDataBus->AddressSelect(paddr);
 	return m_addressDataBus->WriteData(data, endianness);
 }
@@ -675,6 +793,43 @@ static void Test_CPUComponent_PreRunCheck()
 	    gxemul.GetRootComponent()->PreRunCheck(&gxemul) == true);
 }
 
+static void Test_CPUComponent_HostMemoryIsForgotten()
+{
+	GXemul gxemul;
+
+	gxemul.GetCommandInterpreter().RunCommand("add mips_cpu");
+	gxemul.GetCommandInterpreter().RunCommand("add ram cpu0");
+
+	refcount_ptr<Component> cpu =
+	    gxemul.GetRootComponent()->LookupPath("root.cpu0");
+	refcount_ptr<Component> ram =
+	    gxemul.GetRootComponent()->LookupPath("root.cpu0.ram0");
+	UnitTest::Assert("lookup failed", !cpu.IsNULL() && !ram.IsNULL());
+
+	// Writing through the CPU makes it cache a pointer to the RAM block.
+	AddressDataBus* bus = cpu->AsAddressDataBus();
+	uint32_t data32 = 0x12345678;
+	bus->AddressSelect(0xffffffff80001000ULL);
+	bus->WriteData(data32, BigEndian);
+
+	ram->SetVariableValue("writeProtect", "true");
+	data32 = 0x11111111;
+	bus->AddressSelect(0xffffffff80001000ULL);
+	UnitTest::Assert("write to write protected RAM should fail",
+	    bus->WriteData(data32, BigEndian) == false);
+	ram->SetVariableValue("writeProtect", "false");
+
+	bus->AddressSelect(0xffffffff80001000ULL);
+	bus->ReadData(data32, BigEndian);
+	UnitTest::Assert("write protected RAM was modified", data32, 0x12345678);
+
+	// Resetting the RAM releases its blocks.
+	ram->Reset();
+	bus->AddressSelect(0xffffffff80001000ULL);
+	bus->ReadData(data32, BigEndian);
+	UnitTest::Assert("RAM should be zero after a reset", data32, 0);
+}
+
 static void Test_CPUComponent_Methods_Reexecutableness()
 {
 	refcount_ptr<Component> cpu =
@@ -698,6 +853,7 @@ UNITTESTS(CPUComponent)
 	UNITTEST(Test_CPUComponent_IsStable);
 	UNITTEST(Test_CPUComponent_Create);
 	UNITTEST(Test_CPUComponent_PreRunCheck);
+	UNITTEST(Test_CPUComponent_HostMemoryIsForgotten);
 	UNITTEST(Test_CPUComponent_Methods_Reexecutableness);
 }
 
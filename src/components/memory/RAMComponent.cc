@@ -27,6 +27,7 @@
 
 #include <iomanip>
 #include <assert.h>
+#include <unistd.h>
 
 #include "components/RAMComponent.h"
 #include "GXemul.h"
@@ -51,18 +52,71 @@ RAMComponent::RAMComponent(const string& visibleClassName)
 
 RAMComponent::~RAMComponent()
 {
-	ReleaseAllBlocks();
+	FreeBlocks();
 }
 
 
-void RAMComponent::ReleaseAllBlocks()
+void RAMComponent::FreeBlocks()
 {
 	for (size_t i=0; i<m_memoryBlocks.size(); ++i) {
 		if (m_memoryBlocks[i] != NULL) {
-			free(m_memoryBlocks[i]);
+			if (i < m_mappedBlocks.size() && m_mappedBlocks[i])
+				munmap(m_memoryBlocks[i], m_blockSize);
+			else
+				free(m_memoryBlocks[i]);
+
 			m_memoryBlocks[i] = NULL;
 		}
 	}
+
+	m_mappedBlocks.clear();
+	m_selectedHostMemoryBlock = NULL;
+}
+
+
+void RAMComponent::ReleaseAllBlocks()
+{
+	FreeBlocks();
+	FlushHostMemoryUsers();
+}
+
+
+void RAMComponent::FlushHostMemoryUsers()
+{
+	// Other components (CPUs) may hold pointers returned by
+	// LookupHostMemory. They are cached state, so flushing the cached
+	// state of the whole tree makes them look up the memory again.
+	Component* root = this;
+	while (root->GetParent() != NULL)
+		root = root->GetParent();
+
+	root->FlushCachedState();
+}
+
+
+void RAMComponent::SetBlock(size_t blockNr, void *block, bool mapped)
+{
+	if (blockNr+1 > m_memoryBlocks.size())
+		m_memoryBlocks.resize(blockNr + 1);
+
+	if (mapped) {
+		if (blockNr+1 > m_mappedBlocks.size())
+			m_mappedBlocks.resize(blockNr + 1);
+
+		m_mappedBlocks[blockNr] = true;
+	}
+
+	m_memoryBlocks[blockNr] = block;
+
+	// Refresh the selected block, in case it was just replaced.
+	AddressSelect(m_addressSelect);
+}
+
+
+uint64_t RAMComponent::GetMemorySize() const
+{
+	const StateVariable* memoryMappedSize = GetVariable("memoryMappedSize");
+	return memoryMappedSize == NULL? 0 : memoryMappedSize->ToInteger();
 }
 
 
@@ -90,6 +144,17 @@ void RAMComponent::ResetState()
 }
 
 
+bool RAMComponent::CheckVariableWrite(StateVariable& var, const string& oldValue)
+{
+	// Writable host pointers must not be used after write protection
+	// has been turned on.
+	if (var.GetName() == "writeProtect")
+		FlushHostMemoryUsers();
+
+	return MemoryMappedComponent::CheckVariableWrite(var, oldValue);
+}
+
+
 void RAMComponent::GetMethodNames(vector<string>& names) const
 {
 	// Add our method names...
@@ -217,6 +282,34 @@ void RAMComponent::AddressSelect(uint64_t address)
 }
 
 
+uint8_t* RAMComponent::LookupHostMemory(uint64_t address, uint64_t& length,
+	bool writable)
+{
+	if (writable && m_writeProtected)
+		return NULL;
+
+	uint64_t blockNr = address >> m_blockSizeShift;
+	void *block = NULL;
+	if (blockNr < m_memoryBlocks.size())
+		block = m_memoryBlocks[blockNr];
+
+	// Blocks which have not been written to yet read as zeroes. Let the
+	// caller use ReadData for those, rather than allocating memory.
+	if (block == NULL) {
+		if (!writable)
+			return NULL;
+
+		AddressSelect(address);
+		block = m_selectedHostMemoryBlock = AllocateBlock();
+	}
+
+	size_t offsetWithinBlock = address & (m_blockSize-1);
+	length = m_blockSize - offsetWithinBlock;
+
+	return (uint8_t*)block + offsetWithinBlock;
+}
+
+
 void* RAMComponent::AllocateBlock()
 {
 	void * p = calloc(m_blockSize, 1);
@@ -643,6 +736,99 @@ static void Test_RAMComponent_ManualSerialization()
 	UnitTest::Assert("16-bit read", data16_a, 0x3512);
 }
 
+static void Test_RAMComponent_BinarySerialization()
+{
+	refcount_ptr<Component> ram = ComponentFactory::CreateComponent("ram");
+	ram->SetVariableValue("memoryMappedSize", "0x2000000");
+	AddressDataBus* bus = ram->AsAddressDataBus();
+
+	uint32_t data32 = 0x89abcde5;
+	bus->AddressSelect(4);
+	bus->WriteData(data32, BigEndian);
+
+	uint16_t data16_a = 0x1235;
+	bus->AddressSelect(0x1000010);
+	bus->WriteData(data16_a, LittleEndian);
+
+	BinarySerializer serializer;
+	serializer.WriteHeader();
+	ram->SerializeBinary(serializer);
+
+	// Write to a temporary file, and map it back in:
+	char filename[] = "/tmp/gxemul_test_ram.XXXXXX";
+	int fd = mkstemp(filename);
+	UnitTest::Assert("could not create temporary file", fd >= 0);
+	UnitTest::Assert("writev failed", serializer.WriteToFile(fd));
+	close(fd);
+
+	refcount_ptr<Component> ram2;
+	{
+		BinaryDeserializer deserializer;
+		UnitTest::Assert("open failed", deserializer.Open(filename));
+		unlink(filename);
+		UnitTest::Assert("header", deserializer.ReadHeader());
+
+		stringstream messages;
+		ram2 = Component::DeserializeBinary(messages, deserializer);
+		UnitTest::Assert("deserialization failed", !ram2.IsNULL());
+	}
+
+	// The RAM blocks must stay valid after the deserializer is gone.
+	bus = ram2->AsAddressDataBus();
+
+	data32 = 0x22222222;
+	bus->AddressSelect(4);
+	bus->ReadData(data32, LittleEndian);
+	UnitTest::Assert("32-bit read", data32, 0xe5cdab89);
+
+	data16_a = 0xffff;
+	bus->AddressSelect(0x1000010);
+	bus->ReadData(data16_a, BigEndian);
+	UnitTest::Assert("16-bit read", data16_a, 0x3512);
+
+	// Writing must not affect the original.
+	data32 = 0x11223344;
+	bus->AddressSelect(4);
+	bus->WriteData(data32, BigEndian);
+
+	bus = ram->AsAddressDataBus();
+	bus->AddressSelect(4);
+	bus->ReadData(data32, BigEndian);
+	UnitTest::Assert("original was modified?", data32, 0x89abcde5);
+}
+
+static void Test_RAMComponent_BinarySerialization_BlockOutsideRAM()
+{
+	refcount_ptr<Component> ram = ComponentFactory::CreateComponent("ram");
+	ram->SetVariableValue("memoryMappedSize", "0x1000000");
+	AddressDataBus* bus = ram->AsAddressDataBus();
+
+	// Nothing stops writes beyond the end of the RAM component itself,
+	// but such blocks must not be accepted when deserializing.
+	uint32_t data32 = 0x89abcde5;
+	bus->AddressSelect(0x1000004);
+	bus->WriteData(data32, BigEndian);
+
+	BinarySerializer serializer;
+	ram->SerializeBinary(serializer);
+
+	vector<uint8_t> data;
+	serializer.GetData(data);
+
+	BinaryDeserializer deserializer(&data[0], data.size());
+	stringstream messages;
+	refcount_ptr<Component> ram2 =
+	    Component::DeserializeBinary(messages, deserializer);
+	UnitTest::Assert("deserialization failed", !ram2.IsNULL());
+	UnitTest::Assert("the block should have been rejected",
+	    messages.str().find("'data'") != string::npos);
+
+	uint64_t length;
+	UnitTest::Assert("the block should not exist",
+	    ram2->AsAddressDataBus()->LookupHostMemory(0x1000004, length,
+	    false) == NULL);
+}
+
 static void Test_RAMComponent_Methods_Reexecutableness()
 {
 	refcount_ptr<Component> ram = ComponentFactory::CreateComponent("ram");
@@ -665,6 +851,8 @@ UNITTESTS(RAMComponent)
 	UNITTEST(Test_RAMComponent_ClearOnReset);
 	UNITTEST(Test_RAMComponent_Clone);
 	UNITTEST(Test_RAMComponent_ManualSerialization);
+	UNITTEST(Test_RAMComponent_BinarySerialization);
+	UNITTEST(Test_RAMComponent_BinarySerialization_BlockOutsideRAM);
 	UNITTEST(Test_RAMComponent_Methods_Reexecutableness);
 }
 
@@ -57,10 +57,13 @@
  *  to the handle of the correct port on that controller.
  *
  *
- *  NOTE: The code in this module is mostly non-reentrant.
+ *  NOTE: The code in this module is mostly non-reentrant. When machines run
+ *  in host threads of their own (see emul_run()), the functions used by
+ *  devices are serialized by console_lock().
  */
 
 #include <errno.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -299,6 +302,15 @@ static int console_stdout_pending;
 
 #define	CONSOLE_FIFO_LEN	4096
 
+/*
+ *  Output to a slave console is collected per handle, and written with one
+ *  write() call once a newline is seen, when the buffer is full, when input
+ *  is polled, or when the oldest unwritten byte is older than
+ *  CONSOLE_OUTBUF_MAX_DELAY_MS.
+ */
+#define	CONSOLE_OUTBUF_LEN		1024
+#define	CONSOLE_OUTBUF_MAX_DELAY_MS	20
+
 static int console_mouse_x;		/*  absolute x, 0-based  */
 static int console_mouse_y;		/*  absolute y, 0-based  */
 static int console_mouse_fb_nr;		/*  framebuffer number of
@@ -307,6 +319,9 @@ static int console_mouse_buttons;	/*  left=4, middle=2, right=1  */
 
 static int allow_slaves = 0;
 
+/*  Recursive, since e.g. console_readchar() uses console_charavail():  */
+static pthread_mutex_t console_mutex;
+
 struct console_handle {
 	int		in_use;
 	int		in_use_for_input;
@@ -324,6 +339,14 @@ struct console_handle {
 	unsigned int	fifo[CONSOLE_FIFO_LEN];
 	int		fifo_head;
 	int		fifo_tail;
+
+	/*  See console_set_input_notify():  */
+	void		(*input_notify)(void *);
+	void		*input_notify_extra;
+
+	unsigned char	outbuf[CONSOLE_OUTBUF_LEN];
+	size_t		outbuf_len;
+	struct timespec	outbuf_since;	/*  when outbuf became non-empty  */
 };
 
 #define	NOT_USING_XTERM				0
@@ -335,6 +358,64 @@ static struct console_handle *console_handles = NULL;
 static int n_console_handles = 0;
 
 
+static void console_lock(void)
+{
+	pthread_mutex_lock(&console_mutex);
+}
+
+
+static void console_unlock(void)
+{
+	pthread_mutex_unlock(&console_mutex);
+}
+
+
+/*
+ *  console_flush_handle():
+ *
+ *  Writes any buffered output of a slave console handle to its descriptor.
+ *  The console lock must be held by the caller.
+ */
+static void console_flush_handle(int handle)
+{
+	struct console_handle *chp = &console_handles[handle];
+	size_t done = 0;
+
+	while (done < chp->outbuf_len) {
+		ssize_t res = write(chp->w_descriptor, chp->outbuf + done,
+		    chp->outbuf_len - done);
+		if (res < 0 && errno == EINTR)
+			continue;
+		if (res <= 0) {
+			perror("error writing to console handle");
+			break;
+		}
+		done += res;
+	}
+
+	chp->outbuf_len = 0;
+}
+
+
+/*
+ *  console_outbuf_is_stale():
+ *
+ *  Returns 1 if the oldest buffered byte of a handle has been waiting for
+ *  longer than CONSOLE_OUTBUF_MAX_DELAY_MS.
+ */
+static int console_outbuf_is_stale(struct console_handle *chp)
+{
+	struct timespec now;
+	long ms;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	ms = (now.tv_sec - chp->outbuf_since.tv_sec) * 1000 +
+	    (now.tv_nsec - chp->outbuf_since.tv_nsec) / 1000000;
+
+	return ms >= CONSOLE_OUTBUF_MAX_DELAY_MS;
+}
+
+
 /*
  *  console_deinit_main():
  *
@@ -345,6 +426,8 @@ void console_deinit_main(void)
 	if (!console_initialized)
 		return;
 
+	console_flush();
+
 	tcsetattr(STDIN_FILENO, TCSANOW, &console_oldtermios);
 
 	console_initialized = 0;
@@ -500,6 +583,8 @@ static int d_avail(int d)
  */
 void console_makeavail(int handle, int ch)
 {
+	console_lock();
+
 	console_handles[handle].fifo[
 	    console_handles[handle].fifo_head] = ch;
 	console_handles[handle].fifo_head = (
@@ -508,6 +593,12 @@ void console_makeavail(int handle, int ch)
 	if (console_handles[handle].fifo_head ==
 	    console_handles[handle].fifo_tail)
 		fatal("[ WARNING: console fifo overrun, handle %i ]\n", handle);
+
+	console_unlock();
+
+	if (console_handles[handle].input_notify != NULL)
+		console_handles[handle].input_notify(
+		    console_handles[handle].input_notify_extra);
 }
 
 
@@ -630,6 +721,19 @@ int make_available(int handle, const unsigned char *ch, int len, int *i) {
  */
 int console_charavail(int handle)
 {
+	int avail;
+
+	console_lock();
+
+	/*  Whatever was printed is probably what the user is replying to:  */
+	if (allow_slaves) {
+		if (console_handles[handle].outbuf_len > 0)
+			console_flush_handle(handle);
+	} else if (console_stdout_pending) {
+		fflush(stdout);
+		console_stdout_pending = 0;
+	}
+
 	while (console_stdin_avail(handle)) {
 		unsigned char ch[100];		/* = getchar(); */
 		ssize_t len;
@@ -657,11 +761,11 @@ int console_charavail(int handle)
     }
 	}
 
-	if (console_handles[handle].fifo_head ==
-	    console_handles[handle].fifo_tail)
-		return 0;
+	avail = console_handles[handle].fifo_head !=
+	    console_handles[handle].fifo_tail;
 
-	return 1;
+	console_unlock();
+	return avail;
 }
 
 
@@ -672,62 +776,109 @@ int console_charavail(int handle)
  */
 int console_readchar(int handle)
 {
-	int ch;
+	int ch = -1;
+
+	console_lock();
 
 	if (console_handles[handle].using_xterm ==
 	    USING_XTERM_BUT_NOT_YET_OPEN)
 		start_xterm(handle);
 
-	if (!console_charavail(handle))
-		return -1;
-
-	ch = console_handles[handle].fifo[console_handles[handle].fifo_tail];
-	console_handles[handle].fifo_tail ++;
-	console_handles[handle].fifo_tail %= CONSOLE_FIFO_LEN;
+	if (console_charavail(handle)) {
+		ch = console_handles[handle].fifo[
+		    console_handles[handle].fifo_tail];
+		console_handles[handle].fifo_tail ++;
+		console_handles[handle].fifo_tail %= CONSOLE_FIFO_LEN;
+	}
 
+	console_unlock();
 	return ch;
 }
 
 
 /*
- *  console_putchar():
+ *  console_putstr():
  *
- *  Prints a char to stdout, and sets the console_stdout_pending flag.
+ *  Prints len chars from buf to a console handle. Output to stdout goes
+ *  through stdio (and sets the console_stdout_pending flag); output to a
+ *  slave console is buffered in the handle, see CONSOLE_OUTBUF_LEN.
  */
-void console_putchar(int handle, int ch)
+void console_putstr(int handle, const unsigned char *buf, size_t len)
 {
-	char buf[1];
+	struct console_handle *chp;
+	int flush_now = 0;
 
-	if (!console_handles[handle].in_use_for_input &&
-	    !console_handles[handle].outputonly)
+	if (len == 0)
+		return;
+
+	console_lock();
+
+	chp = &console_handles[handle];
+
+	if (!chp->in_use_for_input && !chp->outputonly)
 		console_change_inputability(handle, 1);
 
 	if (!allow_slaves) {
 		/*  stdout:  */
-		putchar(ch);
+		fwrite(buf, 1, len, stdout);
 
 		/*  Assume flushes by OS or libc on newlines:  */
-		if (ch == '\n')
+		if (buf[len-1] == '\n')
 			console_stdout_pending = 0;
 		else
 			console_stdout_pending = 1;
 
+		console_unlock();
 		return;
 	}
 
-	if (!console_handles[handle].in_use) {
-		printf("[ console_putchar(): handle %i not in"
+	if (!chp->in_use) {
+		printf("[ console_putstr(): handle %i not in"
 		    " use! ]\n", handle);
+		console_unlock();
 		return;
-		}
+	}
 
-	if (console_handles[handle].using_xterm ==
-	    USING_XTERM_BUT_NOT_YET_OPEN)
+	if (chp->using_xterm == USING_XTERM_BUT_NOT_YET_OPEN)
 		start_xterm(handle);
 
-	buf[0] = ch;
-	if (write(console_handles[handle].w_descriptor, buf, 1) != 1)
-		perror("error writing to console handle");
+	while (len > 0) {
+		size_t n = CONSOLE_OUTBUF_LEN - chp->outbuf_len;
+		if (n > len)
+			n = len;
+
+		if (chp->outbuf_len == 0)
+			clock_gettime(CLOCK_MONOTONIC, &chp->outbuf_since);
+
+		memcpy(chp->outbuf + chp->outbuf_len, buf, n);
+		if (memchr(buf, '\n', n) != NULL)
+			flush_now = 1;
+
+		chp->outbuf_len += n;
+		buf += n;
+		len -= n;
+
+		if (chp->outbuf_len == CONSOLE_OUTBUF_LEN)
+			console_flush_handle(handle);
+	}
+
+	if (chp->outbuf_len > 0 && (flush_now || console_outbuf_is_stale(chp)))
+		console_flush_handle(handle);
+
+	console_unlock();
+}
+
+
+/*
+ *  console_putchar():
+ *
+ *  Prints a char to a console handle. See console_putstr().
+ */
+void console_putchar(int handle, int ch)
+{
+	unsigned char c = ch;
+
+	console_putstr(handle, &c, 1);
 }
 
 
@@ -735,13 +886,69 @@ void console_putchar(int handle, int ch)
  *  console_flush():
  *
  *  Flushes stdout, if necessary, and resets console_stdout_pending to zero.
+ *  Also writes out the buffered output of all slave console handles. This
+ *  is called regularly from the main emulation loop.
  */
 void console_flush(void)
 {
+	console_lock();
+
 	if (console_stdout_pending)
 		fflush(stdout);
 
 	console_stdout_pending = 0;
+
+	for (int i=0; i<n_console_handles; i++)
+		if (console_handles[i].in_use &&
+		    console_handles[i].outbuf_len > 0)
+			console_flush_handle(i);
+
+	console_unlock();
+}
+
+
+/*
+ *  console_set_input_notify():
+ *
+ *  Registers a function to be called when input arrives for a handle: when
+ *  a character is put in its fifo, or when the mouse is moved or a mouse
+ *  button changes. This lets devices sleep while there is no input, instead
+ *  of polling the console.
+ */
+void console_set_input_notify(int handle, void (*func)(void *), void *extra)
+{
+	console_handles[handle].input_notify = func;
+	console_handles[handle].input_notify_extra = extra;
+}
+
+
+/*
+ *  console_notify_mouse():
+ *
+ *  Mouse state is not per handle, so all input notifiers are called.
+ */
+static void console_notify_mouse(void)
+{
+	for (int i = 0; i < n_console_handles; i++)
+		if (console_handles[i].input_notify != NULL)
+			console_handles[i].input_notify(
+			    console_handles[i].input_notify_extra);
+}
+
+
+/*
+ *  console_poll_input():
+ *
+ *  Moves pending host input (from stdin or a slave terminal) into the fifo
+ *  of every handle with an input notifier, so that the notifier is called.
+ *  Called every now and then from the main loop.
+ */
+void console_poll_input(void)
+{
+	for (int i = 0; i < n_console_handles; i++)
+		if (console_handles[i].input_notify != NULL &&
+		    console_stdin_avail(i))
+			console_charavail(i);
 }
 
 
@@ -756,9 +963,13 @@ void console_mouse_coordinates(int x, int y, int fb_nr)
 {
 	/*  TODO: fb_nr isn't used yet.  */
 
+	console_lock();
 	console_mouse_x = x;
 	console_mouse_y = y;
 	console_mouse_fb_nr = fb_nr;
+	console_unlock();
+
+	console_notify_mouse();
 }
 
 
@@ -773,10 +984,14 @@ void console_mouse_button(int button, int pressed)
 {
 	int mask = 1 << button;
 
+	console_lock();
 	if (pressed)
 		console_mouse_buttons |= mask;
 	else
 		console_mouse_buttons &= ~mask;
+	console_unlock();
+
+	console_notify_mouse();
 }
 
 
@@ -788,10 +1003,12 @@ void console_mouse_button(int button, int pressed)
  */
 void console_getmouse(int *x, int *y, int *buttons, int *fb_nr)
 {
+	console_lock();
 	*x = console_mouse_x;
 	*y = console_mouse_y;
 	*buttons = console_mouse_buttons;
 	*fb_nr = console_mouse_fb_nr;
+	console_unlock();
 }
 
 
@@ -1046,6 +1263,8 @@ int console_change_inputability(int handle, int inputability)
 		exit(1);
 	}
 
+	console_lock();
+
 	old = console_handles[handle].in_use_for_input;
 	console_handles[handle].in_use_for_input = inputability;
 
@@ -1061,10 +1280,12 @@ int console_change_inputability(int handle, int inputability)
 				    "line option!\n%%\n");
 			}
 			console_handles[handle].warning_printed = 1;
+			console_unlock();
 			return 0;
 		}
 	}
 
+	console_unlock();
 	return 1;
 }
 
@@ -1246,6 +1467,12 @@ void console_init(void)
 {
 	int handle;
 	struct console_handle *chp;
+	pthread_mutexattr_t attr;
+
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&console_mutex, &attr);
+	pthread_mutexattr_destroy(&attr);
 
 	console_settings = settings_new();
 
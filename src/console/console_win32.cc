@@ -329,6 +329,10 @@ struct console_handle {
 	int		fifo_head;
 	int		fifo_tail;
 
+	/*  See console_set_input_notify():  */
+	void		(*input_notify)(void *);
+	void		*input_notify_extra;
+
 	PROCESS_INFORMATION proc_info;
 	bool                is_proc_info_valid;
 };
@@ -575,6 +579,10 @@ void console_makeavail(int handle, int ch)
 	if (console_handles[handle].fifo_head ==
 	    console_handles[handle].fifo_tail)
 		fatal("[ WARNING: console fifo overrun, handle %i ]\n", handle);
+
+	if (console_handles[handle].input_notify != NULL)
+		console_handles[handle].input_notify(
+		    console_handles[handle].input_notify_extra);
 }
 
 
@@ -806,6 +814,18 @@ void console_putchar(int handle, int ch)
 }
 
 
+/*
+ *  console_putstr():
+ *
+ *  Prints len chars from buf to a console handle.
+ */
+void console_putstr(int handle, const unsigned char *buf, size_t len)
+{
+	for (size_t i=0; i<len; i++)
+		console_putchar(handle, buf[i]);
+}
+
+
 /*
  *  console_flush():
  *
@@ -820,6 +840,51 @@ void console_flush(void)
 }
 
 
+/*
+ *  console_set_input_notify():
+ *
+ *  Registers a function to be called when input arrives for a handle: when
+ *  a character is put in its fifo, or when the mouse is moved or a mouse
+ *  button changes. This lets devices sleep while there is no input, instead
+ *  of polling the console.
+ */
+void console_set_input_notify(int handle, void (*func)(void *), void *extra)
+{
+	console_handles[handle].input_notify = func;
+	console_handles[handle].input_notify_extra = extra;
+}
+
+
+/*
+ *  console_notify_mouse():
+ *
+ *  Mouse state is not per handle, so all input notifiers are called.
+ */
+static void console_notify_mouse(void)
+{
+	for (int i = 0; i < n_console_handles; i++)
+		if (console_handles[i].input_notify != NULL)
+			console_handles[i].input_notify(
+			    console_handles[i].input_notify_extra);
+}
+
+
+/*
+ *  console_poll_input():
+ *
+ *  Moves pending host input (from stdin or a slave terminal) into the fifo
+ *  of every handle with an input notifier, so that the notifier is called.
+ *  Called every now and then from the main loop.
+ */
+void console_poll_input(void)
+{
+	for (int i = 0; i < n_console_handles; i++)
+		if (console_handles[i].input_notify != NULL &&
+		    console_stdin_avail(i))
+			console_charavail(i);
+}
+
+
 /*
  *  console_mouse_coordinates():
  *
@@ -834,6 +899,8 @@ void console_mouse_coordinates(int x, int y, int fb_nr)
 	console_mouse_x = x;
 	console_mouse_y = y;
 	console_mouse_fb_nr = fb_nr;
+
+	console_notify_mouse();
 }
 
 
@@ -852,6 +919,8 @@ void console_mouse_button(int button, int pressed)
 		console_mouse_buttons |= mask;
 	else
 		console_mouse_buttons &= ~mask;
+
+	console_notify_mouse();
 }
 
 
@@ -245,6 +245,7 @@ void x11_set_cursor_data(struct fb_window *win, size_t n, const struct x11_curso
     SDL_DestroyTexture(win->cursors[n].render);
   }
   win->cursors[n] = cursor;
+  win->needs_present = true;
   if (!cursor.width || !cursor.data.size()) {
     win->cursors[n].render = nullptr;
     return;
@@ -262,6 +263,10 @@ void x11_update_cursor(struct fb_window *win, size_t n, bool on, int x, int y) {
   if (n >= win->cursors.size()) {
     return;
   }
+  if (win->cursors[n].on != on ||
+      (on && (win->cursors[n].render_x != x || win->cursors[n].render_y != y))) {
+    win->needs_present = true;
+  }
   win->cursors[n].on = on;
   win->cursors[n].render_x = x;
   win->cursors[n].render_y = y;
@@ -286,6 +291,7 @@ void x11_fb_resize(struct fb_window *win, int new_xsize, int new_ysize)
 
 	win->x11_fb_winxsize = new_xsize;
 	win->x11_fb_winysize = new_ysize;
+	win->needs_present = true;
 
 	alloc_depth = win->x11_screen_depth;
 	if (alloc_depth == 24)
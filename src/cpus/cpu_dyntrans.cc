@@ -336,6 +336,8 @@ int DYNTRANS_RUN_INSTR_DEF(struct cpu *cpu)
 #endif
 	}
 #ifdef DYNTRANS_PPC
+  if (cpu->cd.ppc.tlb_msg_pending)
+    ppc_tlb_receive(cpu);
   if (!(cpu->ninstrs & (INSTRUCTION_STRIDE - 1)) &&
       cpu->cd.ppc.dec_intr_pending && (cpu->cd.ppc.msr & PPC_MSR_EE)) {
     cpu->cd.ppc.dec_intr_pending = 0;
@@ -359,12 +361,6 @@ int DYNTRANS_RUN_INSTR_DEF(struct cpu *cpu)
 
 	cpu->n_translated_instrs = 0;
 
-  if (GdblibCheckWaiting(cpu)) {
-    if (GdblibSerialInterrupt(cpu)) {
-      single_step = 1;
-    }
-  }
-
   uint64_t prev_instrs = cpu->ninstrs;
   uint64_t next_limit =
     MIN(prev_instrs + N_SAFE_DYNTRANS_LIMIT, cpu->ninstrs_async + INSTR_BETWEEN_INTERRUPTS) -
@@ -734,6 +730,8 @@ void DYNTRANS_INIT_TABLES(struct cpu *cpu)
 	    cpu->is_32bit? instr32(end_of_page) :
 #endif
 	    instr(end_of_page);
+	memset(ppp->ics[DYNTRANS_IC_ENTRIES_PER_PAGE + 0].arg, 0,
+	    sizeof(ppp->ics[0].arg));
 
 	/*  End-of-page-2, for delay-slot architectures:  */
 #ifdef DYNTRANS_DELAYSLOT
@@ -806,11 +804,6 @@ void DYNTRANS_INIT_TABLES(struct cpu *cpu)
 				goto stop_running_translated;
 			}
 	}
-
-  if (GdblibCheckWaiting(cpu)) {
-      fprintf(stderr, "gdb pollin\n");
-      GdblibSerialInterrupt(cpu);
-  }
 #endif	/*  DYNTRANS_TO_BE_TRANSLATED_HEAD  */
 
 
@@ -32,7 +32,11 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <fenv.h>
+#include <float.h>
+#include <sched.h>
 
+#include "checkpoint.h"
 #include "cpu.h"
 #include "devices.h"
 #include "interrupt.h"
@@ -44,6 +48,7 @@
 #include "ppc_spr_strings.h"
 #include "settings.h"
 #include "symbol.h"
+#include "trace.h"
 #include "float_emul.h"
 
 #include "thirdparty/ppc_bat.h"
@@ -209,6 +214,15 @@ int ppc_cpu_new(struct cpu *cpu, struct memory *mem, struct machine *machine,
 	if (cpu->machine->prom_emulation)
 		cpu->cd.ppc.of_emul_addr = 0xfff00000;
 
+	/*  FPU diagnostics, see fpu_op():  */
+	settings_add(cpu->settings, "fpu_debug", 1, SETTINGS_TYPE_UINT8,
+	    SETTINGS_FORMAT_DECIMAL, (void *) &cpu->cd.ppc.fpu_debug);
+
+	/*  Native code for hot instruction runs (0 = off, 1 = on, 2 = check
+	    against the normal instruction functions), see cpu_ppc_native.cc:  */
+	settings_add(cpu->settings, "native", 1, SETTINGS_TYPE_UINT8,
+	    SETTINGS_FORMAT_DECIMAL, (void *) &cpu->cd.ppc.native);
+
 	/*  Add all register names to the settings:  */
 	CPU_SETTINGS_ADD_REGISTER64("pc", cpu->pc);
 	CPU_SETTINGS_ADD_REGISTER64("msr", cpu->cd.ppc.msr);
@@ -339,6 +353,61 @@ void ppc_cpu_dumpinfo(struct cpu *cpu)
 }
 
 
+/*
+ *  ppc_cpu_checkpoint():
+ *
+ *  Save or restore the architectural state of a PPC cpu. Translation
+ *  caches are not part of the checkpoint; the caller invalidates them
+ *  after a restore, and they are rebuilt from the SPRs and segment
+ *  registers as the guest runs.
+ */
+void ppc_cpu_checkpoint(struct cpu *cpu, struct checkpoint *ckpt)
+{
+	struct ppc_cpu *p = &cpu->cd.ppc;
+
+	CHECKPOINT_VAR(ckpt, p->of_emul_addr);
+	CHECKPOINT_VAR(ckpt, p->mode);
+	CHECKPOINT_VAR(ckpt, p->bits);
+	CHECKPOINT_VAR(ckpt, p->irq_asserted);
+	CHECKPOINT_VAR(ckpt, p->dec_intr_pending);
+	CHECKPOINT_VAR(ckpt, p->cr);
+	CHECKPOINT_VAR(ckpt, p->fpscr);
+	CHECKPOINT_VAR(ckpt, p->gpr);
+	CHECKPOINT_VAR(ckpt, p->fpr);
+	CHECKPOINT_VAR(ckpt, p->vr_hi);
+	CHECKPOINT_VAR(ckpt, p->vr_lo);
+	CHECKPOINT_VAR(ckpt, p->msr);
+	CHECKPOINT_VAR(ckpt, p->tgpr);
+	CHECKPOINT_VAR(ckpt, p->sr);
+	CHECKPOINT_VAR(ckpt, p->spr);
+	CHECKPOINT_VAR(ckpt, p->ll_addr);
+	CHECKPOINT_VAR(ckpt, p->ll_bit);
+	CHECKPOINT_VAR(ckpt, p->bytelane_swap_latch);
+	CHECKPOINT_VAR(ckpt, p->bytelane_swap);
+	CHECKPOINT_VAR(ckpt, p->icount);
+
+	if (ckpt->writeflag != MEM_WRITE) {
+		p->bat_decoded_ok = 0;
+		ppc_mmu_flush_pteg_shadow(cpu);
+	}
+}
+
+
+/*
+ *  ppc_cpu_registers_written():
+ *
+ *  Called after the debugger has assigned to a setting. Registers are
+ *  written directly through the settings, bypassing mtspr, so anything
+ *  derived from the BATs or SDR1 has to be thrown away here.
+ */
+void ppc_cpu_registers_written(struct cpu *cpu)
+{
+	cpu->cd.ppc.bat_decoded_ok = 0;
+	ppc_mmu_flush_pteg_shadow(cpu);
+	cpu->invalidate_translation_caches(cpu, 0, INVALIDATE_ALL);
+}
+
+
 /*
  *  reg_access_msr():
  */
@@ -386,8 +455,10 @@ int reg_access_msr(struct cpu *cpu, uint64_t *valuep, int writeflag,
   int new_map = (cpu->cd.ppc.msr >> 4) & 3;
 
 	if (old_le != new_le) {
-		fprintf(stderr, "old LE %d new LE %d\n", old_le, new_le);
+		TRACE(TRACE_PPC, TRACE_DEBUG, "old LE %d new LE %d\n", old_le, new_le);
     cpu->invalidate_translation_caches(cpu, cpu->pc, INVALIDATE_ALL);
+    /*  Loads/stores are translated differently in LE mode:  */
+    cpu->invalidate_code_translation(cpu, 0, INVALIDATE_ALL);
   } else if (old_map != new_map) {
     cpu->invalidate_translation_caches(cpu, cpu->pc, INVALIDATE_ALL | INVALIDATE_IDENTITY);
 	}
@@ -445,6 +516,8 @@ void ppc_exception(struct cpu *cpu, int exception_nr, int exn_extra)
     cpu->cd.ppc.msr &= ~PPC_MSR_ME;
   }
   cpu->cd.ppc.msr |= PPC_MSR_LE & (cpu->cd.ppc.msr >> 16);
+  if ((cpu->cd.ppc.msr ^ cpu->cd.ppc.spr[SPR_SRR1]) & PPC_MSR_LE)
+    cpu->invalidate_code_translation(cpu, 0, INVALIDATE_ALL);
 
 	cpu->pc = exception_nr * 0x100;
 	if (cpu->cd.ppc.msr & PPC_MSR_IP)
@@ -2052,7 +2125,7 @@ void fpu_update_cr1(struct cpu *cpu)
   uint64_t c = (cpu->cd.ppc.fpscr >> 28) & 0xf;
 	cpu->cd.ppc.cr &= ~((uint32_t)0xf << 24);
 	cpu->cd.ppc.cr |= ((uint32_t)c << 24);
-  fprintf(stderr, "%" PRIx64" => %08x\n", c, (uint32_t)cpu->cd.ppc.cr);
+  TRACE(TRACE_PPC, TRACE_DEBUG, "%" PRIx64" => %08x\n", c, (uint32_t)cpu->cd.ppc.cr);
 }
 
 void cpu_ppc_swizzle_offset(struct cpu *cpu, int size, int code, int *swizzle, int *offset) {
@@ -2176,6 +2249,17 @@ int fpu_vsoft(struct cpu *cpu) {
   return (cpu->cd.ppc.fpscr & PPC_FPSCR_VXSOFT);
 }
 
+/*
+ *  FPU diagnostics are controlled by the fpu_debug setting of each cpu:
+ *
+ *	0	off (default)
+ *	1	trace each operation and the resulting FPSCR to stderr
+ *	2	like 1, and also cross-check every operation done on the
+ *		host FPU against softfloat, reporting any mismatch
+ */
+#define	FPU_DEBUG(cpu)		((cpu)->cd.ppc.fpu_debug)
+#define	FPU_TRACE(cpu, ...)	{ if (FPU_DEBUG(cpu)) fprintf(stderr, __VA_ARGS__); }
+
 static inline void fpu_bit_ladder(struct cpu *cpu, bool isnan,  uint64_t &fpscr) {
   fpscr = (fpscr | PPC_FPSCR_VX) ^ PPC_FPSCR_VX;
   if (isnan || (fpscr & (PPC_FPSCR_VXSNAN | PPC_FPSCR_VXISI | PPC_FPSCR_VXIDI | PPC_FPSCR_VXZDZ | PPC_FPSCR_VXIMZ | PPC_FPSCR_VXVC | PPC_FPSCR_VXSQRT | PPC_FPSCR_VXCVI | PPC_FPSCR_VXSOFT))) {
@@ -2189,7 +2273,7 @@ static inline void fpu_bit_ladder(struct cpu *cpu, bool isnan,  uint64_t &fpscr)
   uint32_t z = (fpscr & PPC_FPSCR_ZE) && (fpscr & PPC_FPSCR_ZX);
   uint32_t x = (fpscr & PPC_FPSCR_XE) && (fpscr & PPC_FPSCR_XX);
 
-  fprintf(stderr, "o %x u %x v %x z %x x %x\n", o, u, v, z, x);
+  FPU_TRACE(cpu, "o %x u %x v %x z %x x %x\n", o, u, v, z, x);
   bool fex = o | u | v | z | x;
   fpscr |= fex ? (PPC_FPSCR_FEX | PPC_FPSCR_FX) : 0;
 }
@@ -2198,61 +2282,160 @@ std::string format_float(uint64_t fval) {
   double f;
   memcpy(&f, &fval, sizeof(f));
   char buf[500];
-  sprintf(buf, "%f", f);
+  snprintf(buf, sizeof(buf), "%f", f);
   return std::string(buf);
 }
 
-void fpu_epilog(struct cpu *cpu, extFloat80_t *source, float64_t *result) {
+/*
+ *  fpu_epilog():
+ *
+ *  Updates FPSCR after an arithmetic operation. flags are the softfloat
+ *  exception flags raised while computing result (inexact, overflow and
+ *  underflow are mapped to FI/XX, OX and UX). FR is not computed.
+ */
+void fpu_epilog(struct cpu *cpu, float64_t *result, uint8_t flags) {
   uint64_t fpscr = cpu->cd.ppc.fpscr & ~(0x1f << 12);
 
-  if (source) {
-    // Check for FI
-    // XXX handle FR
-    extFloat80_t re_converted;
-    f64_to_extF80M(*result, &re_converted);
-#if 0
-    if (memcmp(&re_converted, source, sizeof(re_converted))) {
-      fpscr |= PPC_FPSCR_FI;
-    }
-#endif
-  }
+  if (flags & softfloat_flag_inexact)
+    fpscr |= PPC_FPSCR_FI;
 
   fpscr |= (fpscr & (PPC_FPSCR_FI | PPC_FPSCR_FR)) ? PPC_FPSCR_XX : 0;
 
-  if (f64_isinf(*result)) {
-    fprintf(stderr, "is infinite\n");
+  if (f64_isinf(*result) || (flags & softfloat_flag_overflow))
     fpscr |= PPC_FPSCR_OX;
-  }
+
+  if (flags & softfloat_flag_underflow)
+    fpscr |= PPC_FPSCR_UX;
 
   bool isnan = f64_isnan(*result);
   bool qnan = !f64_isSignalingNaN(*result) && isnan;
-  fprintf(stderr, "isnan %d qnan %d\n", isnan, qnan);
 
   fpu_bit_ladder(cpu, isnan, fpscr);
 
-  if (qnan || f64_denormalized(*result) || !memcmp(result, &neg_zero, sizeof(neg_zero))) {
+  if (qnan || result->v == neg_zero.v ||
+      (f64_denormalized(*result) && !f64_iszero(*result))) {
     fpscr |= PPC_FPSCR_CLASS;
   }
 
   if (isnan) {
-    fprintf(stderr, "F - NaN\n");
     fpscr |= PPC_FPSCR_FU;
   } else if (f64_lt(*result, pos_zero)) {
-    fprintf(stderr, "F - LT\n");
     fpscr |= PPC_FPSCR_FL;
   } else if (f64_lt(pos_zero, *result)) {
-    fprintf(stderr, "F - GT\n");
     fpscr |= PPC_FPSCR_FG;
   } else {
-    fprintf(stderr, "F - EQ\n");
     fpscr |= PPC_FPSCR_FE;
   }
 
-  auto formatted = format_float(result->v);
-  fprintf(stderr, "final fpscr %08" PRIx64 " value %s\n", fpscr, formatted.c_str());
+  if (FPU_DEBUG(cpu)) {
+    auto formatted = format_float(result->v);
+    fprintf(stderr, "final fpscr %08" PRIx64 " value %s\n", fpscr, formatted.c_str());
+  }
+
   cpu->cd.ppc.fpscr = fpscr;
 }
 
+enum fpu_op { FPU_OP_ADD, FPU_OP_SUB, FPU_OP_MUL, FPU_OP_DIV };
+
+static const char *fpu_op_name[] = { "fadd", "fsub", "fmul", "fdiv" };
+
+/*  Nonzero, finite and not denormalized.  */
+static inline int f64_isnormal(float64_t f) {
+  uint64_t exp = (f.v >> MANTISSA_BITS) & EXP_MASK;
+  return exp != 0 && exp != EXP_MASK;
+}
+
+static float64_t fpu_softfloat_op(struct cpu *cpu, enum fpu_op op,
+	float64_t a, float64_t b, uint8_t *flags) {
+  float64_t result;
+
+  switch (cpu->cd.ppc.fpscr & PPC_FPSCR_RN_MASK) {
+  case PPC_FPSCR_ROUND_NEAREST: softfloat_roundingMode = softfloat_round_near_even; break;
+  case PPC_FPSCR_ROUND_TO_ZERO:   softfloat_roundingMode = softfloat_round_minMag; break;
+  case PPC_FPSCR_ROUND_TO_PINF:   softfloat_roundingMode = softfloat_round_max; break;
+  default:                      softfloat_roundingMode = softfloat_round_min; break;
+  }
+
+  softfloat_exceptionFlags = 0;
+
+  switch (op) {
+  case FPU_OP_ADD: result = f64_add(a, b); break;
+  case FPU_OP_SUB: result = f64_sub(a, b); break;
+  case FPU_OP_MUL: result = f64_mul(a, b); break;
+  default:         result = f64_div(a, b); break;
+  }
+
+  *flags = softfloat_exceptionFlags;
+  return result;
+}
+
+/*
+ *  fpu_op():
+ *
+ *  Performs a double precision operation. When FPSCR selects round to
+ *  nearest without non-IEEE mode, and both the operands and the result
+ *  are normal numbers, the result computed by the host FPU is bit-exact,
+ *  and the only exception that can occur is inexact, which is read back
+ *  from the host's floating point environment. Everything else (zeros,
+ *  denormals, infinities, NaNs, overflow, underflow, and the other
+ *  rounding modes) is handled by softfloat.
+ *
+ *  The host path requires that doubles are evaluated in double precision
+ *  (not e.g. x87 extended precision), and that the host rounds to nearest.
+ */
+static float64_t fpu_op(struct cpu *cpu, enum fpu_op op,
+	float64_t a, float64_t b, uint8_t *flags) {
+#if defined(FLT_EVAL_METHOD) && FLT_EVAL_METHOD == 0
+  if (!(cpu->cd.ppc.fpscr & (PPC_FPSCR_RN_MASK | PPC_FPSCR_NI)) &&
+      f64_isnormal(a) && f64_isnormal(b)) {
+    volatile double da, db;
+    double dr;
+    float64_t result;
+
+    memcpy((void *)&da, &a.v, sizeof(da));
+    memcpy((void *)&db, &b.v, sizeof(db));
+
+    feclearexcept(FE_INEXACT);
+
+    switch (op) {
+    case FPU_OP_ADD: dr = da + db; break;
+    case FPU_OP_SUB: dr = da - db; break;
+    case FPU_OP_MUL: dr = da * db; break;
+    default:         dr = da / db; break;
+    }
+
+    memcpy(&result.v, &dr, sizeof(dr));
+
+    if (f64_isnormal(result)) {
+      *flags = fetestexcept(FE_INEXACT) ? softfloat_flag_inexact : 0;
+
+      if (FPU_DEBUG(cpu) >= 2) {
+        uint8_t soft_flags;
+        float64_t soft_result = fpu_softfloat_op(cpu, op, a, b, &soft_flags);
+        if (soft_result.v != result.v || soft_flags != *flags)
+          fprintf(stderr, "%s %016" PRIx64 ", %016" PRIx64 ": host FPU "
+              "result %016" PRIx64 " flags %02x, softfloat %016" PRIx64
+              " flags %02x\n", fpu_op_name[op], a.v, b.v, result.v,
+              *flags, soft_result.v, soft_flags);
+      }
+
+      return result;
+    }
+  }
+#endif
+
+  return fpu_softfloat_op(cpu, op, a, b, flags);
+}
+
+static void fpu_trace_op(struct cpu *cpu, enum fpu_op op,
+	float64_t fra, float64_t frc, float64_t result) {
+  auto fra_s = format_float(fra.v), frc_s = format_float(frc.v), result_s = format_float(result.v);
+  fprintf(stderr, "%s raw %016" PRIx64 ", %016" PRIx64 " = %016" PRIx64 "\n",
+      fpu_op_name[op], fra.v, frc.v, result.v);
+  fprintf(stderr, "%s: %s, %s -> %s\n", fpu_op_name[op], fra_s.c_str(),
+      frc_s.c_str(), result_s.c_str());
+}
+
 #define FPINST_PRELUDE() {                                      \
     CHECK_FOR_FPU_EXCEPTION;                                    \
                                                                 \
@@ -2268,14 +2451,21 @@ void fpu_epilog(struct cpu *cpu, extFloat80_t *source, float64_t *result) {
     fpu_clear_non_sticky(cpu);                                  \
   }
 
+#define FPINST_OP(op) {                                         \
+    uint8_t flags;                                              \
+    float64_t result_64 = fpu_op(cpu, op, fra, frc, &flags);    \
+    if (FPU_DEBUG(cpu))                                         \
+      fpu_trace_op(cpu, op, fra, frc, result_64);               \
+    fpu_epilog(cpu, &result_64, flags);                         \
+    *ptarget = result_64.v;                                     \
+  }
+
 void base_fmul(struct cpu *cpu, struct ppc_instr_call *ic, uint64_t *ptarget, uint64_t *pfra, uint64_t *pfrc) {
   float64_t fra = { *pfra };
   float64_t frc = { *pfrc };
 
   FPINST_PRELUDE();
 
-	softfloat_roundingMode = softfloat_round_minMag;
-
   // Multiplying inf by 0 is an invalid multiplication.
   if ((f64_isnan(fra) && f64_iszero(frc)) ||
       (f64_iszero(fra) && f64_isnan(frc))) {
@@ -2283,22 +2473,7 @@ void base_fmul(struct cpu *cpu, struct ppc_instr_call *ic, uint64_t *ptarget, ui
     FPU_EXN;
   }
 
-  float64_t result_64 = f64_mul(fra, frc);
-
-  extFloat80_t efra;
-  f64_to_extF80M(fra, &efra);
-  extFloat80_t efrc;
-  f64_to_extF80M(frc, &efrc);
-  extFloat80_t eresult;
-  extF80M_mul(&efra, &efrc, &eresult);
-  auto fra_s = format_float(fra.v), frc_s = format_float(frc.v), result_s = format_float(result_64.v);
-  fprintf
-    (stderr, "fmul raw %" PRIx64 " * %" PRIx64 " = %" PRIx64 "\n", fra.v, frc.v, result_64.v);
-  fprintf
-    (stderr, "fmul: %s * %s -> %s\n",
-     fra_s.c_str(), frc_s.c_str(), result_s.c_str());
-  fpu_epilog(cpu, &eresult, &result_64);
-  *ptarget = result_64.v;
+  FPINST_OP(FPU_OP_MUL);
 }
 
 // fdiv inf / inf:
@@ -2324,22 +2499,7 @@ void base_fdiv(struct cpu *cpu, struct ppc_instr_call *ic, uint64_t *ptarget, ui
     FPU_EXN;
   }
 
-	softfloat_roundingMode = softfloat_round_near_even;
-
-  float64_t result_64 = f64_div(fra, frc);
-  extFloat80_t efra;
-  f64_to_extF80M(fra, &efra);
-  extFloat80_t efrc;
-  f64_to_extF80M(frc, &efrc);
-  extFloat80_t result;
-  extF80M_div(&efra, &efrc, &result);
-  result_64 = extF80M_to_f64(&result);
-  auto fra_s = format_float(fra.v), frc_s = format_float(frc.v), result_s = format_float(result_64.v);
-  fprintf
-    (stderr, "fdiv: %s / %s -> %s\n",
-     fra_s.c_str(), frc_s.c_str(), result_s.c_str());
-  fpu_epilog(cpu, &result, &result_64);
-  *ptarget = result_64.v;
+  FPINST_OP(FPU_OP_DIV);
 }
 
 void base_fadd(struct cpu *cpu, struct ppc_instr_call *ic, uint64_t *ptarget, uint64_t *pfra, uint64_t *pfrc) {
@@ -2350,21 +2510,7 @@ void base_fadd(struct cpu *cpu, struct ppc_instr_call *ic, uint64_t *ptarget, ui
 
   // XXX detect addition of different infinities.
 
-	softfloat_roundingMode = softfloat_round_minMag;
-
-  extFloat80_t efra;
-  f64_to_extF80M(fra, &efra);
-  extFloat80_t efrc;
-  f64_to_extF80M(frc, &efrc);
-  extFloat80_t result;
-  extF80M_add(&efra, &efrc, &result);
-  float64_t result_64 = extF80M_to_f64(&result);
-  auto fra_s = format_float(fra.v), frc_s = format_float(frc.v), result_s = format_float(result_64.v);
-  fprintf
-    (stderr, "fadd: %s + %s -> %s\n",
-     fra_s.c_str(), frc_s.c_str(), result_s.c_str());
-  fpu_epilog(cpu, &result, &result_64);
-  *ptarget = result_64.v;
+  FPINST_OP(FPU_OP_ADD);
 }
 
 void base_fsub(struct cpu *cpu, struct ppc_instr_call *ic, uint64_t *ptarget, uint64_t *pfra, uint64_t *pfrc) {
@@ -2375,21 +2521,7 @@ void base_fsub(struct cpu *cpu, struct ppc_instr_call *ic, uint64_t *ptarget, ui
 
   // XXX detect addition of different infinities.
 
-	softfloat_roundingMode = softfloat_round_minMag;
-
-  extFloat80_t efra;
-  f64_to_extF80M(fra, &efra);
-  extFloat80_t efrc;
-  f64_to_extF80M(frc, &efrc);
-  extFloat80_t result;
-  extF80M_sub(&efra, &efrc, &result);
-  float64_t result_64 = extF80M_to_f64(&result);
-  auto fra_s = format_float(fra.v), frc_s = format_float(frc.v), result_s = format_float(result_64.v);
-  fprintf
-    (stderr, "fsub: %s - %s -> %s\n",
-     fra_s.c_str(), frc_s.c_str(), result_s.c_str());
-  fpu_epilog(cpu, &result, &result_64);
-  *ptarget = result_64.v;
+  FPINST_OP(FPU_OP_SUB);
 }
 
 void base_cmp(struct cpu *cpu, struct ppc_instr_call *ic, uint64_t *pfra, uint64_t *pfrc) {
@@ -2398,18 +2530,198 @@ void base_cmp(struct cpu *cpu, struct ppc_instr_call *ic, uint64_t *pfra, uint64
 
   FPINST_PRELUDE();
 
-	softfloat_roundingMode = softfloat_round_minMag;
-
-  extFloat80_t efra;
-  f64_to_extF80M(fra, &efra);
-  extFloat80_t efrc;
-  f64_to_extF80M(frc, &efrc);
-  extFloat80_t result;
-  extF80M_sub(&efra, &efrc, &result);
-  float64_t result_64 = extF80M_to_f64(&result);
-  auto fra_s = format_float(fra.v), frc_s = format_float(frc.v), result_s = format_float(result_64.v);
-  fprintf(stderr, "fcmp %s - %s -> %s\n", fra_s.c_str(), frc_s.c_str(), result_s.c_str());
-  fpu_epilog(cpu, &result, &result_64);
+  // Only the sign and class of the difference are used; a compare
+  // never sets FI/XX.
+  uint8_t flags;
+  float64_t result_64 = fpu_op(cpu, FPU_OP_SUB, fra, frc, &flags);
+  if (FPU_DEBUG(cpu))
+    fpu_trace_op(cpu, FPU_OP_SUB, fra, frc, result_64);
+  fpu_epilog(cpu, &result_64, 0);
+}
+
+/*
+ *  ppc_ram_store():
+ *
+ *  Called for writes of len bytes to physical address paddr (by a cpu, or
+ *  by a device doing DMA through memory_rw). Any cpu holding a lwarx
+ *  reservation on one of the touched granules loses it, and shadowed
+ *  PTEGs which overlap the write are dropped.
+ */
+void ppc_ram_store(struct cpu *cpu, uint64_t paddr, size_t len)
+{
+	struct machine *machine = cpu->machine;
+	uint64_t first = paddr & ~(uint64_t)(PPC_RESERVATION_GRANULE - 1);
+	uint64_t last = (paddr + len - 1) & ~(uint64_t)(PPC_RESERVATION_GRANULE - 1);
+	int i;
+
+	for (i=0; i<machine->ncpus; i++) {
+		struct cpu *c = machine->cpus[i];
+
+		/*  (Other cpu threads may be using their reservation.)  */
+		if (__atomic_load_n(&c->cd.ppc.ll_bit, __ATOMIC_ACQUIRE)) {
+			uint64_t ll_addr = __atomic_load_n(&c->cd.ppc.ll_addr,
+			    __ATOMIC_RELAXED);
+			if (ll_addr >= first && ll_addr <= last)
+				__atomic_store_n(&c->cd.ppc.ll_bit, 0,
+				    __ATOMIC_RELAXED);
+		}
+
+		/*  PTEG shadows are not used by threaded cpus.  */
+		if (c != cpu && machine->cpu_threads_running)
+			continue;
+
+		if (paddr < c->cd.ppc.pteg_shadow_hi &&
+		    paddr + len > c->cd.ppc.pteg_shadow_lo)
+			ppc_mmu_invalidate_pteg_shadow(c, paddr, len);
+	}
+}
+
+
+/*
+ *  ppc_tlb_invalidate():
+ *
+ *  Invalidates translations on one cpu, for a tlbie (of effective address
+ *  addr), a tlbia, or an icbi (of effective address addr).
+ */
+void ppc_tlb_invalidate(struct cpu *cpu, int type, uint64_t addr)
+{
+	uint64_t msr = cpu->cd.ppc.msr;
+
+	switch (type) {
+
+	case PPC_TLB_MSG_TLBIE:
+		ppc_mmu_tlbie(cpu, addr);
+
+		/*  Both with and without address translation:  */
+		for (int i = 0; i < 2; i++) {
+			cpu->cd.ppc.msr = (msr & ~0x30) | (i * 0x30);
+			cpu->invalidate_translation_caches(cpu, addr,
+			    INVALIDATE_VADDR | INVALIDATE_INSTR);
+			cpu->invalidate_translation_caches(cpu, addr,
+			    INVALIDATE_VADDR);
+		}
+		break;
+
+	case PPC_TLB_MSG_TLBIA:
+		cpu->invalidate_translation_caches(cpu, 0, INVALIDATE_ALL);
+		break;
+
+	case PPC_TLB_MSG_ICBI:
+		/*  Instruction fetches translate like data accesses:  */
+		cpu->cd.ppc.msr = (msr & ~PPC_MSR_IR) |
+		    ((msr & PPC_MSR_DR)? PPC_MSR_IR : 0);
+		cpu->invalidate_translation_caches(cpu, addr,
+		    INVALIDATE_VADDR | INVALIDATE_INSTR);
+		break;
+	}
+
+	cpu->cd.ppc.msr = msr;
+}
+
+
+static void ppc_tlb_msg_lock(struct cpu *cpu)
+{
+	while (__atomic_exchange_n(&cpu->cd.ppc.tlb_msg_lock, 1,
+	    __ATOMIC_ACQUIRE))
+		sched_yield();
+}
+
+
+static void ppc_tlb_msg_unlock(struct cpu *cpu)
+{
+	__atomic_store_n(&cpu->cd.ppc.tlb_msg_lock, 0, __ATOMIC_RELEASE);
+}
+
+
+/*
+ *  ppc_tlb_broadcast():
+ *
+ *  Sends an invalidation (see ppc_tlb_invalidate()) to all other cpus in
+ *  the machine. If the cpus run in host threads of their own, it is queued,
+ *  and handled by ppc_tlb_receive() on each cpu. If too many are queued,
+ *  the receiving cpu invalidates all its translations instead.
+ */
+void ppc_tlb_broadcast(struct cpu *cpu, int type, uint64_t addr)
+{
+	struct machine *machine = cpu->machine;
+
+	for (int i=0; i<machine->ncpus; i++) {
+		struct cpu *c = machine->cpus[i];
+
+		if (c == cpu)
+			continue;
+
+		if (!machine->cpu_threads_running) {
+			ppc_tlb_invalidate(c, type, addr);
+			continue;
+		}
+
+		ppc_tlb_msg_lock(c);
+		if (c->cd.ppc.n_tlb_msgs < PPC_N_TLB_MSGS) {
+			c->cd.ppc.tlb_msgs[c->cd.ppc.n_tlb_msgs].type = type;
+			c->cd.ppc.tlb_msgs[c->cd.ppc.n_tlb_msgs].addr = addr;
+		}
+		c->cd.ppc.n_tlb_msgs ++;
+		__atomic_add_fetch(&c->cd.ppc.tlb_msg_pending, 1,
+		    __ATOMIC_RELEASE);
+		ppc_tlb_msg_unlock(c);
+	}
+}
+
+
+/*
+ *  ppc_tlb_receive():
+ *
+ *  Handles invalidations queued for a cpu by ppc_tlb_broadcast().
+ */
+void ppc_tlb_receive(struct cpu *cpu)
+{
+	struct ppc_tlb_msg msgs[PPC_N_TLB_MSGS];
+	int n;
+
+	if (!__atomic_load_n(&cpu->cd.ppc.tlb_msg_pending, __ATOMIC_ACQUIRE))
+		return;
+
+	ppc_tlb_msg_lock(cpu);
+	n = cpu->cd.ppc.n_tlb_msgs;
+	memcpy(msgs, cpu->cd.ppc.tlb_msgs,
+	    sizeof(struct ppc_tlb_msg) * MIN(n, PPC_N_TLB_MSGS));
+	cpu->cd.ppc.n_tlb_msgs = 0;
+	ppc_tlb_msg_unlock(cpu);
+
+	if (n > PPC_N_TLB_MSGS) {
+		ppc_mmu_flush_pteg_shadow(cpu);
+		ppc_tlb_invalidate(cpu, PPC_TLB_MSG_TLBIA, 0);
+	} else {
+		for (int i=0; i<n; i++)
+			ppc_tlb_invalidate(cpu, msgs[i].type, msgs[i].addr);
+	}
+
+	/*  Only now are they done, as far as tlbsync is concerned:  */
+	__atomic_sub_fetch(&cpu->cd.ppc.tlb_msg_pending, n, __ATOMIC_RELEASE);
+}
+
+
+/*
+ *  ppc_tlb_sync_pending():
+ *
+ *  Returns 1 if any other running cpu has not yet handled all the
+ *  invalidations sent to it (used by tlbsync).
+ */
+int ppc_tlb_sync_pending(struct cpu *cpu)
+{
+	struct machine *machine = cpu->machine;
+
+	for (int i=0; i<machine->ncpus; i++) {
+		struct cpu *c = machine->cpus[i];
+
+		if (c != cpu && c->running &&
+		    __atomic_load_n(&c->cd.ppc.tlb_msg_pending,
+		    __ATOMIC_ACQUIRE))
+			return 1;
+	}
+
+	return 0;
 }
 
 void ppc_update_for_icount(struct cpu *cpu) {
@@ -84,6 +84,36 @@ static inline void instr(update_pc_for_branch)(struct cpu *cpu, T &arch, Return
 }
 
 
+/*
+ *  host_page:
+ *
+ *  Returns a host pointer to the start of the page containing addr, if
+ *  len bytes starting at addr lie within that page, and the page is
+ *  present in the host_load (or host_store, for writes) table. Otherwise
+ *  NULL is returned, and the access has to go through gen_memory_rw,
+ *  which deals with page crossings, devices and exceptions.
+ *
+ *  Byte addresses within the access may be XORed with the little-endian
+ *  offset/swizzle; that never leaves the page.
+ */
+static inline unsigned char *instr(host_page)(struct cpu *cpu, MODE_uint_t addr,
+	size_t len, int writeflag)
+{
+	if ((addr & 0xfff) + len > 0x1000)
+		return NULL;
+
+	host_load_store_t pages = get_tlb_translation<ppc_tc_physpage>(cpu, addr, false);
+	if (writeflag == MEM_READ)
+		return pages.host_load;
+
+	if (pages.host_store != NULL)
+		ram_store_hook<ppc_tc_physpage>(cpu,
+		    pages.physaddr + (addr & 0xfff), len);
+
+	return pages.host_store;
+}
+
+
 /*
  *  nop:  Do nothing.
  */
@@ -116,10 +146,13 @@ X(addi)
 X(addi_symmetric)
 {
 	if (cpu->cd.ppc.bytelane_swap[0] != cpu->cd.ppc.bytelane_swap_latch) {
-		fprintf(stderr, "Bytelane swap latch -> bytelane swap (%d)\n", cpu->cd.ppc.bytelane_swap_latch);
+		TRACE(TRACE_PPC, TRACE_DEBUG, "Bytelane swap latch -> bytelane swap (%d)\n", cpu->cd.ppc.bytelane_swap_latch);
 		cpu->cd.ppc.bytelane_swap[0] = cpu->cd.ppc.bytelane_swap_latch;
 		cpu->cd.ppc.bytelane_swap[1] = cpu->cd.ppc.bytelane_swap_latch;
 		stwbrx_cache_spill(cpu);
+
+		/*  Loads/stores are specialized for the bytelane mode:  */
+		cpu->invalidate_code_translation(cpu, 0, INVALIDATE_ALL);
 	}
 	reg(ic->arg[2]) = reg(ic->arg[0]) + (int32_t)ic->arg[1];
 }
@@ -297,13 +330,14 @@ X(bcctr_l)
  *  b:  Branch (to a different translated page)
  *
  *  arg[0] = relative offset (as an int32_t) from start of page
+ *  arg[3..4] = link to the target page (see move_to_physpage_linked)
  */
 X(b)
 {
 	cpu->pc = ic->arg[0];
 
 	/*  Find the new physical page and update the translation pointers:  */
-	quick_pc_to_pointers(cpu);
+	cpu->cd.ppc.VPH.move_to_physpage_linked(cpu, &ic->arg[3]);
 }
 
 X(ba)
@@ -327,6 +361,7 @@ X(ba)
  *  arg[0] = relative offset (as an int32_t) from start of page
  *  arg[1] = bo
  *  arg[2] = 31-bi
+ *  arg[3..4] = link to the target page
  */
 X(bc)
 {
@@ -465,6 +500,7 @@ extern bool load_uint32(struct cpu *cpu, uint32_t addr, uint32_t &result);
  *
  *  arg[0] = relative offset (as an int32_t) from start of page
  *  arg[1] = lr offset (relative to start of current page)
+ *  arg[3..4] = link to the target page
  */
 X(bl)
 {
@@ -478,13 +514,13 @@ X(bl)
 	cpu->functioncall_trace(cpu, cpu->pc);
 
 	/*  Find the new physical page and update the translation pointers:  */
-	quick_pc_to_pointers(cpu);
+	cpu->cd.ppc.VPH.move_to_physpage_linked(cpu, &ic->arg[3]);
 
   /*
   if (cpu->pc == 0xd2b38) {
     uint32_t uio_addr;
     uint32_t uio_count;
-    fprintf(stderr, "vnop_rdwr - %s\n", cpu->cd.ppc.gpr[4] ? "write" : "read");
+    TRACE(TRACE_PPC, TRACE_DEBUG, "vnop_rdwr - %s\n", cpu->cd.ppc.gpr[4] ? "write" : "read");
     if (cpu->cd.ppc.gpr[4]) {
       if (load_uint32(cpu, cpu->cd.ppc.gpr[6], uio_addr)) {
         if (load_uint32(cpu, cpu->cd.ppc.gpr[6] + 4, uio_count)) {
@@ -778,6 +814,13 @@ X(dcbz)
   sync_pc(cpu, ic);
 
 	addr &= ~(cacheline_size - 1);
+
+	unsigned char *page = instr(host_page)(cpu, addr, cacheline_size, MEM_WRITE);
+	if (page != NULL) {
+		memset(page + (addr & 0xfff), 0, cacheline_size);
+		return;
+	}
+
 	memset(cacheline, 0, sizeof(cacheline));
 
 	while (cleared < cacheline_size) {
@@ -972,7 +1015,7 @@ X(fcmpu)
   base_cmp(cpu, ic, (uint64_t *)ic->arg[1], (uint64_t *)ic->arg[2]);
 	int bf_shift = ic->arg[0];
   int c = (cpu->cd.ppc.fpscr >> PPC_FPSCR_FPCC_SHIFT) & 0xf;
-  fprintf(stderr, "fcmpu new flags cr%d = %x\n", 7 - (bf_shift / 4), c);
+  TRACE(TRACE_PPC, TRACE_DEBUG, "fcmpu new flags cr%d = %x\n", 7 - (bf_shift / 4), c);
 	cpu->cd.ppc.cr &= ~(0xf << bf_shift);
 	cpu->cd.ppc.cr |= (c << bf_shift);
 }
@@ -1240,8 +1283,9 @@ X(fdivs_dot)
 X(llsc)
 {
 	int iw = ic->arg[0], len = 4, load = 0, xo = (iw >> 1) & 1023;
-	int i, rc = iw & 1, rt, ra, rb;
-  int ll_bit = cpu->cd.ppc.ll_bit;
+	int rc = iw & 1, rt, ra, rb;
+  /*  Other cpu threads may clear ll_bit, see ppc_ram_store():  */
+  int ll_bit = __atomic_load_n(&cpu->cd.ppc.ll_bit, __ATOMIC_ACQUIRE);
 	uint64_t addr = 0, value = 0;
 	unsigned char d[8] = { };
 
@@ -1274,13 +1318,28 @@ X(llsc)
 	/*  Synchronize the PC so the exception below can target the right location.  */
   sync_pc(cpu, ic);
 
-  if (!ppc_translate_v2p(cpu, addr ^ offset, &final_addr, load ? 0 : MEM_WRITE)) {
+	/*  stwcx. without a reservation fails without accessing memory:  */
+	if (!load && !ll_bit) {
+		cpu->cd.ppc.cr = (cpu->cd.ppc.cr & 0x0fffffff) |
+		    ((cpu->cd.ppc.spr[SPR_XER] & PPC_XER_SO) ? 0x10000000 : 0);
+		return;
+	}
+
+	/*
+	 *  The translation is usually in the translation cache; only
+	 *  walk the BATs and page table if it isn't.
+	 */
+	host_load_store_t pages = get_tlb_translation<ppc_tc_physpage>(cpu, addr ^ offset, false);
+	if ((load ? pages.host_load : pages.host_store) != NULL) {
+		final_addr = pages.physaddr;
+	} else if (!ppc_translate_v2p(cpu, addr ^ offset, &final_addr, load ? 0 : MEM_WRITE)) {
     // Will throw.
-    fprintf(stderr, "llsc: no translation?\n");
+    TRACE(TRACE_PPC, TRACE_WARN, "llsc: no translation?\n");
     return;
   }
 
-  final_addr = (final_addr & ~0xfff) | ((addr & 0xfff) ^ offset);
+  final_addr = ((final_addr & ~0xfff) | ((addr & 0xfff) ^ offset)) &
+      ~(uint64_t)(PPC_RESERVATION_GRANULE - 1);
 
 	if (load) {
 		if (rc) {
@@ -1313,10 +1372,11 @@ X(llsc)
         d[3^swizzle];
     }
 
-		cpu->cd.ppc.ll_addr = final_addr;
-		cpu->cd.ppc.ll_bit = 1;
+		__atomic_store_n(&cpu->cd.ppc.ll_addr, final_addr, __ATOMIC_RELAXED);
+		memcpy(&cpu->cd.ppc.ll_value, d, len);
+		__atomic_store_n(&cpu->cd.ppc.ll_bit, 1, __ATOMIC_RELEASE);
     if (cpu->pc > 0xb800 && cpu->pc < 0xc000) {
-      fprintf(stderr, "lwarx %08x = %08x @ %08x\n", (unsigned int)addr, (unsigned int)cpu->cd.ppc.gpr[rt], (unsigned int)cpu->pc);
+      TRACE(TRACE_PPC, TRACE_DEBUG, "lwarx %08x = %08x @ %08x\n", (unsigned int)addr, (unsigned int)cpu->cd.ppc.gpr[rt], (unsigned int)cpu->pc);
     }
 	} else {
 		uint32_t old_so = cpu->cd.ppc.spr[SPR_XER] & PPC_XER_SO;
@@ -1340,7 +1400,9 @@ X(llsc)
       new_cr |= 0x10000000;
     }
 
-		if (!ll_bit || (ll_addr != final_addr)) {
+		if (ll_addr != final_addr) {
+			__atomic_store_n(&cpu->cd.ppc.ll_bit, 0, __ATOMIC_RELAXED);
+			__atomic_store_n(&cpu->cd.ppc.ll_addr, 0, __ATOMIC_RELAXED);
 			cpu->cd.ppc.cr = new_cr;
 			// fprintf(stderr, "stwcx. %08x /!\\ %08x ll %d %08x @ %08x\n", (unsigned int)addr, (unsigned int)value, ll_bit, (unsigned int)cpu->cd.ppc.ll_addr, (unsigned int)cpu->pc);
 			return;
@@ -1366,18 +1428,58 @@ X(llsc)
       d[3^swizzle] = value;
     }
 
+		/*
+		 *  Other cpu threads may store to the same word at any time,
+		 *  so the store is only done if memory still contains what
+		 *  lwarx loaded.
+		 */
+		if (cpu->machine->cpu_threads_running && pages.host_store != NULL) {
+			unsigned char *p = pages.host_store + ((addr ^ offset) & 0xfff);
+			int ok;
+
+			if (len == 8) {
+				uint64_t expected = cpu->cd.ppc.ll_value, desired;
+				memcpy(&desired, d, 8);
+				ok = __atomic_compare_exchange_n((uint64_t *) p,
+				    &expected, desired, false, __ATOMIC_SEQ_CST,
+				    __ATOMIC_SEQ_CST);
+			} else {
+				uint32_t expected, desired;
+				memcpy(&expected, &cpu->cd.ppc.ll_value, 4);
+				memcpy(&desired, d, 4);
+				ok = __atomic_compare_exchange_n((uint32_t *) p,
+				    &expected, desired, false, __ATOMIC_SEQ_CST,
+				    __ATOMIC_SEQ_CST);
+			}
+
+			__atomic_store_n(&cpu->cd.ppc.ll_bit, 0, __ATOMIC_RELAXED);
+			__atomic_store_n(&cpu->cd.ppc.ll_addr, 0, __ATOMIC_RELAXED);
+
+			if (!ok) {
+				cpu->cd.ppc.cr = new_cr;
+				return;
+			}
+
+			/*  What gen_memory_rw does after a store: drop other
+			    reservations, and any code translated from the page.  */
+			ppc_ram_store(cpu, final_addr | ((addr ^ offset) &
+			    (PPC_RESERVATION_GRANULE - 1)), len);
+			cpu->invalidate_code_translation(cpu, final_addr,
+			    INVALIDATE_PADDR);
+			cpu->cd.ppc.cr = new_cr | 0x20000000;
+			return;
+		}
+
     if (!gen_memory_rw<ppc_tc_physpage, false>(cpu, cpu->mem, addr ^ offset, d, len, MEM_WRITE, CACHE_DATA)) {
 			fatal("sc: error: TODO\n");
       return;
     }
 
-		/*  Clear _all_ CPUs' ll_bits:  */
-		for (i=0; i<cpu->machine->ncpus; i++) {
-			cpu->machine->cpus[i]->cd.ppc.ll_addr = 0;
-			cpu->machine->cpus[i]->cd.ppc.ll_bit = 0;
-    }
+		/*  The store above cleared reservations on this granule
+		    (including our own, see ppc_ram_store()).  */
+		__atomic_store_n(&cpu->cd.ppc.ll_bit, 0, __ATOMIC_RELAXED);
+		__atomic_store_n(&cpu->cd.ppc.ll_addr, 0, __ATOMIC_RELAXED);
 
-    // Clear the reserve bit.
 		cpu->cd.ppc.cr = new_cr | 0x20000000;	/*  success!  */
 	}
 }
@@ -1689,6 +1791,10 @@ X(icbi)
   cpu->cd.ppc.msr = (cpu->cd.ppc.msr & ~PPC_MSR_IR) | (dr ? PPC_MSR_IR : 0);
   cpu->invalidate_translation_caches(cpu, ea, INVALIDATE_VADDR | instr);
   cpu->cd.ppc.msr = old_msr;
+
+  /*  icbi is broadcast to the other cpus:  */
+  if (ic->arg[2])
+    ppc_tlb_broadcast(cpu, PPC_TLB_MSG_ICBI, ea);
 }
 
 X(dcbt)
@@ -1846,10 +1952,12 @@ X(mtspr) {
     for (uint64_t addr = bepi; addr < bepi + bl; addr += 1 << 12) {
       cpu->invalidate_translation_caches(cpu, addr, INVALIDATE_VADDR | (sprbank ? 0 : INVALIDATE_INSTR));
     }
+    cpu->cd.ppc.bat_decoded_ok = 0;
     // fprintf(stderr, "%sBAT%d%s CHANGE %08x:%08x <= %08x\n", sprbank ? "D" : "I", regnr, lower ? "L" : "U", (unsigned int)old_upper, (unsigned int)old_lower, (unsigned int)reg(ic->arg[0]));
   } else if (spr == SPR_SDR1) {
-    fprintf(stderr, "SDR1 CHANGE\n");
+    TRACE(TRACE_PPC, TRACE_DEBUG, "SDR1 CHANGE\n");
     cpu->invalidate_translation_caches(cpu, cpu->pc, INVALIDATE_ALL);
+    ppc_mmu_flush_pteg_shadow(cpu);
   }
   reg(ic->arg[1]) = reg(ic->arg[0]);
 }
@@ -2039,6 +2147,16 @@ X(lmw) {
 
   sync_pc(cpu, ic);
 
+	unsigned char *page = instr(host_page)(cpu, addr, (32 - rs) * sizeof(uint32_t), MEM_READ);
+	if (page != NULL) {
+		for (; rs <= 31; rs ++, addr += sizeof(uint32_t)) {
+			unsigned char *p = page + ((addr ^ offset) & 0xfff);
+			cpu->cd.ppc.gpr[rs] = (uint32_t)((p[0 ^ swizzle] << 24) +
+			    (p[1 ^ swizzle] << 16) + (p[2 ^ swizzle] << 8) + p[3 ^ swizzle]);
+		}
+		return;
+	}
+
   uint32_t candidate_values[32];
   auto original_rs = rs;
 
@@ -2074,18 +2192,29 @@ X(stmw) {
     timer_target_addr = cpu->cd.ppc.gpr[3];
   }
 
+	unsigned char *page = instr(host_page)(cpu, addr, (32 - rs) * sizeof(uint32_t), MEM_WRITE);
+	if (page != NULL) {
+		for (; rs <= 31; rs ++, addr += sizeof(uint32_t)) {
+			unsigned char *p = page + ((addr ^ offset) & 0xfff);
+			uint32_t tmp = cpu->cd.ppc.gpr[rs];
+			p[3 ^ swizzle] = tmp; p[2 ^ swizzle] = tmp >> 8;
+			p[1 ^ swizzle] = tmp >> 16; p[0 ^ swizzle] = tmp >> 24;
+		}
+		return;
+	}
+
   auto test_addr = addr;
   for (auto test_rs = rs; test_rs <= 31; test_rs++) {
     if (gen_memory_rw<ppc_tc_physpage, false>(cpu, cpu->mem, test_addr ^ offset, d, sizeof(d),
                        MEM_READ, CACHE_DATA) != MEMORY_ACCESS_OK) {
 			/*  exception  */
-      fprintf(stderr, "%08x STMW read probe failed %08x\n", (unsigned int)cpu->pc, (unsigned int)test_addr);
+      TRACE(TRACE_PPC, TRACE_WARN, "%08x STMW read probe failed %08x\n", (unsigned int)cpu->pc, (unsigned int)test_addr);
 			return;
 		}
     if (gen_memory_rw<ppc_tc_physpage, false>(cpu, cpu->mem, test_addr ^ offset, d, sizeof(d),
                        MEM_WRITE, CACHE_DATA) != MEMORY_ACCESS_OK) {
 			/*  exception  */
-      fprintf(stderr, "%08x STMW write probe failed %08x\n", (unsigned int)cpu->pc, (unsigned int)test_addr);
+      TRACE(TRACE_PPC, TRACE_WARN, "%08x STMW write probe failed %08x\n", (unsigned int)cpu->pc, (unsigned int)test_addr);
 			return;
 		}
 
@@ -2150,6 +2279,7 @@ X(lswi)
 
   uint64_t register_values[32] = { 0 };
   uint32_t start_rt = (rt + 31) & 31;
+  unsigned char *page = instr(host_page)(cpu, addr, nb, MEM_READ);
 
 	while (nb > 0) {
 		unsigned char d;
@@ -2159,7 +2289,9 @@ X(lswi)
 			sub = 0;
 		}
 
-		if (gen_memory_rw<ppc_tc_physpage, false>(cpu, cpu->mem, addr ^ offset ^ swizzle, &d, 1,
+		if (page != NULL)
+			d = page[(addr ^ offset ^ swizzle) & 0xfff];
+		else if (gen_memory_rw<ppc_tc_physpage, false>(cpu, cpu->mem, addr ^ offset ^ swizzle, &d, 1,
                        MEM_READ, CACHE_DATA) != MEMORY_ACCESS_OK) {
 			/*  exception  */
       // fprintf(stderr, "%08x LSW%c read failed %08x\n", (unsigned int)cpu->pc, ix, (unsigned int)addr);
@@ -2218,13 +2350,16 @@ X(stswi)
   // fprintf(stderr, "%08x STSW%c set written %08x nb %d\n", (unsigned int)cpu->pc, ix, (unsigned int)addr, nb);
 
   auto last_byte_ptr = addr + nb - 1;
+  unsigned char *page = instr(host_page)(cpu, addr, nb, MEM_WRITE);
 
   do {
 		unsigned char d = cur >> 24;
 
-		if (gen_memory_rw<ppc_tc_physpage, false>(cpu, cpu->mem, addr ^ offset ^ swizzle, &d, 1,
+		if (page != NULL)
+			page[(addr ^ offset ^ swizzle) & 0xfff] = d;
+		else if (gen_memory_rw<ppc_tc_physpage, false>(cpu, cpu->mem, addr ^ offset ^ swizzle, &d, 1,
                        MEM_WRITE, CACHE_DATA) != MEMORY_ACCESS_OK) {
-      fprintf(stderr, "%08x STSW%c real write failed %08x\n", (unsigned int)pc, ix, addr);
+      TRACE(TRACE_PPC, TRACE_WARN, "%08x STSW%c real write failed %08x\n", (unsigned int)pc, ix, addr);
       /* exception */
       return;
     }
@@ -3030,12 +3165,13 @@ X(vxor)
 X(tlbia)
 {
 	fatal("[ tlbia ]\n");
-	cpu->invalidate_translation_caches(cpu, 0, INVALIDATE_ALL);
+	ppc_tlb_invalidate(cpu, PPC_TLB_MSG_TLBIA, 0);
+	ppc_tlb_broadcast(cpu, PPC_TLB_MSG_TLBIA, 0);
 }
 
 
 /*
- *  tlbie:  TLB invalidate
+ *  tlbie:  TLB invalidate (on all cpus)
  */
 X(tlbie)
 {
@@ -3043,21 +3179,23 @@ X(tlbie)
   sync_pc(cpu, ic);
   // fprintf(stderr, "[ %08x: tlbie %08x %"PRIx64" ]\n", (unsigned int)cpu->pc, (unsigned int)reg(ic->arg[0]), cpu->ninstrs);
 
-  auto msr = cpu->cd.ppc.msr;
-  uint64_t increment = 0x10000000;
-  uint64_t addr_page = reg(ic->arg[0]);
-
-  for (int i = 0; i < 2; i++) {
-    cpu->cd.ppc.msr = (msr & ~0x30) | (i * 0x30);
-    addr_page &= increment - 1;
-    for (int i = 0; i < 16; i++) {
-      cpu->invalidate_translation_caches(cpu, reg(ic->arg[0]), INVALIDATE_VADDR | INVALIDATE_INSTR);
-      cpu->invalidate_translation_caches(cpu, reg(ic->arg[0]), INVALIDATE_VADDR);
-      addr_page += increment;
-    }
-  }
+	ppc_tlb_invalidate(cpu, PPC_TLB_MSG_TLBIE, reg(ic->arg[0]));
+	ppc_tlb_broadcast(cpu, PPC_TLB_MSG_TLBIE, reg(ic->arg[0]));
+}
+
 
-  cpu->cd.ppc.msr = msr;
+/*
+ *  tlbsync:  Wait until tlbie and tlbia have completed on all other cpus.
+ *
+ *  When the cpus run in threads of their own, this instruction is simply
+ *  executed over and over again until the other cpus have handled their
+ *  queued invalidations.
+ */
+X(tlbsync)
+{
+	if (cpu->machine->cpu_threads_running && ppc_tlb_sync_pending(cpu)) {
+		cpu->cd.ppc.VPH.nothing();
+	}
 }
 
 
@@ -3134,6 +3272,12 @@ X(tlbld)
 /*****************************************************************************/
 
 
+/*
+ *  end_of_page:
+ *
+ *  arg[0..1] = link to the next page (there is one end_of_page per
+ *              physpage, and a physpage only has one virtual address)
+ */
 X(end_of_page)
 {
 	/*  Update the PC:  (offset 0, but on the next page)  */
@@ -3141,7 +3285,7 @@ X(end_of_page)
 	cpu->pc += (PPC_IC_ENTRIES_PER_PAGE << PPC_INSTR_ALIGNMENT_SHIFT);
 
 	/*  Find the new physical page and update the translation pointers:  */
-	quick_pc_to_pointers(cpu);
+	cpu->cd.ppc.VPH.move_to_physpage_linked(cpu, &ic->arg[0]);
 
 	/*  end_of_page doesn't count as an executed instruction:  */
 	cpu->n_translated_instrs --;
@@ -3169,6 +3313,278 @@ X(dump_registers) {
   }
 }
 
+#ifdef MODE32
+/*
+ *  Native code for hot runs of simple instructions:  (see cpu_ppc_native.cc)
+ *
+ *  COMBINE(native) puts a native_head in front of each translated instruction
+ *  which the native code generator understands. When a head has been
+ *  executed PPC_NATIVE_THRESHOLD times, the run of instructions starting at
+ *  that point is compiled, and the head is replaced by native_block.
+ *
+ *  native_head:	arg[3] = execution counter
+ *			arg[4] = the instruction's real function
+ *  native_block:	arg[3] = pointer to struct ppc_native_block
+ *			arg[4] = the instruction's real function
+ */
+X(native_head);
+X(native_block);
+
+
+static void (*instr(native_real_f)(struct ppc_instr_call *ic))
+	(struct cpu *, struct ppc_instr_call *)
+{
+	if (ic->f == instr(native_head) || ic->f == instr(native_block))
+		return (void (*)(struct cpu *, struct ppc_instr_call *))
+		    ic->arg[4];
+	return ic->f;
+}
+
+
+static int32_t instr(native_reg_offset)(struct cpu *cpu, size_t ptr, int *ok)
+{
+	size_t ofs = ptr - (size_t)cpu;
+
+	if (ptr < (size_t)cpu || ofs > sizeof(struct cpu) - sizeof(uint32_t))
+		*ok = 0;
+	return ofs;
+}
+
+
+/*
+ *  native_decode():
+ *
+ *  Fills in op from a translated instruction. Returns the PPC_NATIVE_*
+ *  op number, or -1 if the instruction can not be compiled.
+ */
+static int instr(native_decode)(struct cpu *cpu, struct ppc_instr_call *ic,
+	struct ppc_native_op *op)
+{
+	void (*f)(struct cpu *, struct ppc_instr_call *) =
+	    instr(native_real_f)(ic);
+	int ok = 1;
+
+	memset(op, 0, sizeof(struct ppc_native_op));
+
+	if (f == instr(nop)) {
+		op->op = PPC_NATIVE_NOP;
+	} else if (f == instr(li) || f == instr(li_0)) {
+		op->op = PPC_NATIVE_LI;
+		op->imm = f == instr(li)? (uint32_t)ic->arg[1] : 0;
+		op->d = instr(native_reg_offset)(cpu, ic->arg[2], &ok);
+	} else if (f == instr(addi) || f == instr(ori) || f == instr(xori)) {
+		op->op = f == instr(addi)? PPC_NATIVE_ADDI :
+		    f == instr(ori)? PPC_NATIVE_ORI : PPC_NATIVE_XORI;
+		op->a = instr(native_reg_offset)(cpu, ic->arg[0], &ok);
+		op->imm = (uint32_t)ic->arg[1];
+		op->d = instr(native_reg_offset)(cpu, ic->arg[2], &ok);
+	} else if (f == instr(mr)) {
+		op->op = PPC_NATIVE_MR;
+		op->a = instr(native_reg_offset)(cpu, ic->arg[1], &ok);
+		op->d = instr(native_reg_offset)(cpu, ic->arg[2], &ok);
+	} else if (f == instr(add) || f == instr(subf) || f == instr(and) ||
+	    f == instr(or) || f == instr(xor) || f == instr(andc) ||
+	    f == instr(nor)) {
+		op->op = f == instr(add)? PPC_NATIVE_ADD :
+		    f == instr(subf)? PPC_NATIVE_SUBF :
+		    f == instr(and)? PPC_NATIVE_AND :
+		    f == instr(or)? PPC_NATIVE_OR :
+		    f == instr(xor)? PPC_NATIVE_XOR :
+		    f == instr(andc)? PPC_NATIVE_ANDC : PPC_NATIVE_NOR;
+		op->a = instr(native_reg_offset)(cpu, ic->arg[0], &ok);
+		op->b = instr(native_reg_offset)(cpu, ic->arg[1], &ok);
+		op->d = instr(native_reg_offset)(cpu, ic->arg[2], &ok);
+	} else if (f == instr(neg)) {
+		op->op = PPC_NATIVE_NEG;
+		op->a = instr(native_reg_offset)(cpu, ic->arg[0], &ok);
+		op->d = instr(native_reg_offset)(cpu, ic->arg[1], &ok);
+	} else if (f == instr(extsb) || f == instr(extsh)) {
+		op->op = f == instr(extsb)? PPC_NATIVE_EXTSB : PPC_NATIVE_EXTSH;
+		op->a = instr(native_reg_offset)(cpu, ic->arg[0], &ok);
+		op->d = instr(native_reg_offset)(cpu, ic->arg[2], &ok);
+	} else if (f == instr(rlwinm)) {
+		uint32_t iword = ic->arg[2];
+		op->op = PPC_NATIVE_RLWINM;
+		op->a = instr(native_reg_offset)(cpu,
+		    (size_t)&cpu->cd.ppc.gpr[(iword >> 21) & 31], &ok);
+		op->sh = (iword >> 11) & 31;
+		op->imm = (uint32_t)ic->arg[1];
+		op->d = instr(native_reg_offset)(cpu, ic->arg[0], &ok);
+	} else if (f == instr(cmpw) || f == instr(cmpw_cr0) ||
+	    f == instr(cmplw)) {
+		op->op = f == instr(cmplw)? PPC_NATIVE_CMPLW : PPC_NATIVE_CMPW;
+		op->a = instr(native_reg_offset)(cpu, ic->arg[0], &ok);
+		op->b = instr(native_reg_offset)(cpu, ic->arg[1], &ok);
+		op->sh = f == instr(cmpw_cr0)? 28 : ic->arg[2];
+	} else if (f == instr(cmpwi) || f == instr(cmpwi_cr0) ||
+	    f == instr(cmplwi)) {
+		op->op = f == instr(cmplwi)? PPC_NATIVE_CMPLWI : PPC_NATIVE_CMPWI;
+		op->a = instr(native_reg_offset)(cpu, ic->arg[0], &ok);
+		op->imm = (uint32_t)ic->arg[1];
+		op->sh = f == instr(cmpwi_cr0)? 28 : ic->arg[2];
+	} else if (f == instr(b_samepage) || f == instr(bc_samepage_simple0) ||
+	    f == instr(bc_samepage_simple1)) {
+		op->op = f == instr(b_samepage)? PPC_NATIVE_B :
+		    f == instr(bc_samepage_simple0)? PPC_NATIVE_BF : PPC_NATIVE_BT;
+		op->sh = ic->arg[2];
+		op->target = cpu->cd.ppc.VPH.get_ic_page() +
+		    pc_to_ic_entry<ppc_tc_physpage>(ic->arg[0]);
+	} else
+		return -1;
+
+	if (!ok || op->sh < 0 || op->sh > 31)
+		return -1;
+
+	return op->op;
+}
+
+
+/*
+ *  native_check:  Run a native block, and then the same instructions using
+ *  their normal functions, and compare the results.
+ */
+static void instr(native_check)(struct cpu *cpu, struct ppc_instr_call *ic)
+{
+	struct ppc_native_block *b = (struct ppc_native_block *) ic->arg[3];
+	uint64_t gpr[32], native_gpr[32];
+	uint32_t cr = cpu->cd.ppc.cr, native_cr;
+	struct ppc_instr_call *native_next;
+	int i;
+
+	memcpy(gpr, cpu->cd.ppc.gpr, sizeof(gpr));
+	native_next = b->code(cpu);
+	memcpy(native_gpr, cpu->cd.ppc.gpr, sizeof(native_gpr));
+	native_cr = cpu->cd.ppc.cr;
+	memcpy(cpu->cd.ppc.gpr, gpr, sizeof(gpr));
+	cpu->cd.ppc.cr = cr;
+
+	for (i = 0; i < b->n_instrs; i++) {
+		cpu->cd.ppc.VPH.jump_to_ic(ic + i + 1);
+		instr(native_real_f)(ic + i)(cpu, ic + i);
+	}
+
+	if (memcmp(native_gpr, cpu->cd.ppc.gpr, sizeof(gpr)) != 0 ||
+	    native_cr != cpu->cd.ppc.cr ||
+	    native_next != cpu->cd.ppc.VPH.get_next_ic()) {
+		fatal("ppc_native: MISMATCH in block at pc 0x%08" PRIx32
+		    " (%i instructions)\n", (uint32_t)ic->pc, b->n_instrs);
+		for (i = 0; i < 32; i++)
+			if (native_gpr[i] != cpu->cd.ppc.gpr[i])
+				fatal("  r%i: native 0x%08" PRIx32 ", expected"
+				    " 0x%08" PRIx32 "\n", i,
+				    (uint32_t)native_gpr[i],
+				    (uint32_t)cpu->cd.ppc.gpr[i]);
+		fatal("  cr: native 0x%08" PRIx32 ", expected 0x%08" PRIx32
+		    "\n", native_cr, cpu->cd.ppc.cr);
+		fatal("  next ic: native %p, expected %p\n", native_next,
+		    cpu->cd.ppc.VPH.get_next_ic());
+		exit(1);
+	}
+
+	cpu->n_translated_instrs += b->n_instrs - 1;
+	cpu->cd.ppc.icount += b->n_instrs - 1;
+}
+
+
+/*
+ *  A native block runs its whole run of instructions in one call, so it is
+ *  bypassed (but kept) while the debugger single-steps or instructions are
+ *  traced, which must see the instructions one at a time.
+ */
+#define	NATIVE_PAUSED(cpu)	(single_step != NOT_SINGLE_STEPPING ||	\
+				    (cpu)->machine->instruction_trace)
+
+
+X(native_head)
+{
+	void (*f)(struct cpu *, struct ppc_instr_call *) =
+	    (void (*)(struct cpu *, struct ppc_instr_call *)) ic->arg[4];
+
+	if (!cpu->cd.ppc.native || ppc_recording != NULL) {
+		ic->f = f;
+	} else if (NATIVE_PAUSED(cpu)) {
+		/*  Don't count towards compilation.  */
+	} else if (++ ic->arg[3] >= PPC_NATIVE_THRESHOLD) {
+		struct ppc_native_op ops[PPC_NATIVE_MAX_OPS];
+		struct ppc_instr_call *page_end =
+		    cpu->cd.ppc.VPH.get_ic_page() + PPC_IC_ENTRIES_PER_PAGE;
+		struct ppc_native_block *b = NULL;
+		int n = 0, op;
+
+		while (n < PPC_NATIVE_MAX_OPS && ic + n < page_end) {
+			op = instr(native_decode)(cpu, ic + n, &ops[n]);
+			if (op < 0)
+				break;
+			n ++;
+			if (op >= PPC_NATIVE_B)
+				break;
+		}
+
+		if (n >= 2)
+			b = ppc_native_compile(cpu, ops, n, ic + n);
+
+		/*  Note: ic may have been invalidated by ppc_native_compile,
+		    if the cache had to be flushed.  */
+		if (b != NULL) {
+			ic->arg[3] = (size_t) b;
+			ic->f = instr(native_block);
+			instr(native_block)(cpu, ic);
+			return;
+		}
+		if (ic->f == instr(native_head))
+			ic->f = f;
+	}
+
+	f(cpu, ic);
+}
+
+
+X(native_block)
+{
+	struct ppc_native_block *b = (struct ppc_native_block *) ic->arg[3];
+
+	if (!cpu->cd.ppc.native || ppc_recording != NULL) {
+		ic->f = (void (*)(struct cpu *, struct ppc_instr_call *))
+		    ic->arg[4];
+		ic->f(cpu, ic);
+		return;
+	}
+
+	if (NATIVE_PAUSED(cpu)) {
+		((void (*)(struct cpu *, struct ppc_instr_call *))
+		    ic->arg[4])(cpu, ic);
+		return;
+	}
+
+	if (cpu->cd.ppc.native > 1) {
+		instr(native_check)(cpu, ic);
+		return;
+	}
+
+	cpu->cd.ppc.VPH.jump_to_ic(b->code(cpu));
+	cpu->n_translated_instrs += b->n_instrs - 1;
+	cpu->cd.ppc.icount += b->n_instrs - 1;
+}
+
+
+/*
+ *  Combination check, called after an instruction has been translated:
+ */
+void COMBINE(native)(struct cpu *cpu, struct ppc_instr_call *ic, int low_addr)
+{
+	struct ppc_native_op op;
+	int n = instr(native_decode)(cpu, ic, &op);
+
+	if (n < 0 || n >= PPC_NATIVE_B)
+		return;
+
+	ic->arg[3] = 0;
+	ic->arg[4] = (size_t) ic->f;
+	ic->f = instr(native_head);
+}
+#endif	/*  MODE32  */
+
+
 /*****************************************************************************/
 
 
@@ -3206,7 +3622,7 @@ X(to_be_translated)
 	/*  Read the instruction word from memory:  */
   if (!gen_memory_rw<ppc_tc_physpage, false>(cpu, cpu->mem, addr ^ offset, ib,
                                              sizeof(ib), MEM_READ, CACHE_INSTRUCTION)) {
-    fprintf(stderr, "%08x: translation failed\n", (unsigned int)addr);
+    TRACE(TRACE_PPC, TRACE_WARN, "%08x: translation failed\n", (unsigned int)addr);
     memcpy(ic, &nothing_call, sizeof(nothing_call));
     low_pc = ~0ull;
     goto bad;
@@ -3448,7 +3864,16 @@ X(to_be_translated)
       abort();
       break;
 		}
-		if (ic->f == NULL) {
+		if (ic->f == NULL && PPC_LE_BYTELANE_SWAP(cpu)) {
+			ic->f =
+#ifdef MODE32
+			    ppc32_loadstore_le
+#else
+			    ppc_loadstore_le
+#endif
+			    [size + 4*zero + 8*load + (imm==0? 16 : 0)
+			    + 32*update];
+		} else if (ic->f == NULL) {
 			ic->f =
 #ifdef MODE32
 			    ppc32_loadstore
@@ -3501,6 +3926,7 @@ X(to_be_translated)
 		ic->arg[0] = addr + tmp_addr;
 		ic->arg[1] = bo;
 		ic->arg[2] = 31-bi;
+		ic->arg[3] = ic->arg[4] = 0;
 		/*  Branches are calculated as cur PC + offset.  */
 		/*  Special case: branch within the same page:  */
 		{
@@ -3539,6 +3965,7 @@ X(to_be_translated)
 		}
     ic->arg[0] = addr + (int32_t)tmp_addr;
 		ic->arg[1] = (addr & 0xffc) + 4;
+		ic->arg[3] = ic->arg[4] = 0;
 		/*  Branches are calculated as cur PC + offset.  */
 		/*  Special case: branch within the same page:  */
 		{
@@ -3637,7 +4064,7 @@ X(to_be_translated)
 			break;
 
 		default:{
-      fprintf(stderr, "PPC_HI6_19: unknown xo %d\n", xo);
+      TRACE(TRACE_PPC, TRACE_WARN, "PPC_HI6_19: unknown xo %d\n", xo);
       goto bad;
     }
 		}
@@ -3718,7 +4145,7 @@ X(to_be_translated)
 			break;
 
 		default:{
-      fprintf(stderr, "PPC_HI6_30: unknown xo %d\n", xo);
+      TRACE(TRACE_PPC, TRACE_WARN, "PPC_HI6_30: unknown xo %d\n", xo);
       goto bad;
     }
 		}
@@ -3978,9 +4405,8 @@ X(to_be_translated)
 		case PPC_31_TLBSYNC:
 			/*  According to IBM, "Ensures that a tlbie and
 			    tlbia instruction executed by one processor has
-			    completed on all other processors.", which in
-			    GXemul means a nop :-)  */
-			ic->f = instr(nop);
+			    completed on all other processors."  */
+			ic->f = instr(tlbsync);
 			break;
 
 		case PPC_31_TLBIE:
@@ -4133,9 +4559,13 @@ X(to_be_translated)
 			case PPC_31_LWZX:  size=2; load=1; break;
 			case PPC_31_LWZUX: size=2; load=update = 1; break;
 			case PPC_31_LHBRX: size=1; load=1; byterev=1;
-					   ic->f = instr(lhbrx); break;
+					   ic->f = PPC_LE_BYTELANE_SWAP(cpu)?
+					       instr(lhbrx_le) : instr(lhbrx);
+					   break;
 			case PPC_31_LWBRX: size=2; load=1; byterev=1;
-					   ic->f = instr(lwbrx); break;
+					   ic->f = PPC_LE_BYTELANE_SWAP(cpu)?
+					       instr(lwbrx_le) : instr(lwbrx);
+					   break;
 			case PPC_31_LFDX:  size=3; load=1; fp=1;
 					   ic->f = instr(lfdx); break;
 			case PPC_31_LFSX:  size=2; load=1; fp=1;
@@ -4149,9 +4579,13 @@ X(to_be_translated)
 			case PPC_31_STDX:  size=3; break;
 			case PPC_31_STDUX: size=3; update = 1; break;
 			case PPC_31_STHBRX:size=1; byterev = 1;
-					   ic->f = instr(sthbrx); break;
+					   ic->f = PPC_LE_BYTELANE_SWAP(cpu)?
+					       instr(sthbrx_le) : instr(sthbrx);
+					   break;
 			case PPC_31_STWBRX:size=2; byterev = 1;
-					   ic->f = instr(stwbrx); break;
+					   ic->f = PPC_LE_BYTELANE_SWAP(cpu)?
+					       instr(stwbrx_le) : instr(stwbrx);
+					   break;
 			case PPC_31_STFDX: size=3; fp=1;
 					   ic->f = instr(stfdx); break;
 			case PPC_31_STFSX: size=2; fp=1;
@@ -4161,7 +4595,16 @@ X(to_be_translated)
 				ic->arg[0] = (size_t)(&cpu->cd.ppc.fpr[rs]);
 			else
 				ic->arg[0] = (size_t)(&cpu->cd.ppc.gpr[rs]);
-			if (!byterev && ic->f == NULL) {
+			if (!byterev && ic->f == NULL &&
+			    PPC_LE_BYTELANE_SWAP(cpu)) {
+				ic->f =
+#ifdef MODE32
+				    ppc32_loadstore_indexed_le
+#else
+				    ppc_loadstore_indexed_le
+#endif
+				    [size + 4*zero + 8*load + 16*update];
+			} else if (!byterev && ic->f == NULL) {
 				ic->f =
 #ifdef MODE32
 				    ppc32_loadstore_indexed
@@ -4380,7 +4823,7 @@ X(to_be_translated)
 			break;
 
 		default:{
-      fprintf(stderr, "PPC_31: unknown xo %d\n", xo);
+      TRACE(TRACE_PPC, TRACE_WARN, "PPC_31: unknown xo %d\n", xo);
       goto bad;
     }
 		}
@@ -4447,7 +4890,7 @@ X(to_be_translated)
 		default:/*  Use all 10 bits of xo:  */
 			switch (xo) {
 			default:{
-        fprintf(stderr, "PPC_59: unknown xo %d\n", xo);
+        TRACE(TRACE_PPC, TRACE_WARN, "PPC_59: unknown xo %d\n", xo);
         goto bad;
       }
 			}
@@ -4659,7 +5102,7 @@ X(to_be_translated)
         break;
         
 			default:{
-        fprintf(stderr, "PPC_63: unknown xo %d (%08x)\n", xo, iword);
+        TRACE(TRACE_PPC, TRACE_WARN, "PPC_63: unknown xo %d (%08x)\n", xo, iword);
         goto bad;
       }
       }
@@ -4667,12 +5110,17 @@ X(to_be_translated)
 		break;
 
   default:{
-    fprintf(stderr, "unknown ppc hi6 %d\n", main_opcode);
+    TRACE(TRACE_PPC, TRACE_WARN, "unknown ppc hi6 %d\n", main_opcode);
     goto bad;
   }
   }
 
  end:
+#ifdef MODE32
+	if (cpu->cd.ppc.native && ppc_native_available())
+		cpu->cd.ppc.combination_check = COMBINE(native);
+#endif
+
 #define	DYNTRANS_TO_BE_TRANSLATED_TAIL
 #include "cpu_dyntrans.cc"
 #undef	DYNTRANS_TO_BE_TRANSLATED_TAIL
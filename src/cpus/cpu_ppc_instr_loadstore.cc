@@ -69,7 +69,22 @@ void LS_GENERIC_N(struct cpu *cpu, struct ppc_instr_call *ic)
   unsigned char data[LS_SIZE] = { };
 
   int swizzle, offset;
+#ifdef LS_LE
+	/*
+	 *  Translated for little-endian mode with bytelane swapping, where
+	 *  the address needs no munging and every access is simply byte
+	 *  reversed. If the mode has changed since this instruction was
+	 *  translated, let the normal code handle it.
+	 */
+	if (!(cpu->cd.ppc.msr & PPC_MSR_LE) || !cpu->cd.ppc.bytelane_swap[0]) {
+		LS_GENERIC_ANYMODE_N(cpu, ic);
+		return;
+	}
+  swizzle = LS_SIZE - 1;
+  offset = 0;
+#else
   cpu_ppc_swizzle_offset(cpu, LS_SIZE, 0, &swizzle, &offset);
+#endif
 
 #ifdef LS_BYTEREVERSE
 #ifdef LS_H
@@ -89,7 +104,7 @@ void LS_GENERIC_N(struct cpu *cpu, struct ppc_instr_call *ic)
 
 #ifndef LS_B
 	if ((addr & 0xfff) + LS_SIZE-1 > 0xfff) {
-		if (swizzle | offset) {
+		if (offset) {
       fprintf(stderr, "misaligned LE without full translation\n");
       exit(1);
     }
@@ -151,22 +166,35 @@ void LS_GENERIC_N(struct cpu *cpu, struct ppc_instr_call *ic)
 	}
 #endif
 
+	/*
+	 *  The access is within one page here. If the page is in the
+	 *  translation cache, access the host memory directly; otherwise
+	 *  gen_memory_rw deals with devices, exceptions and filling in the
+	 *  translation cache.
+	 */
 #ifdef LS_LOAD
-	if (!gen_memory_rw<ppc_tc_physpage, false>(cpu, cpu->mem, addr ^ offset, data, sizeof(data),
+	unsigned char *page = instr(host_page)(cpu, addr ^ offset, LS_SIZE, MEM_READ);
+	if (page != NULL)
+		memcpy(data, page + ((addr ^ offset) & 0xfff), sizeof(data));
+	else if (!gen_memory_rw<ppc_tc_physpage, false>(cpu, cpu->mem, addr ^ offset, data, sizeof(data),
                       MEM_READ, CACHE_DATA)) {
 		/*  Exception.  */
 		return;
 	}
 
   load_reg<LS_SIZE * 8, DO_ZERO>(ic->arg[0], data, swizzle);
-
-  access_log(cpu, 0, addr^offset, data, sizeof(data), swizzle);
 #else	/*  store:  */
   store_reg<LS_SIZE * 8>(ic->arg[0], data, swizzle);
 
-  access_log(cpu, 1, addr^offset, data, sizeof(data), swizzle);
+	/*  Only needed while a bytelane swap may be pending, see dev_eagle:  */
+	if (cpu->cd.ppc.bytelane_swap_tracking &&
+	    !cpu->cd.ppc.bytelane_swap_latch)
+		access_log(cpu, 1, addr^offset, data, sizeof(data), swizzle);
 
-	if (!gen_memory_rw<ppc_tc_physpage, false>(cpu, cpu->mem, addr^offset, data, sizeof(data),
+	unsigned char *page = instr(host_page)(cpu, addr ^ offset, LS_SIZE, MEM_WRITE);
+	if (page != NULL)
+		memcpy(page + ((addr ^ offset) & 0xfff), data, sizeof(data));
+	else if (!gen_memory_rw<ppc_tc_physpage, false>(cpu, cpu->mem, addr^offset, data, sizeof(data),
                       MEM_WRITE, CACHE_DATA)) {
 		/*  Exception.  */
 		return;
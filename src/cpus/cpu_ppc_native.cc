@@ -0,0 +1,401 @@
+/*
+ *  Native (host) code for hot PowerPC instruction runs.
+ *
+ *  cpu_ppc_instr.cc decodes a run of simple translated instructions into
+ *  struct ppc_native_op entries, and ppc_native_compile() turns them into
+ *  one host function. The function takes the cpu pointer, updates the
+ *  emulated registers in place (they are addressed as offsets from the cpu
+ *  pointer), and returns the ppc_instr_call to continue with.
+ *
+ *  Only 32-bit mode and x86-64 hosts are supported. Everything else (loads,
+ *  stores, instructions which may cause exceptions, etc.) is still done by
+ *  the normal instruction functions, in between native blocks.
+ *
+ *  Compiled code is kept in a per-cpu buffer. When it is full, all
+ *  translations of the cpu are invalidated and the buffer is reused.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "cpu.h"
+#include "machine.h"
+#include "misc.h"
+
+#include "thirdparty/ppc_spr.h"
+
+
+#if defined(__x86_64__)
+
+struct ppc_native_cache {
+	unsigned char	*base;
+	size_t		size;
+	size_t		used;
+};
+
+/*
+ *  Bytes reserved per ppc_native_op, plus one for the end. The largest
+ *  emitter is a register cmpw/cmplw, at 78 bytes.
+ */
+#define	MAX_BYTES_PER_OP	128
+
+/*  x86 registers used by the generated code:  */
+#define	EAX	0
+#define	ECX	1
+#define	EDX	2
+
+
+static int native_failed = 0;
+
+
+static inline void emit8(unsigned char **p, uint8_t x)
+{
+	*(*p)++ = x;
+}
+
+static inline void emit32(unsigned char **p, uint32_t x)
+{
+	memcpy(*p, &x, sizeof(x));
+	(*p) += sizeof(x);
+}
+
+static inline void emit64(unsigned char **p, uint64_t x)
+{
+	memcpy(*p, &x, sizeof(x));
+	(*p) += sizeof(x);
+}
+
+
+/*  mov reg, [rdi + ofs]  */
+static void emit_load(unsigned char **p, int reg, int32_t ofs)
+{
+	emit8(p, 0x8b); emit8(p, 0x87 | (reg << 3)); emit32(p, ofs);
+}
+
+/*  mov [rdi + ofs], reg  */
+static void emit_store(unsigned char **p, int reg, int32_t ofs)
+{
+	emit8(p, 0x89); emit8(p, 0x87 | (reg << 3)); emit32(p, ofs);
+}
+
+/*  <alu> eax, ecx  (0x01 add, 0x09 or, 0x21 and, 0x29 sub, 0x31 xor,
+    0x39 cmp)  */
+static void emit_alu_eax_ecx(unsigned char **p, uint8_t opcode)
+{
+	emit8(p, opcode); emit8(p, 0xc8);
+}
+
+/*  <alu> eax, imm32  (0x05 add, 0x0d or, 0x25 and, 0x35 xor, 0x3d cmp)  */
+static void emit_alu_eax_imm(unsigned char **p, uint8_t opcode, uint32_t imm)
+{
+	emit8(p, opcode); emit32(p, imm);
+}
+
+/*  movabs rax, imm64; ret  */
+static void emit_return(unsigned char **p, void *ic)
+{
+	emit8(p, 0x48); emit8(p, 0xb8); emit64(p, (size_t)ic);
+	emit8(p, 0xc3);
+}
+
+
+/*
+ *  emit_cmp():
+ *
+ *  Compare eax with ecx (or imm, if use_imm is set), and set the cr field
+ *  at bit op->sh to LT/GT/EQ, plus the SO bit copied from XER.
+ */
+static void emit_cmp(unsigned char **p, struct cpu *cpu,
+	struct ppc_native_op *op, int is_signed, int use_imm)
+{
+	int32_t cr_ofs = (unsigned char *)&cpu->cd.ppc.cr - (unsigned char *)cpu;
+	int32_t xer_ofs = (unsigned char *)&cpu->cd.ppc.spr[SPR_XER] -
+	    (unsigned char *)cpu;
+
+	if (use_imm)
+		emit_alu_eax_imm(p, 0x3d, op->imm);
+	else
+		emit_alu_eax_ecx(p, 0x39);
+
+	/*  setl/setb cl; setg/seta dl; sete al  */
+	emit8(p, 0x0f); emit8(p, is_signed? 0x9c : 0x92); emit8(p, 0xc1);
+	emit8(p, 0x0f); emit8(p, is_signed? 0x9f : 0x97); emit8(p, 0xc2);
+	emit8(p, 0x0f); emit8(p, 0x94); emit8(p, 0xc0);
+
+	/*  movzx ecx, cl; movzx edx, dl; movzx eax, al  */
+	emit8(p, 0x0f); emit8(p, 0xb6); emit8(p, 0xc9);
+	emit8(p, 0x0f); emit8(p, 0xb6); emit8(p, 0xd2);
+	emit8(p, 0x0f); emit8(p, 0xb6); emit8(p, 0xc0);
+
+	/*  eax = eq*2 | lt*8 | gt*4  */
+	emit8(p, 0xc1); emit8(p, 0xe1); emit8(p, 3);	/*  shl ecx, 3  */
+	emit8(p, 0xc1); emit8(p, 0xe2); emit8(p, 2);	/*  shl edx, 2  */
+	emit8(p, 0x01); emit8(p, 0xc0);			/*  add eax, eax  */
+	emit8(p, 0x09); emit8(p, 0xc8);			/*  or eax, ecx  */
+	emit8(p, 0x09); emit8(p, 0xd0);			/*  or eax, edx  */
+
+	/*  SO:  */
+	emit_load(p, EDX, xer_ofs);
+	emit8(p, 0xc1); emit8(p, 0xea); emit8(p, 31);	/*  shr edx, 31  */
+	emit8(p, 0x09); emit8(p, 0xd0);			/*  or eax, edx  */
+
+	if (op->sh != 0) {
+		emit8(p, 0xc1); emit8(p, 0xe0); emit8(p, op->sh); /* shl eax */
+	}
+
+	emit_load(p, EDX, cr_ofs);
+	emit8(p, 0x81); emit8(p, 0xe2); emit32(p, ~(0xfU << op->sh));
+	emit8(p, 0x09); emit8(p, 0xc2);			/*  or edx, eax  */
+	emit_store(p, EDX, cr_ofs);
+}
+
+
+/*
+ *  emit_op():
+ *
+ *  Emits code for one instruction. Returns 1 if the op ended the block
+ *  (a branch), 0 otherwise.
+ */
+static int emit_op(unsigned char **p, struct cpu *cpu,
+	struct ppc_native_op *op, struct ppc_instr_call *next)
+{
+	int32_t cr_ofs = (unsigned char *)&cpu->cd.ppc.cr - (unsigned char *)cpu;
+
+	switch (op->op) {
+
+	case PPC_NATIVE_NOP:
+		break;
+
+	case PPC_NATIVE_LI:
+		if (op->imm == 0) {
+			emit8(p, 0x31); emit8(p, 0xc0);	/*  xor eax, eax  */
+		} else {
+			emit8(p, 0xb8); emit32(p, op->imm);
+		}
+		emit_store(p, EAX, op->d);
+		break;
+
+	case PPC_NATIVE_ADDI:
+	case PPC_NATIVE_ORI:
+	case PPC_NATIVE_XORI:
+		emit_load(p, EAX, op->a);
+		emit_alu_eax_imm(p, op->op == PPC_NATIVE_ADDI? 0x05 :
+		    op->op == PPC_NATIVE_ORI? 0x0d : 0x35, op->imm);
+		emit_store(p, EAX, op->d);
+		break;
+
+	case PPC_NATIVE_MR:
+		emit_load(p, EAX, op->a);
+		emit_store(p, EAX, op->d);
+		break;
+
+	case PPC_NATIVE_ADD:
+	case PPC_NATIVE_AND:
+	case PPC_NATIVE_OR:
+	case PPC_NATIVE_XOR:
+		emit_load(p, EAX, op->a);
+		emit_load(p, ECX, op->b);
+		emit_alu_eax_ecx(p, op->op == PPC_NATIVE_ADD? 0x01 :
+		    op->op == PPC_NATIVE_AND? 0x21 :
+		    op->op == PPC_NATIVE_OR? 0x09 : 0x31);
+		emit_store(p, EAX, op->d);
+		break;
+
+	case PPC_NATIVE_SUBF:
+		emit_load(p, EAX, op->b);
+		emit_load(p, ECX, op->a);
+		emit_alu_eax_ecx(p, 0x29);
+		emit_store(p, EAX, op->d);
+		break;
+
+	case PPC_NATIVE_ANDC:
+		emit_load(p, EAX, op->a);
+		emit_load(p, ECX, op->b);
+		emit8(p, 0xf7); emit8(p, 0xd1);		/*  not ecx  */
+		emit_alu_eax_ecx(p, 0x21);
+		emit_store(p, EAX, op->d);
+		break;
+
+	case PPC_NATIVE_NOR:
+		emit_load(p, EAX, op->a);
+		emit_load(p, ECX, op->b);
+		emit_alu_eax_ecx(p, 0x09);
+		emit8(p, 0xf7); emit8(p, 0xd0);		/*  not eax  */
+		emit_store(p, EAX, op->d);
+		break;
+
+	case PPC_NATIVE_NEG:
+		emit_load(p, EAX, op->a);
+		emit8(p, 0xf7); emit8(p, 0xd8);		/*  neg eax  */
+		emit_store(p, EAX, op->d);
+		break;
+
+	case PPC_NATIVE_EXTSB:
+	case PPC_NATIVE_EXTSH:
+		/*  movsx eax, byte/word [rdi + a]  */
+		emit8(p, 0x0f); emit8(p, op->op == PPC_NATIVE_EXTSB? 0xbe : 0xbf);
+		emit8(p, 0x87); emit32(p, op->a);
+		emit_store(p, EAX, op->d);
+		break;
+
+	case PPC_NATIVE_RLWINM:
+		emit_load(p, EAX, op->a);
+		if (op->sh != 0) {
+			emit8(p, 0xc1); emit8(p, 0xc0); emit8(p, op->sh);
+		}
+		emit_alu_eax_imm(p, 0x25, op->imm);
+		emit_store(p, EAX, op->d);
+		break;
+
+	case PPC_NATIVE_CMPW:
+	case PPC_NATIVE_CMPLW:
+		emit_load(p, EAX, op->a);
+		emit_load(p, ECX, op->b);
+		emit_cmp(p, cpu, op, op->op == PPC_NATIVE_CMPW, 0);
+		break;
+
+	case PPC_NATIVE_CMPWI:
+	case PPC_NATIVE_CMPLWI:
+		emit_load(p, EAX, op->a);
+		emit_cmp(p, cpu, op, op->op == PPC_NATIVE_CMPWI, 1);
+		break;
+
+	case PPC_NATIVE_B:
+		emit_return(p, op->target);
+		return 1;
+
+	case PPC_NATIVE_BT:
+	case PPC_NATIVE_BF:
+		emit_load(p, EDX, cr_ofs);
+		/*  movabs rax, next; movabs rcx, target  */
+		emit8(p, 0x48); emit8(p, 0xb8); emit64(p, (size_t)next);
+		emit8(p, 0x48); emit8(p, 0xb9); emit64(p, (size_t)op->target);
+		/*  bt edx, sh  */
+		emit8(p, 0x0f); emit8(p, 0xba); emit8(p, 0xe2); emit8(p, op->sh);
+		/*  cmovc / cmovnc rax, rcx  */
+		emit8(p, 0x48); emit8(p, 0x0f);
+		emit8(p, op->op == PPC_NATIVE_BT? 0x42 : 0x43); emit8(p, 0xc1);
+		emit8(p, 0xc3);				/*  ret  */
+		return 1;
+
+	default:
+		fatal("ppc_native: unimplemented op %i\n", op->op);
+		exit(1);
+	}
+
+	return 0;
+}
+
+
+/*
+ *  ppc_native_alloc():
+ *
+ *  Returns space for a block and its code, or NULL if the cache is full
+ *  (in which case it is flushed) or could not be allocated.
+ */
+static unsigned char *ppc_native_alloc(struct cpu *cpu, size_t len)
+{
+	struct ppc_native_cache *cache = cpu->cd.ppc.native_cache;
+
+	if (cache == NULL) {
+		CHECK_ALLOCATION(cache = (struct ppc_native_cache *)
+		    calloc(1, sizeof(struct ppc_native_cache)));
+		cache->size = PPC_NATIVE_CACHE_SIZE;
+		cache->base = (unsigned char *) mmap(NULL, cache->size,
+		    PROT_READ | PROT_WRITE | PROT_EXEC,
+		    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (cache->base == MAP_FAILED) {
+			fatal("[ ppc_native: could not allocate executable "
+			    "memory; native code disabled ]\n");
+			free(cache);
+			native_failed = 1;
+			return NULL;
+		}
+		cpu->cd.ppc.native_cache = cache;
+	}
+
+	cache->used = (cache->used + 15) & ~(size_t)15;
+	if (cache->used + len > cache->size) {
+		/*  Forget all native blocks, and start over:  */
+		cache->used = 0;
+		cpu->invalidate_code_translation(cpu, 0, INVALIDATE_ALL);
+		return NULL;
+	}
+
+	cache->used += len;
+	return cache->base + cache->used - len;
+}
+
+
+int ppc_native_available(void)
+{
+	return !native_failed;
+}
+
+
+/*
+ *  ppc_native_compile():
+ *
+ *  Compiles n_ops instructions. If the last op is not a branch, the code
+ *  continues with the ppc_instr_call at next. Returns NULL if the block
+ *  could not be compiled right now.
+ */
+struct ppc_native_block *ppc_native_compile(struct cpu *cpu,
+	struct ppc_native_op *ops, int n_ops, struct ppc_instr_call *next)
+{
+	struct ppc_native_block *block;
+	unsigned char *mem, *p;
+	size_t header = (sizeof(struct ppc_native_block) + 15) & ~(size_t)15;
+	size_t reserved = header + (n_ops + 1) * MAX_BYTES_PER_OP;
+	int i, ended = 0;
+
+	if (native_failed || n_ops < 1)
+		return NULL;
+
+	mem = ppc_native_alloc(cpu, reserved);
+	if (mem == NULL)
+		return NULL;
+
+	block = (struct ppc_native_block *) mem;
+	p = mem + header;
+	block->code = (struct ppc_instr_call *(*)(struct cpu *)) p;
+	block->n_instrs = n_ops;
+
+	for (i = 0; i < n_ops && !ended; i++) {
+		ended = emit_op(&p, cpu, &ops[i], next);
+		assert(p <= mem + header + (size_t)(i + 1) * MAX_BYTES_PER_OP);
+	}
+
+	if (!ended)
+		emit_return(&p, next);
+
+	assert(p <= mem + reserved);
+
+	/*  Give back what was not used:  */
+	cpu->cd.ppc.native_cache->used = p - cpu->cd.ppc.native_cache->base;
+
+	return block;
+}
+
+
+#else	/*  !__x86_64__  */
+
+
+int ppc_native_available(void)
+{
+	return 0;
+}
+
+
+struct ppc_native_block *ppc_native_compile(struct cpu *cpu,
+	struct ppc_native_op *ops, int n_ops, struct ppc_instr_call *next)
+{
+	return NULL;
+}
+
+
+#endif	/*  !__x86_64__  */
+
@@ -33,9 +33,67 @@ char *sizechar[4] = { "b", "h", "w", "d" };
 char *modes[2] = { "", "32" };
 
 
-void do_it(int mode)
+void print_generic_name(int mode, int load, int size, int zero,
+	int update, int indexed)
+{
+	printf("ppc%s_generic_", modes[mode]);
+	if (load)
+		printf("l");
+	else
+		printf("st");
+	printf("%s", sizechar[size]);
+	if (load) {
+		if (zero)
+			printf("z");
+		else
+			printf("a");
+	}
+	if (update)
+		printf("u");
+	if (indexed)
+		printf("x");
+}
+
+
+void print_instr_name(int mode, int load, int size, int zero,
+	int update, int ignoreofs, int indexed)
+{
+	printf("ppc%s_instr_", modes[mode]);
+	if (load)
+		printf("l");
+	else
+		printf("st");
+	printf("%s", sizechar[size]);
+	if (load && size < 3) {
+		if (zero)
+			printf("z");
+		else
+			printf("a");
+	}
+	if (update)
+		printf("u");
+	if (ignoreofs)
+		printf("_0");
+	if (indexed)
+		printf("x");
+}
+
+
+/*
+ *  do_it():
+ *
+ *  If le is non-zero, the "_le" family of loads/stores is generated. These
+ *  are chosen at translation time when the cpu runs in little-endian mode
+ *  with bytelane swapping turned on, and fall back to the normal generic
+ *  functions (LS_GENERIC_ANYMODE_N) if the mode has changed since then.
+ */
+void do_it(int mode, int le)
 {
 	int n, load, size, zero, ignoreofs, update;
+	const char *suffix = le? "_le" : "";
+
+	if (le)
+		printf("#define LS_LE\n");
 
 	n = 0;
 	for (update=0; update<=1; update++)
@@ -64,45 +122,24 @@ void do_it(int mode)
 			if (update)
 				printf("#define LS_UPDATE\n");
 
-			printf("#define LS_GENERIC_N ppc%s_generic_",
-			    modes[mode]);
-			if (load)
-				printf("l");
-			else
-				printf("st");
-			printf("%s", sizechar[size]);
-			if (load) {
-				if (zero)
-					printf("z");
-				else
-					printf("a");
-			}
-			if (update)
-				printf("u");
-			printf("\n");
+			printf("#define LS_GENERIC_N ");
+			print_generic_name(mode, load, size, zero, update, 0);
+			printf("%s\n", suffix);
 
-			printf("#define LS_N ppc%s_instr_", modes[mode]);
-			if (load)
-				printf("l");
-			else
-				printf("st");
-			printf("%s", sizechar[size]);
-			if (load && size < 3) {
-				if (zero)
-					printf("z");
-				else
-					printf("a");
-			}
-			if (update)
-				printf("u");
-			if (ignoreofs)
-				printf("_0");
+			printf("#define LS_GENERIC_ANYMODE_N ");
+			print_generic_name(mode, load, size, zero, update, 0);
 			printf("\n");
 
+			printf("#define LS_N ");
+			print_instr_name(mode, load, size, zero, update,
+			    ignoreofs, 0);
+			printf("%s\n", suffix);
+
 			printf("#include \"cpu_ppc_instr_loadstore.cc\"\n");
 
 			printf("#undef LS_N\n");
 			printf("#undef LS_GENERIC_N\n");
+			printf("#undef LS_GENERIC_ANYMODE_N\n");
 			switch (size) {
 			case 0:	printf("#undef LS_B\n"); break;
 			case 1:	printf("#undef LS_H\n"); break;
@@ -145,45 +182,23 @@ void do_it(int mode)
 			if (update)
 				printf("#define LS_UPDATE\n");
 
-			printf("#define LS_GENERIC_N ppc%s_generic_",
-			    modes[mode]);
-			if (load)
-				printf("l");
-			else
-				printf("st");
-			printf("%s", sizechar[size]);
-			if (load) {
-				if (zero)
-					printf("z");
-				else
-					printf("a");
-			}
-			if (update)
-				printf("u");
-			printf("x");
-			printf("\n");
+			printf("#define LS_GENERIC_N ");
+			print_generic_name(mode, load, size, zero, update, 1);
+			printf("%s\n", suffix);
 
-			printf("#define LS_N ppc%s_instr_", modes[mode]);
-			if (load)
-				printf("l");
-			else
-				printf("st");
-			printf("%s", sizechar[size]);
-			if (load && size < 3) {
-				if (zero)
-					printf("z");
-				else
-					printf("a");
-			}
-			if (update)
-				printf("u");
-			printf("x");
+			printf("#define LS_GENERIC_ANYMODE_N ");
+			print_generic_name(mode, load, size, zero, update, 1);
 			printf("\n");
 
+			printf("#define LS_N ");
+			print_instr_name(mode, load, size, zero, update, 0, 1);
+			printf("%s\n", suffix);
+
 			printf("#include \"cpu_ppc_instr_loadstore.cc\"\n");
 
 			printf("#undef LS_N\n");
 			printf("#undef LS_GENERIC_N\n");
+			printf("#undef LS_GENERIC_ANYMODE_N\n");
 			switch (size) {
 			case 0:	printf("#undef LS_B\n"); break;
 			case 1:	printf("#undef LS_H\n"); break;
@@ -203,36 +218,24 @@ void do_it(int mode)
 
 
 	/*  Lookup tables for loads/stores:  */
-	printf("\n\nvoid (*ppc%s_loadstore[64])(struct cpu *, struct "
-	    "ppc_instr_call *) = {\n", modes[mode]);
+	printf("\n\nvoid (*ppc%s_loadstore%s[64])(struct cpu *, struct "
+	    "ppc_instr_call *) = {\n", modes[mode], suffix);
 	n = 0;
 	for (update=0; update<=1; update++)
 	  for (ignoreofs=0; ignoreofs<=1; ignoreofs++)
 	    for (load=0; load<=1; load++)
 		for (zero=0; zero<=1; zero++)
 		    for (size=0; size<4; size++) {
-			printf("\tppc%s_instr_", modes[mode]);
+			printf("\t");
 
 			if (load && !zero && size == 3) {
-				printf("invalid");
+				printf("ppc%s_instr_invalid", modes[mode]);
 				goto cont;
 			}
 
-			if (load)
-				printf("l");
-			else
-				printf("st");
-			printf("%s", sizechar[size]);
-			if (load && size < 3) {
-				if (zero)
-					printf("z");
-				else
-					printf("a");
-			}
-			if (update)
-				printf("u");
-			if (ignoreofs)
-				printf("_0");
+			print_instr_name(mode, load, size, zero, update,
+			    ignoreofs, 0);
+			printf("%s", suffix);
 cont:
 			if (++n < 64)
 				printf(",");
@@ -241,34 +244,22 @@ cont:
 
 	printf("};\n\n");
 
-	printf("\n\nvoid (*ppc%s_loadstore_indexed[32])(struct cpu *, struct "
-	    "ppc_instr_call *) = {\n", modes[mode]);
+	printf("\n\nvoid (*ppc%s_loadstore_indexed%s[32])(struct cpu *, struct "
+	    "ppc_instr_call *) = {\n", modes[mode], suffix);
 	n = 0;
 	for (update=0; update<=1; update++)
 	    for (load=0; load<=1; load++)
 		for (zero=0; zero<=1; zero++)
 		    for (size=0; size<4; size++) {
-			printf("\tppc%s_instr_", modes[mode]);
+			printf("\t");
 
 			if (load && !zero && size == 3) {
-				printf("invalid");
+				printf("ppc%s_instr_invalid", modes[mode]);
 				goto cont_x;
 			}
 
-			if (load)
-				printf("l");
-			else
-				printf("st");
-			printf("%s", sizechar[size]);
-			if (load && size < 3) {
-				if (zero)
-					printf("z");
-				else
-					printf("a");
-			}
-			if (update)
-				printf("u");
-			printf("x");
+			print_instr_name(mode, load, size, zero, update, 0, 1);
+			printf("%s", suffix);
 cont_x:
 			if (++n < 32)
 				printf(",");
@@ -283,42 +274,55 @@ cont_x:
 
 	    "#define LS_SIZE 2\n"
 	    "#define LS_H\n"
-	    "#define LS_GENERIC_N ppc%s_generic_lhbrx\n"
-	    "#define LS_N ppc%s_instr_lhbrx\n"
+	    "#define LS_GENERIC_N ppc%s_generic_lhbrx%s\n"
+	    "#define LS_GENERIC_ANYMODE_N ppc%s_generic_lhbrx\n"
+	    "#define LS_N ppc%s_instr_lhbrx%s\n"
 	    "#define LS_LOAD\n"
 	    "#include \"cpu_ppc_instr_loadstore.cc\"\n"
 	    "#undef LS_LOAD\n"
 	    "#undef LS_N\n"
 	    "#undef LS_GENERIC_N\n"
-	    "#define LS_GENERIC_N ppc%s_generic_sthbrx\n"
-	    "#define LS_N ppc%s_instr_sthbrx\n"
+	    "#undef LS_GENERIC_ANYMODE_N\n",
+	    modes[mode], suffix, modes[mode], modes[mode], suffix);
+	printf("#define LS_GENERIC_N ppc%s_generic_sthbrx%s\n"
+	    "#define LS_GENERIC_ANYMODE_N ppc%s_generic_sthbrx\n"
+	    "#define LS_N ppc%s_instr_sthbrx%s\n"
 	    "#include \"cpu_ppc_instr_loadstore.cc\"\n"
 	    "#undef LS_N\n"
 	    "#undef LS_GENERIC_N\n"
+	    "#undef LS_GENERIC_ANYMODE_N\n"
 	    "#undef LS_H\n"
-	    "#undef LS_SIZE\n"
+	    "#undef LS_SIZE\n",
+	    modes[mode], suffix, modes[mode], modes[mode], suffix);
 
-	    "#define LS_SIZE 4\n"
+	printf("#define LS_SIZE 4\n"
 	    "#define LS_W\n"
-	    "#define LS_GENERIC_N ppc%s_generic_lwbrx\n"
-	    "#define LS_N ppc%s_instr_lwbrx\n"
+	    "#define LS_GENERIC_N ppc%s_generic_lwbrx%s\n"
+	    "#define LS_GENERIC_ANYMODE_N ppc%s_generic_lwbrx\n"
+	    "#define LS_N ppc%s_instr_lwbrx%s\n"
 	    "#define LS_LOAD\n"
 	    "#include \"cpu_ppc_instr_loadstore.cc\"\n"
 	    "#undef LS_LOAD\n"
 	    "#undef LS_N\n"
 	    "#undef LS_GENERIC_N\n"
-	    "#define LS_GENERIC_N ppc%s_generic_stwbrx\n"
-	    "#define LS_N ppc%s_instr_stwbrx\n"
+	    "#undef LS_GENERIC_ANYMODE_N\n",
+	    modes[mode], suffix, modes[mode], modes[mode], suffix);
+	printf("#define LS_GENERIC_N ppc%s_generic_stwbrx%s\n"
+	    "#define LS_GENERIC_ANYMODE_N ppc%s_generic_stwbrx\n"
+	    "#define LS_N ppc%s_instr_stwbrx%s\n"
 	    "#include \"cpu_ppc_instr_loadstore.cc\"\n"
 	    "#undef LS_N\n"
 	    "#undef LS_GENERIC_N\n"
+	    "#undef LS_GENERIC_ANYMODE_N\n"
 	    "#undef LS_W\n"
 	    "#undef LS_SIZE\n"
 
 	    "#undef LS_INDEXED\n"
 	    "#undef LS_BYTEREVERSE\n",
-	    modes[mode], modes[mode], modes[mode], modes[mode],
-	    modes[mode], modes[mode], modes[mode], modes[mode]);
+	    modes[mode], suffix, modes[mode], modes[mode], suffix);
+
+	if (le)
+		printf("#undef LS_LE\n");
 }
 
 int main(int argc, char *argv[])
@@ -333,7 +337,8 @@ int main(int argc, char *argv[])
 		else
 			printf("#ifdef MODE32\n");
 
-		do_it(mode);
+		do_it(mode, 0);
+		do_it(mode, 1);
 
 		printf("#endif\n");
 	}
@@ -28,8 +28,6 @@
  *  Included from cpu_ppc.c.
  */
 
-#define STWBRX_CACHE_SIZE 100000
-uint32_t **stwbrx_cache[1024];
 
 extern int trace_mapping;
 
@@ -50,6 +48,48 @@ static inline int check_access(bool msr_pr, int vs_vp, int pp, bool write) {
   return access_result[(write << 3) | (key << 2) | pp];
 }
 
+/*
+ *  ppc_bat_decode():
+ *
+ *  Decodes the BAT registers into cpu->cd.ppc.bat_decoded[], and records
+ *  for each 256 MB region of the effective address space which BATs may
+ *  map addresses within it. Called lazily after any BAT register has been
+ *  written.
+ */
+static void ppc_bat_decode(struct cpu *cpu)
+{
+	int i, r;
+
+	memset(cpu->cd.ppc.bat_candidates, 0,
+	    sizeof(cpu->cd.ppc.bat_candidates));
+
+	for (i=0; i<8; i++) {
+		struct ppc_bat_decoded *b = &cpu->cd.ppc.bat_decoded[i];
+		int regnr = SPR_IBAT0U + i * 2;
+		uint32_t upper = cpu->cd.ppc.spr[regnr];
+		uint32_t lower = cpu->cd.ppc.spr[regnr + 1];
+
+		b->mask = ((upper & BAT_BL) << 15) | 0x1ffff;
+		b->bepi = upper & BAT_EPI & ~b->mask;
+		b->phys = lower & BAT_RPN & ~b->mask;
+		b->vs_vp = upper & BAT_V;
+		b->pp = lower & BAT_PP;
+
+		if (!b->vs_vp)
+			continue;
+
+		for (r=0; r<16; r++) {
+			uint32_t region = (uint32_t)r << 28;
+			if (b->bepi <= (region | 0x0fffffff) &&
+			    (b->bepi | b->mask) >= region)
+				cpu->cd.ppc.bat_candidates[i >> 2][r] |= 1 << (i & 3);
+		}
+	}
+
+	cpu->cd.ppc.bat_decoded_ok = 1;
+}
+
+
 /*
  *  ppc_bat():
  *
@@ -58,12 +98,8 @@ static inline int check_access(bool msr_pr, int vs_vp, int pp, bool write) {
  */
 int ppc_bat(struct cpu *cpu, uint64_t vaddr, uint64_t *return_paddr, int flags)
 {
-	int i, istart = 0, iend = 8;
-
-	if (flags & FLAG_INSTR)
-		iend = 4;
-	else
-		istart = 4;
+	int i, bank = flags & FLAG_INSTR ? 0 : 1, candidates;
+	bool user = cpu->cd.ppc.msr & PPC_MSR_PR;
 
 	if (cpu->cd.ppc.bits != 32) {
 		fatal("TODO: ppc_bat() for non-32-bit\n");
@@ -74,37 +110,164 @@ int ppc_bat(struct cpu *cpu, uint64_t vaddr, uint64_t *return_paddr, int flags)
 		exit(1);
 	}
 
-	/*  Scan either the 4 instruction BATs or the 4 data BATs:  */
-	for (i=istart; i<iend; i++) {
-		int regnr = SPR_IBAT0U + i * 2;
-		uint32_t upper = cpu->cd.ppc.spr[regnr];
-		uint32_t lower = cpu->cd.ppc.spr[regnr + 1];
-		uint32_t phys = lower & BAT_RPN, ebs = upper & BAT_EPI;
-		uint32_t mask = ((upper & BAT_BL) << 15) | 0x1ffff;
-    bool user = cpu->cd.ppc.msr & PPC_MSR_PR;
+	if (!cpu->cd.ppc.bat_decoded_ok)
+		ppc_bat_decode(cpu);
 
-		/*  Not valid in either supervisor or user mode?  */
-		if (user && !(upper & BAT_Vu))
+	/*  Check the instruction or data BATs which may map this region:  */
+	candidates = cpu->cd.ppc.bat_candidates[bank][(vaddr >> 28) & 15];
+	for (i=0; candidates != 0; i++, candidates >>= 1) {
+		struct ppc_bat_decoded *b = &cpu->cd.ppc.bat_decoded[bank * 4 + i];
+
+		if (!(candidates & 1))
 			continue;
-		if (!user && !(upper & BAT_Vs))
+
+		/*  Not valid in either supervisor or user mode?  */
+		if (!(b->vs_vp & (user ? BAT_Vu : BAT_Vs)))
 			continue;
 
 		/*  Virtual address mismatch? Then skip.  */
-		if ((vaddr & ~mask) != (ebs & ~mask))
+		if ((vaddr & ~b->mask) != b->bepi)
 			continue;
 
-		*return_paddr = (vaddr & mask) | (phys & ~mask);
-
-    int vs_vp = upper & 3;
-		int pp = lower & BAT_PP;
+		*return_paddr = (vaddr & b->mask) | b->phys;
 
-    return check_access(user, vs_vp, pp, flags & FLAG_WRITEFLAG);
+		return check_access(user, b->vs_vp, b->pp, flags & FLAG_WRITEFLAG);
 	}
 
 	return -1;
 }
 
 
+/*
+ *  ppc_pteg_addr():
+ *
+ *  Physical address of the PTE group selected by a (primary or secondary)
+ *  hash value, for a given SDR1.
+ */
+static inline uint32_t ppc_pteg_addr(uint64_t sdr1, uint32_t hash)
+{
+	uint64_t htaborg = sdr1 & 0xffff0000UL;
+	uint32_t tmp = (hash >> 10) & (sdr1 & 0x1ff);
+
+	return (htaborg & 0xfe000000) | ((hash & 0x3ff) << 6) |
+	    (htaborg & 0x01ff0000) | (tmp << 16);
+}
+
+
+/*
+ *  ppc_mmu_flush_pteg_shadow():
+ *
+ *  Drops all shadowed PTEGs (e.g. when SDR1 changes).
+ */
+void ppc_mmu_flush_pteg_shadow(struct cpu *cpu)
+{
+	int i;
+
+	for (i=0; i<PPC_N_PTEG_SHADOW; i++)
+		cpu->cd.ppc.pteg_shadow[i].host = NULL;
+
+	cpu->cd.ppc.pteg_shadow_lo = cpu->cd.ppc.pteg_shadow_hi = 0;
+}
+
+
+/*
+ *  ppc_mmu_invalidate_pteg_shadow():
+ *
+ *  Drops shadowed PTEGs which overlap a write to physical memory.
+ */
+void ppc_mmu_invalidate_pteg_shadow(struct cpu *cpu, uint64_t paddr, size_t len)
+{
+	uint64_t a, end = paddr + len;
+
+	if (len >= 64 * PPC_N_PTEG_SHADOW) {
+		ppc_mmu_flush_pteg_shadow(cpu);
+		return;
+	}
+
+	for (a = paddr & ~63; a < end; a += 64) {
+		struct ppc_pteg_shadow *sh = &cpu->cd.ppc.pteg_shadow[
+		    (a >> 6) % PPC_N_PTEG_SHADOW];
+		if (sh->host != NULL && sh->pteg_addr == a)
+			sh->host = NULL;
+	}
+}
+
+
+/*
+ *  ppc_mmu_tlbie():
+ *
+ *  Drops the shadowed primary and secondary PTEGs for an effective address,
+ *  using the current segment registers.
+ */
+void ppc_mmu_tlbie(struct cpu *cpu, uint64_t vaddr)
+{
+	uint32_t vsid = cpu->cd.ppc.sr[(vaddr >> 28) & 15] & 0x00ffffff;
+	uint32_t hash1 = (vsid & 0x7ffff) ^ ((vaddr >> 12) & 0xffff);
+	uint64_t sdr1 = cpu->cd.ppc.spr[SPR_SDR1];
+
+	ppc_mmu_invalidate_pteg_shadow(cpu, ppc_pteg_addr(sdr1, hash1), 64);
+	ppc_mmu_invalidate_pteg_shadow(cpu, ppc_pteg_addr(sdr1, hash1 ^ 0x7ffff), 64);
+}
+
+
+/*
+ *  ppc_pteg_shadow_lookup():
+ *
+ *  Returns the shadow of a PTE group, decoding it from guest memory if it
+ *  is not already present. Returns NULL if the PTEG is not in RAM.
+ */
+static struct ppc_pteg_shadow *ppc_pteg_shadow_lookup(struct cpu *cpu,
+	uint32_t pteg_select)
+{
+	struct ppc_pteg_shadow *sh = &cpu->cd.ppc.pteg_shadow[
+	    (pteg_select >> 6) % PPC_N_PTEG_SHADOW];
+	int swizzle, offset, i;
+
+	cpu_ppc_swizzle_offset(cpu, 8, 0, &swizzle, &offset);
+
+	/*
+	 *  Stores from other cpu threads don't invalidate this cpu's
+	 *  shadows, so while the cpus run in threads, the PTEG is decoded
+	 *  from guest memory every time.
+	 */
+	if (sh->host != NULL && sh->pteg_addr == pteg_select &&
+	    sh->swizzle == swizzle && !cpu->machine->cpu_threads_running)
+		return sh;
+
+	unsigned char *d = memory_paddr_to_hostaddr(cpu->mem, pteg_select, 1);
+	if (d == NULL)
+		return NULL;
+
+	unsigned char pte[64];
+
+	for (int bi = 0; bi < 64; bi++) {
+		pte[bi] = d[bi ^ swizzle];
+	}
+
+	for (i=0; i<8; i++) {
+		uint32_t *ep = (uint32_t *) (pte + (i << 3));
+		sh->upper[i] = BE32_TO_HOST(ep[0]);
+		sh->lower[i] = BE32_TO_HOST(ep[1]);
+	}
+
+	sh->host = d;
+	sh->pteg_addr = pteg_select;
+	sh->swizzle = swizzle;
+
+	if (cpu->cd.ppc.pteg_shadow_lo == cpu->cd.ppc.pteg_shadow_hi) {
+		cpu->cd.ppc.pteg_shadow_lo = pteg_select;
+		cpu->cd.ppc.pteg_shadow_hi = pteg_select + 64;
+	} else {
+		if (pteg_select < cpu->cd.ppc.pteg_shadow_lo)
+			cpu->cd.ppc.pteg_shadow_lo = pteg_select;
+		if (pteg_select + 64 > cpu->cd.ppc.pteg_shadow_hi)
+			cpu->cd.ppc.pteg_shadow_hi = pteg_select + 64;
+	}
+
+	return sh;
+}
+
+
 /*
  *  get_pte_low():
  *
@@ -121,29 +284,18 @@ static int get_pte_low
  int *swizzle_ptr,
  uint32_t cmp)
 {
-  int swizzle, offset;
-  cpu_ppc_swizzle_offset(cpu, 8, 0, &swizzle, &offset);
-  *swizzle_ptr = swizzle;
-
-  unsigned char *d = memory_paddr_to_hostaddr(cpu->mem, pteg_select, 1);
-  int i;
-
-  unsigned char pte[64];
+	struct ppc_pteg_shadow *sh = ppc_pteg_shadow_lookup(cpu, pteg_select);
+	int i;
 
-  for (int bi = 0; bi < 64; bi++) {
-    pte[bi] = d[bi ^ swizzle];
-  }
-
-  for (i=0; i<8; i++) {
-		uint32_t *ep = (uint32_t *) (pte + (i << 3)), upper;
-		upper = *ep;
-		upper = BE32_TO_HOST(upper);
+	if (sh == NULL)
+		return 0;
 
+	for (i=0; i<8; i++) {
 		/*  Valid PTE, and correct api and vsid?  */
-		if (upper == cmp) {
-      uint32_t lo = BE32_TO_HOST(ep[1]);
-      *entry_ptr = &d[i << 3];
-      *lowp = lo;
+		if (sh->upper[i] == cmp) {
+			*entry_ptr = sh->host + (i << 3);
+			*swizzle_ptr = sh->swizzle;
+			*lowp = sh->lower[i];
 			return 1;
 		}
 	}
@@ -168,18 +320,13 @@ static int ppc_vtp32(struct cpu *cpu, uint32_t vaddr, uint64_t *return_paddr,
 	int match, swizzle;
   uint8_t *entry_ptr = nullptr;
 	uint32_t vsid = cpu->cd.ppc.sr[srn] & 0x00ffffff;
-	uint64_t sdr1 = cpu->cd.ppc.spr[SPR_SDR1], htaborg;
-	uint32_t hash1, hash2, pteg_select, tmp;
+	uint64_t sdr1 = cpu->cd.ppc.spr[SPR_SDR1];
+	uint32_t hash1, hash2, pteg_select;
 	uint32_t lower_pte = 0, cmp;
 
-	htaborg = sdr1 & 0xffff0000UL;
-
 	/*  Primary hash:  */
 	hash1 = (vsid & 0x7ffff) ^ ((vaddr >> 12) & 0xffff);
-	tmp = (hash1 >> 10) & (sdr1 & 0x1ff);
-	pteg_select = htaborg & 0xfe000000;
-	pteg_select |= ((hash1 & 0x3ff) << 6);
-	pteg_select |= (htaborg & 0x01ff0000) | (tmp << 16);
+	pteg_select = ppc_pteg_addr(sdr1, hash1);
 	cpu->cd.ppc.spr[SPR_HASH1] = pteg_select;
 	cmp = cpu->cd.ppc.spr[instr? SPR_ICMP : SPR_DCMP] =
 	    PTE_VALID | api | (vsid << PTE_VSID_SHFT);
@@ -187,10 +334,7 @@ static int ppc_vtp32(struct cpu *cpu, uint32_t vaddr, uint64_t *return_paddr,
 
 	/*  Secondary hash:  */
 	hash2 = hash1 ^ 0x7ffff;
-	tmp = (hash2 >> 10) & (sdr1 & 0x1ff);
-	pteg_select = htaborg & 0xfe000000;
-	pteg_select |= ((hash2 & 0x3ff) << 6);
-	pteg_select |= (htaborg & 0x01ff0000) | (tmp << 16);
+	pteg_select = ppc_pteg_addr(sdr1, hash2);
 	cpu->cd.ppc.spr[SPR_HASH2] = pteg_select;
 	if (!match) {
 		cmp |= PTE_HID;
@@ -331,34 +475,49 @@ int ppc_translate_v2p(struct cpu *cpu, uint64_t vaddr,
 	return 0;
 }
 
-void stwbrx_remember(uint32_t addr) {
+/*
+ *  stwbrx_remember():
+ *
+ *  Marks the doubleword at addr as stored to while the bytelane swap latch
+ *  was clear, so that stwbrx_cache_spill() can swap it. Each cpu has its
+ *  own bitmap (see bytelane_swap_tracking), which is only touched by the
+ *  thread running that cpu.
+ */
+void stwbrx_remember(struct cpu *cpu, uint32_t addr) {
+  uint32_t ***cache = cpu->cd.ppc.stwbrx_cache;
+  if (!cache) {
+    CHECK_ALLOCATION(cache = (uint32_t ***)calloc(1024, sizeof(uint32_t **)));
+    cpu->cd.ppc.stwbrx_cache = cache;
+  }
   uint32_t pl1 = (addr >> 22) & 1023;
-  if (!stwbrx_cache[pl1]) {
-    stwbrx_cache[pl1] = (uint32_t **)calloc(1024, sizeof(uint32_t*));
+  if (!cache[pl1]) {
+    CHECK_ALLOCATION(cache[pl1] = (uint32_t **)calloc(1024, sizeof(uint32_t*)));
   }
   uint32_t pl2 = (addr >> 12) & 1023;
-  if (!stwbrx_cache[pl1][pl2]) {
-    stwbrx_cache[pl1][pl2] = (uint32_t *)calloc(1024, sizeof(uint32_t));
+  if (!cache[pl1][pl2]) {
+    CHECK_ALLOCATION(cache[pl1][pl2] = (uint32_t *)calloc(1024, sizeof(uint32_t)));
   }
   uint32_t word = (addr & 4095) >> 3;
   uint32_t bit = word % 32;
-  stwbrx_cache[pl1][pl2][word] |= 1 << bit;
+  cache[pl1][pl2][word] |= 1 << bit;
 }
 
 void access_log(struct cpu *cpu, int write, uint64_t addr, void *data, int size, int write_rev) {
   if (write) {
     if (!cpu->cd.ppc.bytelane_swap_latch) {
-      stwbrx_remember(addr);
+      stwbrx_remember(cpu, addr);
     }
   }
 
   if (write) {
     if ((addr >= 0xfe050000) && (addr <= 0xfe080000)) {
-      fprintf(stderr, "%" PRIx64 "@ %08x: %08x <=", cpu->ninstrs, (unsigned int)cpu->pc, (unsigned int)addr);
-      for (int i = 0; i < size; i++) {
-        fprintf(stderr, " %02x", ((uint8_t *)data)[i]);
+      if (TRACE_ENABLED(TRACE_MEM, TRACE_DEBUG)) {
+        uint64_t v = 0;
+        for (int i = 0; i < size && i < 8; i++) {
+          v = (v << 8) | ((uint8_t *)data)[i];
+        }
+        TRACE(TRACE_MEM, TRACE_DEBUG, "%" PRIx64 "@ %08x: %08x <= %0*" PRIx64 "\n", cpu->ninstrs, (unsigned int)cpu->pc, (unsigned int)addr, size * 2, v);
       }
-      fprintf(stderr, "\n");
     }
   }
 }
@@ -366,9 +525,12 @@ void access_log(struct cpu *cpu, int write, uint64_t addr, void *data, int size,
 void stwbrx_cache_spill(struct cpu *cpu) {
   uint8_t data[8];
   uint8_t swapped[8];
-  fprintf(stderr, "%08" PRIx64" CACHE SPILL FOR ENDIAN SWAP\n", cpu->pc);
+  uint32_t ***cache = cpu->cd.ppc.stwbrx_cache;
+  TRACE(TRACE_MEM, TRACE_DEBUG, "%08" PRIx64" CACHE SPILL FOR ENDIAN SWAP\n", cpu->pc);
+  if (!cache)
+    return;
   for (uint32_t pl1 = 0; pl1 < 1024; pl1++) {
-    auto lv1 = stwbrx_cache[pl1];
+    auto lv1 = cache[pl1];
     if (lv1) {
       for (uint32_t pl2 = 0; pl2 < 1024; pl2++) {
         auto lv2 = lv1[pl2];
@@ -404,7 +566,7 @@ void stwbrx_cache_spill(struct cpu *cpu) {
         }
       }
       free(lv1);
-      stwbrx_cache[pl1] = nullptr;
+      cache[pl1] = nullptr;
     }
   }
 }
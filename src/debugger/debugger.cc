@@ -41,6 +41,7 @@
 #include <iostream>
 #include <fstream>
 
+#include "checkpoint.h"
 #include "console.h"
 #include "cpu.h"
 #include "device.h"
@@ -53,6 +54,7 @@
 #include "net.h"
 #include "settings.h"
 #include "timer.h"
+#include "trace.h"
 #include "x11.h"
 
 
@@ -373,6 +375,14 @@ void debugger_assignment(struct machine *m, char *cmd)
 			    "of the assignment.\n");
 			break;
 		default:
+			/*  Registers may have been changed behind the
+			    cpu's back:  */
+			if (m->arch == ARCH_PPC) {
+				int i;
+				for (i=0; i<m->ncpus; i++)
+					ppc_cpu_registers_written(m->cpus[i]);
+			}
+
 			debugger_cmd_print(m, left);
 		}
 	}
@@ -1554,8 +1554,7 @@ static void debugger_cmd_kbd(struct machine *m, char *cmd_line) {
 
     cmd_line = endptr;
 
-    keyboard_event_t k = { static_cast<int>(kbd) };
-    keyboard_debug_events.push_back(k);
+    dev_pckbc_inject(static_cast<int>(kbd));
   } while (isxdigit(*endptr));
 }
 
@@ -1741,6 +1740,54 @@ static void debugger_cmd_screenshot(struct machine *m, char *cmd_line) {
   png_destroy_write_struct(&png, &info);
 }
 
+static void debugger_cmd_vmstate(struct machine *m, char *cmd_line) {
+  const char *fname = strchr(cmd_line, ' ');
+  if (fname != NULL) {
+    while (*fname == ' ') {
+      fname++;
+    }
+  }
+
+  if (fname == NULL || !*fname) {
+    printf("usage: vmstate save|restore file\n");
+    return;
+  }
+
+  if (strncmp(cmd_line, "save ", 5) == 0) {
+    machine_checkpoint_save(m, fname);
+  } else if (strncmp(cmd_line, "restore ", 8) == 0) {
+    machine_checkpoint_restore(m, fname);
+  } else {
+    printf("usage: vmstate save|restore file\n");
+  }
+}
+
+/*
+ *  debugger_cmd_tracelog():
+ *
+ *  Shows or changes trace levels, or dumps/clears the trace ring.
+ */
+static void debugger_cmd_tracelog(struct machine *m, char *cmd_line)
+{
+	while (cmd_line[0] == ' ')
+		cmd_line ++;
+
+	if (cmd_line[0] == '\0') {
+		trace_show_levels();
+	} else if (strcmp(cmd_line, "dump") == 0) {
+		trace_dump(stdout, 0);
+	} else if (strcmp(cmd_line, "new") == 0) {
+		trace_dump(stdout, 1);
+	} else if (strcmp(cmd_line, "clear") == 0) {
+		trace_clear();
+	} else if (trace_set_levels(cmd_line)) {
+		trace_show_levels();
+	} else {
+		printf("syntax: tracelog [dump|new|clear|"
+		    "category[=level][,...]]\n");
+	}
+}
+
 static void debugger_cmd_e7(struct machine *m, char *cmd_line) {
   ppc_exception(m->cpus[0], PPC_EXCEPTION_PRG, 1 << 17);
 }
@@ -1837,6 +1884,9 @@ static struct cmd cmds[] = {
 	{ "trace", "[on|off]", 0, debugger_cmd_trace,
 		"toggle show_trace_tree on or off" },
 
+	{ "tracelog", "...", 0, debugger_cmd_tracelog,
+		"show, set, or dump the trace ring" },
+
 	{ "unassemble", "[addr [endaddr]]", 0, debugger_cmd_unassemble,
 		"dump memory contents as instructions" },
 
@@ -1878,6 +1928,8 @@ static struct cmd cmds[] = {
 
   { "wantsr1", "value", 0, debugger_cmd_want_sr1, "Step only along code that has a specific sr1 value" },
 
+  { "vmstate", "save|restore file", 0, debugger_cmd_vmstate, "Save or restore a checkpoint of the whole machine" },
+
 	/*  Note: NULL handler.  */
 	{ "x = expr", "", 0, NULL, "generic assignment" },
 
@@ -54,16 +54,28 @@
  *    mAA..AA,LLLL  Read LLLL bytes at address AA..AA      hex data or ENN
  *    MAA..AA,LLLL: Write LLLL bytes at address AA.AA      OK or ENN
  *
+ *    XAA..AA,LLLL: Write LLLL binary bytes at AA..AA      OK or ENN
+ *
  *    c             Resume at current address              SNN   ( signal NN)
  *    cAA..AA       Continue at address AA..AA             SNN
  *
  *    s             Step one instruction                   SNN
  *    sAA..AA       Step one instruction from AA..AA       SNN
  *
+ *    vCont;A       Continue (c/C), step (s/S) or stop (t)  SNN or OK
+ *
+ *    qXfer:features:read:target.xml:OO..,LL..            m/l + data
+ *    QNonStop:N    Enable/disable non-stop mode           OK
+ *    QStartNoAckMode  Stop sending/expecting '+' acks     OK
+ *
  *    k             kill
  *
  *    ?             What was the last sigval ?             SNN   (signal NN)
  *
+ * In non-stop mode, resuming replies OK right away, and stops are reported
+ * asynchronously with a %Stop notification, which gdb acknowledges with
+ * vStopped.
+ *
  * All commands and responses are sent with a packet which includes a
  * Checksum.  A packet consists of
  *
@@ -94,6 +106,7 @@
 #include <arpa/inet.h>
 #include <netinet/in.h>
 #endif
+#include <errno.h>
 #include <stddef.h>
 #include <stdlib.h>
 #include <stdint.h>
@@ -113,16 +126,30 @@ extern volatile uint64_t single_step;
 extern volatile int exit_debugger;
 extern int debugger_n_steps_left_before_interaction;
 
+// Largest packet accepted from gdb (advertised as PacketSize in qSupported).
+#define GDBLIB_PACKET_SIZE 16384
+
 BREAKPOINT BreakPoints[64];
+// Outgoing packet, including the leading '$' and the trailing #CC.
 char DataOutBuffer[65536];
 volatile int DataOutAddr, DataOutCsum;
-char DataInBuffer[128];
-volatile int DataInAddr, ParseState = 0, ComputedCsum, ActualCsum;
+char DataInBuffer[GDBLIB_PACKET_SIZE + 1];
+volatile int DataInAddr, DataInLen, ParseState = -1, ComputedCsum, ActualCsum;
 volatile int PacketSent = 0, SendSignal = 0;
 volatile int Continue = 0, Signal = 0, SingleStep = 0;
+volatile int NoAckMode = 0, NonStop = 0;
 
 int gdbstub_socket = -1, gdbstub_listen = -1;
 
+// Bytes received from gdb, but not yet parsed.
+static char RecvBuffer[4096];
+static int RecvHead = 0, RecvTail = 0;
+
+static const char *TargetXml =
+    "<?xml version=\"1.0\"?>"
+    "<!DOCTYPE target SYSTEM \"gdb-target.dtd\">"
+    "<target><architecture>powerpc:common</architecture></target>";
+
 typedef cpu ppc_trap_frame_t;
 
 volatile ppc_trap_frame_t RegisterSaves, *RegisterSaveArea = &RegisterSaves;
@@ -143,20 +170,44 @@ char *hex = "0123456789abcdef";
 
 static void Wait(struct cpu *cpu);
 
-void gdbstub_send(char c) {
-    fprintf(stderr, "%c", c);
-    if (gdbstub_socket != -1) {
-        if (send(gdbstub_socket, &c, 1, 0) < 1) {
-            close(gdbstub_socket);
-            gdbstub_socket = -1;
+static void gdbstub_disconnect() {
+    close(gdbstub_socket);
+    gdbstub_socket = -1;
+    RecvHead = RecvTail = 0;
+    Continue = true;
+}
+
+// Sends a whole buffer, typically a complete packet, with as few send()
+// calls as possible.
+void gdbstub_send_buf(const char *buf, int len) {
+    while (len > 0 && gdbstub_socket != -1) {
+        int res = send(gdbstub_socket, buf, len, 0);
+        if (res < 1) {
+            if (res < 0 && errno == EINTR) {
+                continue;
+            }
+            gdbstub_disconnect();
+            break;
         }
+        buf += res;
+        len -= res;
     }
 }
 
+void gdbstub_send(char c) {
+    gdbstub_send_buf(&c, 1);
+}
+
 int rdy(struct cpu *cpu, int wait)
 {
     int result = 0;
     int n_pfds = 1;
+
+    // Already received, but not yet parsed?
+    if (RecvHead < RecvTail) {
+        return 1;
+    }
+
     if (gdbstub_listen == -1) {
         return 0;
     }
@@ -174,17 +225,18 @@ int rdy(struct cpu *cpu, int wait)
         n_pfds += 1;
     }
 
+    // When waiting, block until gdb sends something (or connects).
 #ifdef _WIN32
-    int poll_result = WSAPoll(pfd_read, n_pfds, wait ? 1000 : 0);
+    int poll_result = WSAPoll(pfd_read, n_pfds, wait ? -1 : 0);
 #else
-    int poll_result = poll(pfd_read, n_pfds, wait ? 1000 : 0);
+    int poll_result = poll(pfd_read, n_pfds, wait ? -1 : 0);
 #endif
     if (poll_result < 1) {
         return 0;
     }
 
-    // Try to read from the socket.
-    if (pfd_read[1].revents & POLLIN) {
+    // Try to read from the socket. (A hangup is noticed by recv.)
+    if (pfd_read[1].revents & (POLLIN | POLLHUP | POLLERR)) {
         result = 1;
     }
 
@@ -192,24 +244,40 @@ int rdy(struct cpu *cpu, int wait)
     if (pfd_read[0].revents & POLLIN) {
         struct sockaddr_in sa = { };
         socklen_t len = sizeof(sa);
+        if (gdbstub_socket != -1) {
+            close(gdbstub_socket);
+        }
         gdbstub_socket = accept(gdbstub_listen, (struct sockaddr *)&sa, &len);
+        RecvHead = RecvTail = 0;
+        ParseState = -1;
+        NoAckMode = 0;
+        NonStop = 0;
+        result = 0;
     }
 
     return result;
 }
 
 char gdbstub_recv() {
-    char c;
+    if (RecvHead == RecvTail) {
+        int res = -1;
 
-    int res = recv(gdbstub_socket, &c, sizeof(c), 0);
-    if (res < 1) {
-        close(gdbstub_socket);
-        gdbstub_socket = -1;
-        c = 0xff;
-        Continue = true;
+        if (gdbstub_socket != -1) {
+            res = recv(gdbstub_socket, RecvBuffer, sizeof(RecvBuffer), 0);
+        }
+        if (res < 1) {
+            if (gdbstub_socket != -1) {
+                gdbstub_disconnect();
+            }
+            Continue = true;
+            return 0xff;
+        }
+
+        RecvHead = 0;
+        RecvTail = res;
     }
 
-    return c;
+    return RecvBuffer[RecvHead++];
 }
 
 static void close_ports() {
@@ -253,6 +321,22 @@ int GdblibCheckWaiting(struct cpu *cpu) {
     return rdy(cpu, 0);
 }
 
+int GdblibHandleEvents(struct cpu *cpu) {
+    int step = 0;
+
+    if (gdbstub_listen == -1) {
+        return 0;
+    }
+
+    while (GdblibCheckWaiting(cpu)) {
+        if (GdblibSerialInterrupt(cpu)) {
+            step = 1;
+        }
+    }
+
+    return step;
+}
+
 int GdblibCheckConnected() {
     return gdbstub_socket != -1;
 }
@@ -299,6 +383,10 @@ int PacketReadHexNumber(int dig)
 
 void PacketWriteChar(int ch)
 {
+    // Leave room for the trailing #CC.
+    if (DataOutAddr >= (int)sizeof(DataOutBuffer) - 3) {
+        return;
+    }
     DataOutCsum += ch;
     DataOutBuffer[DataOutAddr++] = ch;
 }
@@ -326,35 +414,42 @@ int PacketWriteHexNumber(int hnum, int dig, int little_endian)
 void PacketStart()
 {
     DataOutCsum = 0;
-    DataOutAddr = 0;
+    DataOutBuffer[0] = '$';
+    DataOutAddr = 1;
 }
 
 void PacketEnd()
 {
+    DataOutBuffer[DataOutAddr++] = '#';
+    DataOutBuffer[DataOutAddr++] = hex[(DataOutCsum >> 4) & 15];
+    DataOutBuffer[DataOutAddr++] = hex[DataOutCsum & 15];
 }
 
 void PacketFinish(struct cpu *cpu)
 {
-    int i, ch;
-
     PacketSent = 0;
+    PacketEnd();
 
     do {
-        SerialWrite('$');
-        for (i = 0; i < DataOutAddr; i++)
-        {
-            SerialWrite(DataOutBuffer[i]);
-        }
-        SerialWrite('#');
-        SerialWrite(hex[(DataOutCsum >> 4) & 15]);
-        SerialWrite(hex[DataOutCsum & 15]);
+        gdbstub_send_buf(DataOutBuffer, DataOutAddr);
+
+        if (NoAckMode || gdbstub_socket == -1) break;
 
-        while(!rdy(cpu, 1));
+        while(gdbstub_socket != -1 && !rdy(cpu, 1));
         if (SerialRead() == '+') break;
-    } while(PacketSent != 1);
+    } while(PacketSent != 1 && gdbstub_socket != -1);
+}
+
+// Sends the current packet as an asynchronous notification (%...#CC),
+// which gdb does not acknowledge.
+void PacketFinishNotification(struct cpu *cpu)
+{
+    DataOutBuffer[0] = '%';
+    PacketEnd();
+    gdbstub_send_buf(DataOutBuffer, DataOutAddr);
 }
 
-void PacketWriteString(char *str)
+void PacketWriteString(const char *str)
 {
     while(*str) PacketWriteChar(*str++);
 }
@@ -380,6 +475,20 @@ void PacketWriteSignal(struct cpu *cpu, int code)
     PacketFinish(cpu);
 }
 
+// Reports a stop to gdb; as a notification when in non-stop mode.
+void PacketWriteStop(struct cpu *cpu, int code)
+{
+    if (!NonStop) {
+        PacketWriteSignal(cpu, code);
+        return;
+    }
+
+    PacketStart();
+    PacketWriteString("Stop:S");
+    PacketWriteHexNumber(code, 2, 0);
+    PacketFinishNotification(cpu);
+}
+
 void PacketWriteError(struct cpu *cpu, int code)
 {
     PacketStart();
@@ -388,10 +497,132 @@ void PacketWriteError(struct cpu *cpu, int code)
     PacketFinish(cpu);
 }
 
+// Reads or writes guest memory, without crossing page boundaries in a
+// single access.
+static int GdbMemoryAccess(struct cpu *cpu, uint32_t addr, uint8_t *buf,
+    int len, int writeflag)
+{
+    while (len > 0) {
+        int chunk = 4096 - (addr & 4095);
+        if (chunk > len) {
+            chunk = len;
+        }
+
+        if (cpu->memory_rw(cpu, cpu->mem, addr, buf, chunk, writeflag, CACHE_NONE | NO_EXCEPTIONS | HOST_ACCESS) == MEMORY_ACCESS_FAILED) {
+            return 0;
+        }
+
+        addr += chunk;
+        buf += chunk;
+        len -= chunk;
+    }
+
+    return 1;
+}
+
+static void GdbContinue(struct cpu *cpu)
+{
+    fprintf(stderr, "Continue packet\n");
+    debugger_step(cpu->machine, 0);
+    SingleStep = 0;
+    Continue = 1;
+    single_step = 0;
+    exit_debugger = 1;
+}
+
+static void GdbStep(struct cpu *cpu)
+{
+    fprintf(stderr, "Step\n");
+    Continue = 1;
+    SingleStep = 1;
+    debugger_reset();
+    debugger_step(cpu->machine, 1);
+    fprintf(stderr, "Leaving step\n");
+}
+
+// Handles a 'v' packet; DataInAddr points just after the 'v'.
+static void GotVPacket(struct cpu *cpu)
+{
+    const char *cmd = &DataInBuffer[DataInAddr];
+
+    if (!strcmp(cmd, "Cont?")) {
+        PacketStart();
+        PacketWriteString("vCont;c;C;s;S;t");
+        PacketFinish(cpu);
+    } else if (!strncmp(cmd, "Cont;", 5)) {
+        // Only one thread, so the first action applies.
+        switch (cmd[5]) {
+        case 'c':
+        case 'C':
+            if (NonStop) {
+                PacketOk(cpu);
+            }
+            GdbContinue(cpu);
+            break;
+
+        case 's':
+        case 'S':
+            if (NonStop) {
+                PacketOk(cpu);
+            }
+            GdbStep(cpu);
+            break;
+
+        case 't':
+            PacketOk(cpu);
+            PacketWriteStop(cpu, 0);
+            Wait(cpu);
+            break;
+
+        default:
+            PacketWriteError(cpu, 1);
+            break;
+        }
+    } else if (!strcmp(cmd, "Stopped")) {
+        // Only one stop is ever pending.
+        PacketOk(cpu);
+    } else {
+        PacketEmpty(cpu);
+    }
+}
+
+// Handles qXfer:features:read:target.xml:offset,length.
+static void GotQXferPacket(struct cpu *cpu)
+{
+    const char *prefix = "qXfer:features:read:target.xml:";
+    int offset, length, total = strlen(TargetXml);
+
+    if (strncmp(DataInBuffer, prefix, strlen(prefix))) {
+        PacketEmpty(cpu);
+        return;
+    }
+
+    DataInAddr = strlen(prefix);
+    offset = PacketReadHexNumber(8);
+    DataInAddr++;
+    length = PacketReadHexNumber(8);
+
+    if (offset > total) {
+        PacketWriteError(cpu, 1);
+        return;
+    }
+
+    if (length > total - offset) {
+        length = total - offset;
+    }
+
+    PacketStart();
+    PacketWriteChar(offset + length < total ? 'm' : 'l');
+    for (int i = 0; i < length; i++) {
+        PacketWriteChar(TargetXml[offset + i]);
+    }
+    PacketFinish(cpu);
+}
+
 void GotPacket(struct cpu *cpu)
 {
     int i, memaddr, memsize;
-    uint8_t membuf[4];
+    uint8_t membuf[256];
     char namebuf[10];
     auto OldSaveArea = RegisterSaveArea;
     RegisterSaveArea = cpu;
@@ -447,9 +678,9 @@ void GotPacket(struct cpu *cpu)
 
         while(memsize > 0)
         {
-            int readsize = memsize > sizeof(membuf) ? sizeof(membuf) : memsize;
+            int readsize = memsize > (int)sizeof(membuf) ? sizeof(membuf) : memsize;
 
-            if (cpu->memory_rw(cpu, cpu->mem, memaddr, membuf, readsize, MEM_READ, CACHE_NONE | NO_EXCEPTIONS | HOST_ACCESS) == MEMORY_ACCESS_FAILED) {
+            if (!GdbMemoryAccess(cpu, memaddr, membuf, readsize, MEM_READ)) {
                 break;
             }
 
@@ -469,11 +700,59 @@ void GotPacket(struct cpu *cpu)
         DataInAddr++;
         memsize = PacketReadHexNumber(8);
         DataInAddr++;
-        while(memsize-- > 0)
+        while(memsize > 0)
         {
-            *((char *)memaddr++) = PacketReadHexNumber(2);
+            int writesize = memsize > (int)sizeof(membuf) ? sizeof(membuf) : memsize;
+
+            for (i = 0; i < writesize; i++) {
+                membuf[i] = PacketReadHexNumber(2);
+            }
+
+            if (!GdbMemoryAccess(cpu, memaddr, membuf, writesize, MEM_WRITE)) {
+                break;
+            }
+
+            memsize -= writesize;
+            memaddr += writesize;
+        }
+        if (memsize > 0) {
+            PacketWriteError(cpu, 14);
+        } else {
+            PacketOk(cpu);
+        }
+        break;
+
+    case 'X':
+        // Like 'M', but with binary data, where 0x7d escapes the next
+        // byte (xor 0x20).
+        memaddr = PacketReadHexNumber(8);
+        DataInAddr++;
+        memsize = PacketReadHexNumber(8);
+        DataInAddr++;
+        while(memsize > 0)
+        {
+            int writesize = memsize > (int)sizeof(membuf) ? sizeof(membuf) : memsize;
+
+            for (i = 0; i < writesize && DataInAddr < DataInLen; i++) {
+                int ch = (uint8_t)DataInBuffer[DataInAddr++];
+                if (ch == 0x7d && DataInAddr < DataInLen) {
+                    ch = (uint8_t)DataInBuffer[DataInAddr++] ^ 0x20;
+                }
+                membuf[i] = ch;
+            }
+
+            if (i < writesize || !GdbMemoryAccess(cpu, memaddr, membuf, writesize, MEM_WRITE)) {
+                break;
+            }
+
+            memsize -= writesize;
+            memaddr += writesize;
+        }
+        if (memsize > 0) {
+            PacketWriteError(cpu, 14);
+        } else {
+            PacketOk(cpu);
         }
-        PacketOk(cpu);
         break;
 
     case '?':
@@ -482,12 +761,7 @@ void GotPacket(struct cpu *cpu)
 
     case 'C':
     case 'c':
-        fprintf(stderr, "Continue packet\n");
-        debugger_step(cpu->machine, 0);
-        SingleStep = 0;
-        Continue = 1;
-        single_step = 0;
-        exit_debugger = 1;
+        GdbContinue(cpu);
         break;
 
     case 'H':
@@ -497,16 +771,11 @@ void GotPacket(struct cpu *cpu)
 
     case 'S':
     case 's':
-        fprintf(stderr, "Step\n");
-        Continue = 1;
-        SingleStep = 1;
-        debugger_reset();
-        debugger_step(cpu->machine, 1);
-        fprintf(stderr, "Leaving step\n");
+        GdbStep(cpu);
         break;
 
     case 'v':
-        PacketEmpty(cpu);
+        GotVPacket(cpu);
         break;
 
     case 'z': // Delete breakpoint
@@ -544,12 +813,19 @@ void GotPacket(struct cpu *cpu)
             PacketFinish(cpu);
             break;
 
-        case 'S': /*upported => nothing*/
+        case 'S': /*upported*/
             PacketStart();
-            PacketWriteString("xmlRegisters-;swbreak-;hwbreak-");
+            PacketWriteString("PacketSize=");
+            PacketWriteHexNumber(GDBLIB_PACKET_SIZE, 8, 0);
+            PacketWriteString(";qXfer:features:read+;QStartNoAckMode+"
+                ";QNonStop+;vContSupported+;swbreak-;hwbreak-");
             PacketFinish(cpu);
             break;
 
+        case 'X': /*fer*/
+            GotQXferPacket(cpu);
+            break;
+
         case 'O': /*ffsets*/
             PacketEmpty(cpu);
             break;
@@ -579,6 +855,19 @@ void GotPacket(struct cpu *cpu)
         }
         break;
 
+    case 'Q':
+        if (!strcmp(DataInBuffer, "QStartNoAckMode")) {
+            // This reply is still acknowledged by gdb.
+            PacketOk(cpu);
+            NoAckMode = 1;
+        } else if (!strncmp(DataInBuffer, "QNonStop:", 9)) {
+            NonStop = DataInBuffer[9] == '1';
+            PacketOk(cpu);
+        } else {
+            PacketEmpty(cpu);
+        }
+        break;
+
     default:
         PacketOk(cpu);
         break;
@@ -589,14 +878,15 @@ void GotPacket(struct cpu *cpu)
 
 bool GdblibSerialInterrupt(struct cpu *cpu)
 {
-    int ch = SerialRead();
-    fprintf(stderr, "%c", ch);
+    int ch = (uint8_t)SerialRead();
 
-    if (ch == '+')
+    // Acks, and interrupts from gdb, are only recognized between packets,
+    // since 'X' packets may contain any byte.
+    if (ch == '+' && ParseState == -1)
     {
         PacketSent = 1;
     }
-    else if (ch == '-')
+    else if (ch == '-' && ParseState == -1)
     {
         PacketSent = -1;
     }
@@ -611,16 +901,18 @@ bool GdblibSerialInterrupt(struct cpu *cpu)
     {
         ParseState = 2;
     }
-    else if (ch == 3 && ParseState == 0)
+    else if (ch == 3 && ParseState == -1)
     {
-        ParseState = 0;
         DataInAddr = 0;
+        PacketWriteStop(cpu, 2);
         Wait(cpu);
     }
     else if (ParseState == 0)
     {
         ComputedCsum += ch;
-        DataInBuffer[DataInAddr++] = ch;
+        if (DataInAddr < GDBLIB_PACKET_SIZE) {
+            DataInBuffer[DataInAddr++] = ch;
+        }
     }
     else if (ParseState == 2)
     {
@@ -632,13 +924,16 @@ bool GdblibSerialInterrupt(struct cpu *cpu)
         ActualCsum = hex2int(ch) | (hex2int(ActualCsum) << 4);
         ComputedCsum &= 255;
         ParseState = -1;
-        if (ComputedCsum == ActualCsum)
+        if (ComputedCsum == ActualCsum || NoAckMode)
         {
             ComputedCsum = 0;
             DataInBuffer[DataInAddr] = 0;
+            DataInLen = DataInAddr;
             DataInAddr = 0;
             Continue = 0;
-            SerialWrite('+');
+            if (!NoAckMode) {
+                SerialWrite('+');
+            }
             GotPacket(cpu);
         }
         else {
@@ -658,7 +953,7 @@ void GdblibTakeException(struct cpu *cpu, int n)
     RegisterSaveArea = cpu;
     if (SendSignal) {
         fprintf(stderr, "send signal packet\n");
-        PacketWriteSignal(cpu, Signal);
+        PacketWriteStop(cpu, Signal);
     }
     SingleStep = 0;
     SendSignal = 0;
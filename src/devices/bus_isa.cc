@@ -44,6 +44,7 @@
 #include "interrupt.h"
 #include "machine.h"
 #include "misc.h"
+#include "trace.h"
 
 /*
  *  isa_interrupt_common():
@@ -70,7 +71,7 @@ void isa_interrupt_assert(struct interrupt *interrupt)
 	struct bus_isa_data *d = (struct bus_isa_data *) interrupt->extra;
 	int line = interrupt->line;
 
-	if (line) { fprintf(stderr, "ISA_INTERRUPT_ASSERT(%d)\n", line); }
+	if (line) { TRACE(TRACE_ISA, TRACE_DEBUG, "ISA_INTERRUPT_ASSERT(%d)\n", line); }
 
 	isa_interrupt_common(d, line, 1);
 }
@@ -85,7 +86,7 @@ void isa_interrupt_deassert(struct interrupt *interrupt)
 {
 	struct bus_isa_data *d = (struct bus_isa_data *) interrupt->extra;
 	int line = interrupt->line;
-	if (line) { fprintf(stderr, "ISA_INTERRUPT_DEASSERT(%d)\n", line); }
+	if (line) { TRACE(TRACE_ISA, TRACE_DEBUG, "ISA_INTERRUPT_DEASSERT(%d)\n", line); }
 	int old_irr1 = d->pic1->irr;
 
 	isa_interrupt_common(d, line, 0);
@@ -197,7 +198,7 @@ struct bus_isa_data *bus_isa_init(struct machine *machine,
       d->pic2->last_int = &machine->isa_pic_data.last_int;
       d->pic2->chained_to = d->pic1;
       d->pic2->chained_int_line = 2;
-      fprintf(stderr, "set up chained 8259\n");
+      TRACE(TRACE_ISA, TRACE_DEBUG, "set up chained 8259\n");
 		}
 	} else {
 		bus_isa_flags &= ~BUS_ISA_EXTERNAL_PIC;
@@ -254,6 +255,15 @@ struct bus_isa_data *bus_isa_init(struct machine *machine,
 
 	if (bus_isa_flags & BUS_ISA_FDC) {
 		bus_isa_flags &= ~BUS_ISA_FDC;
+
+		/*  The floppy controller needs ISA DMA:  */
+		if (machine->isa_dma == NULL) {
+			snprintf(tmpstr, sizeof(tmpstr), "8237 addr=0x%llx",
+			    (long long)isa_portbase);
+			machine->isa_dma = (struct dma8237_data *)
+			    device_add(machine, tmpstr);
+		}
+
 		snprintf(tmpstr, sizeof(tmpstr), "fdc irq=%s.isa.%i "
 		    "addr=0x%llx", interrupt_base_path, 6,
 		    (long long)(isa_portbase + 0x3f0));
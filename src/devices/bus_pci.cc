@@ -50,6 +50,7 @@
 
 #include "bus_isa.h"
 #include "bus_pci.h"
+#include "checkpoint.h"
 #include "cpu.h"
 #include "device.h"
 #include "devices.h"
@@ -57,6 +58,7 @@
 #include "machine.h"
 #include "memory.h"
 #include "misc.h"
+#include "trace.h"
 #include "wdc.h"
 
 #include "thirdparty/cpc700reg.h"
@@ -77,6 +79,32 @@ struct pci_space_association {
 int pci_io_target = 0;
 struct pci_space_association pci_io_allocation[0x100];
 
+struct pci_bar_window {
+  bool io_space;
+  uint32_t base;
+  uint32_t end;		/*  exclusive  */
+  uint64_t allocated_space;
+};
+
+
+/*
+ *  bus_pci_find_device():
+ *
+ *  Returns the device at a bus/device/function, or NULL if there is none.
+ */
+static struct pci_device *bus_pci_find_device(struct pci_data *pci_data,
+	int bus, int device, int function)
+{
+	struct pci_device *dev;
+
+	for (dev = pci_data->first_device; dev != NULL; dev = dev->next)
+		if (dev->bus == bus && dev->device == device &&
+		    dev->function == function)
+			break;
+
+	return dev;
+}
+
 /*
  *  bus_pci_decompose_1():
  *
@@ -101,21 +129,11 @@ void bus_pci_decompose_1(uint32_t t, int *bus, int *dev, int *func, int *reg)
 void bus_pci_data_access(struct cpu *cpu, struct pci_data *pci_data,
 	uint64_t *data, int len, int writeflag)
 {
-	struct pci_device *dev;
+	struct pci_device *dev = pci_data->cur_dev;
 	unsigned char *cfg_base;
 	uint64_t x, idata = *data;
 	int i;
 
-	/*  Scan through the list of pci_device entries.  */
-	dev = pci_data->first_device;
-	while (dev != NULL) {
-		if (dev->bus      == pci_data->cur_bus &&
-		    dev->function == pci_data->cur_func &&
-		    dev->device   == pci_data->cur_device)
-			break;
-		dev = dev->next;
-	}
-
 	/*  No device? Then return emptiness.  */
 	if (dev == NULL) {
 		if (writeflag == MEM_READ) {
@@ -151,6 +169,12 @@ void bus_pci_data_access(struct cpu *cpu, struct pci_data *pci_data,
 			// return;
 		}
 
+		/*  BAR and decode enable changes move the device's windows:  */
+		if (pci_data->cur_reg == PCI_COMMAND_STATUS_REG ||
+		    (pci_data->cur_reg >= PCI_MAPREG_START &&
+		    pci_data->cur_reg < PCI_MAPREG_END))
+			pci_data->bar_windows_valid = 0;
+
 		if (dev->cfg_reg_write == NULL ||
 		    dev->cfg_reg_write(cpu, dev, pci_data->cur_reg, *data) == 0) {
 			/*  Print a warning for unhandled writes:  */
@@ -189,42 +213,103 @@ static uint32_t bus_pci_read_cfg(struct pci_device *dev, int offset) {
   return dev->cfg_mem[offset] | (dev->cfg_mem[offset + 1] << 8) | (dev->cfg_mem[offset + 2] << 16) | (dev->cfg_mem[offset + 3] << 24);
 }
 
-uint64_t bus_pci_get_io_target(struct cpu *cpu, struct pci_data *pci_data, bool io, uint32_t target, int len) {
-	struct pci_device *dev;
-	int i;
+static int bus_pci_bar_window_cmp(const void *a, const void *b)
+{
+  const struct pci_bar_window *wa = (const struct pci_bar_window *) a;
+  const struct pci_bar_window *wb = (const struct pci_bar_window *) b;
+
+  if (wa->io_space != wb->io_space)
+    return wa->io_space ? 1 : -1;
+  return wa->base < wb->base ? -1 : wa->base > wb->base;
+}
+
+/*
+ *  bus_pci_rebuild_bar_windows():
+ *
+ *  Compiles the BARs of all devices into pci_data->bar_windows. The n-th
+ *  I/O (or memory) BAR of a device is backed by the n-th I/O (or memory)
+ *  entry in pci_io_allocation with the device's id. BARs which are
+ *  unassigned (zero), or whose space is disabled in the command register,
+ *  do not decode.
+ */
+static void bus_pci_rebuild_bar_windows(struct pci_data *pci_data)
+{
+  struct pci_device *dev;
+  int n = 0, max = 0;
+
+  for (dev = pci_data->first_device; dev != NULL; dev = dev->next) {
+    uint32_t id = bus_pci_read_cfg(dev, PCI_ID_REG);
+    uint32_t cmd = bus_pci_read_cfg(dev, PCI_COMMAND_STATUS_REG);
+    int n_io = 0, n_mem = 0;
 
-	/*  Scan through the list of pci_device entries.  */
-	dev = pci_data->first_device;
-	while (dev != NULL) {
-    // Check bars for a match to target addr.
-    uint32_t id = bus_pci_read_cfg(dev, 0);
-    for (i = PCI_MAPREG_START; i < PCI_MAPREG_END; i += 4) {
+    for (int i = PCI_MAPREG_START; i < PCI_MAPREG_END; i += 4) {
       uint32_t bar = bus_pci_read_cfg(dev, i);
+      bool io = PCI_MAPREG_TYPE(bar) == PCI_MAPREG_TYPE_IO;
       uint32_t bar_addr = (io ? PCI_MAPREG_IO_ADDR(bar) : PCI_MAPREG_MEM_ADDR(bar)) & 0x7fffffff;
+      int nth = io ? n_io++ : n_mem++;
 
-#if 0
-      fprintf
-        (stderr, "[ pci: search for %s %s target %08x? bar %02x = %08x ]\n",
-         io ? "io" : "mem",
-         dev->name,
-         (unsigned int)target,
-         i,
-         (unsigned int)bar_addr
-         );
-#endif
+      if (bar_addr == 0 ||
+          !(cmd & (io ? PCI_COMMAND_IO_ENABLE : PCI_COMMAND_MEM_ENABLE)))
+        continue;
+
+      for (int j = 0; j < pci_io_target; j++) {
+        struct pci_space_association *assoc = &pci_io_allocation[j];
+        if (assoc->id != id || assoc->io_space != io || nth-- > 0)
+          continue;
 
-      if (target >= bar_addr) {
-        for (auto j = 0; j < pci_io_target; j++) {
-          if (id == pci_io_allocation[j].id && pci_io_allocation[j].io_space == io && target < bar_addr + pci_io_allocation[j].size) {
-            return pci_io_allocation[j].allocated_space + (target - bar_addr);
-          }
+        if (n >= max) {
+          max = max * 2 + 8;
+          CHECK_ALLOCATION(pci_data->bar_windows = (struct pci_bar_window *)
+            realloc(pci_data->bar_windows, max * sizeof(struct pci_bar_window)));
         }
+
+        pci_data->bar_windows[n].io_space = io;
+        pci_data->bar_windows[n].base = bar_addr;
+        pci_data->bar_windows[n].end = bar_addr + assoc->size;
+        pci_data->bar_windows[n].allocated_space = assoc->allocated_space;
+        TRACE(TRACE_PCI, TRACE_DEBUG, "[ pci: %s %s window %08x-%08x ]\n",
+              dev->name, io ? "io" : "mem", bar_addr, bar_addr + assoc->size - 1);
+        n++;
+        break;
       }
     }
-		dev = dev->next;
-	}
+  }
+
+  qsort(pci_data->bar_windows, n, sizeof(struct pci_bar_window),
+        bus_pci_bar_window_cmp);
+
+  pci_data->n_bar_windows = n;
+  pci_data->bar_windows_valid = 1;
+}
+
+/*
+ *  bus_pci_get_io_target():
+ *
+ *  Returns the emulated address which backs a PCI bus address in I/O or
+ *  memory space, or 0 if no BAR decodes it.
+ */
+uint64_t bus_pci_get_io_target(struct cpu *cpu, struct pci_data *pci_data, bool io, uint32_t target, int len) {
+  if (!pci_data->bar_windows_valid)
+    bus_pci_rebuild_bar_windows(pci_data);
+
+  /*  Binary search for the last window starting at or below target:  */
+  int lo = 0, hi = pci_data->n_bar_windows;
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    struct pci_bar_window *w = &pci_data->bar_windows[mid];
+    if (w->io_space < io || (w->io_space == io && w->base <= target))
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  if (lo > 0) {
+    struct pci_bar_window *w = &pci_data->bar_windows[lo - 1];
+    if (w->io_space == io && target < w->end)
+      return w->allocated_space + (target - w->base);
+  }
 
-  fprintf(stderr, "bus_pci_get_io_target: pci addr %08x failed\n", target);
+  TRACE(TRACE_PCI, TRACE_WARN, "bus_pci_get_io_target: pci addr %08x failed\n", target);
 
   return 0;
 }
@@ -246,6 +331,10 @@ void bus_pci_setaddr(struct cpu *cpu, struct pci_data *pci_data,
 	pci_data->cur_device = device;
 	pci_data->cur_func = function;
 	pci_data->cur_reg = reg;
+
+	/*  Look the device up once, instead of on every data access:  */
+	pci_data->cur_dev = bus_pci_find_device(pci_data, bus, device,
+	    function);
 }
 
 
@@ -267,21 +356,16 @@ void bus_pci_add(struct machine *machine, struct pci_data *pci_data,
 		abort();
 	}
 
-  fprintf(stderr, "PCI: bus%d device%d = %s\n", bus, device, name);
+  TRACE(TRACE_PCI, TRACE_INFO, "PCI: bus%d device%d = %s\n", bus, device, name);
 
 	/*  Find the PCI device:  */
 	init = pci_lookup_initf(name);
 
 	/*  Make sure this bus/device/function number isn't already in use:  */
-	pd = pci_data->first_device;
-	while (pd != NULL) {
-		if (pd->bus == bus && pd->device == device &&
-		    pd->function == function) {
-			fatal("bus_pci_add(): (bus %i, device %i, function"
-			    " %i) already in use\n", bus, device, function);
-			exit(1);
-		}
-		pd = pd->next;
+	if (bus_pci_find_device(pci_data, bus, device, function) != NULL) {
+		fatal("bus_pci_add(): (bus %i, device %i, function"
+		    " %i) already in use\n", bus, device, function);
+		exit(1);
 	}
 
 	CHECK_ALLOCATION(pd = (struct pci_device *) malloc(sizeof(struct pci_device)));
@@ -315,6 +399,10 @@ void bus_pci_add(struct machine *machine, struct pci_data *pci_data,
 
 	/*  Call the PCI device' init function:  */
 	init(machine, mem, pd);
+
+	pci_data->cur_dev = bus_pci_find_device(pci_data, pci_data->cur_bus,
+	    pci_data->cur_device, pci_data->cur_func);
+	pci_data->bar_windows_valid = 0;
 }
 
 
@@ -429,6 +517,39 @@ struct pci_data *bus_pci_init(struct machine *machine, const char *irq_path,
 }
 
 
+/*
+ *  bus_pci_checkpoint():
+ *
+ *  Save or restore the configuration registers of all devices on a PCI bus,
+ *  and the current register access state of the bus itself. Devices are
+ *  matched by position, so the bus must have been populated the same way.
+ */
+void bus_pci_checkpoint(struct checkpoint *ckpt, struct pci_data *pci_data)
+{
+	struct pci_device *dev;
+
+	CHECKPOINT_VAR(ckpt, pci_data->cur_pci_portbase);
+	CHECKPOINT_VAR(ckpt, pci_data->cur_pci_membase);
+	CHECKPOINT_VAR(ckpt, pci_data->cur_bus);
+	CHECKPOINT_VAR(ckpt, pci_data->cur_device);
+	CHECKPOINT_VAR(ckpt, pci_data->cur_func);
+	CHECKPOINT_VAR(ckpt, pci_data->cur_reg);
+	CHECKPOINT_VAR(ckpt, pci_data->last_was_write_ffffffff);
+
+	for (dev = pci_data->first_device; dev != NULL; dev = dev->next) {
+		CHECKPOINT_VAR(ckpt, dev->cfg_mem);
+		CHECKPOINT_VAR(ckpt, dev->cur_mapreg_offset);
+	}
+
+	if (ckpt->writeflag == MEM_WRITE)
+		return;
+
+	pci_data->cur_dev = bus_pci_find_device(pci_data, pci_data->cur_bus,
+	    pci_data->cur_device, pci_data->cur_func);
+	pci_data->bar_windows_valid = 0;
+}
+
+
 
 /******************************************************************************
  *                                                                            *
@@ -488,20 +609,20 @@ int s3_virge_cfg_reg_write(struct cpu *cpu, struct pci_device *pd, int reg, uint
     return 1;
 
   case 0x10: {
-    fprintf(stderr, "vga: set BAR0 to %08x\n", value);
+    TRACE(TRACE_PCI, TRACE_DEBUG, "vga: set BAR0 to %08x\n", value);
     uint32_t mem_stride = 0xfc000000;
     PCI_SET_DATA(reg, value & mem_stride);
     return 1;
   }
 
   case 0x30:
-    fprintf(stderr, "vga: set option rom address to %08x\n", value);
+    TRACE(TRACE_PCI, TRACE_DEBUG, "vga: set option rom address to %08x\n", value);
     // PCI_SET_DATA(reg, value & 0xffff8000);
     PCI_SET_DATA(reg, 0);
     return 1;
 
   case 0x3c:
-    fprintf(stderr, "vga: set interrupt line? %08x\n", value);
+    TRACE(TRACE_PCI, TRACE_DEBUG, "vga: set interrupt line? %08x\n", value);
     PCI_SET_DATA(reg, 0x100 | (value & 0xff));
     return 1;
 
@@ -519,6 +640,9 @@ PCIINIT(s3_virge)
                PCI_CLASS_CODE(PCI_CLASS_DISPLAY,
                               PCI_SUBCLASS_DISPLAY_VGA, 0) + 0x01);
 
+	PCI_SET_DATA(PCI_COMMAND_STATUS_REG,
+               PCI_COMMAND_IO_ENABLE | PCI_COMMAND_MEM_ENABLE);
+
   PCI_SET_DATA(PCI_MAPREG_START, 0x04000000);
 	PCI_SET_DATA(PCI_INTERRUPT_REG, 0x00000100);	/*  interrupt pin D  */
 
@@ -544,20 +668,20 @@ int wd_90c00_cfg_reg_write(struct cpu *cpu, struct pci_device *pd, int reg, uint
     return 1;
 
   case 0x10: {
-    fprintf(stderr, "vga: set BAR0 to %08x\n", value);
+    TRACE(TRACE_PCI, TRACE_DEBUG, "vga: set BAR0 to %08x\n", value);
     uint32_t mem_stride = 0xff000000;
     PCI_SET_DATA(reg, value & mem_stride);
     return 1;
   }
 
   case 0x30:
-    fprintf(stderr, "vga: set option rom address to %08x\n", value);
+    TRACE(TRACE_PCI, TRACE_DEBUG, "vga: set option rom address to %08x\n", value);
     // PCI_SET_DATA(reg, value & 0xffff8000);
     PCI_SET_DATA(reg, 0);
     return 1;
 
   case 0x3c:
-    fprintf(stderr, "vga: set interrupt line? %08x\n", value);
+    TRACE(TRACE_PCI, TRACE_DEBUG, "vga: set interrupt line? %08x\n", value);
     PCI_SET_DATA(reg, 0x100 | (value & 0xff));
     return 1;
 
@@ -575,6 +699,9 @@ PCIINIT(wd90c00)
                PCI_CLASS_CODE(PCI_CLASS_DISPLAY,
                               PCI_SUBCLASS_DISPLAY_VGA, 0) + 0x01);
 
+	PCI_SET_DATA(PCI_COMMAND_STATUS_REG,
+               PCI_COMMAND_IO_ENABLE | PCI_COMMAND_MEM_ENABLE);
+
   PCI_SET_DATA(PCI_MAPREG_START, 0x00f00000);
   PCI_SET_DATA(PCI_INTERRUPT_REG, 0x00000100);	/*  interrupt pin D  */
 
@@ -605,16 +732,16 @@ int lsi53c895a_cfg_reg_write(struct cpu *cpu, struct pci_device *pd, int reg, ui
     return 1;
   case 0x10:
     bar_loc = value & ~0xff;
-    fprintf(stderr, "lsi: set BAR0 %08x\n", bar_loc);
+    TRACE(TRACE_PCI, TRACE_DEBUG, "lsi: set BAR0 %08x\n", bar_loc);
     PCI_SET_DATA(reg, bar_loc | 1);
     return 1;
   case 0x14:
     bar_loc = value & ~0x1fff;
-    fprintf(stderr, "lsi: set BAR1 %08x (raw %08x)\n", bar_loc, value);
+    TRACE(TRACE_PCI, TRACE_DEBUG, "lsi: set BAR1 %08x (raw %08x)\n", bar_loc, value);
     PCI_SET_DATA(reg, bar_loc);
     return 1;
   case 0x3c: // Max lat, Min gnt, Int pin, Int Line
-    fprintf(stderr, "lsi: set INT# %08x\n", value);
+    TRACE(TRACE_PCI, TRACE_DEBUG, "lsi: set INT# %08x\n", value);
     PCI_SET_DATA(reg, 0x100 | (value & 0xff));
     return 1;
   default:
@@ -666,7 +793,7 @@ PCIINIT(lsi53c895a)
 
   snprintf(tmpstr, sizeof(tmpstr), "lsi53c895a addr=0x%llx irq=%s",
            first_alloc, irqstr);
-  fprintf(stderr, "lsi53c895a: add with string %s\n", tmpstr);
+  TRACE(TRACE_PCI, TRACE_DEBUG, "lsi53c895a: add with string %s\n", tmpstr);
 
   device_add(machine, tmpstr);
 }
@@ -1017,12 +1144,12 @@ int i82378zb_cfg_reg_write(struct cpu *cpu, struct pci_device *pd, int reg, uint
     return 1;
 
   case 0x10:
-    fprintf(stderr, "isa: set BAR0 %08x\n", (unsigned int)value);
+    TRACE(TRACE_PCI, TRACE_DEBUG, "isa: set BAR0 %08x\n", (unsigned int)value);
     PCI_SET_DATA(0x10, value & ~0xffff);
     return 1;
 
   case 0x14:
-    fprintf(stderr, "isa: set BAR1 %08x\n", (unsigned int)value);
+    TRACE(TRACE_PCI, TRACE_DEBUG, "isa: set BAR1 %08x\n", (unsigned int)value);
     PCI_SET_DATA(0x14, value & ~0xffffff);
     return 1;
   }
@@ -1619,7 +1746,7 @@ PCIINIT(dec21030)
 int eagle_cfg_reg_write(struct cpu *cpu, struct pci_device *pd, int reg,
                         uint32_t value)
 {
-  fprintf(stderr, "[ bus_pci: write eagle reg %02x value %08x ]\n", reg, value);
+  TRACE(TRACE_PCI, TRACE_DEBUG, "[ bus_pci: write eagle reg %02x value %08x ]\n", reg, value);
 
 	switch (reg) {
   case 0x04: {
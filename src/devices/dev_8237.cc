@@ -0,0 +1,388 @@
+/*
+ *  COMMENT: Intel 8237 DMA controller pair (PC-style ISA DMA)
+ *
+ *  The two cascaded controllers of a PC: channels 0-3 (8-bit) at ISA port
+ *  0x00, and channels 4-7 (16-bit) at 0xc0. The page registers are at 0x80,
+ *  and the high page registers (as in the Intel 82378 SIO) at 0x480. addr
+ *  should be the base of the ISA port space.
+ *
+ *  ISA devices which use DMA (e.g. the floppy controller) find the
+ *  controllers through machine->isa_dma, and move their data with
+ *  dev_8237_transfer().
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "checkpoint.h"
+#include "cpu.h"
+#include "device.h"
+#include "devices.h"
+#include "machine.h"
+#include "memory.h"
+#include "misc.h"
+
+
+#define	DEV_8237_LENGTH		0x10
+#define	DEV_8237_PAGE_LENGTH	0x10
+
+/*  Transfers are done in chunks of this size, which divides 64 KB:  */
+#define	DMA_CHUNK_SIZE		4096
+
+#define	DMA_MODE_TYPE_MASK	0x0c
+#define	DMA_MODE_VERIFY		0x00
+#define	DMA_MODE_AUTOINIT	0x10
+#define	DMA_MODE_DECREMENT	0x20
+
+struct dma8237_channel {
+	uint16_t	base_addr;
+	uint16_t	base_count;
+	uint16_t	addr;
+	uint16_t	count;
+	uint8_t		mode;
+};
+
+struct dma8237_data {
+	struct dma8237_channel channel[8];
+
+	/*  One of each per controller:  */
+	uint8_t		flipflop[2];
+	uint8_t		command[2];
+	uint8_t		status[2];
+	uint8_t		mask[2];
+	uint8_t		request[2];
+
+	/*  Page registers, indexed by port offset:  */
+	uint8_t		page[DEV_8237_PAGE_LENGTH];
+	uint8_t		high_page[DEV_8237_PAGE_LENGTH];
+};
+
+/*  Page register offset for each channel:  */
+static const int dma_page_offset[8] = { 7, 3, 1, 2, 0xf, 0xb, 9, 0xa };
+
+
+/*
+ *  dma_paddr():
+ *
+ *  Returns the physical address which channel ch currently points to.
+ *  The 16-bit channels count in words, and ignore bit 0 of the page.
+ */
+static uint64_t dma_paddr(struct dma8237_data *d, int ch)
+{
+	int ofs = dma_page_offset[ch];
+	uint64_t paddr = ((uint64_t) d->high_page[ofs] << 24);
+
+	if (ch < 4)
+		return paddr | (d->page[ofs] << 16) | d->channel[ch].addr;
+
+	return paddr | ((d->page[ofs] & 0xfe) << 16) |
+	    (d->channel[ch].addr << 1);
+}
+
+
+/*
+ *  dev_8237_remaining():
+ *
+ *  Returns the number of bytes left to transfer on a channel.
+ */
+size_t dev_8237_remaining(struct dma8237_data *d, int ch)
+{
+	return ((size_t) d->channel[ch].count + 1) << (ch >> 2);
+}
+
+
+/*
+ *  dev_8237_transfer():
+ *
+ *  Moves up to len bytes between buf and the memory that channel ch is
+ *  programmed for. writeflag is MEM_WRITE for transfers into memory (i.e.
+ *  device reads), and MEM_READ for transfers from memory.
+ *
+ *  The data is copied a page at a time, rather than per byte or word, and
+ *  the channel's address and count registers are updated as if the transfer
+ *  had been done by the controller. When the count runs out, terminal count
+ *  is flagged in the status register, and the channel is either masked or
+ *  (in autoinit mode) reloaded. A channel programmed for verify transfers
+ *  advances its address and count in the same way, but memory and buf are
+ *  left untouched.
+ *
+ *  Returns the number of bytes transferred, which is 0 if the channel is
+ *  masked.
+ */
+size_t dev_8237_transfer(struct cpu *cpu, struct dma8237_data *d, int ch,
+	unsigned char *buf, size_t len, int writeflag)
+{
+	struct dma8237_channel *c = &d->channel[ch];
+	int ctrl = ch >> 2, bit = 1 << (ch & 3), shift = ch >> 2;
+	size_t remaining = dev_8237_remaining(d, ch), done = 0;
+	int verify = (c->mode & DMA_MODE_TYPE_MASK) == DMA_MODE_VERIFY;
+
+	if (d->mask[ctrl] & bit)
+		return 0;
+
+	if (len > remaining)
+		len = remaining;
+	len = (len >> shift) << shift;
+
+	while (done < len && !(c->mode & DMA_MODE_DECREMENT)) {
+		uint64_t paddr = dma_paddr(d, ch);
+		size_t chunk = DMA_CHUNK_SIZE - (paddr & (DMA_CHUNK_SIZE - 1));
+
+		if (chunk > len - done)
+			chunk = len - done;
+
+		if (!verify)
+			cpu->memory_rw(cpu, cpu->mem, paddr, buf + done,
+			    chunk, writeflag, PHYSICAL | NO_EXCEPTIONS);
+
+		c->addr += chunk >> shift;
+		c->count -= chunk >> shift;
+		done += chunk;
+	}
+
+	/*
+	 *  Address decrement mode: Each byte (or word, on the 16-bit channels)
+	 *  goes below the previous one in memory, so each chunk is copied via
+	 *  tmp, with the order of the bytes (or words) reversed.
+	 */
+	while (done < len) {
+		unsigned char tmp[DMA_CHUNK_SIZE];
+		uint64_t paddr = dma_paddr(d, ch);
+		size_t unit = 1 << shift, i, n;
+		size_t chunk = (paddr & (DMA_CHUNK_SIZE - 1)) + unit;
+
+		if (chunk > len - done)
+			chunk = len - done;
+		n = chunk >> shift;
+		paddr = paddr + unit - chunk;
+
+		if (!verify && writeflag == MEM_WRITE)
+			for (i = 0; i < n; i++)
+				memcpy(tmp + (n-1-i) * unit,
+				    buf + done + i * unit, unit);
+
+		if (!verify)
+			cpu->memory_rw(cpu, cpu->mem, paddr, tmp, chunk,
+			    writeflag, PHYSICAL | NO_EXCEPTIONS);
+
+		if (!verify && writeflag == MEM_READ)
+			for (i = 0; i < n; i++)
+				memcpy(buf + done + i * unit,
+				    tmp + (n-1-i) * unit, unit);
+
+		c->addr -= n;
+		c->count -= n;
+		done += chunk;
+	}
+
+	if (done == remaining) {
+		d->status[ctrl] |= bit;
+		d->request[ctrl] &= ~bit;
+
+		if (c->mode & DMA_MODE_AUTOINIT) {
+			c->addr = c->base_addr;
+			c->count = c->base_count;
+		} else
+			d->mask[ctrl] |= bit;
+	}
+
+	return done;
+}
+
+
+/*
+ *  dma_register_access():
+ *
+ *  Access to register regnr of controller ctrl (0 or 1).
+ */
+static uint64_t dma_register_access(struct dma8237_data *d, int ctrl,
+	int regnr, int writeflag, uint64_t idata)
+{
+	struct dma8237_channel *c = &d->channel[ctrl * 4 + ((regnr >> 1) & 3)];
+	uint64_t odata = 0;
+	int bit = 1 << (idata & 3);
+
+	if (regnr < 8) {
+		/*  Address or count, low byte first:  */
+		int hi = d->flipflop[ctrl];
+		uint16_t *cur = (regnr & 1)? &c->count : &c->addr;
+		uint16_t *base = (regnr & 1)? &c->base_count : &c->base_addr;
+
+		if (writeflag == MEM_WRITE) {
+			if (hi)
+				*base = (*base & 0x00ff) | ((idata & 0xff) << 8);
+			else
+				*base = (*base & 0xff00) | (idata & 0xff);
+			*cur = *base;
+		} else
+			odata = hi? (*cur >> 8) : (*cur & 0xff);
+
+		d->flipflop[ctrl] = !hi;
+		return odata;
+	}
+
+	switch (regnr) {
+
+	case 8:	if (writeflag == MEM_WRITE)
+			d->command[ctrl] = idata;
+		else {
+			odata = d->status[ctrl] | (d->request[ctrl] << 4);
+			d->status[ctrl] = 0;
+		}
+		break;
+
+	case 9:	if (writeflag == MEM_WRITE) {
+			if (idata & 4)
+				d->request[ctrl] |= bit;
+			else
+				d->request[ctrl] &= ~bit;
+		}
+		break;
+
+	case 10:if (writeflag == MEM_WRITE) {
+			if (idata & 4)
+				d->mask[ctrl] |= bit;
+			else
+				d->mask[ctrl] &= ~bit;
+		}
+		break;
+
+	case 11:if (writeflag == MEM_WRITE)
+			d->channel[ctrl * 4 + (idata & 3)].mode = idata;
+		break;
+
+	case 12:if (writeflag == MEM_WRITE)
+			d->flipflop[ctrl] = 0;
+		break;
+
+	case 13:/*  Master clear (reads the temporary register):  */
+		if (writeflag == MEM_WRITE) {
+			d->flipflop[ctrl] = 0;
+			d->command[ctrl] = 0;
+			d->status[ctrl] = 0;
+			d->request[ctrl] = 0;
+			d->mask[ctrl] = 0x0f;
+		}
+		break;
+
+	case 14:if (writeflag == MEM_WRITE)
+			d->mask[ctrl] = 0;
+		break;
+
+	case 15:if (writeflag == MEM_WRITE)
+			d->mask[ctrl] = idata & 0x0f;
+		else
+			odata = d->mask[ctrl];
+		break;
+	}
+
+	return odata;
+}
+
+
+DEVICE_ACCESS(8237_1)
+{
+	struct dma8237_data *d = (struct dma8237_data *) extra;
+	uint64_t idata = 0, odata;
+
+	if (writeflag == MEM_WRITE)
+		idata = memory_readmax64(cpu, data, len);
+
+	odata = dma_register_access(d, 0, relative_addr, writeflag, idata);
+
+	if (writeflag == MEM_READ)
+		memory_writemax64(cpu, data, len, odata);
+
+	return 1;
+}
+
+
+DEVICE_ACCESS(8237_2)
+{
+	struct dma8237_data *d = (struct dma8237_data *) extra;
+	uint64_t idata = 0, odata;
+
+	if (writeflag == MEM_WRITE)
+		idata = memory_readmax64(cpu, data, len);
+
+	/*  The 16-bit controller's registers are at even addresses:  */
+	odata = dma_register_access(d, 1, relative_addr >> 1, writeflag, idata);
+
+	if (writeflag == MEM_READ)
+		memory_writemax64(cpu, data, len, odata);
+
+	return 1;
+}
+
+
+DEVICE_ACCESS(8237_page)
+{
+	struct dma8237_data *d = (struct dma8237_data *) extra;
+
+	if (writeflag == MEM_WRITE)
+		d->page[relative_addr] = memory_readmax64(cpu, data, len);
+	else
+		memory_writemax64(cpu, data, len, d->page[relative_addr]);
+
+	return 1;
+}
+
+
+DEVICE_ACCESS(8237_high_page)
+{
+	struct dma8237_data *d = (struct dma8237_data *) extra;
+
+	if (writeflag == MEM_WRITE)
+		d->high_page[relative_addr] = memory_readmax64(cpu, data, len);
+	else
+		memory_writemax64(cpu, data, len, d->high_page[relative_addr]);
+
+	return 1;
+}
+
+
+DEVICE_CHECKPOINT(8237)
+{
+	struct dma8237_data *d = (struct dma8237_data *) extra;
+
+	CHECKPOINT_VAR(ckpt, d->channel);
+	CHECKPOINT_VAR(ckpt, d->flipflop);
+	CHECKPOINT_VAR(ckpt, d->command);
+	CHECKPOINT_VAR(ckpt, d->status);
+	CHECKPOINT_VAR(ckpt, d->mask);
+	CHECKPOINT_VAR(ckpt, d->request);
+	CHECKPOINT_VAR(ckpt, d->page);
+	CHECKPOINT_VAR(ckpt, d->high_page);
+}
+
+
+DEVINIT(8237)
+{
+	struct dma8237_data *d;
+
+	CHECK_ALLOCATION(d = (struct dma8237_data *) malloc(sizeof(struct dma8237_data)));
+	memset(d, 0, sizeof(struct dma8237_data));
+
+	/*  All channels are masked after reset:  */
+	d->mask[0] = d->mask[1] = 0x0f;
+
+	memory_device_register(devinit->machine->memory, "8237 [channels 0-3]",
+	    devinit->addr, DEV_8237_LENGTH, dev_8237_1_access, d,
+	    DM_DEFAULT, NULL);
+	memory_device_register(devinit->machine->memory, "8237 [channels 4-7]",
+	    devinit->addr + 0xc0, DEV_8237_LENGTH * 2, dev_8237_2_access, d,
+	    DM_DEFAULT, NULL);
+	memory_device_register(devinit->machine->memory, "8237 [page]",
+	    devinit->addr + 0x80, DEV_8237_PAGE_LENGTH, dev_8237_page_access,
+	    d, DM_DEFAULT, NULL);
+	memory_device_register(devinit->machine->memory, "8237 [high page]",
+	    devinit->addr + 0x480, DEV_8237_PAGE_LENGTH,
+	    dev_8237_high_page_access, d, DM_DEFAULT, NULL);
+	machine_add_checkpoint_function(devinit->machine, devinit->name,
+	    dev_8237_checkpoint, d);
+
+	devinit->return_ptr = d;
+	return 1;
+}
+
@@ -47,6 +47,7 @@
 #include "memory.h"
 #include "misc.h"
 #include "timer.h"
+#include "trace.h"
 
 #include "thirdparty/i8253reg.h"
 
@@ -180,7 +181,7 @@ DEVICE_ACCESS(8253)
 
 	case I8253_TIMER_MODE:
 		if (writeflag == MEM_WRITE) {
-			fprintf(stderr, "[ 8253: timer mode %x ]\n", idata & 0xff);
+			TRACE(TRACE_ISA, TRACE_DEBUG, "[ 8253: timer mode %x ]\n", idata & 0xff);
 			d->mode_byte = idata;
 
 			d->counter_select = idata >> 6;
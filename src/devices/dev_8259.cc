@@ -36,6 +36,7 @@
 #include <string.h>
 #include <assert.h>
 
+#include "checkpoint.h"
 #include "cpu.h"
 #include "device.h"
 #include "devices.h"
@@ -376,6 +377,27 @@ DEVICE_ACCESS(8259)
 }
 
 
+DEVICE_CHECKPOINT(8259)
+{
+	struct pic8259_data *d = (struct pic8259_data *) extra;
+
+	CHECKPOINT_VAR(ckpt, d->init_state);
+	CHECKPOINT_VAR(ckpt, d->icw);
+	CHECKPOINT_VAR(ckpt, d->rotate);
+	CHECKPOINT_VAR(ckpt, d->rotation_pri);
+	CHECKPOINT_VAR(ckpt, d->read_ir_is);
+	CHECKPOINT_VAR(ckpt, d->special_mask_mode);
+	CHECKPOINT_VAR(ckpt, d->poll_cmd);
+	CHECKPOINT_VAR(ckpt, d->irr);
+	CHECKPOINT_VAR(ckpt, d->isr);
+	CHECKPOINT_VAR(ckpt, d->ier);
+
+	/*  The last acknowledged interrupt is shared; the primary owns it.  */
+	if (d->chained_to == NULL && d->last_int != NULL)
+		CHECKPOINT_VAR(ckpt, *d->last_int);
+}
+
+
 /*
  *  devinit_8259():
  *
@@ -413,6 +435,8 @@ DEVINIT(8259)
 	memory_device_register(devinit->machine->memory, name2,
 	    devinit->addr, DEV_8259_LENGTH, dev_8259_access, d,
 	    DM_DEFAULT, NULL);
+	machine_add_checkpoint_function(devinit->machine, name2,
+	    dev_8259_checkpoint, d);
 
 	devinit->return_ptr = d;
 	return 1;
@@ -25,3244 +25,110 @@
  *  SUCH DAMAGE.
  *   
  *
- *  COMMENT: VGA framebuffer device (charcell and graphics modes)
+ *  COMMENT: S3 86C764 (Trio64) VGA framebuffer
  *
- *  It should work with 80x25 and 40x25 text modes, and with a few graphics
- *  modes as long as no fancy VGA features are used.
+ *  The chip specific parts: the hardware graphics cursor, display size and
+ *  chip ID registers. The VGA registers and the 2D engine are in s3vga.cc.
  */
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-#include "console.h"
 #include "cpu.h"
 #include "devices.h"
 #include "machine.h"
 #include "memory.h"
 #include "misc.h"
-#include "bus_isa.h"
 
+#include "s3vga.h"
+#include "trace.h"
 #include "vga.h"
 #include "x11.h"
 
-#define S_CRTC 0
-#define S_SEQ 1
-#define S_GR 2
-#define S_ATT 3
-#define S_PRIMARY 4
-#define S_EXTENDED 5
-#define S_SEQ2 6
-#define S_CRT2 7
-#define S_BEE8 8
 
-#define ON_READ 1
-#define ON_WRITE 2
-#define ON_RW 3
-
-struct register_name_table_t {
-  int source;
-  int reg_index;
-  const char *reg_name;
-  int assert_fail_if_used;
-};
-
-static const char *group_names[] = {
-  "CRTC",
-  "SEQ",
-  "GR",
-  "Attribute",
-  "Primary Registers 0x3b0+",
-  "Extended 0x8xxx-0xfxxx",
-  "Extended Sequencer",
-  "Extended CRTC",
-  "BEE8 Selector",
-  nullptr
-};
-
-#if 0
-#define REG_WRITE(R) do { \
-  if (writeflag == MEM_WRITE) {                         \
-    fprintf(stderr, "@@@o%08x", relative_addr + (R));     \
-    for (int ii = 0; ii < len; ii++) {                    \
-      fprintf(stderr, " %02x", data[ii]);                 \
-    }                                                     \
-    fprintf(stderr, "\n");                                \
-  }                                                       \
-  } while (0)
-#else
-#define REG_WRITE(X) do { } while (0)
-#endif
-
-static struct register_name_table_t r_name_table[] = {
-  { source: S_PRIMARY,
-    reg_index: 0x00,
-    reg_name: "Attribute Controller Index"
-  },
-  { source: S_PRIMARY,
-    reg_index: 0x01,
-    reg_name: "Attribute Controller Data"
-  },
-  { source: S_PRIMARY,
-    reg_index: 0x02,
-    reg_name: "Misc. Output/Input Status 3c2"
-  },
-  { source: S_PRIMARY,
-    reg_index: 0x03,
-    reg_name: "Input Status 1"
-  },
-  { source: S_PRIMARY,
-    reg_index: 0x04,
-    reg_name: "VGA Sequencer Index"
-  },
-  { source: S_PRIMARY,
-    reg_index: 0x05,
-    reg_name: "VGA Sequencer Data"
-  },
-  { source: S_PRIMARY,
-    reg_index: 0x0c,
-    reg_name: "Misc. Output 3cc"
-  },
-  { source: S_PRIMARY,
-    reg_index: 0x0a,
-    reg_name: "Feature Control 3ca"
-  },
-  { source: S_PRIMARY,
-    reg_index: 0x1a,
-    reg_name: "Feature Control 3da"
-  },
-  { source: S_PRIMARY,
-    reg_index: 0x14,
-    reg_name: "CRT Control Index"
-  },
-  { source: S_PRIMARY,
-    reg_index: 0x15,
-    reg_name: "CRT Control Data"
-  },
-  { source: S_SEQ,
-    reg_index: 0x00,
-    reg_name: "Reset"
-  },
-  { source: S_SEQ,
-    reg_index: 0x01,
-    reg_name: "Clocking Mode"
-  },
-  { source: S_SEQ,
-    reg_index: 0x02,
-    reg_name: "Enable Write Planes"
-  },
-  { source: S_SEQ,
-    reg_index: 0x03,
-    reg_name: "Character Font Select"
-  },
-  { source: S_SEQ,
-    reg_index: 0x04,
-    reg_name: "Memory Mode Control"
-  },
-  { source: S_CRTC,
-    reg_index: 0x00,
-    reg_name: "Horizontal Total"
-  },
-  { source: S_CRTC,
-    reg_index: 0x01,
-    reg_name: "Horizontal Display End"
-  },
-  { source: S_CRTC,
-    reg_index: 0x02,
-    reg_name: "Start Horizontal Blank"
-  },
-  { source: S_CRTC,
-    reg_index: 0x03,
-    reg_name: "End Horizontal Blank"
-  },
-  { source: S_CRTC,
-    reg_index: 0x04,
-    reg_name: "Start Horizontal Sync Position"
-  },
-  { source: S_CRTC,
-    reg_index: 0x05,
-    reg_name: "End Horizontal Sync Position"
-  },
-  { source: S_CRTC,
-    reg_index: 0x06,
-    reg_name: "Vertial Total"
-  },
-  { source: S_CRTC,
-    reg_index: 0x07,
-    reg_name: "CRTC Overflow"
-  },
-  { source: S_CRTC,
-    reg_index: 0x08,
-    reg_name: "Preset Row Scan"
-  },
-  { source: S_CRTC,
-    reg_index: 0x09,
-    reg_name: "Maximum Scan Line"
-  },
-  { source: S_CRTC,
-    reg_index: 0x0a,
-    reg_name: "Cursor Start Scan Line"
-  },
-  { source: S_CRTC,
-    reg_index: 0x0b,
-    reg_name: "Cursor End Scan Line"
-  },
-  { source: S_CRTC,
-    reg_index: 0x0c,
-    reg_name: "Start Address High"
-  },
-  { source: S_CRTC,
-    reg_index: 0x0d,
-    reg_name: "Start Address Low"
-  },
-  { source: S_CRTC,
-    reg_index: 0x0e,
-    reg_name: "Cursor Location Address High"
-  },
-  { source: S_CRTC,
-    reg_index: 0x0f,
-    reg_name: "Cursor Location Address Low"
-  },
-  { source: S_CRTC,
-    reg_index: 0x10,
-    reg_name: "Vertical Retrace Start"
-  },
-  { source: S_CRTC,
-    reg_index: 0x11,
-    reg_name: "Vertical Retrace End"
-  },
-  { source: S_CRTC,
-    reg_index: 0x12,
-    reg_name: "Vertical Display End"
-  },
-  { source: S_CRTC,
-    reg_index: 0x13,
-    reg_name: "Offset - Line Stride in bytes"
-  },
-  { source: S_CRTC,
-    reg_index: 0x14,
-    reg_name: "Underline Location"
-  },
-  { source: S_CRTC,
-    reg_index: 0x15,
-    reg_name: "Start Vertical Blank"
-  },
-  { source: S_CRTC,
-    reg_index: 0x16,
-    reg_name: "End Vertical Blank"
-  },
-  { source: S_CRTC,
-    reg_index: 0x17,
-    reg_name: "Mode Control - CGA Emulation"
-  },
-  { source: S_CRTC,
-    reg_index: 0x18,
-    reg_name: "Line Compare"
-  },
-  { source: S_CRTC,
-    reg_index: 0x22,
-    reg_name: "CPU Latch Data"
-  },
-  { source: S_CRTC,
-    reg_index: 0x24,
-    reg_name: "Attribute Controller Flag"
-  },
-  { source: S_CRTC,
-    reg_index: 0x26,
-    reg_name: "Attribute Controller Index"
-  },
-  { source: S_PRIMARY,
-    reg_index: 0x0e,
-    reg_name: "Graphics Controller Index"
-  },
-  { source: S_PRIMARY,
-    reg_index: 0x0f,
-    reg_name: "Graphics Controller Data"
-  },
-  { source: S_GR,
-    reg_index: 0x00,
-    reg_name: "Set/Reset"
-  },
-  { source: S_GR,
-    reg_index: 0x01,
-    reg_name: "Enable Set/Reset"
-  },
-  { source: S_GR,
-    reg_index: 0x02,
-    reg_name: "Color Compare"
-  },
-  { source: S_GR,
-    reg_index: 0x03,
-    reg_name: "Raster Operation/Rotate Counter"
-  },
-  { source: S_GR,
-    reg_index: 0x04,
-    reg_name: "Read Plane Select"
-  },
-  { source: S_GR,
-    reg_index: 0x05,
-    reg_name: "Graphics Controller Mode"
-  },
-  { source: S_GR,
-    reg_index: 0x06,
-    reg_name: "Memory Map Mode Control"
-  },
-  { source: S_GR,
-    reg_index: 0x07,
-    reg_name: "Color Don't Care"
-  },
-  { source: S_GR,
-    reg_index: 0x09,
-    reg_name: "Bit Mask"
-  },
-  { source: S_ATT,
-    reg_index: 0x00,
-    reg_name: "Palette Register 0"
-  },
-  { source: S_ATT,
-    reg_index: 0x01,
-    reg_name: "Palette Register 1"
-  },
-  { source: S_ATT,
-    reg_index: 0x02,
-    reg_name: "Palette Register 2"
-  },
-  { source: S_ATT,
-    reg_index: 0x03,
-    reg_name: "Palette Register 3"
-  },
-  { source: S_ATT,
-    reg_index: 0x04,
-    reg_name: "Palette Register 4"
-  },
-  { source: S_ATT,
-    reg_index: 0x05,
-    reg_name: "Palette Register 5"
-  },
-  { source: S_ATT,
-    reg_index: 0x06,
-    reg_name: "Palette Register 6"
-  },
-  { source: S_ATT,
-    reg_index: 0x07,
-    reg_name: "Palette Register 7"
-  },
-  { source: S_ATT,
-    reg_index: 0x08,
-    reg_name: "Palette Register 8"
-  },
-  { source: S_ATT,
-    reg_index: 0x09,
-    reg_name: "Palette Register 9"
-  },
-  { source: S_ATT,
-    reg_index: 0x0a,
-    reg_name: "Palette Register a"
-  },
-  { source: S_ATT,
-    reg_index: 0x0b,
-    reg_name: "Palette Register b"
-  },
-  { source: S_ATT,
-    reg_index: 0x0c,
-    reg_name: "Palette Register c"
-  },
-  { source: S_ATT,
-    reg_index: 0x0d,
-    reg_name: "Palette Register d"
-  },
-  { source: S_ATT,
-    reg_index: 0x0e,
-    reg_name: "Palette Register e"
-  },
-  { source: S_ATT,
-    reg_index: 0x0f,
-    reg_name: "Palette Register f"
-  },
-  { source: S_ATT,
-    reg_index: 0x10,
-    reg_name: "Attribute Mode Control"
-  },
-  { source: S_ATT,
-    reg_index: 0x11,
-    reg_name: "Border Control"
-  },
-  { source: S_ATT,
-    reg_index: 0x12,
-    reg_name: "Color Plane Enabled"
-  },
-  { source: S_ATT,
-    reg_index: 0x13,
-    reg_name: "Horizontal Pixel Panning"
-  },
-  { source: S_ATT,
-    reg_index: 0x14,
-    reg_name: "Pixel Padding"
-  },
-  { source: S_PRIMARY,
-    reg_index: 0x06,
-    reg_name: "DAC Mask"
-  },
-  { source: S_PRIMARY,
-    reg_index: 0x07,
-    reg_name: "DAC Read Index"
-  },
-  { source: S_PRIMARY,
-    reg_index: 0x08,
-    reg_name: "DAC Write Index"
-  },
-  { source: S_PRIMARY,
-    reg_index: 0x09,
-    reg_name: "DAC Data"
-  },
-  { source: S_SEQ,
-    reg_index: 0x08,
-    reg_name: "Extended Sequencer Lock"
-  },
-  { source: S_SEQ,
-    reg_index: 0x09,
-    reg_name: "Extended Sequencer 9"
-  },
-  { source: S_SEQ,
-    reg_index: 0x0a,
-    reg_name: "Extended Sequencer A"
-  },
-  { source: S_SEQ,
-    reg_index: 0x0d,
-    reg_name: "Extended Sequencer D"
-  },
-  { source: S_SEQ,
-    reg_index: 0x10,
-    reg_name: "MCLK Value Low"
-  },
-  { source: S_SEQ,
-    reg_index: 0x11,
-    reg_name: "MCLK Value High"
-  },
-  { source: S_SEQ,
-    reg_index: 0x12,
-    reg_name: "DCLK Value Low"
-  },
-  { source: S_SEQ,
-    reg_index: 0x13,
-    reg_name: "DCLK Value High"
-  },
-  { source: S_SEQ,
-    reg_index: 0x14,
-    reg_name: "CLKSYN Control 1"
-  },
-  { source: S_SEQ,
-    reg_index: 0x15,
-    reg_name: "CLKSYN Control 2"
-  },
-  { source: S_SEQ,
-    reg_index: 0x16,
-    reg_name: "CLKSYN Test High SR16"
-  },
-  { source: S_SEQ,
-    reg_index: 0x17,
-    reg_name: "CLKSYN Test High SR17"
-  },
-  { source: S_SEQ,
-    reg_index: 0x18,
-    reg_name: "RAMDAC/CLKSYN Control SR18"
-  },
-  { source: S_SEQ,
-    reg_index: 0x1a,
-    reg_name: "Extended Sequencer 1a"
-  },
-  { source: S_SEQ,
-    reg_index: 0x1b,
-    reg_name: "Extended Sequencer 1b"
-  },
-  { source: S_SEQ,
-    reg_index: 0x1c,
-    reg_name: "Extended Sequencer 1c"
-  },
-  { source: S_SEQ,
-    reg_index: 0x1d,
-    reg_name: "Extended Sequencer 1d"
-  },
-  { source: S_SEQ,
-    reg_index: 0x1e,
-    reg_name: "Extended Sequencer 1e"
-  },
-  { source: S_SEQ,
-    reg_index: 0x1f,
-    reg_name: "Extended Sequencer 1f"
-  },
-  { source: S_SEQ,
-    reg_index: 0x20,
-    reg_name: "Extended Sequencer 20"
-  },
-  { source: S_SEQ,
-    reg_index: 0x21,
-    reg_name: "Extended Sequencer 21"
-  },
-  { source: S_SEQ,
-    reg_index: 0x22,
-    reg_name: "DCLK0 Value Low"
-  },
-  { source: S_SEQ,
-    reg_index: 0x23,
-    reg_name: "DCLK0 Value High"
-  },
-  { source: S_SEQ,
-    reg_index: 0x24,
-    reg_name: "DCLK1 Value Low"
-  },
-  { source: S_SEQ,
-    reg_index: 0x25,
-    reg_name: "DCLK1 Value High"
-  },
-  { source: S_SEQ,
-    reg_index: 0x26,
-    reg_name: "Paired Register Read/Write Select",
-    assert_fail_if_used: ON_RW
-  },
-  { source: S_SEQ,
-    reg_index: 0x27,
-    reg_name: "MCLK Control"
-  },
-  { source: S_SEQ,
-    reg_index: 0x28,
-    reg_name: "DCLK Control"
-  },
-  { source: S_SEQ,
-    reg_index: 0x29,
-    reg_name: "Flat Panel Frame Buffer"
-  },
-  { source: S_SEQ,
-    reg_index: 0x30,
-    reg_name: "Architectural Configuration"
-  },
-  { source: S_SEQ,
-    reg_index: 0x31,
-    reg_name: "Flat Panel Display Mode"
-  },
-  { source: S_SEQ,
-    reg_index: 0x32,
-    reg_name: "Flat Panel Polarity Control"
-  },
-  { source: S_SEQ,
-    reg_index: 0x34,
-    reg_name: "Flat Panel AC Modulation"
-  },
-  { source: S_SEQ,
-    reg_index: 0x35,
-    reg_name: "Flat Panel Modulation Clock Select"
-  },
-  { source: S_SEQ,
-    reg_index: 0x36,
-    reg_name: "Flat Panel Dither Control"
-  },
-  { source: S_SEQ,
-    reg_index: 0x37,
-    reg_name: "Flat Panel FRC Weight Select RAM Index"
-  },
-  { source: S_SEQ,
-    reg_index: 0x38,
-    reg_name: "Flat Panel FRC Weight Select RAM Data"
-  },
-  { source: S_SEQ,
-    reg_index: 0x39,
-    reg_name: "Flat Panel Algorithm Control"
-  },
-  { source: S_SEQ,
-    reg_index: 0x3a,
-    reg_name: "Flat Panel FRC Tuning 1"
-  },
-  { source: S_SEQ,
-    reg_index: 0x3b,
-    reg_name: "Flat Panel FRC Tuning 2"
-  },
-  { source: S_SEQ,
-    reg_index: 0x3c,
-    reg_name: "Flat Panel FRC Tuning 3"
-  },
-  { source: S_SEQ,
-    reg_index: 0x3d,
-    reg_name: "Flat Panel Configuraiton 1"
-  },
-  { source: S_SEQ,
-    reg_index: 0x40,
-    reg_name: "Flat Panel Dither Control"
-  },
-  { source: S_SEQ,
-    reg_index: 0x41,
-    reg_name: "Flat Panel Power Sequence Control"
-  },
-  { source: S_SEQ,
-    reg_index: 0x42,
-    reg_name: "Flat Panel Power Management Control"
-  },
-  { source: S_SEQ,
-    reg_index: 0x43,
-    reg_name: "Flat Panel Standby Control"
-  },
-  { source: S_SEQ,
-    reg_index: 0x44,
-    reg_name: "Flat Panel Power Management"
-  },
-  { source: S_SEQ,
-    reg_index: 0x45,
-    reg_name: "Flat Panel PLL Power Management"
-  },
-  { source: S_SEQ,
-    reg_index: 0x46,
-    reg_name: "Flat Panel Power Management Status"
-  },
-  { source: S_SEQ,
-    reg_index: 0x47,
-    reg_name: "CLUT Control"
-  },
-  { source: S_SEQ,
-    reg_index: 0x48,
-    reg_name: "Icon Mode"
-  },
-  { source: S_SEQ,
-    reg_index: 0x49,
-    reg_name: "Icon Color Stack"
-  },
-  { source: S_SEQ,
-    reg_index: 0x4a,
-    reg_name: "Icon X Position High"
-  },
-  { source: S_SEQ,
-    reg_index: 0x4b,
-    reg_name: "Icon X Position Low"
-  },
-  { source: S_SEQ,
-    reg_index: 0x4c,
-    reg_name: "Icon Y Position High"
-  },
-  { source: S_SEQ,
-    reg_index: 0x4d,
-    reg_name: "Icon Y Position Low"
-  },
-  { source: S_SEQ,
-    reg_index: 0x4e,
-    reg_name: "Icon Address"
-  },
-  { source: S_SEQ,
-    reg_index: 0x4f,
-    reg_name: "Dual Scan STN Data Address"
-  },
-  { source: S_SEQ,
-    reg_index: 0x50,
-    reg_name: "Dual Scan STN Frame Buffer Size Low"
-  },
-  { source: S_SEQ,
-    reg_index: 0x51,
-    reg_name: "Dual Scan STN Frame Buffer Size High"
-  },
-  { source: S_SEQ,
-    reg_index: 0x52,
-    reg_name: "Flat Panel PWM Register"
-  },
-  { source: S_SEQ,
-    reg_index: 0x53,
-    reg_name: "Flat Panel PWM Duty Cycle"
-  },
-  { source: S_SEQ,
-    reg_index: 0x54,
-    reg_name: "Flat Panel Horizontal Compensation 1 SR54"
-  },
-  { source: S_SEQ,
-    reg_index: 0x55,
-    reg_name: "Flat Panel Horizontal Compensation 2 SR55"
-  },
-  { source: S_SEQ,
-    reg_index: 0x56,
-    reg_name: "Flat Panel Horizontal Compensation 1 SR56"
-  },
-  { source: S_SEQ,
-    reg_index: 0x57,
-    reg_name: "Flat Panel Vertical Compensation 1"
-  },
-  { source: S_SEQ,
-    reg_index: 0x58,
-    reg_name: "Flat Panel Horizontal Border"
-  },
-  { source: S_SEQ,
-    reg_index: 0x59,
-    reg_name: "Flat Panel Horizontal Expansion Factor SR59"
-  },
-  { source: S_SEQ,
-    reg_index: 0x5a,
-    reg_name: "Flat Panel Vertical Border"
-  },
-  { source: S_SEQ,
-    reg_index: 0x5b,
-    reg_name: "Flat Panel Horizontal Expansion Factor SR5b"
-  },
-  { source: S_SEQ,
-    reg_index: 0x5c,
-    reg_name: "Flat Panel Display Enable Position Control"
-  },
-  { source: S_SEQ,
-    reg_index: 0x5d,
-    reg_name: "Flat Panel/CRT Sync Position Control"
-  },
-  { source: S_SEQ,
-    reg_index: 0x5f,
-    reg_name: "FIFO Control SR5f"
-  },
-  { source: S_SEQ,
-    reg_index: 0x60,
-    reg_name: "Flat Panel Horizontal Total"
-  },
-  { source: S_SEQ,
-    reg_index: 0x61,
-    reg_name: "Flat Panel Horizontal Panel Size"
-  },
-  { source: S_SEQ,
-    reg_index: 0x62,
-    reg_name: "Flat Panel Horizontal Blank Start"
-  },
-  { source: S_SEQ,
-    reg_index: 0x63,
-    reg_name: "Flat Panel Horizontal Blank End"
-  },
-  { source: S_SEQ,
-    reg_index: 0x64,
-    reg_name: "Flat Panel Horizontal Sync Start"
-  },
-  { source: S_SEQ,
-    reg_index: 0x65,
-    reg_name: "Flat Panel Horizontal Sync End"
-  },
-  { source: S_SEQ,
-    reg_index: 0x66,
-    reg_name: "Flat Panel Horizontal Overflow"
-  },
-  { source: S_SEQ,
-    reg_index: 0x68,
-    reg_name: "Flat Panel Vertical Total"
-  },
-  { source: S_SEQ,
-    reg_index: 0x69,
-    reg_name: "Flat Panel Vertical Panel Size"
-  },
-  { source: S_SEQ,
-    reg_index: 0x6a,
-    reg_name: "Flat Panel Vertical Blank Start"
-  },
-  { source: S_SEQ,
-    reg_index: 0x6b,
-    reg_name: "Flat Panel Vertical Blank End"
-  },
-  { source: S_SEQ,
-    reg_index: 0x6c,
-    reg_name: "Flat Panel Vertical Sync Start"
-  },
-  { source: S_SEQ,
-    reg_index: 0x6d,
-    reg_name: "Flat Panel Vertical Sync End"
-  },
-  { source: S_SEQ,
-    reg_index: 0x6e,
-    reg_name: "Flat Panel Vertical Overflow 1"
-  },
-  { source: S_SEQ,
-    reg_index: 0x6f,
-    reg_name: "Flat Panel Vertical Overflow 2"
-  },
-  { source: S_CRTC,
-    reg_index: 0x22,
-    reg_name: "CRT Test 1"
-  },
-  { source: S_CRTC,
-    reg_index: 0x2d,
-    reg_name: "Device ID High"
-  },
-  { source: S_CRTC,
-    reg_index: 0x2e,
-    reg_name: "Device ID Low"
-  },
-  { source: S_CRTC,
-    reg_index: 0x2f,
-    reg_name: "Revision"
-  },
-  { source: S_CRTC,
-    reg_index: 0x30,
-    reg_name: "Chip ID/Rev"
-  },
-  { source: S_CRTC,
-    reg_index: 0x31,
-    reg_name: "Memory Configuration",
-    assert_fail_if_used: ON_RW
-  },
-  { source: S_CRTC,
-    reg_index: 0x32,
-    reg_name: "Backward Compatibility 1"
-  },
-  { source: S_CRTC,
-    reg_index: 0x33,
-    reg_name: "Backward Compatibiltiy 2"
-  },
-  { source: S_CRTC,
-    reg_index: 0x34,
-    reg_name: "Backward Compatibility 3"
-  },
-  { source: S_CRTC,
-    reg_index: 0x35,
-    reg_name: "CRT Register Lock"
-  },
-  { source: S_CRTC,
-    reg_index: 0x36,
-    reg_name: "Configuration 1",
-    assert_fail_if_used: ON_RW
-  },
-  { source: S_CRTC,
-    reg_index: 0x37,
-    reg_name: "Configuration 2",
-    assert_fail_if_used: ON_RW
-  },
-  { source: S_CRTC,
-    reg_index: 0x38,
-    reg_name: "Register Lock 1"
-  },
-  { source: S_CRTC,
-    reg_index: 0x39,
-    reg_name: "Register Lock 2"
-  },
-  { source: S_CRTC,
-    reg_index: 0x3a,
-    reg_name: "Misc. 1 CR3a",
-    assert_fail_if_used: ON_RW
-  },
-  { source: S_CRTC,
-    reg_index: 0x3b,
-    reg_name: "Start Display FIFO Fetch",
-    assert_fail_if_used: ON_RW
-  },
-  { source: S_CRTC,
-    reg_index: 0x3c,
-    reg_name: "Interlace Retrace Start"
-  },
-  { source: S_CRTC,
-    reg_index: 0x3d,
-    reg_name: "NTSC/PAL Control"
-  },
-  { source: S_CRTC,
-    reg_index: 0x40,
-    reg_name: "System Configuration",
-    assert_fail_if_used: ON_RW
-  },
-  { source: S_CRTC,
-    reg_index: 0x41,
-    reg_name: "BIOS Flag 1"
-  },
-  { source: S_CRTC,
-    reg_index: 0x42,
-    reg_name: "Mode Control CR42"
-  },
-  { source: S_CRTC,
-    reg_index: 0x43,
-    reg_name: "Extended Mode CR43"
-  },
-  { source: S_CRTC,
-    reg_index: 0x45,
-    reg_name: "Hardware Graphics Cursor Mode"
-  },
-  { source: S_CRTC,
-    reg_index: 0x46,
-    reg_name: "Hardware Graphics Cursor Origin X Low"
-  },
-  { source: S_CRTC,
-    reg_index: 0x47,
-    reg_name: "Hardware Graphics Cursor Origin X High"
-  },
-  { source: S_CRTC,
-    reg_index: 0x48,
-    reg_name: "Hardware Graphics Cursor Origin Y Low"
-  },
-  { source: S_CRTC,
-    reg_index: 0x48,
-    reg_name: "Hardware Graphics Cursor Origin Y High"
-  },
-  { source: S_CRTC,
-    reg_index: 0x4a,
-    reg_name: "Hardware Graphics Cursor Foreground Stack"
-  },
-  { source: S_CRTC,
-    reg_index: 0x4b,
-    reg_name: "Hardware Graphics Cursor Background Stack"
-  },
-  { source: S_CRTC,
-    reg_index: 0x4c,
-    reg_name: "Hardware Graphics Cursor Start Address Low"
-  },
-  { source: S_CRTC,
-    reg_index: 0x4d,
-    reg_name: "Hardware Graphics Cursor Start Address High"
-  },
-  { source: S_CRTC,
-    reg_index: 0x4e,
-    reg_name: "Hardware Graphics Cursor Pattern Display Start X Pixel Position"
-  },
-  { source: S_CRTC,
-    reg_index: 0x4f,
-    reg_name: "Hardware Graphics Cursor Pattern Display Start Y Pixel Position"
-  },
-  { source: S_CRTC,
-    reg_index: 0x50,
-    reg_name: "Extended System Control 1"
-  },
-  { source: S_CRTC,
-    reg_index: 0x51,
-    reg_name: "Extended System Control 2"
-  },
-  { source: S_CRTC,
-    reg_index: 0x52,
-    reg_name: "Extended BIOS Flag 1"
-  },
-  { source: S_CRTC,
-    reg_index: 0x53,
-    reg_name: "Extended Memory Control 1",
-    assert_fail_if_used: ON_RW
-  },
-  { source: S_CRTC,
-    reg_index: 0x54,
-    reg_name: "Extended Memory Control 2",
-    assert_fail_if_used: ON_RW
-  },
-  { source: S_CRTC,
-    reg_index: 0x55,
-    reg_name: "Extended DAC Control"
-  },
-  { source: S_CRTC,
-    reg_index: 0x56,
-    reg_name: "External Sync Control 1"
-  },
-  { source: S_CRTC,
-    reg_index: 0x58,
-    reg_name: "Linear Address Window Control",
-    assert_fail_if_used: ON_RW
-  },
-  { source: S_CRTC,
-    reg_index: 0x59,
-    reg_name: "Linear Address Window Position High"
-  },
-  { source: S_CRTC,
-    reg_index: 0x5a,
-    reg_name: "Linear Address Window Position Low"
-  },
-  { source: S_CRTC,
-    reg_index: 0x5c,
-    reg_name: "General Output Port"
-  },
-  { source: S_CRTC,
-    reg_index: 0x5d,
-    reg_name: "Extended Horizontal Overflow CR5D"
-  },
-  { source: S_CRTC,
-    reg_index: 0x5e,
-    reg_name: "Extended Vertical Ovreflow CR5E"
-  },
-  { source: S_CRTC,
-    reg_index: 0x60,
-    reg_name: "Extended Memory Control 3",
-    assert_fail_if_used: ON_RW
-  },
-  { source: S_CRTC,
-    reg_index: 0x61,
-    reg_name: "Extended Memory Control 4",
-    assert_fail_if_used: ON_RW
-  },
-  { source: S_CRTC,
-    reg_index: 0x63,
-    reg_name: "Horizontal Timing Control CR63"
-  },
-  { source: S_CRTC,
-    reg_index: 0x65,
-    reg_name: "Extended Miscellaneous Control CR65"
-  },
-  { source: S_CRTC,
-    reg_index: 0x66,
-    reg_name: "Extended Miscellaneous Control 1 CR66"
-  },
-  { source: S_CRTC,
-    reg_index: 0x67,
-    reg_name: "Extended Miscellaneous Control 2 CR67"
-  },
-  { source: S_CRTC,
-    reg_index: 0x68,
-    reg_name: "Configuration 3 CR68"
-  },
-  { source: S_CRTC,
-    reg_index: 0x69,
-    reg_name: "Extended System Control 3 CR69"
-  },
-  { source: S_CRTC,
-    reg_index: 0x6a,
-    reg_name: "Extended System Control 4 CR6a"
-  },
-  { source: S_CRTC,
-    reg_index: 0x6b,
-    reg_name: "Extended BIOS Flag 3"
-  },
-  { source: S_CRTC,
-    reg_index: 0x6c,
-    reg_name: "Extended BIOS Flag 4"
-  },
-  { source: S_CRTC,
-    reg_index: 0x6d,
-    reg_name: "Extended BIOS Flag 5"
-  },
-  { source: S_CRTC,
-    reg_index: 0x6e,
-    reg_name: "Extended BIOS Flag 6"
-  },
-  { source: S_CRTC,
-    reg_index: 0x6f,
-    reg_name: "Configuration 4 CR6f"
-  },
-  { source: S_CRTC,
-    reg_index: 0x71,
-    reg_name: "Extended Miscellaneous Control 2 CR71"
-  },
-  { source: S_CRTC,
-    reg_index: 0x72,
-    reg_name: "Extended Memory Control 5",
-    assert_fail_if_used: ON_RW
-  },
-  { source: S_CRTC,
-    reg_index: 0x73,
-    reg_name: "Extended Memory Control 6",
-    assert_fail_if_used: ON_RW
-  },
-  { source: S_CRTC,
-    reg_index: 0x74,
-    reg_name: "Extended Memory Control 7",
-    assert_fail_if_used: ON_RW
-  },
-  { source: S_CRTC,
-    reg_index: 0x75,
-    reg_name: "Extended Memory Control 8",
-    assert_fail_if_used: ON_RW
-  },
-  { source: S_CRTC,
-    reg_index: 0x76,
-    reg_name: "Extended Memory Control 9",
-    assert_fail_if_used: ON_RW
-  },
-  { source: S_EXTENDED,
-    reg_index: 0x42e8,
-    reg_name: "Subsystem Status",
-    assert_fail_if_used: ON_RW
-  },
-  { source: S_EXTENDED,
-    reg_index: 0x4ae8,
-    reg_name: "Advanced Function Control",
-    assert_fail_if_used: ON_RW
-  },
-  { source: S_EXTENDED,
-    reg_index: 0x82e8,
-    reg_name: "Current Y Position",
-    assert_fail_if_used: ON_RW
-  },
-  { source: S_EXTENDED,
-    reg_index: 0x86e8,
-    reg_name: "Current X Position",
-    assert_fail_if_used: ON_RW
-  },
-  { source: S_EXTENDED,
-    reg_index: 0x8ae8,
-    reg_name: "Destination Y Position"
-  },
-  { source: S_EXTENDED,
-    reg_index: 0x8ee8,
-    reg_name: "Destination X Position"
-  },
-  { source: S_EXTENDED,
-    reg_index: 0x92e8,
-    reg_name: "Line Error Term",
-    assert_fail_if_used: ON_RW
-  },
-  { source: S_EXTENDED,
-    reg_index: 0x96e8,
-    reg_name: "Major Axis Pixel Count",
-    assert_fail_if_used: ON_RW
-  },
-  { source: S_EXTENDED,
-    reg_index: 0x9ae8,
-    reg_name: "Graphics Processor Status",
-    assert_fail_if_used: ON_RW
-  },
-  { source: S_EXTENDED,
-    reg_index: 0x9ee8,
-    reg_name: "Short Stroke Transfer Vector"
-  },
-  { source: S_EXTENDED,
-    reg_index: 0xa2e8,
-    reg_name: "Background Color"
-  },
-  { source: S_EXTENDED,
-    reg_index: 0xa6e8,
-    reg_name: "Foreground Color"
-  },
-  { source: S_EXTENDED,
-    reg_index: 0xaae8,
-    reg_name: "Bitplane Write Mask"
-  },
-  { source: S_EXTENDED,
-    reg_index: 0xaee8,
-    reg_name: "Bitplane Read Mask"
-  },
-  { source: S_EXTENDED,
-    reg_index: 0xb2e8,
-    reg_name: "Color Compare"
-  },
-  { source: S_EXTENDED,
-    reg_index: 0xb6e8,
-    reg_name: "Background Mix"
-  },
-  { source: S_EXTENDED,
-    reg_index: 0xbae8,
-    reg_name: "Foreground Mix"
-  },
-  { source: S_EXTENDED,
-    reg_index: 0xbee8,
-    reg_name: "Read Register Data",
-    assert_fail_if_used: ON_RW
-  },
-  { source: S_BEE8,
-    reg_index: 0,
-    reg_name: "Minor Axis Pixel Count"
-  },
-  { source: S_BEE8,
-    reg_index: 1,
-    reg_name: "Top Scissors"
-  },
-  { source: S_BEE8,
-    reg_index: 2,
-    reg_name: "Left Scissors"
-  },
-  { source: S_BEE8,
-    reg_index: 3,
-    reg_name: "Bottom Scissors"
-  },
-  { source: S_BEE8,
-    reg_index: 4,
-    reg_name: "Right Scissors"
-  },
-  { source: S_BEE8,
-    reg_index: 0x0a,
-    reg_name: "Pixel Control"
-  },
-  { source: S_BEE8,
-    reg_index: 0x0d,
-    reg_name: "Multifunction Control Miscellaneous 2",
-    assert_fail_if_used: ON_RW
-  },
-  { source: S_BEE8,
-    reg_index: 0x0e,
-    reg_name: "Multifunction Control Miscellaneous",
-    assert_fail_if_used: ON_RW
-  },
-  { source: S_BEE8,
-    reg_index: 0x0f,
-    reg_name: "Read Register Select"
-  },
-  { source: S_EXTENDED,
-    reg_index: 0xe2e8,
-    reg_name: "Pixel Data Transfer"
-  },
-  { source: S_EXTENDED,
-    reg_index: 0xe2ea,
-    reg_name: "Pixel Data Transfer Extended"
-  },
-  { source: S_EXTENDED,
-    reg_index: 0x8180,
-    reg_name: "Primary Stream Control",
-    assert_fail_if_used: ON_RW
-  },
-  { source: S_EXTENDED,
-    reg_index: 0x8184,
-    reg_name: "Color/Chroma Key Control",
-    assert_fail_if_used: ON_RW
-  },
-  { source: S_EXTENDED,
-    reg_index: 0x8190,
-    reg_name: "Secondary Stream Control",
-    assert_fail_if_used: ON_RW
-  },
-  { source: S_EXTENDED,
-    reg_index: 0x8194,
-    reg_name: "Chroma Key Upper Bound",
-    assert_fail_if_used: ON_RW
-  },
-  { source: S_EXTENDED,
-    reg_index: 0x8198,
-    reg_name: "Secondary Stream Stretch/Filter Constants",
-    assert_fail_if_used: ON_RW
-  },
-  { source: S_EXTENDED,
-    reg_index: 0x81a0,
-    reg_name: "Blend Control",
-    assert_fail_if_used: ON_RW
-  },
-  { source: S_EXTENDED,
-    reg_index: 0x81c0,
-    reg_name: "Primary Stream Frame Buffer Address 0",
-    assert_fail_if_used: ON_RW
-  },
-  { source: S_EXTENDED,
-    reg_index: 0x81c4,
-    reg_name: "Primary Stream Frame Buffer Address 1",
-    assert_fail_if_used: ON_RW
-  },
-  { source: S_EXTENDED,
-    reg_index: 0x81c8,
-    reg_name: "Primary Stream Stride",
-    assert_fail_if_used: ON_RW
-  },
-  { source: S_EXTENDED,
-    reg_index: 0x81cc,
-    reg_name: "Double Buffer/LPB Support",
-    assert_fail_if_used: ON_RW
-  },
-  { source: S_EXTENDED,
-    reg_index: 0x81d0,
-    reg_name: "Secondary Stream Frame Buffer Address 0",
-    assert_fail_if_used: ON_RW
-  },
-  { source: S_EXTENDED,
-    reg_index: 0x81d4,
-    reg_name: "Secondary Stream Frame Buffer Address 1",
-    assert_fail_if_used: ON_RW
-  },
-  { source: S_EXTENDED,
-    reg_index: 0x81d8,
-    reg_name: "Secondary Stream Stride",
-    assert_fail_if_used: ON_RW
-  },
-  { source: S_EXTENDED,
-    reg_index: 0x81dc,
-    reg_name: "Blend Control",
-    assert_fail_if_used: ON_RW
-  },
-  { source: S_EXTENDED,
-    reg_index: 0x81e0,
-    reg_name: "K1 Vertical Scale Factor",
-    assert_fail_if_used: ON_RW
-  },
-  { source: S_EXTENDED,
-    reg_index: 0x81e4,
-    reg_name: "K2 Vertical Scale Factor",
-    assert_fail_if_used: ON_RW
-  },
-  { source: S_EXTENDED,
-    reg_index: 0x81e8,
-    reg_name: "DDA Vertical Accumulator Initial Value",
-    assert_fail_if_used: ON_RW
-  },
-  { source: S_EXTENDED,
-    reg_index: 0x81ec,
-    reg_name: "Streams FIFO and RAS Controls",
-    assert_fail_if_used: ON_RW
-  },
-  { source: S_EXTENDED,
-    reg_index: 0x81f0,
-    reg_name: "Primary Stream Window Start Coordinates",
-    assert_fail_if_used: ON_RW
-  },
-  { source: S_EXTENDED,
-    reg_index: 0x81f4,
-    reg_name: "Primary Stream Widnow Size",
-    assert_fail_if_used: ON_RW
-  },
-  { source: S_EXTENDED,
-    reg_index: 0x81f8,
-    reg_name: "Secondary Stream Window Start Coordinates",
-    assert_fail_if_used: ON_RW
-  },
-  { source: S_EXTENDED,
-    reg_index: 0x81fc,
-    reg_name: "Secondary Stream Window Size",
-    assert_fail_if_used: ON_RW
-  },
-  { source: S_EXTENDED,
-    reg_index: 0xff00,
-    reg_name: "LPB Mode",
-    assert_fail_if_used: ON_RW,
-  },
-  { source: S_EXTENDED,
-    reg_index: 0xff04,
-    reg_name: "LPB FIFO Status",
-    assert_fail_if_used: ON_RW
-  },
-  { source: S_EXTENDED,
-    reg_index: 0xff08,
-    reg_name: "LPB Interrupt Flags",
-    assert_fail_if_used: ON_RW
-  },
-  { source: S_EXTENDED,
-    reg_index: 0xff0c,
-    reg_name: "LPB Frame Buffer Address 0",
-    assert_fail_if_used: ON_RW
-  },
-  { source: S_EXTENDED,
-    reg_index: 0xff10,
-    reg_name: "LPB Frame Buffer Address 1",
-    assert_fail_if_used: ON_RW
-  },
-  { source: S_EXTENDED,
-    reg_index: 0xff14,
-    reg_name: "LPB Direct Read/Write Address",
-    assert_fail_if_used: ON_RW
-  },
-  { source: S_EXTENDED,
-    reg_index: 0xff18,
-    reg_name: "LPB Direct Read/Write Data",
-    assert_fail_if_used: ON_RW
-  },
-  { source: S_EXTENDED,
-    reg_index: 0xff1c,
-    reg_name: "LPB General Purpose Input/Output Port",
-    assert_fail_if_used: ON_RW
-  },
-  { source: S_EXTENDED,
-    reg_index: 0xff20,
-    reg_name: "Serial Port",
-    assert_fail_if_used: ON_RW
-  },
-  { source: S_EXTENDED,
-    reg_index: 0xff24,
-    reg_name: "LPB Video Input Window Size",
-    assert_fail_if_used: ON_RW
-  },
-  { source: S_EXTENDED,
-    reg_index: 0xff28,
-    reg_name: "LPB Video Data Offsets",
-    assert_fail_if_used: ON_RW
-  },
-  { source: S_EXTENDED,
-    reg_index: 0xff2c,
-    reg_name: "LPB Horizontal Decimation Control",
-    assert_fail_if_used: ON_RW
-  },
-  { source: S_EXTENDED,
-    reg_index: 0xff30,
-    reg_name: "LPB Vertical Decimation Control",
-    assert_fail_if_used: ON_RW
-  },
-  { source: S_EXTENDED,
-    reg_index: 0xff34,
-    reg_name: "LPB Line Stride",
-    assert_fail_if_used: ON_RW
-  },
-  { source: S_EXTENDED,
-    reg_index: 0xff40,
-    reg_name: "LPB Output FIFO",
-    assert_fail_if_used: ON_RW
-  },
-  { source: 0,
-    reg_index: 0,
-    reg_name: nullptr,
-    assert_fail_if_used: 0,
-  }
-};
-
-#define VGA_DEBUG 0
-
-#if VGA_DEBUG
-#define L(x) do { x; } while (0)
-#define G(x) do { if (d->window_mapped) { x; } } while (0)
-#else
-#define L(x) do { } while(0)
-#define G(x) do { } while(0)
-#endif
-
-/*  For videomem -> framebuffer updates:  */
-#define	VGA_TICK_SHIFT		18
-
-#define	MAX_RETRACE_SCANLINES	420
-#define	N_IS1_READ_THRESHOLD	50
-
-#define	GFX_ADDR_WINDOW		(32 * 1024 * 1024)
-
-#define	VGA_FB_ADDR	0x1c00000000ULL
-
-#define	MODE_CHARCELL		1
-#define	MODE_GRAPHICS		2
-
-#define	GRAPHICS_MODE_8BIT	1
-#define	GRAPHICS_MODE_4BIT	2
-
-#define S3_PIO_SEQ_LEN 11
-
-struct vga_data {
-	uint64_t	videomem_base;
-	uint64_t	control_base;
-
-	struct vfb_data *fb;
-	uint32_t	fb_size;
-
-	int		fb_max_x;		/*  pixels  */
-	int		fb_max_y;		/*  pixels  */
-	int		max_x;			/*  charcells or pixels  */
-	int		max_y;			/*  charcells or pixels  */
-
-	/*  Selects charcell mode or graphics mode:  */
-	int		cur_mode;
-
-	/*  Common for text and graphics modes:  */
-	int		pixel_repx, pixel_repy;
-
-	/*  Textmode:  */
-	int		font_width;
-	int		font_height;
-	unsigned char	*font;
-	size_t		charcells_size;
-	unsigned char	*charcells;		/*  2 bytes per char  */
-	unsigned char	*charcells_outputed;	/*  text  */
-	unsigned char	*charcells_drawn;	/*  framebuffer  */
-
-	/*  Graphics:  */
-	int		graphics_mode;
-	int		bits_per_pixel;
-	unsigned char	*gfx_mem;
-	uint32_t	gfx_mem_size;
-
-	/*  Registers:  */
-	int		attribute_state;	/*  0 or 1  */
-	unsigned char	attribute_reg_select;
-	unsigned char	attribute_reg[256];
-
-	unsigned char	misc_output_reg;
-
-	unsigned char	sequencer_reg_select;
-	unsigned char	sequencer_reg[256];
-
-	unsigned char	graphcontr_reg_select;
-	unsigned char	graphcontr_reg[256];
-
-	unsigned char	crtc_reg_select;
-	unsigned char	crtc_reg[256];
-
-	unsigned char	palette_read_index;
-	char		palette_read_subindex;
-	unsigned char	palette_write_index;
-	char		palette_write_subindex;
-
-	int		current_retrace_line;
-	int		input_status_1;
-
-	/*  Palette per scanline during retrace:  */
-	unsigned char	*retrace_palette;
-	int		use_palette_per_line;
-	int64_t		n_is1_reads;
-
-  uint16_t  hend, vend, helast, velast;
-
-	/*  Misc.:  */
-	int		console_handle;
-
-	int		cursor_x;
-	int		cursor_y;
-
-	int		modified;
-	int		palette_modified;
-	int		update_x1;
-	int		update_y1;
-	int		update_x2;
-	int		update_y2;
-
-	/* S3 */
-  int   s3_pio_select;
-  int   s3_src_x, s3_src_y;
-  int   s3_pix_x, s3_pix_y;
-  int   s3_fg_color, s3_bg_color;
-  int   s3_fg_color_mix, s3_bg_color_mix;
-  int   s3_v_dir, s3_h_dir, s3_pixel_bit;
-  bool  s3_y_major, s3_last_pof, s3_no_draw, s3_bit_order;
-  int   s3_rect_width, s3_rect_height;
-  int   s3_curr_x, s3_curr_y;
-  int   s3_dest_x, s3_dest_y;
-  int   s3_current_command;
-  uint32_t s3_pixel_xfer;
-  uint32_t s3_color_compare;
-  uint32_t s3_cursor_address;
-
-  /* BEE8H */
-  uint16_t bee8_regs[16];
-
-  /* Command */
-  int s3_cmd_mx, s3_cmd_bus_size, s3_cmd_swap, s3_cmd_pxtrans;
-  uint8_t s3_color_stack;
-  struct x11_cursor gfx_cursor;
-
-  /* Ext sequencer */
-  bool ext_seq_unlock;
-
-  /* Mapping */
-  bool window_mapped;
-  int window_address;
-  int fifo_in_progress;
-  bool odd_fifo;
-
-  uint32_t plane_read_mask, plane_write_mask;
-  uint32_t adv_fun_4ae8, short_stroke_transfer;
-  uint16_t line_errorterm, line_axial_step, line_diagonal_step;
-
-  uint8_t reg_ff00_data[0x100];
-};
-
-static inline uint16_t get_le_16(bool already, uint64_t idata) {
-  if (already) {
-    return idata;
-  } else {
-    return ((idata >> 8) & 0xff) | ((idata << 8) & 0xff00);
-  }
-}
-
-static inline uint32_t get_le_32(bool already, uint64_t idata) {
-  if (already) {
-    return idata;
-  } else {
-    return get_le_16(false, idata >> 16) | (get_le_16(false, idata) << 16);
-  }
-}
-
-static inline uint32_t get_le_swap(bool already, uint64_t idata, int len) {
-  if (already || len == 1) {
-    return idata;
-  }
-  else if (len == 2) {
-    return (get_le_16(false, idata >> 16) << 16) | get_le_16(false, idata);
-  }
-  else {
-    return get_le_16(false, idata >> 16) | (get_le_16(false, idata) << 16);
-  }
-}
-
-static const char *vga_find_register_prim(int source, int id) {
-  for (int i = 0; r_name_table[i].reg_name; i++) {
-    if (r_name_table[i].source == source && r_name_table[i].reg_index == id) {
-      return r_name_table[i].reg_name;
-    }
-  }
-
-  return nullptr;
-}
-
-static char vga_find_register_name_buf[100];
-static const char *vga_find_register_name(struct vga_data *d, int source, int relative_addr) {
-  const char *result = nullptr;
-  if (source == S_PRIMARY && relative_addr == 0x01) {
-    result = vga_find_register_prim(S_ATT, d->attribute_reg_select);
-    if (result) {
-      return result;
-    }
-  }
-  if (source == S_PRIMARY && relative_addr == 0x05) {
-    if ((d->sequencer_reg[8] & 15) == 6) {
-      result = vga_find_register_prim(S_SEQ2, d->sequencer_reg_select);
-    }
-    if (!result) {
-      result = vga_find_register_prim(S_SEQ, d->sequencer_reg_select);
-    }
-
-    if (result) {
-      return result;
-    }
-  }
-  if (source == S_PRIMARY && relative_addr == 0x0f) {
-    result = vga_find_register_prim(S_GR, d->graphcontr_reg_select);
-    if (result) {
-      return result;
-    }
-  }
-
-  if (source == S_PRIMARY && relative_addr == 0x15) {
-    if (((d->crtc_reg[0x38] & 0xcc) == 0x48) && (d->crtc_reg[0x39] & 1)) {
-      result = vga_find_register_prim(S_CRT2, d->crtc_reg_select);
-    }
-    if (!result) {
-      result = vga_find_register_prim(S_CRTC, d->crtc_reg_select);
-    }
-
-    if (result) {
-      return result;
-    }
-  }
-
-  result = vga_find_register_prim(S_EXTENDED, relative_addr);
-  if (result) {
-    return result;
-  }
-
-  result = vga_find_register_prim(S_PRIMARY, relative_addr);
-  if (result) {
-    return result;
-  }
-
-  sprintf(vga_find_register_name_buf, "vga unknown register %s %x", group_names[source], relative_addr);
-  return vga_find_register_name_buf;
-}
-
-/*
- *  recalc_cursor_position():
- *
- *  Should be called whenever the cursor location _or_ the display
- *  base has been changed.
- */
-static void recalc_cursor_position(struct vga_data *d)
-{
-	int base = (d->crtc_reg[VGA_CRTC_START_ADDR_HIGH] << 8)
-	    + d->crtc_reg[VGA_CRTC_START_ADDR_LOW];
-	int ofs = d->crtc_reg[VGA_CRTC_CURSOR_LOCATION_HIGH] * 256 +
-	    d->crtc_reg[VGA_CRTC_CURSOR_LOCATION_LOW];
-	ofs -= base;
-	d->cursor_x = ofs % d->max_x;
-	d->cursor_y = ofs / d->max_x;
-}
-
-
-/*
- *  register_reset():
- *
- *  Resets many registers to sane values.
- */
-static void register_reset(struct vga_data *d)
-{
-	/*  Home cursor and start at the top:  */
-	d->crtc_reg[VGA_CRTC_CURSOR_LOCATION_HIGH] =
-	    d->crtc_reg[VGA_CRTC_CURSOR_LOCATION_LOW] = 0;
-	d->crtc_reg[VGA_CRTC_START_ADDR_HIGH] =
-	    d->crtc_reg[VGA_CRTC_START_ADDR_LOW] = 0;
-
-	recalc_cursor_position(d);
-
-	/*  Reset cursor scanline stuff:  */
-	d->crtc_reg[VGA_CRTC_CURSOR_SCANLINE_START] = d->font_height - 2;
-	d->crtc_reg[VGA_CRTC_CURSOR_SCANLINE_END] = d->font_height - 1;
-
-	d->sequencer_reg[VGA_SEQ_MAP_MASK] = 0x0f;
-	d->graphcontr_reg[VGA_GRAPHCONTR_MASK] = 0xff;
-
-	d->misc_output_reg = VGA_MISC_OUTPUT_IOAS;
-	d->n_is1_reads = 0;
-
-  d->crtc_reg[0x13] = 0x50;
-  d->crtc_reg[0x51] = 0;
-  d->crtc_reg[0x30] = 0xe1;
-  d->crtc_reg[0x2d] = 0x88;
-  d->crtc_reg[0x2e] = 0x12;
-  // Revision 0x40
-  d->crtc_reg[0x2f] = 0x40;
-  d->crtc_reg[0x36] = 4 << 5; // 2mb
-}
-
-
-static void c_putstr(struct vga_data *d, const char *s)
-{
-	while (*s)
-		console_putchar(d->console_handle, *s++);
-}
-
-
-/*
- *  reset_palette():
- */
-static void reset_palette(struct vga_data *d, int grayscale)
-{
-	int i, r, g, b;
-
-	/*  TODO: default values for entry 16..255?  */
-	for (i=16; i<256; i++)
-		d->fb->rgb_palette[i*3 + 0] = d->fb->rgb_palette[i*3 + 1] =
-		    d->fb->rgb_palette[i*3 + 2] = (i & 15) * 4;
-	d->palette_modified = 1;
-	i = 0;
-
-	if (grayscale) {
-		for (r=0; r<2; r++)
-		    for (g=0; g<2; g++)
-			for (b=0; b<2; b++) {
-				d->fb->rgb_palette[i + 0] =
-				    d->fb->rgb_palette[i + 1] =
-				    d->fb->rgb_palette[i + 2] =
-				    (r+g+b) * 0xaa / 3;
-				d->fb->rgb_palette[i + 8*3 + 0] =
-				    d->fb->rgb_palette[i + 8*3 + 1] =
-				    d->fb->rgb_palette[i + 8*3 + 2] =
-				    (r+g+b) * 0xaa / 3 + 0x55;
-				i+=3;
-			}
-		return;
-	}
-
-	for (r=0; r<2; r++)
-		for (g=0; g<2; g++)
-			for (b=0; b<2; b++) {
-				d->fb->rgb_palette[i + 0] = r * 0xaa;
-				d->fb->rgb_palette[i + 1] = g * 0xaa;
-				d->fb->rgb_palette[i + 2] = b * 0xaa;
-				i+=3;
-			}
-	for (r=0; r<2; r++)
-		for (g=0; g<2; g++)
-			for (b=0; b<2; b++) {
-				d->fb->rgb_palette[i + 0] = r * 0xaa + 0x55;
-				d->fb->rgb_palette[i + 1] = g * 0xaa + 0x55;
-				d->fb->rgb_palette[i + 2] = b * 0xaa + 0x55;
-				i+=3;
-			}
-}
-
-
-/*
- *  vga_update_textmode():
- *
- *  Called from vga_update() when x11 in_use is false. This causes modified
- *  character cells to be "simulated" by outputing ANSI escape sequences
- *  that draw the characters in a terminal window instead.
- */
-static void vga_update_textmode(struct machine *machine,
-	struct vga_data *d, int base, int start, int end)
-{
-	char s[50];
-	int i, oldcolor = -1, printed_last = 0;
-
-	for (i=start; i<=end; i+=2) {
-		unsigned char ch = d->charcells[base+i];
-		int fg = d->charcells[base+i+1] & 15;
-		int bg = (d->charcells[base+i+1] >> 4) & 15;
-			/*  top bit of bg = blink  */
-		int x = (i/2) % d->max_x;
-		int y = (i/2) / d->max_x;
-
-		if (d->charcells[base+i] == d->charcells_outputed[i] &&
-		    d->charcells[base+i+1] == d->charcells_outputed[i+1]) {
-			printed_last = 0;
-			continue;
-		}
-
-		d->charcells_outputed[i] = d->charcells[base+i];
-		d->charcells_outputed[i+1] = d->charcells[base+i+1];
-
-		if (!printed_last || x == 0) {
-			snprintf(s, sizeof(s), "\033[%i;%iH", y + 1, x + 1);
-			c_putstr(d, s);
-		}
-		if (oldcolor < 0 || (bg<<4)+fg != oldcolor || !printed_last) {
-			snprintf(s, sizeof(s), "\033[0;"); c_putstr(d, s);
-
-			switch (fg & 7) {
-			case 0:	c_putstr(d, "30"); break;
-			case 1:	c_putstr(d, "34"); break;
-			case 2:	c_putstr(d, "32"); break;
-			case 3:	c_putstr(d, "36"); break;
-			case 4:	c_putstr(d, "31"); break;
-			case 5:	c_putstr(d, "35"); break;
-			case 6:	c_putstr(d, "33"); break;
-			case 7:	c_putstr(d, "37"); break;
-			}
-			if (fg & 8)
-				c_putstr(d, ";1");
-			c_putstr(d, ";");
-			switch (bg & 7) {
-			case 0:	c_putstr(d, "40"); break;
-			case 1:	c_putstr(d, "44"); break;
-			case 2:	c_putstr(d, "42"); break;
-			case 3:	c_putstr(d, "46"); break;
-			case 4:	c_putstr(d, "41"); break;
-			case 5:	c_putstr(d, "45"); break;
-			case 6:	c_putstr(d, "43"); break;
-			case 7:	c_putstr(d, "47"); break;
-			}
-			/*  TODO: blink  */
-			c_putstr(d, "m");
-		}
-
-		if (ch >= 0x20 && ch != 127)
-			console_putchar(d->console_handle, ch);
-
-		oldcolor = (bg << 4) + fg;
-		printed_last = 1;
-	}
-
-	/*  Restore the terminal's cursor position:  */
-	snprintf(s, sizeof(s), "\033[%i;%iH", d->cursor_y + 1, d->cursor_x + 1);
-	c_putstr(d, s);
-}
-
-
-static void update_cursor(struct machine *machine, struct vga_data *d)
-{
-  uint16_t origin_x = ((d->crtc_reg[VGA_CRTC_HARDWARE_GRAPHICS_CURSOR_ORIGIN_X_HIGH] & 15) << 8) | d->crtc_reg[VGA_CRTC_HARDWARE_GRAPHICS_CURSOR_ORIGIN_X_LOW];
-  uint16_t origin_y = ((d->crtc_reg[VGA_CRTC_HARDWARE_GRAPHICS_CURSOR_ORIGIN_Y_HIGH] & 15) << 8) | d->crtc_reg[VGA_CRTC_HARDWARE_GRAPHICS_CURSOR_ORIGIN_Y_LOW];
-  d->gfx_cursor.on = d->crtc_reg[VGA_CRTC_HARDWARE_GRAPHICS_CURSOR_MODE] & 1;
-  d->gfx_cursor.render_x = origin_x;
-  d->gfx_cursor.render_y = origin_y;
-  x11_update_cursor
-    (d->fb->fb_window,
-     1,
-     d->gfx_cursor.on,
-     d->gfx_cursor.render_x,
-     d->gfx_cursor.render_y
-     );
-}
-
-
-/*
- * Fill in gfx_cursor from the data we have and update it in the display system.
- *
- * Based on whether windows or x11 mode is set, change the transparent and inverse colors in
- * the palette.
- *
- * Read the bit masks and compose the cursor image.
- *
- * Set the center of the cursor image.
- */
-static void compose_cursor(struct machine *machine, struct vga_data *d)
-{
-  bool x11_mode = !!(d->crtc_reg[VGA_CRTC_EXTENDED_RAMDAC_CONTROL] & 0x10);
-  auto alpha_mask = 0xff000000;
-  if (x11_mode) {
-    d->gfx_cursor.palette[0] &= ~alpha_mask;
-    d->gfx_cursor.palette[1] &= ~alpha_mask;
-    d->gfx_cursor.palette[2] |= alpha_mask;
-    d->gfx_cursor.palette[3] |= alpha_mask;
-    d->gfx_cursor.invert_color = -1;
-  } else { // windows
-    d->gfx_cursor.palette[2] &= ~alpha_mask;
-    d->gfx_cursor.palette[3] &= ~alpha_mask;
-    d->gfx_cursor.palette[0] |= alpha_mask;
-    d->gfx_cursor.palette[1] |= alpha_mask;
-    d->gfx_cursor.invert_color = 3;
-  }
-
-  for (int y = 0; y < 64; y++) {
-    uint32_t row = d->s3_cursor_address + 16 * y;
-    for (int x = 0; x < 64; x++) {
-      uint8_t word_pair = x >> 4;
-      uint8_t byte_off = (x >> 3) & 1;
-      uint8_t byte_0 = d->gfx_mem[row + word_pair * 4 + byte_off];
-      uint8_t byte_1 = d->gfx_mem[row + word_pair * 4 + 2 + byte_off];
-      uint8_t mask = 1 << (7 - (x & 7));
-      uint8_t color = (!!(byte_0 & mask) << 1) | !!(byte_1 & mask);
-      d->gfx_cursor.data[y * 64 + x] = color;
-    }
-  }
-
-  x11_set_cursor_data(d->fb->fb_window, 1, d->gfx_cursor);
-  update_cursor(machine, d);
-}
-
-
-/*
- *  vga_update_graphics():
- *
- *  This function should be called whenever any part of d->gfx_mem[] has
- *  been written to. It will redraw all pixels within the range x1,y1
- *  .. x2,y2 using the right palette.
- */
-static void vga_update_graphics(struct machine *machine, struct vga_data *d,
-	int x1, int y1, int x2, int y2)
-{
-	int x, y, ix, iy, c, rx = d->pixel_repx, ry = d->pixel_repy;
-	unsigned char pixel[3];
-
-  auto logical_width_high = (d->crtc_reg[0x51] >> 4) & 3;
-  auto logical_width = (d->crtc_reg[0x13] + (logical_width_high << 8)) * 8;
-
-	for (y=y1; y<=y2; y++) {
-		for (x=x1; x<=x2; x++) {
-			/*  addr is where to read from VGA memory, addr2 is
-			    where to write on the 24-bit framebuffer device  */
-			int addr = (y * logical_width + x) * d->bits_per_pixel;
-      addr += (d->crtc_reg[0x51] & 0xc) << 16;
-      addr += (d->crtc_reg[0x35] & 0xf) << 14;
-			switch (d->bits_per_pixel) {
-			case 8:	addr >>= 3;
-				if (addr >= d->gfx_mem_size) {
-					break;
-				}
-				c = d->gfx_mem[addr];
-				pixel[0] = d->fb->rgb_palette[c*3+0];
-				pixel[1] = d->fb->rgb_palette[c*3+1];
-				pixel[2] = d->fb->rgb_palette[c*3+2];
-				break;
-			case 4:	addr >>= 2;
-				if (addr >> 1 >= d->gfx_mem_size) {
-					break;
-				}
-				if (addr & 1)
-					c = d->gfx_mem[addr >> 1] >> 4;
-				else
-					c = d->gfx_mem[addr >> 1] & 0xf;
-				pixel[0] = d->fb->rgb_palette[c*3+0];
-				pixel[1] = d->fb->rgb_palette[c*3+1];
-				pixel[2] = d->fb->rgb_palette[c*3+2];
-				break;
-			}
-
-      for (iy=y*ry; iy<(y+1)*ry; iy++) {
-        for (ix=x*rx; ix<(x+1)*rx; ix++) {
-          uint32_t addr2 = (d->fb_max_x * iy
-                            + ix) * 3;
-          if (addr2 < d->fb_size)
-            dev_fb_access(machine->cpus[0],
-                          machine->memory, addr2,
-                          pixel, sizeof(pixel),
-                          MEM_WRITE, d->fb);
-        }
-      }
-    }
-  }
-}
-
-
-/*
- *  vga_update_text():
- *
- *  This function should be called whenever any part of d->charcells[] has
- *  been written to. It will redraw all characters within the range x1,y1
- *  .. x2,y2 using the right palette.
- */
-static void vga_update_text(struct machine *machine, struct vga_data *d,
-	int x1, int y1, int x2, int y2)
-{
-	int fg, bg, x,y, subx, line;
-	size_t i, start, end, base;
-	int font_size = d->font_height;
-	int font_width = d->font_width;
-	unsigned char *pal = d->fb->rgb_palette;
-
-	if (d->pixel_repx * font_width > 8*8) {
-		fatal("[ too large font ]\n");
-		return;
-	}
-
-	/*  Hm... I'm still using the old start..end code:  */
-	start = (d->max_x * y1 + x1) * 2;
-	end   = (d->max_x * y2 + x2) * 2;
-
-	start &= ~1;
-	end |= 1;
-
-	if (end >= d->charcells_size)
-		end = d->charcells_size - 1;
-
-	base = ((d->crtc_reg[VGA_CRTC_START_ADDR_HIGH] << 8)
-          + d->crtc_reg[VGA_CRTC_START_ADDR_LOW]) * 2;
-
-	if (!machine->x11_md.in_use)
-		vga_update_textmode(machine, d, base, start, end);
-
-	for (i=start; i<=end; i+=2) {
-		unsigned char ch = d->charcells[i + base];
-
-		if (!d->palette_modified && d->charcells_drawn[i] == ch &&
-		    d->charcells_drawn[i+1] == d->charcells[i+base+1])
-			continue;
-
-		d->charcells_drawn[i] = ch;
-		d->charcells_drawn[i+1] = d->charcells[i + base + 1];
-
-		fg = d->charcells[i+base + 1] & 15;
-		bg = (d->charcells[i+base + 1] >> 4) & 7;
-
-		/*  Blink is hard to do :-), but inversion might be ok too:  */
-		if (d->charcells[i+base + 1] & 128) {
-			int tmp = fg; fg = bg; bg = tmp;
-		}
-
-		x = (i/2) % d->max_x; x *= font_width;
-		y = (i/2) / d->max_x; y *= font_size;
-
-		/*  Draw the character:  */
-		for (line = 0; line < font_size; line++) {
-			/*  hardcoded for max 8 scaleup... :-)  */
-			unsigned char rgb_line[3 * 8 * 8];
-			int iy;
-
-			for (subx = 0; subx < font_width; subx++) {
-				int ix, color_index;
-
-				if (d->use_palette_per_line) {
-					int sline = d->pixel_repy * (line+y);
-					if (sline < MAX_RETRACE_SCANLINES)
-						pal = d->retrace_palette
-						    + sline * 256*3;
-					else
-						pal = d->fb->rgb_palette;
-				}
-
-				if (d->font[ch * font_size + line] &
-				    (128 >> subx))
-					color_index = fg;
-				else
-					color_index = bg;
-
-				for (ix=0; ix<d->pixel_repx; ix++)
-					memcpy(rgb_line + (subx*d->pixel_repx +
-					    ix) * 3, &pal[color_index * 3], 3);
-			}
-
-			for (iy=0; iy<d->pixel_repy; iy++) {
-				uint32_t addr = (d->fb_max_x * (d->pixel_repy *
-				    (line+y) + iy) + x * d->pixel_repx) * 3;
-				if (addr >= d->fb_size)
-					continue;
-				dev_fb_access(machine->cpus[0],
-				    machine->memory, addr, rgb_line,
-				    3 * machine->x11_md.scaleup * font_width,
-				    MEM_WRITE, d->fb);
-			}
-		}
-	}
-}
-
-
-/*
- *  vga_update_cursor():
- */
-static void vga_update_cursor(struct machine *machine, struct vga_data *d)
-{
-	int onoff = 1, height = d->crtc_reg[VGA_CRTC_CURSOR_SCANLINE_END]
-	    - d->crtc_reg[VGA_CRTC_CURSOR_SCANLINE_START] + 1;
-
-	if (d->cur_mode != MODE_CHARCELL)
-		onoff = 0;
-
-	if (d->crtc_reg[VGA_CRTC_CURSOR_SCANLINE_START] >
-	    d->crtc_reg[VGA_CRTC_CURSOR_SCANLINE_END]) {
-		onoff = 0;
-		height = 1;
-	}
-
-	if (d->crtc_reg[VGA_CRTC_CURSOR_SCANLINE_START] >= d->font_height)
-		onoff = 0;
-
-  x11_update_cursor(d->fb->fb_window, 0, onoff, d->cursor_x * d->font_width, d->cursor_y * d->font_height + d->crtc_reg[VGA_CRTC_CURSOR_SCANLINE_START]);
-}
-
-
-DEVICE_TICK(s3)
-{
-	struct vga_data *d = (struct vga_data *) extra;
-	int64_t low = -1, high;
-
-  auto logical_width_high = (d->crtc_reg[0x51] >> 4) & 3;
-  auto logical_width = (d->crtc_reg[0x13] + (logical_width_high << 8)) * 8;
-
-  if (d->hend != d->helast || d->vend != d->velast) {
-    d->helast = d->hend;
-    d->velast = d->vend;
-    d->fb_max_x = d->helast;
-    d->fb_max_y = d->velast;
-    dev_fb_resize(d->fb, d->helast, d->velast);
-    d->fb_size = d->fb_max_x * d->fb_max_y * 3;
-    vga_update_graphics(cpu->machine, d, 0, 0, d->helast, d->velast);
-  }
-
-	vga_update_cursor(cpu->machine, d);
-
-	/*  TODO: text vs graphics tick?  */
-	memory_device_dyntrans_access(cpu, cpu->mem, extra,
-	    (uint64_t *) &low, (uint64_t *) &high);
-
-	if (low != -1) {
-		int base = ((d->crtc_reg[VGA_CRTC_START_ADDR_HIGH] << 8)
-		    + d->crtc_reg[VGA_CRTC_START_ADDR_LOW]) * 2;
-		int new_u_y1, new_u_y2;
-		debug("[ dev_vga_tick: dyntrans access, %" PRIx64" .. %"
-		    PRIx64" ]\n", (uint64_t) low, (uint64_t) high);
-		low -= base;
-		high -= base;
-		d->update_x1 = 0;
-		d->update_x2 = d->max_x - 1;
-		new_u_y1 = (low/2) / logical_width;
-		new_u_y2 = ((high/2) / logical_width) + 1;
-		if (new_u_y1 < d->update_y1)
-			d->update_y1 = new_u_y1;
-		if (new_u_y2 > d->update_y2)
-			d->update_y2 = new_u_y2;
-		if (d->update_y1 < 0)
-			d->update_y1 = 0;
-		if (d->update_y2 >= d->max_y)
-			d->update_y2 = d->max_y - 1;
-		d->modified = 1;
-	}
-
-	if (d->n_is1_reads > N_IS1_READ_THRESHOLD &&
-	    d->retrace_palette != NULL) {
-		d->use_palette_per_line = 1;
-		d->update_x1 = 0;
-		d->update_x2 = d->max_x - 1;
-		d->update_y1 = 0;
-		d->update_y2 = d->max_y - 1;
-		d->modified = 1;
-	} else {
-		if (d->use_palette_per_line) {
-			d->use_palette_per_line = 0;
-			d->update_x1 = 0;
-			d->update_x2 = d->max_x - 1;
-			d->update_y1 = 0;
-			d->update_y2 = d->max_y - 1;
-			d->modified = 1;
-		}
-	}
-
-	if (!cpu->machine->x11_md.in_use) {
-		/*  NOTE: 2 > 0, so this only updates the cursor, no
-		    character cells.  */
-		vga_update_textmode(cpu->machine, d, 0, 2, 0);
-	}
-
-	if (d->modified) {
-		if (d->cur_mode == MODE_CHARCELL)
-			vga_update_text(cpu->machine, d, d->update_x1,
-			    d->update_y1, d->update_x2, d->update_y2);
-		else
-			vga_update_graphics(cpu->machine, d, d->update_x1,
-                          d->update_y1, d->update_x2, d->update_y2);
-
-		d->palette_modified = 0;
-		d->modified = 0;
-		d->update_x1 = 0;
-		d->update_y1 = 0;
-		d->update_x2 = d->fb_max_x;
-		d->update_y2 = d->fb_max_y;
-	}
-
-	if (d->n_is1_reads > N_IS1_READ_THRESHOLD)
-		d->n_is1_reads = 0;
-}
-
-/*
- *  Reads and writes to the VGA video memory (pixels).
- */
-DEVICE_ACCESS(s3_graphics)
-{
-	struct vga_data *d = (struct vga_data *) extra;
-	int j, x=0, y=0, x2=0, y2=0, modified = 0;
-	size_t i;
-
-  // fprintf(stderr, "@@@%08x", relative_addr);
-  for (int ii = 0; ii < len; ii++) {
-    // fprintf(stderr, " %02x", data[ii]);
-  }
-  // fprintf(stderr, "\n");
-
-	// L(fprintf(stderr, "VGA: mode %d gfx %d relative_addr %08" PRIx64" len %08" PRIx64"\n", d->cur_mode, d->graphics_mode, relative_addr, len));
-
-  //                 0x38000000
-  if (relative_addr >= 0x10a0000) {
-    fprintf(stderr, "Access S3d register %04lx\n", relative_addr - 0x10a0000);
-    return 0;
-  }
-  if (relative_addr >= 0x1008000) {
-    uint8_t data_copy[8];
-    if (d->window_mapped) {
-      for (i = 0; i < len; i++) {
-        data_copy[len - i - 1] = data[i];
-      }
-    } else {
-      memcpy(data_copy, data, len);
-    }
-    bool result = cpu->memory_rw(cpu, cpu->mem, VIRTUAL_ISA_PORTBASE + 0x80000000 + relative_addr - 0x1000000, data_copy, len, writeflag, PHYSICAL) == MEMORY_ACCESS_OK;
-    L(fprintf(stderr, "[ vga: windowed, io address %s relative_addr %04lx", writeflag == MEM_WRITE ? "write" : "read", relative_addr));
-    for (i = 0; i < len; i++) {
-      L(fprintf(stderr, " %02x", data_copy[i]));
-    }
-    L(fprintf(stderr, " ]\n"));
-    if (d->window_mapped && relative_addr != 0x1009ae8) {
-      for (i = 0; i < len; i++) {
-        data[len - i - 1] = data_copy[i];
-      }
-    } else {
-      memcpy(data, data_copy, len);
-    }
-    return result;
-  }
-  if (relative_addr >= 0x1000000) {
-    // fprintf(stderr, "[ vga: windowed, pixel transfer? ]\n", relative_addr);
-    int size = len;
-    while (size > 0) {
-      bool result = cpu->memory_rw(cpu, cpu->mem, VIRTUAL_ISA_PORTBASE + 0x80000000 + 0xe2e8, data, std::min(2, size), writeflag, PHYSICAL) == MEMORY_ACCESS_OK;
-      if (!result) {
-        return 0;
-      }
-      data += 2;
-      size -= 2;
-    }
-    return 1;
-  }
-
-  auto logical_width_high = (d->crtc_reg[0x51] >> 4) & 3;
-  auto logical_width = (d->crtc_reg[0x13] + (logical_width_high << 8)) * 8;
-
-	if (relative_addr + len >= d->gfx_mem_size) {
-    fprintf(stderr, "[ vga: failed access at %08lx+%lx greater than %08x ]\n", relative_addr, len, d->gfx_mem_size);
-		return 0;
-  }
-
-	if (d->cur_mode != MODE_GRAPHICS)
-		return 1;
-
-	switch (d->graphics_mode) {
-	case GRAPHICS_MODE_8BIT:
-		y = relative_addr / logical_width;
-		x = relative_addr % logical_width;
-		y2 = (relative_addr+len-1) / logical_width;
-		x2 = (relative_addr+len-1) % logical_width;
-
-		if (writeflag == MEM_WRITE) {
-			memcpy(d->gfx_mem + relative_addr, data, len);
-      if (d->crtc_reg[VGA_CRTC_HARDWARE_GRAPHICS_CURSOR_MODE] && ((relative_addr >> 10) == (d->s3_cursor_address >> 10))) {
-        compose_cursor(cpu->machine, d);
-      }
-			modified = 1;
-		} else
-			memcpy(data, d->gfx_mem + relative_addr, len);
-		break;
-	case GRAPHICS_MODE_4BIT:
-		y = relative_addr * 8 / d->max_x;
-		x = relative_addr * 8 % d->max_x;
-		y2 = ((relative_addr+len)*8-1) / d->max_x;
-		x2 = ((relative_addr+len)*8-1) % d->max_x;
-		/*  TODO: color stuff  */
-
-		/*  Read/write d->gfx_mem in 4-bit color:  */
-		if (writeflag == MEM_WRITE) {
-			/*  i is byte index to write, j is bit index  */
-			for (i=0; i<len; i++)
-				for (j=0; j<8; j++) {
-					int pixelmask = 1 << (7-j);
-					int b = data[i] & pixelmask;
-					int m = d->sequencer_reg[
-					    VGA_SEQ_MAP_MASK] & 0x0f;
-					uint32_t addr = (y * d->max_x + x +
-					    i*8 + j) * d->bits_per_pixel / 8;
-					unsigned char byte;
-					if (!(d->graphcontr_reg[
-					    VGA_GRAPHCONTR_MASK] & pixelmask))
-						continue;
-					if (addr >= d->gfx_mem_size)
-						continue;
-					byte = d->gfx_mem[addr];
-					if (b && j&1)
-						byte |= m << 4;
-					if (b && !(j&1))
-						byte |= m;
-					if (!b && j&1)
-						byte &= ~(m << 4);
-					if (!b && !(j&1))
-						byte &= ~m;
-					d->gfx_mem[addr] = byte;
-				}
-			modified = 1;
-		} else {
-			fatal("TODO: 4 bit graphics read, mask=0x%02x\n",
-			    d->sequencer_reg[VGA_SEQ_MAP_MASK]);
-			for (i=0; i<len; i++)
-				data[i] = random();
-		}
-		break;
-	default:fatal("dev_vga: Unimplemented graphics mode %i\n",
-		    d->graphics_mode);
-		/*cpu->running = 0;*/
-	}
-
-	if (modified) {
-		d->modified = 1;
-		if (x < d->update_x1)  d->update_x1 = x;
-		if (x > d->update_x2)  d->update_x2 = x;
-		if (y < d->update_y1)  d->update_y1 = y;
-		if (y > d->update_y2)  d->update_y2 = y;
-		if (x2 < d->update_x1)  d->update_x1 = x2;
-		if (x2 > d->update_x2)  d->update_x2 = x2;
-		if (y2 < d->update_y1)  d->update_y1 = y2;
-		if (y2 > d->update_y2)  d->update_y2 = y2;
-		if (y != y2) {
-			d->update_x1 = 0;
-			d->update_x2 = d->max_x - 1;
-		}
-	}
-	return 1;
-}
-
-
-/*
- *  Reads and writes the VGA video memory (charcells).
- */
-DEVICE_ACCESS(s3)
-{
-	struct vga_data *d = (struct vga_data *) extra;
-	uint64_t idata = 0, odata = 0;
-	int x, y, x2, y2, r, base;
-	size_t i;
-
-  auto logical_width_high = (d->crtc_reg[0x51] >> 4) & 3;
-  auto logical_width = (d->crtc_reg[0x13] + (logical_width_high << 8)) * 8;
-
-	if (writeflag == MEM_WRITE)
-		idata = memory_readmax64(cpu, data, len);
-
-	base = ((d->crtc_reg[VGA_CRTC_START_ADDR_HIGH] << 8)
-	    + d->crtc_reg[VGA_CRTC_START_ADDR_LOW]) * 2;
-	r = relative_addr - base;
-	y = r / (logical_width * 2);
-	x = (r/2) % logical_width;
-	y2 = (r+len-1) / (logical_width * 2);
-	x2 = ((r+len-1)/2) % logical_width;
-
-	if (relative_addr + len - 1 < d->charcells_size) {
-		if (writeflag == MEM_WRITE) {
-			for (i=0; i<len; i++) {
-				int old = d->charcells[relative_addr + i];
-				if (old != data[i]) {
-					d->charcells[relative_addr + i] =
-					    data[i];
-					d->modified = 1;
-				}
-			}
-
-			if (d->modified) {
-				if (x < d->update_x1)  d->update_x1 = x;
-				if (x > d->update_x2)  d->update_x2 = x;
-				if (y < d->update_y1)  d->update_y1 = y;
-				if (y > d->update_y2)  d->update_y2 = y;
-				if (x2 < d->update_x1)  d->update_x1 = x2;
-				if (x2 > d->update_x2)  d->update_x2 = x2;
-				if (y2 < d->update_y1)  d->update_y1 = y2;
-				if (y2 > d->update_y2)  d->update_y2 = y2;
-
-				if (y != y2) {
-					d->update_x1 = 0;
-					d->update_x2 = d->max_x - 1;
-				}
-			}
-		} else
-			memcpy(data, d->charcells + relative_addr, len);
-		return 1;
-	}
-
-	switch (relative_addr) {
-	default:
-		if (writeflag==MEM_READ) {
-			debug("[ vga: read from 0x%08lx ]\n",
-			    (long)relative_addr);
-		} else {
-			debug("[ vga: write to  0x%08lx: 0x%08x ]\n",
-			    (long)relative_addr, idata);
-		}
-	}
-
-	if (writeflag == MEM_READ)
-		memory_writemax64(cpu, data, len, odata);
-
-	return 1;
-}
-
-
-void s3_hack_start(struct machine *machine, struct vga_data *d) {
-  d->cur_mode = MODE_GRAPHICS;
-  d->max_x = d->hend = d->helast =
-    machine->machine_subtype == MACHINE_PREP_IBM860 ? 1024 : 800;
-  d->max_y = d->vend = d->velast =
-    machine->machine_subtype == MACHINE_PREP_IBM860 ? 768 : 600;
-  d->graphics_mode = GRAPHICS_MODE_8BIT;
-  d->bits_per_pixel = 8;
-  d->pixel_repx = d->pixel_repy = 1;
-
-  d->gfx_mem_size = 2 * 1024 * 1024; /*d->max_x * d->max_y /
-                                       (d->graphics_mode == GRAPHICS_MODE_8BIT? 1 : 2);*/
-
-  CHECK_ALLOCATION(d->gfx_mem = (unsigned char *) malloc(d->gfx_mem_size));
-}
-
-static inline uint32_t pixtrans_lane_u32(uint32_t pixel_xfer, uint8_t bus_size, uint32_t lane)
-{
-  // bus_size: 0=8-bit, 1=16-bit, >=2=32-bit
-  int bs = (bus_size >= 2) ? 2 : bus_size;
-  const uint32_t lanes = 1u << bs;           // 1, 2, 4
-  lane &= (lanes - 1);
-
-  return (pixel_xfer >> (lane * 8)) & 0xff;
-}
-
-static inline uint32_t s3_color_mix(uint8_t mix_mode, uint32_t src, uint32_t dst)
-{
-  switch (mix_mode)
-  {
-    case 0x00: return ~dst;
-    case 0x01: return 0;
-    case 0x02: return ~0;
-    case 0x03: return dst;
-    case 0x04: return ~src;
-    case 0x05: return src ^ dst;
-    case 0x06: return ~(src ^ dst);
-    case 0x07: return src;
-    case 0x08: return ~(src & dst);
-    case 0x09: return (~src) | dst;
-    case 0x0a: return src | (~dst);
-    case 0x0b: return src | dst;
-    case 0x0c: return src & dst;
-    case 0x0d: return src & (~dst);
-    case 0x0e: return (~src) & dst;
-    case 0x0f: return ~(src | dst);
-    default:   return src;            // shouldn't reach here
-  }
-}
-
-void s3_do_pixel(cpu* cpu, struct vga_data* d, bool use_fgmix)
-{
-  uint32_t lane;
-  int nowrite = 0;
-  auto logical_width_high = (d->crtc_reg[0x51] >> 4) & 3;
-  auto logical_width = (d->crtc_reg[0x13] + (logical_width_high << 8)) * 8;
-
-  uint64_t source = ((d->s3_src_y * logical_width) + d->s3_src_x) % d->gfx_mem_size;
-  uint64_t target = ((d->s3_pix_y * logical_width) + d->s3_pix_x) % d->gfx_mem_size;
-
-  // Step 1: Clipping — derive actual pixel coordinates for the scissors test.
-  nowrite = ((d->s3_pix_y < d->bee8_regs[1])||
-             (d->s3_pix_y > d->bee8_regs[3])||
-             (d->s3_pix_x < d->bee8_regs[2])||
-             (d->s3_pix_x > d->bee8_regs[4]));
-
-  // Step 2: Select source color and mix mode
-  uint16_t mix_reg = use_fgmix ? d->s3_fg_color_mix : d->s3_bg_color_mix;
-  uint8_t sel = (mix_reg >> 5) & 3;                  // bits 6-5: CLR-SRC
-  uint8_t mix_mode = mix_reg & 0x0f;                 // bits 3-0: MIX type
-  uint32_t src_dat = 0, dst_dat = 0;
-
-  switch (sel)
-  {
-    case 0: // Background Color register
-      src_dat = d->s3_bg_color;
-      break;
-    case 1: // Foreground Color register
-      src_dat = d->s3_fg_color;
-      break;
-    case 2: // CPU data (pixel transfer register)
-      lane = (d->s3_pix_x >= d->s3_curr_x) ? (d->s3_pix_x - d->s3_curr_x) : (d->s3_curr_x - d->s3_pix_x);
-      src_dat = pixtrans_lane_u32(d->s3_pixel_xfer, d->s3_cmd_bus_size, lane);
-      break;
-    case 3: // Display memory (VRAM at source coords)
-      src_dat = d->gfx_mem[source];
-      break;
-  }
-
-  // Step 3: Read destination
-  dst_dat = d->gfx_mem[target];
-
-  // Step 4: Color Compare gate
-  if (d->bee8_regs[0xe] & 0x100)
-  {
-    auto src_ne = d->bee8_regs[0xe] & 0x80;
-    bool match = (src_dat == d->s3_color_compare);
-    // SRC NE = 0: write only when source != compare (skip when match)
-    // SRC NE = 1: write only when source == compare (skip when no match)
-    if (src_ne ? !match : match) nowrite = 1; // color compare rejects this pixel
-  }
-
-  // Step 5: Apply MIX
-  uint32_t pixel = s3_color_mix(mix_mode, src_dat, dst_dat);
-
-  // Step 6: Write Mask merge
-  uint32_t wrt_mask = d->plane_write_mask;
-  pixel = (pixel & wrt_mask) | (dst_dat & ~wrt_mask);
-
-  // Step 7: Write to VRAM
-  if (!nowrite) d->gfx_mem[target] = pixel;
-}
-
-static inline void s3_write_fg(cpu* cpu, struct vga_data* d)
-{
-  s3_do_pixel(cpu, d, true);
-}
-
-static inline void s3_write_bg(cpu* cpu, struct vga_data* d)
-{
-  s3_do_pixel(cpu, d, false);
-}
-  
-void s3_pixel_write(cpu* cpu, struct vga_data* d)
-{
-  int data_size = 8;
-  uint32_t xfer;
-
-  auto logical_width_high = (d->crtc_reg[0x51] >> 4) & 3;
-  auto logical_width = (d->crtc_reg[0x13] + (logical_width_high << 8)) * 8;
-  uint64_t source = ((d->s3_src_y * logical_width) + d->s3_src_x) % d->gfx_mem_size;
-
-  switch (d->bee8_regs[0xa] & 0x00c0)
-  {
-    case 0x0000:  // Foreground Mix only
-      s3_write_fg(cpu, d);
-      break;
-    case 0x0040:  // fixed pattern (?)
-      // TODO
-      break;
-    case 0x0080:  // use pixel transfer register
-      if (d->s3_cmd_bus_size == 0)  // 8-bit
-        data_size = 8;
-      if (d->s3_cmd_bus_size == 1)  // 16-bit
-        data_size = 16;
-      if (d->s3_cmd_bus_size >= 2)  // 32-bit
-        data_size = 32;
-      xfer = d->s3_pixel_xfer;
-      if (d->s3_cmd_swap && (data_size != 8)) {
-        if (data_size == 16) {
-          xfer = ((xfer & 0x00ff) << 8) | ((xfer & 0xff00) >> 8);
-        }
-      else if (data_size == 32) {
-        xfer = ((xfer & 0x000000ff) << 24) |
-                ((xfer & 0x0000ff00) << 8) |
-                ((xfer & 0x00ff0000) >> 8) |
-                ((xfer & 0xff000000) >> 24);
-        }
-      }
-      if (d->s3_cmd_mx)
-      {
-        // Mono expand: bit order depends on CMD bit 3 (0x0008).
-        //  - 0x0008 clear: MSB-first
-        //  - 0x0008 set:   LSB-first
-        uint32_t bitpos;
-        if (d->s3_bit_order) {
-          bitpos = d->s3_pixel_bit;                     // LSB-first
-        }
-        else {
-          bitpos = (data_size - 1u) - d->s3_pixel_bit;  // MSB-first
-        }
-        const uint32_t mask = 1u << bitpos;
-        if (xfer & mask)
-          s3_write_fg(cpu, d);
-        else
-          s3_write_bg(cpu, d);
-      }
-      else
-      {
-        s3_write_fg(cpu, d);
-      }
-      d->s3_pixel_bit++;
-      if (d->s3_pixel_bit >= data_size)
-        d->s3_pixel_bit = 0;
-      break;
-    case 0x00c0:  // use source plane
-    {
-      uint32_t srcpix = d->gfx_mem[source];
-      // In Mix Select==11 mode the source plane (VRAM) selects between FG/BG mix.
-      // The Read Mask register chooses which bit(s) in the source byte are examined.
-      uint32_t readmask = d->plane_read_mask; // foreground only when all bits are set
-	  const bool use_fg = ((srcpix & readmask) == readmask); // always true if readmask = 0
-      if (use_fg) s3_write_fg(cpu, d);
-      else        s3_write_bg(cpu, d);
-      break;
-    }
-  }
-}
-
-void bitblt(cpu *cpu, struct vga_data *d) {
-  int rectangle_height = d->bee8_regs[0];
-  int clipping_top = d->bee8_regs[1];
-  int clipping_left = d->bee8_regs[2];
-  int clipping_bottom = d->bee8_regs[3];
-  int clipping_right = d->bee8_regs[4];
-  int width = d->s3_rect_width;
-  int rows = d->s3_rect_height;
-
-  d->s3_src_y = d->s3_curr_y;
-  d->s3_pix_y = d->s3_dest_y;
-
-  auto logical_width_high = (d->crtc_reg[0x51] >> 4) & 3;
-  auto logical_width = (d->crtc_reg[0x13] + (logical_width_high << 8)) * 8;
-
-  L(fprintf(stderr, "[ s3: bitblt x=%d-%d y=%d-%d ]\n", d->s3_curr_x, d->s3_curr_y, d->s3_dest_x, d->s3_dest_y));
-  
-  for (int y = 0; y <= rows; y++)
-  {
-    d->s3_src_x = d->s3_curr_x;
-    d->s3_pix_x = d->s3_dest_x;
-    for (int x = 0; x <= width; x++)
-    {
-      s3_pixel_write(cpu, d);
-      d->s3_src_x += d->s3_h_dir;
-      d->s3_pix_x += d->s3_h_dir;
-    }
-    d->s3_pixel_bit = 0;
-    d->s3_src_y += d->s3_v_dir;
-    d->s3_pix_y += d->s3_v_dir;
-  }
-}
-
-
-void patblt(cpu* cpu, struct vga_data* d) {
-  int rectangle_height = d->bee8_regs[0];
-  int clipping_top = d->bee8_regs[1];
-  int clipping_left = d->bee8_regs[2];
-  int clipping_bottom = d->bee8_regs[3];
-  int clipping_right = d->bee8_regs[4];
-  auto height = d->s3_rect_height;
-  auto width = d->s3_rect_width;
-
-  d->s3_pix_x = d->s3_dest_x;
-  d->s3_pix_y = d->s3_dest_y;
-  auto start_x = d->s3_curr_x;
-  auto start_y = d->s3_curr_y;
-  auto pattern_x = d->s3_dest_x & 7;
-  auto pattern_y = d->s3_dest_y & 7;
-
-  L(fprintf(stderr, "[ s3: patblt x=%d-%d y=%d-%d ]\n", d->s3_curr_x, d->s3_curr_y, d->s3_dest_x, d->s3_dest_y));
-  
-  for (int y = 0; y <= height; y++)
-  {
-    for (int x = 0; x <= width; x++)
-    {
-      d->s3_src_x = start_x + pattern_x;
-      d->s3_src_y = start_y + pattern_y;
-      s3_pixel_write(cpu, d);
-      d->s3_pix_x += d->s3_h_dir;
-      pattern_x = (pattern_x + d->s3_h_dir) & 7;
-    }
-    d->s3_pixel_bit = 0;
-    d->s3_pix_x = d->s3_dest_x;
-    d->s3_pix_y += d->s3_v_dir;
-    pattern_x = d->s3_dest_x & 7;
-    pattern_y = (pattern_y + d->s3_v_dir) & 7;
-  }
-
-  d->s3_curr_x = start_x;
-  d->s3_curr_y = start_y;
-}
-
-
-void fillrect(cpu *cpu, struct vga_data *d, uint16_t command) {
-  int height = d->s3_rect_height;
-  int width = d->s3_rect_width;
-  auto start_x = d->s3_curr_x;
-  auto start_y = d->s3_curr_y;
-
-  if (command & 0x10) {
-    // Actually draw
-    d->s3_src_x = d->s3_curr_x;
-    d->s3_pix_x = d->s3_curr_x;
-    d->s3_src_y = d->s3_curr_y;
-    d->s3_pix_y = d->s3_curr_y;
-
-    for (int y = 0; y <= height; y++)
-    {
-      for (int x = 0; x <= width; x++)
-      {
-        s3_pixel_write(cpu, d);
-        d->s3_src_x += d->s3_h_dir;
-        d->s3_pix_x += d->s3_h_dir;
-      }
-      d->s3_pixel_bit = 0;
-      d->s3_src_y += d->s3_v_dir;
-      d->s3_pix_y += d->s3_v_dir;
-      d->s3_src_x = d->s3_curr_x;
-      d->s3_pix_x = d->s3_curr_x;
-    }
-
-    d->s3_curr_x = d->s3_src_x;
-    d->s3_curr_y = d->s3_src_y;
-  }
-}
-
-void linedraw(cpu *cpu, struct vga_data *d, uint16_t command) {
-  int height = d->s3_rect_height;
-  int width = d->s3_rect_width;
-  auto start_x = d->s3_curr_x;
-  auto start_y = d->s3_curr_y;
-
-  d->s3_src_x = d->s3_curr_x;
-  d->s3_pix_x = d->s3_curr_x;
-  d->s3_src_y = d->s3_curr_y;
-  d->s3_pix_y = d->s3_curr_y;
-
-  if (command & 0x0008) 
-  {
-    uint32_t offset;
-    int x = 0;
-    bool last_pxof = (command & 0x04) != 0;  // CMD bit 2
-
-    while (x <= d->s3_rect_width) {
-      // skip last pixel if LAST_PXOF set
-      if (!(last_pxof && x == d->s3_rect_width)) {
-        s3_pixel_write(cpu, d);
-      }
-
-      switch ((command & 0x00e0) >> 5) {
-        case 0:  // 0 degrees
-          d->s3_src_x++;
-          d->s3_pix_x++;
-          break;
-        case 1:  // 45 degrees
-          d->s3_src_x++;
-          d->s3_pix_x++;
-          d->s3_src_y--;
-          d->s3_pix_y--;
-          break;
-        case 2:  // 90 degrees
-          d->s3_src_y--;
-          d->s3_pix_y--;
-          break;
-        case 3:  // 135 degrees
-          d->s3_src_y--;
-          d->s3_pix_y--;
-          d->s3_src_x--;
-          d->s3_pix_x--;
-          break;
-        case 4:  // 180 degrees
-          d->s3_src_x--;
-          d->s3_pix_x--;
-          break;
-        case 5:  // 225 degrees
-          d->s3_src_x--;
-          d->s3_pix_x--;
-          d->s3_src_y++;
-          d->s3_pix_y++;
-          break;
-        case 6:  // 270 degrees
-          d->s3_src_y++;
-          d->s3_pix_y++;
-          break;
-        case 7:  // 315 degrees
-          d->s3_src_y++;
-          d->s3_pix_y++;
-          d->s3_src_x++;
-          d->s3_pix_x++;
-          break;
-      }
-      x++;
-    }
-  } else if (command & 0x0800) {
-    // ============================================================
-    // Trio64 CMD type 1001: Polyline / 2-Point Line
-    // (S3 Trio64 datasheet Section 13.3.3.11)
-    //
-    // Draws from (curr_x, curr_y) to (dest_x, dest_y).
-    // The hardware auto-computes direction, major axis, and
-    // Bresenham parameters from the endpoints.
-    //
-    // Register 8AE8h = ending Y coordinate (dest_y)
-    // Register 8EE8h = ending X coordinate (dest_x)
-    // ============================================================
-
-    int32_t x0 = (int16_t)d->s3_curr_x;
-    int32_t y0 = (int16_t)d->s3_curr_y;
-    int32_t x1 = (int16_t)d->s3_dest_x;
-    int32_t y1 = (int16_t)d->s3_dest_y;
-
-    int32_t dx = (x1 > x0) ? (x1 - x0) : (x0 - x1);
-    int32_t dy = (y1 > y0) ? (y1 - y0) : (y0 - y1);
-    int sx = (x1 >= x0) ? 1 : -1;
-    int sy = (y1 >= y0) ? 1 : -1;
-
-    bool steep = (dy > dx);
-    int count = steep ? dy : dx;
-    int err;
-    bool last_pxof = (command & 0x04) != 0;
-
-    if (steep)
-      err = 2 * dx - dy;
-    else
-      err = 2 * dy - dx;
-
-    for (int i = 0; i <= count; i++) {
-      d->s3_src_x = (int16_t)(x0 & 0xfff);
-      d->s3_pix_x = (int16_t)(x0 & 0xfff);
-      d->s3_src_y = (int16_t)(y0 & 0xfff);
-      d->s3_pix_y = (int16_t)(y0 & 0xfff);
-
-      if (!(last_pxof && i == count)) {
-        s3_pixel_write(cpu, d);
-      }
-
-      if (steep) {
-        if (err >= 0) { x0 += sx; err -= 2 * dy; }
-        err += 2 * dx;
-        y0 += sy;
-      } else {
-        if (err >= 0) { y0 += sy; err -= 2 * dx; }
-        err += 2 * dy;
-        x0 += sx;
-      }
-    }
-
-    d->s3_curr_x = (int16_t)(x0 & 0xfff);
-    d->s3_curr_y = (int16_t)(y0 & 0xfff);
-  } else {
-    // ============================================================
-    // CMD type 0001: Draw Line (traditional Bresenham)
-    //
-    // Uses pre-programmed step constants:
-    //   8AE8h = Axial Step Constant (14-bit signed)
-    //   8EE8h = Diagonal Step Constant (14-bit signed)
-    //   92E8h = Error Term (14-bit signed)
-    //   96E8h = Major Axis Pixel Count
-    // Direction from CMD bits: INC_X (5), YMAJAXIS (6), INC_Y (7)
-    // ============================================================
-
-    int16_t err = d->line_errorterm;
-    int16_t axial_step = d->line_axial_step;
-    int16_t diag_step = d->line_diagonal_step;
-    int count = d->s3_rect_width;
-    bool last_pxof = (command & 0x04) != 0;
-
-    // Sign-extend 14-bit register values to 16-bit
-    if (err & 0x2000) err |= 0xC000;
-    if (axial_step & 0x2000) axial_step |= 0xC000;
-    if (diag_step & 0x2000) diag_step |= 0xC000;
-
-    // Direction bits
-    int sx = (command & 0x0020) ? 1 : -1;
-    int sy = (command & 0x0080) ? 1 : -1;
-    bool y_major = (command & 0x0040) != 0;
-
-    int32_t cx = d->s3_curr_x;
-    if (cx >= 0x800) cx |= ~0x7ff;
-    int32_t cy = d->s3_curr_y;
-    if (cy >= 0x800) cy |= ~0x7ff;
-
-    for (int i = 0; i <= count; i++) {
-      d->s3_src_x = cx & 0xfff;
-      d->s3_pix_x = cx & 0xfff;
-      d->s3_src_y = cy & 0xfff;
-      d->s3_pix_y = cy & 0xfff;
-
-      if (!(last_pxof && i == count)) {
-        s3_pixel_write(cpu, d);
-      }
-
-      if (err >= 0) {
-        err += diag_step;
-        if (y_major) cx += sx; else cy += sy;
-      } else {
-        err += axial_step;
-      }
-
-      if (y_major) cy += sy; else cx += sx;
-    }
-
-    // Update position registers
-    d->s3_curr_x = cx & 0xfff;
-    d->s3_curr_y = cy & 0xfff;
-  }
-}
-
-void pixel_wait_draw(cpu* cpu, struct vga_data* d, bool across_the_plane, int len)
-{
-  uint32_t height, width;
-  height = (d->s3_pix_y > d->s3_curr_y)?
-           (d->s3_pix_y - d->s3_curr_y):
-           (d->s3_curr_y - d->s3_pix_y);
-
-  if (height > d->s3_rect_height) {
-    L(fprintf(stderr, "[ s3: out of copy height (%d) ]\n", d->bee8_regs[0] + 1));
-    return;
-  }
-
-  if (across_the_plane)
-  {
-    // "across plane" mode
-    for (int x = 0; x < len * 8; x++)
-    {
-      s3_pixel_write(cpu, d);
-      d->s3_src_x += d->s3_h_dir;
-      d->s3_pix_x += d->s3_h_dir;
-
-      width = (d->s3_pix_x > d->s3_curr_x)?
-              (d->s3_pix_x - d->s3_curr_x):
-              (d->s3_curr_x - d->s3_pix_x);
-
-      if (width > d->s3_rect_width)
-      {
-        d->s3_src_x = d->s3_curr_x;
-        d->s3_pix_x = d->s3_curr_x;
-        d->s3_src_y += d->s3_v_dir;
-        d->s3_pix_y += d->s3_v_dir;
-        d->s3_pixel_bit = 0;
-        return;
-      }
-    }
-  }
-  else
-  {
-    // "through plane" mode (single pixel)
-    for (int x = 0; x < len * 8; x = x + 8)
-    {
-      s3_pixel_write(cpu, d);
-      d->s3_src_x += d->s3_h_dir;
-      d->s3_pix_x += d->s3_h_dir;
-
-      width = (d->s3_pix_x > d->s3_curr_x)?
-              (d->s3_pix_x - d->s3_curr_x):
-              (d->s3_curr_x - d->s3_pix_x);
-
-      if (width > d->s3_rect_width)
-      {
-        d->s3_src_x = d->s3_curr_x;
-        d->s3_pix_x = d->s3_curr_x;
-        d->s3_src_y += d->s3_v_dir;
-        d->s3_pix_y += d->s3_v_dir;
-        d->s3_pixel_bit = 0;
-        return;
-      }
-    }
-  }
-}
-
-DEVICE_ACCESS(vga_s3_control) { // 9ae8, CMD
-	struct vga_data *d = (struct vga_data *) extra;
-  uint16_t written;
-
-  REG_WRITE( 0x9ae8);
-
-  if (writeflag != MEM_WRITE) {
-    d->odd_fifo = !d->odd_fifo;
-    uint16_t outval = d->odd_fifo ? 0 : d->fifo_in_progress ? 0x08 : 0x04; // tell them all entries are clear?
-    d->fifo_in_progress = false;
-    if (len == 1) {
-      outval >>= relative_addr * 8;
-    }
-    memory_writemax64(cpu, data, len, outval);
-  } else {
-    written = get_le_16(d->window_mapped, memory_readmax64(cpu, data, len));
-    G(fprintf(stderr, "[ s3: command = %d (raw %04x) ]\n", (int)written, (int)written));
-    d->s3_cmd_mx = !!(written & 2);
-    d->s3_cmd_pxtrans = !!(written & 0x100);
-    bool draws_up = written & (1 << 7);
-    d->s3_pix_x = d->s3_curr_x;
-    d->s3_pix_y = d->s3_curr_y;
-    d->s3_v_dir = draws_up ? 1 : -1;
-    bool draws_right = written & (1 << 5);
-    d->s3_h_dir = draws_right ? 1 : -1;
-    d->s3_y_major = written & (1 << 6);
-    d->s3_last_pof = written & (1 << 2);
-    d->s3_bit_order = written & (1 << 3);
-    d->s3_cmd_swap = (written >> 12) & 1;
-    d->s3_no_draw = !(written & (1 << 4));
-    d->s3_current_command = written >> 13;
-
-    d->fifo_in_progress = true;
-    d->s3_pixel_bit = 0;
-    if (d->s3_no_draw) {
-      fprintf(stderr, "[ s3: just move not implemented ]\n");
-      d->s3_curr_x = d->s3_dest_x;
-      d->s3_curr_y = d->s3_dest_y;
-    } else {
-      switch (d->s3_current_command) {
-      case 0: // Nop
-        break;
-
-      case 1: // Line draw
-        if (!(written & 0x100)) {
-          L(fprintf(stderr, "[ s3 linedraw ]\n"));
-          linedraw(cpu, d, written & 0x1fff);
-        } // Otherwise accept pixel fill below.
-        break;
-
-      case 2: // Rectangle Fill
-        if (!(written & 0x100)) {
-          L(fprintf(stderr, "[ s3 fillrect ]\n"));
-          fillrect(cpu, d, written & 0x1fff);
-        } // Otherwise accept pixel fill below.
-        break;
-
-      case 6: // BitBLT
-        bitblt(cpu, d);
-        break;
-
-      case 7: // PatBLT
-        patblt(cpu, d);
-        break;
-
-      default:
-        G(fprintf(stderr, "[ s3: unimplemented cmd %d (%04x) ]\n", written >> 13, written));
-        break;
-      }
-    }
-  }
-
-  d->modified = 1;
-  return 1;
-}
-
-
-DEVICE_ACCESS(vga_s3_curx) {
-  struct vga_data *d = (struct vga_data *) extra;
-  uint16_t written;
-
-  REG_WRITE( 0x86e8);
-
-  if (writeflag == MEM_WRITE) {
-    written = get_le_16(d->window_mapped, memory_readmax64(cpu, data, len)) & 0x7ff;
-    d->s3_curr_x = written;
-    G(fprintf(stderr, "[ s3: set pix x = %d (raw %04x) ]\n", (int)written, (int)written));
-  } else {
-    fprintf(stderr, "[ s3: get pix x ]\n");
-    memory_writemax64(cpu, data, len, d->s3_curr_x);
-  }
-
-  return 1;
-}
-
-
-DEVICE_ACCESS(vga_s3_cury) {
-  struct vga_data *d = (struct vga_data *) extra;
-  uint16_t written;
-
-  REG_WRITE( 0x82e8);
-
-  if (writeflag == MEM_WRITE) {
-    written = get_le_16(d->window_mapped, memory_readmax64(cpu, data, len)) & 0x7ff;
-    d->s3_curr_y = written;
-    G(fprintf(stderr, "[ s3: set pix y = %d (raw %04x) ]\n", (int)written, (int)written));
-  } else {
-    fprintf(stderr, "[ s3: get pix y ]\n");
-    memory_writemax64(cpu, data, len, d->s3_curr_y);
-  }
-
-  return 1;
-}
-
-
-DEVICE_ACCESS(vga_s3_bg_color) {
-  struct vga_data *d = (struct vga_data *) extra;
-  uint16_t written;
-
-  REG_WRITE( 0xa2e8);
-
-  if (writeflag == MEM_WRITE) {
-    d->s3_bg_color = get_le_16(d->window_mapped, memory_readmax64(cpu, data, len));
-    G(fprintf(stderr, "[ s3: set bg color = %d (raw %04x) ]\n", (int)d->s3_bg_color, (int)written));
-  } else {
-    fprintf(stderr, "[ s3: get bg color ]\n");
-    memory_writemax64(cpu, data, len, d->s3_bg_color);
-  }
-
-  return 1;
-}
-
-
-DEVICE_ACCESS(vga_s3_fg_color) {
-  struct vga_data *d = (struct vga_data *) extra;
-  uint16_t written;
-
-  REG_WRITE( 0xbae8);
-
-  if (writeflag == MEM_WRITE) {
-    d->s3_fg_color = get_le_16(d->window_mapped, memory_readmax64(cpu, data, len));
-    G(fprintf(stderr, "[ s3: set fg color = %d (raw %04x) ]\n", (int)d->s3_fg_color, (int)written));
-  } else {
-    fprintf(stderr, "[ s3: get fg color ]\n");
-    memory_writemax64(cpu, data, len, d->s3_fg_color);
-  }
-
-  return 1;
-}
-
-
-DEVICE_ACCESS(vga_s3_fg_color_mix) {
-  struct vga_data *d = (struct vga_data *) extra;
-  uint16_t written;
-
-  REG_WRITE( 0xbae8);
-
-  if (writeflag == MEM_WRITE) {
-    d->s3_fg_color_mix = get_le_16(d->window_mapped, memory_readmax64(cpu, data, len));
-    G(fprintf(stderr, "[ s3: set fg color mix = %d (raw %04x) ]\n", (int)d->s3_fg_color_mix, (int)written));
-  } else {
-    memory_writemax64(cpu, data, len, d->s3_fg_color_mix);
-  }
-
-  return 1;
-}
-
-
-DEVICE_ACCESS(vga_s3_bg_color_mix) {
-  struct vga_data *d = (struct vga_data *) extra;
-  uint16_t written;
-
-  REG_WRITE( 0xb6e8);
-
-  if (writeflag == MEM_WRITE) {
-    d->s3_bg_color_mix = get_le_16(d->window_mapped, memory_readmax64(cpu, data, len));
-    G(fprintf(stderr, "[ s3: set bg color mix = %d (raw %04x) ]\n", (int)d->s3_bg_color_mix, (int)written));
-  } else {
-    memory_writemax64(cpu, data, len, d->s3_bg_color_mix);
-  }
-
-  return 1;
-}
-
-
-DEVICE_ACCESS(vga_s3_destx) {
-  struct vga_data *d = (struct vga_data *) extra;
-  uint16_t written;
-
-  REG_WRITE( 0x8ee8);
-
-  if (writeflag == MEM_WRITE) {
-    d->line_diagonal_step = get_le_16(d->window_mapped, memory_readmax64(cpu, data, len)) & 0x3fff;
-    d->s3_dest_x = get_le_16(d->window_mapped, memory_readmax64(cpu, data, len)) & 0x0fff;
-    G(fprintf(stderr, "[ s3: set destx = %d ]\n", (int)d->s3_dest_x));
-  }
-
-  return 1;
-}
-
-
-DEVICE_ACCESS(vga_s3_desty) {
-  struct vga_data *d = (struct vga_data *) extra;
-  uint16_t written;
-
-  REG_WRITE( 0x8ae8);
-
-  if (writeflag == MEM_WRITE) {
-    d->line_axial_step = get_le_16(d->window_mapped, memory_readmax64(cpu, data, len)) & 0x3fff;
-    d->s3_dest_y = get_le_16(d->window_mapped, memory_readmax64(cpu, data, len)) & 0x0fff;
-    G(fprintf(stderr, "[ s3: set desty = %d ]\n", (int)d->s3_dest_y));
-  }
-
-  return 1;
-}
-
-
-DEVICE_ACCESS(vga_s3_major_axis_len) {
-  struct vga_data *d = (struct vga_data *) extra;
-  uint16_t written;
-
-  REG_WRITE( 0x96e8);
-
-  if (writeflag == MEM_WRITE) {
-    d->s3_rect_width = get_le_16(d->window_mapped, memory_readmax64(cpu, data, len));
-    G(fprintf(stderr, "[ s3: set draw width %d (raw %04x) ]\n", d->s3_rect_width, (int)written));
-  }
-
-  return 1;
-}
-
-
-DEVICE_ACCESS(vga_s3_color_compare) {
-  struct vga_data *d = (struct vga_data *) extra;
-  int write_index;
-
-  REG_WRITE( 0xb2e8);
-
-  if (writeflag == MEM_WRITE) {
-    d->s3_color_compare = get_le_32(d->window_mapped, memory_readmax64(cpu, data, len));
-    G(fprintf(stderr, "[ s3: set color compare %08x ]\n", (int)d->s3_color_compare));
-  }
-
-  return 1;
+static void update_cursor(struct machine *machine, struct vga_data *d)
+{
+  uint16_t origin_x = ((d->crtc_reg[VGA_CRTC_HARDWARE_GRAPHICS_CURSOR_ORIGIN_X_HIGH] & 15) << 8) | d->crtc_reg[VGA_CRTC_HARDWARE_GRAPHICS_CURSOR_ORIGIN_X_LOW];
+  uint16_t origin_y = ((d->crtc_reg[VGA_CRTC_HARDWARE_GRAPHICS_CURSOR_ORIGIN_Y_HIGH] & 15) << 8) | d->crtc_reg[VGA_CRTC_HARDWARE_GRAPHICS_CURSOR_ORIGIN_Y_LOW];
+  d->gfx_cursor.on = d->crtc_reg[VGA_CRTC_HARDWARE_GRAPHICS_CURSOR_MODE] & 1;
+  d->gfx_cursor.render_x = origin_x;
+  d->gfx_cursor.render_y = origin_y;
+  x11_update_cursor
+    (d->fb->fb_window,
+     1,
+     d->gfx_cursor.on,
+     d->gfx_cursor.render_x,
+     d->gfx_cursor.render_y
+     );
 }
 
 
-DEVICE_ACCESS(vga_s3_pio_cmd) {
-  struct vga_data *d = (struct vga_data *) extra;
-  uint64_t idata = 0;
-  uint16_t written;
-  int write_index;
-
-  REG_WRITE( 0xbee8);
-
-  if (writeflag == MEM_WRITE) {
-    written = get_le_16(d->window_mapped, memory_readmax64(cpu, data, len));
-    write_index = written >> 12;
-    d->bee8_regs[write_index] = written & 0xfff;
-
-    G(fprintf(stderr, "[ s3: bee8 write reg %x = %03x ]\n", write_index, (int)(written & 0xfff)));
-
-    switch (write_index) {
-    case 0:
-      d->s3_rect_height = d->bee8_regs[0] & 0x0fff;
-      break;
-    
-    default:
-      break;
-    }
+/*
+ * Fill in gfx_cursor from the data we have and update it in the display system.
+ *
+ * Based on whether windows or x11 mode is set, change the transparent and inverse colors in
+ * the palette.
+ *
+ * Read the bit masks and compose the cursor image.
+ *
+ * Set the center of the cursor image.
+ */
+static void compose_cursor(struct machine *machine, struct vga_data *d)
+{
+  bool x11_mode = !!(d->crtc_reg[VGA_CRTC_EXTENDED_RAMDAC_CONTROL] & 0x10);
+  auto alpha_mask = 0xff000000;
+  if (x11_mode) {
+    d->gfx_cursor.palette[0] &= ~alpha_mask;
+    d->gfx_cursor.palette[1] &= ~alpha_mask;
+    d->gfx_cursor.palette[2] |= alpha_mask;
+    d->gfx_cursor.palette[3] |= alpha_mask;
+    d->gfx_cursor.invert_color = -1;
+  } else { // windows
+    d->gfx_cursor.palette[2] &= ~alpha_mask;
+    d->gfx_cursor.palette[3] &= ~alpha_mask;
+    d->gfx_cursor.palette[0] |= alpha_mask;
+    d->gfx_cursor.palette[1] |= alpha_mask;
+    d->gfx_cursor.invert_color = 3;
   }
 
-  return 1;
-}
-
-DEVICE_ACCESS(vga_s3_pix_transfer) {
-  struct vga_data *d = (struct vga_data *) extra;
-  uint8_t to_write[4];
-  uint64_t idata;
-
-  REG_WRITE( 0xe2e8);
-
-  if (writeflag == MEM_WRITE) {
-    idata = memory_readmax64(cpu, data, len);
-    d->s3_pixel_xfer = get_le_swap(!d->s3_cmd_swap, idata, len);
-    L(fprintf(stderr, "[ s3: set pixel transfer %08x (raw %08x) ]\n", (int)d->s3_pixel_xfer, (int)idata));
-    int swizzle = d->s3_cmd_swap ? len - 1 : 0;
-    for (int i = 0; i < len; i++) {
-      to_write[i ^ swizzle] = idata >> (i * 8);
-    }
-
-    d->s3_cmd_bus_size = len - 1;
-
-    if (d->s3_cmd_mx) {
-      // Transfer across the plane, 1bpp
-      L(fprintf(stderr, "[ vga: transfer cross the plane (width %d) ", d->s3_rect_width + 1));
-      for (int i = 0; i < len * 8; i++) {
-        bool cpu = !!(to_write[i / 8] & (1 << (7 - (i % 8))));
-        L(fprintf(stderr, "%c", cpu ? '#' : '.'));
-      }
-      L(fprintf(stderr, " ]\n"));
-      pixel_wait_draw(cpu, d, true, len);
-    } else {
-      L(fprintf(stderr, "Pixel transfer, not s3_cmd_mx\n"));
-      pixel_wait_draw(cpu, d, false, len);
+  for (int y = 0; y < 64; y++) {
+    uint32_t row = d->s3_cursor_address + 16 * y;
+    for (int x = 0; x < 64; x++) {
+      uint8_t word_pair = x >> 4;
+      uint8_t byte_off = (x >> 3) & 1;
+      uint8_t byte_0 = d->gfx_mem[row + word_pair * 4 + byte_off];
+      uint8_t byte_1 = d->gfx_mem[row + word_pair * 4 + 2 + byte_off];
+      uint8_t mask = 1 << (7 - (x & 7));
+      uint8_t color = (!!(byte_0 & mask) << 1) | !!(byte_1 & mask);
+      d->gfx_cursor.data[y * 64 + x] = color;
     }
   }
 
-  d->modified = 1;
-  return 1;
+  x11_set_cursor_data(d->fb->fb_window, 1, d->gfx_cursor);
+  update_cursor(machine, d);
 }
 
 
 /*
- *  vga_crtc_reg_write():
+ *  s3_crtc_write():
  *
- *  Writes to VGA CRTC registers.
+ *  S3 specific CRTC registers.
  */
-static void vga_crtc_reg_write(struct machine *machine, struct cpu *cpu, struct vga_data *d,
-	int regnr, int idata)
+static int s3_crtc_write(struct machine *machine, struct cpu *cpu,
+	struct vga_data *d, int regnr, int idata)
 {
-	int i, grayscale;
-  uint8_t dev_address[4] = { }, value[4] = { };
-  uint8_t idata_byte;
-
-  fatal("[ vga_crtc_reg_write: regnr=0x%02x idata=0x%02x (%s) ]\n",
-		    regnr, idata, vga_find_register_name(d, S_PRIMARY, 0x15));
 	switch (regnr) {
-	case VGA_CRTC_CURSOR_SCANLINE_START:		/*  0x0a  */
-	case VGA_CRTC_CURSOR_SCANLINE_END:		/*  0x0b  */
-		break;
-	case VGA_CRTC_START_ADDR_HIGH:			/*  0x0c  */
-	case VGA_CRTC_START_ADDR_LOW:			/*  0x0d  */
-		d->update_x1 = 0;
-		d->update_x2 = d->max_x - 1;
-		d->update_y1 = 0;
-		d->update_y2 = d->max_y - 1;
-		d->modified = 1;
-		recalc_cursor_position(d);
-		break;
-	case VGA_CRTC_CURSOR_LOCATION_HIGH:		/*  0x0e  */
-	case VGA_CRTC_CURSOR_LOCATION_LOW:		/*  0x0f  */
-		recalc_cursor_position(d);
-		break;
+	case 0x30:
+		/*  Chip ID, read-only:  */
+		d->crtc_reg[regnr] = 0xe1;
+		return 1;
   case VGA_CRTC_VERTICAL_DISPLAY_END:
   case VGA_CRTC_OVERFLOW_REGISTER: {
     uint16_t vend_high = ((d->crtc_reg[VGA_CRTC_OVERFLOW_REGISTER] >> 5) & 2) | ((d->crtc_reg[VGA_CRTC_OVERFLOW_REGISTER] >> 1) & 1);
     uint16_t vend_low = d->crtc_reg[VGA_CRTC_VERTICAL_DISPLAY_END];
     d->vend = ((vend_high << 8) | vend_low) + 1;
-    fprintf(stderr, "[ vga: vertical end %d ]\n", d->vend);
+    TRACE(TRACE_VGA, TRACE_DEBUG, "[ vga: vertical end %d ]\n", d->vend);
     break;
   }
   case VGA_CRTC_HORIZONTAL_DISPLAY_END:
@@ -3270,7 +136,7 @@ static void vga_crtc_reg_write(struct machine *machine, struct cpu *cpu, struct
     uint16_t hend_high = (d->crtc_reg[VGA_CRTC_EXTENDED_HORIZONTAL_OVERFLOW] >> 1) & 1;
     uint16_t hend_low = d->crtc_reg[VGA_CRTC_HORIZONTAL_DISPLAY_END];
     d->hend = (((hend_high << 8) | hend_low) + 1) * 8;
-    fprintf(stderr, "[ vga: horizontal end %d ]\n", d->hend);
+    TRACE(TRACE_VGA, TRACE_DEBUG, "[ vga: horizontal end %d ]\n", d->hend);
     break;
   }
   case VGA_CRTC_HARDWARE_GRAPHICS_CURSOR_FG_COLOR_STACK:
@@ -3309,6 +175,7 @@ static void vga_crtc_reg_write(struct machine *machine, struct cpu *cpu, struct
     break;
   }
   case VGA_CRTC_HARDWARE_GRAPHICS_CURSOR_MODE:
+    d->s3_color_stack = 0;
     if (d->crtc_reg[regnr] != (d->gfx_cursor.on & 1)) {
       compose_cursor(machine, d);
     }
@@ -3320,633 +187,59 @@ static void vga_crtc_reg_write(struct machine *machine, struct cpu *cpu, struct
     update_cursor(machine, d);
     break;
   }
-	case 0xff:
-		grayscale = 0;
-		switch (d->crtc_reg[0xff]) {
-		case 0x00:
-			grayscale = 1;
-		case 0x01:
-			d->cur_mode = MODE_CHARCELL;
-			d->max_x = 40; d->max_y = 25;
-			d->pixel_repx = machine->x11_md.scaleup * 2;
-			d->pixel_repy = machine->x11_md.scaleup;
-			d->font_width = 8;
-			d->font_height = 16;
-			// d->font = font8x16;
-			break;
-		case 0x02:
-			grayscale = 1;
-		case 0x03:
-			d->cur_mode = MODE_CHARCELL;
-			d->max_x = 80; d->max_y = 25;
-			d->pixel_repx = d->pixel_repy = machine->x11_md.scaleup;
-			d->font_width = 8;
-			d->font_height = 16;
-			// d->font = font8x16;
-			break;
-		case 0x08:
-			d->cur_mode = MODE_GRAPHICS;
-			d->max_x = 160;	d->max_y = 200;
-			d->graphics_mode = GRAPHICS_MODE_4BIT;
-			d->bits_per_pixel = 4;
-			d->pixel_repx = 4 * machine->x11_md.scaleup;
-			d->pixel_repy = 2 * machine->x11_md.scaleup;
-			break;
-		case 0x09:
-		case 0x0d:
-			d->cur_mode = MODE_GRAPHICS;
-			d->max_x = 320;	d->max_y = 200;
-			d->graphics_mode = GRAPHICS_MODE_4BIT;
-			d->bits_per_pixel = 4;
-			d->pixel_repx = d->pixel_repy =
-			    2 * machine->x11_md.scaleup;
-			break;
-		case 0x0e:
-			d->cur_mode = MODE_GRAPHICS;
-			d->max_x = 640;	d->max_y = 200;
-			d->graphics_mode = GRAPHICS_MODE_4BIT;
-			d->bits_per_pixel = 4;
-			d->pixel_repx = machine->x11_md.scaleup;
-			d->pixel_repy = machine->x11_md.scaleup * 2;
-			break;
-		case 0x10:
-			d->cur_mode = MODE_GRAPHICS;
-			d->max_x = 640; d->max_y = 350;
-			d->graphics_mode = GRAPHICS_MODE_4BIT;
-			d->bits_per_pixel = 4;
-			d->pixel_repx = d->pixel_repy = machine->x11_md.scaleup;
-			break;
-		case 0x12:
-			d->cur_mode = MODE_GRAPHICS;
-			d->max_x = 640; d->max_y = 480;
-			d->graphics_mode = GRAPHICS_MODE_4BIT;
-			d->bits_per_pixel = 4;
-			d->pixel_repx = d->pixel_repy = machine->x11_md.scaleup;
-			break;
-		case 0x13:
-			d->cur_mode = MODE_GRAPHICS;
-			d->max_x = 320;	d->max_y = 200;
-			d->graphics_mode = GRAPHICS_MODE_8BIT;
-			d->bits_per_pixel = 8;
-			d->pixel_repx = d->pixel_repy =
-			    2 * machine->x11_md.scaleup;
-			break;
-		default:
-			fatal("TODO! video mode change hack (mode 0x%02x)\n",
-			    d->crtc_reg[0xff]);
-			exit(1);
-		}
-
-		if (d->cur_mode == MODE_CHARCELL) {
-			dev_fb_resize(d->fb, d->max_x * d->font_width *
-			    d->pixel_repx, d->max_y * d->font_height *
-			    d->pixel_repy);
-			d->fb_size = d->max_x * d->pixel_repx * d->font_width *
-			     d->max_y * d->pixel_repy * d->font_height * 3;
-		} else {
-			dev_fb_resize(d->fb, d->max_x * d->pixel_repx,
-			    d->max_y * d->pixel_repy);
-			d->fb_size = d->max_x * d->pixel_repx *
-			     d->max_y * d->pixel_repy * 3;
-		}
-
-		for (i=0; i<machine->ncpus; i++)
-			machine->cpus[i]->invalidate_translation_caches(
-			    machine->cpus[i], 0, INVALIDATE_ALL);
-
-		if (d->gfx_mem != NULL)
-			free(d->gfx_mem);
-		d->gfx_mem_size = 1;
-		if (d->cur_mode == MODE_GRAPHICS)
-			d->gfx_mem_size = d->max_x * d->max_y /
-			    (d->graphics_mode == GRAPHICS_MODE_8BIT? 1 : 2);
-
-		CHECK_ALLOCATION(d->gfx_mem = (unsigned char *) malloc(d->gfx_mem_size));
-
-		/*  Clear screen and reset the palette:  */
-		memset(d->charcells_outputed, 0, d->charcells_size);
-		memset(d->charcells_drawn, 0, d->charcells_size);
-		memset(d->gfx_mem, 0, d->gfx_mem_size);
-		d->update_x1 = 0;
-		d->update_x2 = d->max_x - 1;
-		d->update_y1 = 0;
-		d->update_y2 = d->max_y - 1;
-		d->modified = 1;
-		reset_palette(d, grayscale);
-		register_reset(d);
-		break;
-  case 0x58:
-    if (idata & 1) {
-      d->window_mapped = true;
-      debug("[ vga_crtc: non-linear mode ]\n");
-    } else {
-      d->window_mapped = false;
-      debug("[ vga_crtc: linear mode ]\n");
-    }
-    break;
-  case 0x59:
-    debug("[ vga_crtc: set PCI bar upper byte ]\n");
-    idata_byte = idata;
-    dev_address[0] = 0x10;
-    dev_address[1] = 14 << 3;
-    dev_address[3] = 0x80;
-    // Set a pci address
-    cpu->memory_rw(cpu, cpu->mem, 0x80000cf8, dev_address, 4, MEM_WRITE, PHYSICAL);
-    cpu->memory_rw(cpu, cpu->mem, 0x80000cfc, value, 4, MEM_READ, PHYSICAL);
-    value[3] = idata_byte;
-    value[1] = 0x55;
-    value[0] = 0xaa;
-    cpu->memory_rw(cpu, cpu->mem, 0x80000cfc, value, 4, MEM_WRITE, PHYSICAL);
-    break;
-  case 0x5a:
-    debug("[ vga_crtc: set PCI bar lower upper byte ]\n");
-    idata_byte = idata;
-    dev_address[0] = 0x10;
-    dev_address[1] = 14 << 3;
-    dev_address[3] = 0x80;
-    // Set a pci address
-    cpu->memory_rw(cpu, cpu->mem, 0x80000cf8, dev_address, 4, MEM_WRITE, PHYSICAL);
-    // Write a byte
-    cpu->memory_rw(cpu, cpu->mem, 0x80000cfc, value, 4, MEM_READ, PHYSICAL);
-    value[2] = idata_byte;
-    value[1] = 0x55;
-    value[0] = 0xaa;
-    cpu->memory_rw(cpu, cpu->mem, 0x80000cfc, value, 4, MEM_WRITE, PHYSICAL);
-    break;
-	default:
-    break;
-	}
-}
-
-
-/*
- *  vga_sequencer_reg_write():
- *
- *  Writes to VGA Sequencer registers.
- */
-static void vga_sequencer_reg_write(struct machine *machine, struct cpu *cpu, struct vga_data *d,
-	int regnr, int idata)
-{
-	switch (regnr) {
-	case VGA_SEQ_RESET:
-	case VGA_SEQ_MAP_MASK:
-	case VGA_SEQ_SEQUENCER_MEMORY_MODE:
-		debug("[ vga_sequencer_reg_write: select %i: TODO ]\n", regnr);
-		break;
-	default:fatal("[ vga_sequencer_reg_write: select %i ]\n", regnr);
-		/*  cpu->running = 0;  */
 	}
-}
 
-
-/*
- *  vga_graphcontr_reg_write():
- *
- *  Writes to VGA Graphics Controller registers.
- */
-static void vga_graphcontr_reg_write(struct machine *machine,
-	struct vga_data *d, int regnr, int idata)
-{
-	switch (regnr) {
-	case VGA_GRAPHCONTR_READMAPSELECT:
-	case VGA_GRAPHCONTR_GRAPHICSMODE:
-	case VGA_GRAPHCONTR_MISC:
-	case VGA_GRAPHCONTR_MASK:
-		debug("[ vga_graphcontr_reg_write: select %i: TODO ]\n", regnr);
-		break;
-	default:fatal("[ vga_graphcontr_reg_write: select %i ]\n", regnr);
-		/*  cpu->running = 0;  */
-	}
+	return 0;
 }
 
 
 /*
- *  vga_attribute_reg_write():
+ *  s3_vram_write():
  *
- *  Writes to VGA Attribute registers.
+ *  Recomposes the hardware cursor if its image was written to.
  */
-static void vga_attribute_reg_write(struct machine *machine, struct vga_data *d,
-	int regnr, int idata)
+static void s3_vram_write(struct machine *machine, struct vga_data *d,
+	uint64_t addr, size_t len)
 {
-	/*  0-15 are palette registers: TODO  */
-	if (regnr >= 0 && regnr <= 0xf)
-		return;
-
-	switch (regnr) {
-	default:fatal("[ vga_attribute_reg_write: select %i ]\n", regnr);
-		/*  cpu->running = 0;  */
-	}
+	if (d->crtc_reg[VGA_CRTC_HARDWARE_GRAPHICS_CURSOR_MODE] &&
+	    (addr >> 10) == (d->s3_cursor_address >> 10))
+		compose_cursor(machine, d);
 }
 
 
 /*
- *  dev_vga_ctrl_access():
+ *  s3_restore():
  *
- *  Reads and writes of the VGA control registers.
+ *  Rebuilds the hardware cursor image after a checkpoint restore.
  */
-DEVICE_ACCESS(s3_ctrl)
+static void s3_restore(struct vga_data *d)
 {
-	struct vga_data *d = (struct vga_data *) extra;
-	size_t i;
-	uint64_t idata = 0, odata = 0;
-
-  REG_WRITE( 0x3c0);
-
-	for (i=0; i<len; i++) {
-		idata = data[i];
-
-		/*  0x3C0 + relative_addr...  */
-
-		switch (relative_addr) {
-
-		case VGA_ATTRIBUTE_ADDR:		/*  0x00  */
-			switch (d->attribute_state) {
-			case 0:	if (writeflag == MEM_READ)
-					odata = d->attribute_reg_select;
-				else {
-					d->attribute_reg_select = 1;
-					d->attribute_state = 1;
-				}
-				break;
-			case 1:	d->attribute_state = 0;
-				d->attribute_reg[d->attribute_reg_select] =
-				    idata;
-				vga_attribute_reg_write(cpu->machine, d,
-				    d->attribute_reg_select, idata);
-				break;
-			}
-			break;
-		case VGA_ATTRIBUTE_DATA_READ:		/*  0x01  */
-			if (writeflag == MEM_WRITE)
-				fatal("[ dev_vga: WARNING: Write to "
-				    "VGA_ATTRIBUTE_DATA_READ? ]\n");
-			else {
-				if (d->attribute_state == 0)
-					fatal("[ dev_vga: WARNING: Read from "
-					    "VGA_ATTRIBUTE_DATA_READ, but no"
-					    " register selected? ]\n");
-				else
-					odata = d->attribute_reg[
-					    d->attribute_reg_select];
-			}
-			break;
-
-		case VGA_MISC_OUTPUT_W:			/*  0x02  */
-			if (writeflag == MEM_WRITE)
-				d->misc_output_reg = idata;
-			else {
-				/*  Reads: Input Status 0  */
-				odata = 0x00;
-			}
-			break;
-
-		case VGA_SEQUENCER_ADDR:		/*  0x04  */
-			if (writeflag == MEM_READ)
-				odata = d->sequencer_reg_select;
-			else
-				d->sequencer_reg_select = idata;
-			break;
-		case VGA_SEQUENCER_DATA:		/*  0x05  */
-			if (writeflag == MEM_READ)
-				odata = d->sequencer_reg[
-				    d->sequencer_reg_select];
-			else {
-        d->sequencer_reg[d->sequencer_reg_select] = idata;
-        L(fprintf(stderr, "[ dev_vga: sequencer %02x = %02x (%s) ]\n", d->sequencer_reg_select, (unsigned int)idata, vga_find_register_name(d, S_PRIMARY, relative_addr)));
-        vga_sequencer_reg_write(cpu->machine, cpu, d, d->sequencer_reg_select, idata);
-			}
-			break;
-
-		case VGA_DAC_ADDR_READ:			/*  0x07  */
-			if (writeflag == MEM_WRITE) {
-				d->palette_read_index = idata;
-				d->palette_read_subindex = 0;
-			} else {
-				debug("[ dev_vga: WARNING: Read from "
-				    "VGA_DAC_ADDR_READ? TODO ]\n");
-				/*  TODO  */
-			}
-			break;
-		case VGA_DAC_ADDR_WRITE:		/*  0x08  */
-			if (writeflag == MEM_WRITE) {
-				d->palette_write_index = idata;
-				d->palette_write_subindex = 0;
-
-				d->palette_read_index = idata;
-				d->palette_read_subindex = 0;
-			} else {
-				fatal("[ dev_vga: WARNING: Read from "
-				    "VGA_DAC_ADDR_WRITE? ]\n");
-				odata = d->palette_write_index;
-			}
-			break;
-		case VGA_DAC_DATA:			/*  0x09  */
-			if (writeflag == MEM_WRITE) {
-        L(fprintf(stderr, "[ vga: writing dac data (index %d sub %d) ]\n", d->palette_write_index, d->palette_write_subindex));
-				int new_ = (idata & 63) << 2;
-				int old = d->fb->rgb_palette[d->
-				    palette_write_index*3+d->
-				    palette_write_subindex];
-				d->fb->rgb_palette[d->palette_write_index * 3 +
-				    d->palette_write_subindex] = new_;
-				/*  Redraw whole screen, if the
-				    palette changed:  */
-				if (new_ != old) {
-					d->modified = 1;
-					d->palette_modified = 1;
-					d->update_x1 = d->update_y1 = 0;
-					d->update_x2 = d->max_x - 1;
-					d->update_y2 = d->max_y - 1;
-				}
-				d->palette_write_subindex ++;
-				if (d->palette_write_subindex == 3) {
-					d->palette_write_index ++;
-					d->palette_write_subindex = 0;
-				}
-        if (d->palette_write_index > 255) {
-          d->palette_write_index = 0;
-        }
-			} else {
-				odata = (d->fb->rgb_palette[d->
-				    palette_read_index * 3 +
-				    d->palette_read_subindex] >> 2) & 63;
-				d->palette_read_subindex ++;
-				if (d->palette_read_subindex == 3) {
-					d->palette_read_index ++;
-					d->palette_read_subindex = 0;
-				}
-			}
-			break;
-
-		case VGA_MISC_OUTPUT_R:
-			odata = d->misc_output_reg;
-			break;
-
-		case VGA_GRAPHCONTR_ADDR:		/*  0x0e  */
-			if (writeflag == MEM_READ)
-				odata = d->graphcontr_reg_select;
-			else
-				d->graphcontr_reg_select = idata;
-			break;
-		case VGA_GRAPHCONTR_DATA:		/*  0x0f  */
-			if (writeflag == MEM_READ)
-				odata = d->graphcontr_reg[
-				    d->graphcontr_reg_select];
-			else {
-				d->graphcontr_reg[d->
-				    graphcontr_reg_select] = idata;
-				vga_graphcontr_reg_write(cpu->machine, d,
-				    d->graphcontr_reg_select, idata);
-			}
-			break;
-
-		case VGA_CRTC_ADDR:			/*  0x14  */
-			if (writeflag == MEM_READ)
-				odata = d->crtc_reg_select;
-			else
-				d->crtc_reg_select = idata;
-			break;
-		case VGA_CRTC_DATA:			/*  0x15  */
-			if (writeflag == MEM_READ) {
-				odata = d->crtc_reg[d->crtc_reg_select];
-        fatal("[ vga_crtc_reg_read: regnr=0x%02x idata=0x%02x (%s) ]\n",
-              d->crtc_reg_select, (unsigned int)odata, vga_find_register_name(d, S_PRIMARY, relative_addr));
-      } else {
-        if (d->crtc_reg_select != 0x30) {
-          d->crtc_reg[d->crtc_reg_select] = idata;
-        }
-        if (d->crtc_reg_select == VGA_CRTC_HARDWARE_GRAPHICS_CURSOR_MODE) {
-          d->s3_color_stack = 0;
-        }
-				vga_crtc_reg_write(cpu->machine, cpu, d,
-				    d->crtc_reg_select, idata);
-			}
-			break;
-
-		case VGA_INPUT_STATUS_1:	/*  0x1A  */
-			odata = 0;
-			d->n_is1_reads ++;
-			d->current_retrace_line ++;
-			d->current_retrace_line %= (MAX_RETRACE_SCANLINES * 8);
-			/*  Whenever we are "inside" a scan line, copy the
-			    current palette into retrace_palette[][]:  */
-			if ((d->current_retrace_line & 7) == 7) {
-				if (d->retrace_palette == NULL &&
-				    d->n_is1_reads > N_IS1_READ_THRESHOLD) {
-					CHECK_ALLOCATION(d->retrace_palette =
-					    (unsigned char *) malloc(
-					    MAX_RETRACE_SCANLINES * 256*3));
-				}
-				if (d->retrace_palette != NULL)
-					memcpy(d->retrace_palette + (d->
-					    current_retrace_line >> 3) * 256*3,
-					    d->fb->rgb_palette, d->cur_mode ==
-					    MODE_CHARCELL? (16*3) : (256*3));
-			}
-			/*  These need to go on and off, to fake the
-			    real vertical and horizontal retrace info.  */
-			if (d->current_retrace_line < 20*8)
-				odata |= VGA_IS1_DISPLAY_VRETRACE;
-			else {
-				if ((d->current_retrace_line & 7) == 0)
-					odata = VGA_IS1_DISPLAY_VRETRACE | VGA_IS1_DISPLAY_DISPLAY_DISABLE;
-			}
-			L(fprintf(stderr, "input status 1: %08" PRIx64"\n", odata));
-			break;
-		}
-
-		if (writeflag == MEM_READ)
-			data[i] = odata;
-
-    fprintf(stderr, "vga ctr at %08x [%04lx] %s %02x (%s)\n", (unsigned int)cpu->pc, relative_addr, writeflag == MEM_READ ? "read" : "write", data[i], vga_find_register_name(d, S_PRIMARY, relative_addr));
-
-		/*  For multi-byte accesses:  */
-		relative_addr ++;
-	}
-
-	return 1;
-}
-
-DEVICE_ACCESS(vga_s3_42e8) {
-	struct vga_data *d = (struct vga_data *) extra;
-
-  REG_WRITE( 0x42e8);
-
-  fprintf(stderr, "vga 42e8 (%s)\n", vga_find_register_name(d, S_EXTENDED, 0x42e8));
-  return 0;
-}
-
-DEVICE_ACCESS(vga_s3_4ae8) {
-	struct vga_data *d = (struct vga_data *) extra;
-  fprintf(stderr, "vga 4ae8 (%s)\n", vga_find_register_name(d, S_EXTENDED, 0x4ae8));
-
-  REG_WRITE( 0x4ae8);
-
-  if (writeflag == MEM_WRITE) {
-		d->adv_fun_4ae8 = memory_readmax64(cpu, data, len);
-  } else {
-    memory_writemax64(cpu, data, len, d->adv_fun_4ae8);
-  }
-
-  return 1;
-}
-
-DEVICE_ACCESS(vga_s3_92e8) {
-	struct vga_data *d = (struct vga_data *) extra;
-  fprintf(stderr, "vga 92e8 (%s)\n", vga_find_register_name(d, S_EXTENDED, 0x92e8));
-
-  REG_WRITE( 0x92e8);
-
-  if (writeflag == MEM_WRITE) {
-		d->line_errorterm = memory_readmax64(cpu, data, len);
-  } else {
-    memory_writemax64(cpu, data, len, d->line_errorterm);
-  }
-
-  return 1;
-}
-
-DEVICE_ACCESS(vga_s3_9ee8) {
-	struct vga_data *d = (struct vga_data *) extra;
-  fprintf(stderr, "vga 9ee8 (%s)\n", vga_find_register_name(d, S_EXTENDED, 0x9ee8));
-
-  REG_WRITE( 0x9ee8);
-
-  if (writeflag == MEM_WRITE) {
-		d->short_stroke_transfer = memory_readmax64(cpu, data, len);
-  } else {
-    memory_writemax64(cpu, data, len, d->short_stroke_transfer);
-  }
-
-  return 1;
-}
-
-DEVICE_ACCESS(vga_s3_aae8) {
-	struct vga_data *d = (struct vga_data *) extra;
-
-  REG_WRITE( 0xaae8);
-
-  if (writeflag == MEM_WRITE) {
-		d->plane_write_mask = memory_readmax64(cpu, data, len);
-  } else {
-    memory_writemax64(cpu, data, len, d->plane_write_mask);
-  }
-  return 1;
+	compose_cursor(NULL, d);	/*  machine is not used  */
 }
 
-DEVICE_ACCESS(vga_s3_aee8) {
-	struct vga_data *d = (struct vga_data *) extra;
 
-  REG_WRITE( 0xaee8);
-
-  if (writeflag == MEM_WRITE) {
-		d->plane_read_mask = memory_readmax64(cpu, data, len);
-  } else {
-    memory_writemax64(cpu, data, len, d->plane_read_mask);
-  }
-  return 1;
-}
+static const struct s3vga_chip s3_chip = {
+	"s3_gfx", "s3_ctrl", "S3 VGA", 0,
+	NULL, s3_crtc_write, NULL, s3_vram_write, s3_restore
+};
 
-DEVICE_ACCESS(vga_s3_8100_range) {
-	struct vga_data *d = (struct vga_data *) extra;
-  int register_map[][3] = {
-    { 0x00, 0x82e8, -1 },
-    { 0x02, 0x86e8, -1 },
-    { 0x08, 0x8ae8, -1 },
-    { 0x0a, 0x8ee8, -1 },
-    { 0x10, 0x92e8, -1 },
-    { 0x18, 0x9ae8, -1 },
-    { 0x1c, 0x9ee8, -1 },
-    { 0x20, 0xa2e8, -1 },
-    { 0x24, 0xa6e8, -1 },
-    { 0x28, 0xaae8, -1 },
-    { 0x2c, 0xaee8, -1 },
-    { 0x30, 0xb2e8, -1 },
-    { 0x34, 0xb6e8, -1 },
-    { 0x36, 0xbae8, -1 },
-    { 0x38, 0xbee8, 1 },
-    { 0x3a, 0xbee8, 2 },
-    { 0x3c, 0xbee8, 3 },
-    { 0x3e, 0xbee8, 4 },
-    { 0x40, 0xbee8, 0xa },
-    { 0x42, 0xbee8, 0xd },
-    { 0x44, 0xbee8, 0xe },
-    { 0x46, 0xbee8, 0xf },
-    { 0x48, 0xbee8, 0 },
-    { 0x4a, 0x96e8, -1 },
-    { 0, 0, 0 },
-  };
 
-  REG_WRITE( 0x8100);
+void s3_hack_start(struct machine *machine, struct vga_data *d) {
+  d->cur_mode = MODE_GRAPHICS;
+  d->max_x = d->hend = d->helast =
+    machine->machine_subtype == MACHINE_PREP_IBM860 ? 1024 : 800;
+  d->max_y = d->vend = d->velast =
+    machine->machine_subtype == MACHINE_PREP_IBM860 ? 768 : 600;
+  d->graphics_mode = GRAPHICS_MODE_8BIT;
+  d->bits_per_pixel = 8;
+  d->pixel_repx = d->pixel_repy = 1;
 
-  uint8_t *dselect = data + len - 2;
-  if (writeflag == MEM_WRITE) {
-    bool found = false;
-    while (len > 0) {
-      int amount = MIN(len, 2);
-      for (int i = 0; register_map[i][1]; i++) {
-        if (relative_addr != register_map[i][0]) {
-          continue;
-        }
+  d->gfx_mem_size = 2 * 1024 * 1024; /*d->max_x * d->max_y /
+                                       (d->graphics_mode == GRAPHICS_MODE_8BIT? 1 : 2);*/
 
-        found = true;
-        if (register_map[i][2] != -1) {
-          d->bee8_regs[0xf] = register_map[i][2];
-          d->bee8_regs[0x1] = 0;
-          d->bee8_regs[0x2] = 0;
-          d->bee8_regs[0x3] = 0xfff;
-          d->bee8_regs[0x4] = 0xfff;
-        }
-        fprintf(stderr, "[ vga: write %04x via 8100 compressed area %02x %02x ]\n", register_map[i][1], dselect[0], dselect[1]);
-        cpu->memory_rw(cpu, cpu->mem, VIRTUAL_ISA_PORTBASE + 0x80000000 + register_map[i][1], dselect, amount, MEM_WRITE, PHYSICAL);
-        found = true;
-        break;
-      }
-      relative_addr += 2;
-      dselect -= 2;
-      len -= amount;
-    }
-    if (!found) {
-      cpu->memory_rw(cpu, cpu->mem, VIRTUAL_ISA_PORTBASE + 0x80000000 + 0xe2e8, data, len, MEM_WRITE, PHYSICAL);
-    }
-  } else {
-    for (int i = 0; register_map[i][1]; i++) {
-      if (relative_addr ^ 2 == register_map[i][0]) {
-        if (register_map[i][2] != -1) {
-          d->bee8_regs[0xf] = register_map[i][2];
-        }
-        memset(data, 0, len);
-        cpu->memory_rw(cpu, cpu->mem, VIRTUAL_ISA_PORTBASE + 0x80000000 + register_map[i][1], data, 2, MEM_READ, PHYSICAL);
-        fprintf(stderr, "[ vga: read %04x via 8100 compressed area yielding", register_map[i][1]);
-        for (int j = 0; j < len; j++) {
-          fprintf(stderr, " %02x", data[j]);
-        }
-        fprintf(stderr, "]\n");
-        break;
-      }
-    }
-  }
-  return 1;
+  CHECK_ALLOCATION(d->gfx_mem = (unsigned char *) malloc(d->gfx_mem_size));
 }
 
-DEVICE_ACCESS(vga_s3_ff00_range) {
-	struct vga_data *d = (struct vga_data *) extra;
-
-  REG_WRITE( 0xff00);
-
-  relative_addr &= 0xff;
-  if (writeflag == MEM_WRITE) {
-    memcpy(&d->reg_ff00_data[relative_addr], data, len);
-  } else {
-    memcpy(data, &d->reg_ff00_data[relative_addr], len);
-  }
-  fprintf(stderr, "vga ff00 %s", writeflag == MEM_WRITE ? "read" : "write");
-  for (int i = 0; i < len; i++) {
-    fprintf(stderr, " %02x", data[i]);
-  }
-  fprintf(stderr, " (%s)\n", vga_find_register_name(d, S_EXTENDED, 0xff00 + relative_addr));
-  return 1;
-}
 
 DEVICE_ACCESS(vga_option_rom)
 {
@@ -4002,45 +295,19 @@ DEVICE_ACCESS(vga_option_rom)
       result = rom_data[relative_addr % rom_size] | (rom_data[(relative_addr + 1) % rom_size] << 8) | (rom_data[(relative_addr + 2) % rom_size] << 16) | (rom_data[(relative_addr + 3) % rom_size] << 24);
     }
 
-    fprintf(stderr, "vga: access option rom: %08lx @ %08lx = %08x\n", relative_addr, cpu->pc, result);
+    TRACE(TRACE_VGA, TRACE_DEBUG, "vga: access option rom: %08lx @ %08lx = %08x\n", relative_addr, cpu->pc, result);
     memory_writemax64(cpu, data, len, result);
   }
   return 1;
 }
 
-/*
- *  dev_vga_init():
- *
- *  Register a VGA text console device. max_x and max_y could be something
- *  like 80 and 25, respectively.
- */
+
 void dev_86mc64_init(struct machine *machine, struct memory *mem,
                      uint64_t videomem_base, uint64_t control_base, const char *name)
 {
-	struct vga_data *d;
-	size_t allocsize, i;
-
-	CHECK_ALLOCATION(d = (struct vga_data *) malloc(sizeof(struct vga_data)));
-	memset(d, 0, sizeof(struct vga_data));
+	struct vga_data *d = s3vga_new(machine, &s3_chip);
 
-	d->console_handle = console_start_slave(machine, "vga",
-	    CONSOLE_OUTPUT_ONLY);
-
-	d->videomem_base  = videomem_base;
-	d->control_base   = control_base | VIRTUAL_ISA_PORTBASE;
-	d->pixel_repx = d->pixel_repy = machine->x11_md.scaleup;
   s3_hack_start(machine, d);
-
-	memset(d->charcells_drawn, 0, d->charcells_size);
-
-	for (i=0; i<d->charcells_size; i+=2) {
-		d->charcells[i] = ' ';
-		d->charcells[i+1] = 0x07;  /*  Default color  */
-		d->charcells_drawn[i] = ' ';
-		d->charcells_drawn[i+1] = 0x07;
-	}
-
-	memset(d->charcells_outputed, 0, d->charcells_size);
 	memset(d->gfx_mem, 0, d->gfx_mem_size);
 
 	// d->font = font8x16;
@@ -4049,109 +316,9 @@ void dev_86mc64_init(struct machine *machine, struct memory *mem,
 
 	d->fb_max_x = d->pixel_repx * d->max_x;
 	d->fb_max_y = d->pixel_repy * d->max_y;
-	if (d->cur_mode == MODE_CHARCELL) {
-		d->fb_max_x *= d->font_width;
-		d->fb_max_y *= d->font_height;
-	}
-
-	/*
-	memory_device_register(mem, "vga_charcells", videomem_base + 0x18000,
-	    allocsize, dev_vga_access, d, DM_DYNTRANS_OK |
-	    DM_DYNTRANS_WRITE_OK | DM_READS_HAVE_NO_SIDE_EFFECTS,
-	    d->charcells);
-	*/
-	memory_device_register(mem, "s3_gfx", videomem_base, GFX_ADDR_WINDOW,
-                         dev_s3_graphics_access, d, DM_DEFAULT |
-                         DM_READS_HAVE_NO_SIDE_EFFECTS, d->gfx_mem);
-
-	// memory_device_register(mem, "vga_gfx", 0xc0000000, 0xc0000,
-  //                        dev_vga_graphics_access, d, DM_DEFAULT |
-  //                        DM_READS_HAVE_NO_SIDE_EFFECTS, d->gfx_mem);
-
-  // memory_device_register(mem, "vga_rom", 0xc00c0000,
-  //     65536, dev_vga_option_rom_access, d, DM_DEFAULT, NULL);
-
-	memory_device_register(mem, "s3_ctrl", control_base,
-	    32, dev_s3_ctrl_access, d, DM_DEFAULT, NULL);
-
-	memory_device_register(mem, "vga_s3_subsystem_control", VIRTUAL_ISA_PORTBASE | 0x800042e8, 4,
-                         dev_vga_s3_42e8_access, d, DM_DEFAULT, NULL);
-
-	memory_device_register(mem, "vga_s3_adv_func_control", VIRTUAL_ISA_PORTBASE | 0x80004ae8, 4,
-                         dev_vga_s3_4ae8_access, d, DM_DEFAULT, NULL);
-
-	memory_device_register(mem, "vga_s3_8100_range", VIRTUAL_ISA_PORTBASE | 0x80008100, 0x100,
-                         dev_vga_s3_8100_range_access, d, DM_DEFAULT, NULL);
-
-	memory_device_register(mem, "vga_s3_cury", VIRTUAL_ISA_PORTBASE | 0x800082e8, 4,
-                         dev_vga_s3_cury_access, d, DM_DEFAULT, NULL);
-
-	memory_device_register(mem, "vga_s3_curx", VIRTUAL_ISA_PORTBASE | 0x800086e8, 4,
-	    dev_vga_s3_curx_access, d, DM_DEFAULT, NULL);
-
-  memory_device_register(mem, "vga_s3_desty", VIRTUAL_ISA_PORTBASE | 0x80008ae8, 4,
-                         dev_vga_s3_desty_access, d, DM_DEFAULT, NULL);
-
-  memory_device_register(mem, "vga_s3_destx", VIRTUAL_ISA_PORTBASE | 0x80008ee8, 4,
-                         dev_vga_s3_destx_access, d, DM_DEFAULT, NULL);
-
-	memory_device_register(mem, "vga_s3_line_term_error", VIRTUAL_ISA_PORTBASE | 0x800092e8, 4,
-                         dev_vga_s3_92e8_access, d, DM_DEFAULT, NULL);
-
-	memory_device_register(mem, "vga_s3_major_axis_len", VIRTUAL_ISA_PORTBASE | 0x800096e8, 4,
-	    dev_vga_s3_major_axis_len_access, d, DM_DEFAULT, NULL);
-
-  memory_device_register(mem, "vga_s3_control", VIRTUAL_ISA_PORTBASE | 0x80009ae8, 4,
-                         dev_vga_s3_control_access, d, DM_DEFAULT, NULL);
-
-	memory_device_register(mem, "vga_s3_short_stroke_transfer", VIRTUAL_ISA_PORTBASE | 0x80009ee8, 4,
-                         dev_vga_s3_9ee8_access, d, DM_DEFAULT, NULL);
-
-  memory_device_register(mem, "vga_s3_bg_color", VIRTUAL_ISA_PORTBASE | 0x8000a2e8, 4,
-                         dev_vga_s3_bg_color_access, d, DM_DEFAULT, NULL);
-
-  memory_device_register(mem, "vga_s3_fg_color", VIRTUAL_ISA_PORTBASE | 0x8000a6e8, 4,
-                         dev_vga_s3_fg_color_access, d, DM_DEFAULT, NULL);
-
-	memory_device_register(mem, "vga_s3_bitplane_write_mask", VIRTUAL_ISA_PORTBASE | 0x8000aae8, 4,
-                         dev_vga_s3_aae8_access, d, DM_DEFAULT, NULL);
-
-	memory_device_register(mem, "vga_s3_bitplane_read_mask", VIRTUAL_ISA_PORTBASE | 0x8000aee8, 4,
-                         dev_vga_s3_aee8_access, d, DM_DEFAULT, NULL);
-
-  memory_device_register(mem, "vga_s3_color_compare", VIRTUAL_ISA_PORTBASE | 0x8000b2e8, 4,
-                         dev_vga_s3_color_compare_access, d, DM_DEFAULT, NULL);
-
-	memory_device_register(mem, "vga_s3_bg_color_mix", VIRTUAL_ISA_PORTBASE | 0x8000b6e8, 4,
-                         dev_vga_s3_bg_color_mix_access, d, DM_DEFAULT, NULL);
-
-  memory_device_register(mem, "vga_s3_fg_color_mix", VIRTUAL_ISA_PORTBASE | 0x8000bae8, 4,
-                         dev_vga_s3_fg_color_mix_access, d, DM_DEFAULT, NULL);
-
-  memory_device_register(mem, "vga_s3_pio_cmd", VIRTUAL_ISA_PORTBASE | 0x8000bee8, 4,
-                         dev_vga_s3_pio_cmd_access, d, DM_DEFAULT, NULL);
-
-	memory_device_register(mem, "vga_s3_pix_transfer", VIRTUAL_ISA_PORTBASE | 0x8000e2e8, 4,
-	    dev_vga_s3_pix_transfer_access, d, DM_DEFAULT, NULL);
-
-	memory_device_register(mem, "vga_s3_ff00_range", VIRTUAL_ISA_PORTBASE | 0x8000ff00, 0x80,
-                         dev_vga_s3_ff00_range_access, d, DM_DEFAULT, NULL);
-
-	/*  This will force an initial redraw/resynch:  */
-	d->update_x1 = 0;
-	d->update_x2 = d->max_x - 1;
-	d->update_y1 = 0;
-	d->update_y2 = d->max_y - 1;
-	d->modified = 1;
-
-  // Used when window_mapped is true.
-  d->window_address = 0;
-
-	machine_add_tickfunction(machine, dev_s3_tick, d, VGA_TICK_SHIFT);
 
-	d->fb = dev_fb_init(machine, mem, VGA_FB_ADDR, VFB_GENERIC,
-                      d->fb_max_x, d->fb_max_y, d->fb_max_x, d->fb_max_y, 24, "S3 VGA");
-	d->fb_size = d->fb_max_x * d->fb_max_y * 3;
+	s3vga_attach(machine, mem, d, videomem_base, control_base);
+	s3vga_register_engine(machine, mem, d);
 
   // text and graphic
   x11_set_num_cursors(d->fb->fb_window, 2);
@@ -4164,7 +331,7 @@ void dev_86mc64_init(struct machine *machine, struct memory *mem,
     d->gfx_cursor.data.push_back(0);
   }
 
-	vga_update_cursor(machine, d);
-  reset_palette(d, 0);
-  register_reset(d);
+	s3vga_update_cursor(machine, d);
+  s3vga_reset_palette(d, 0);
+  s3vga_register_reset(d);
 }
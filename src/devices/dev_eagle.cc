@@ -34,6 +34,7 @@
 
 #include "bus_isa.h"
 #include "bus_pci.h"
+#include "checkpoint.h"
 #include "cpu.h"
 #include "device.h"
 #include "devices.h"
@@ -41,6 +42,7 @@
 #include "machine.h"
 #include "memory.h"
 #include "misc.h"
+#include "trace.h"
 
 struct eagle_glob eagle_comm;
 
@@ -78,7 +80,7 @@ DEVICE_ACCESS(eagle)
       int shift = (relative_addr % 4) * 8;
       uint32_t mask = (1 << (len * 8)) - 1;
       idata = (prev_value & ~(mask << shift)) | ((idata & mask) << shift);
-      fprintf(stderr, "[ dev_eagle: small pci write: len %d relative_addr %d, original write %08x, prev value %08x, write value %08x ]\n", len, relative_addr, (unsigned int)odata, (unsigned int)prev_value, (unsigned int)idata);
+      TRACE(TRACE_EAGLE, TRACE_DEBUG, "[ dev_eagle: small pci write: len %d relative_addr %d, original write %08x, prev value %08x, write value %08x ]\n", len, relative_addr, (unsigned int)odata, (unsigned int)prev_value, (unsigned int)idata);
     }
     bus_pci_data_access(cpu, d->pci_data, writeflag == MEM_READ?
                         &odata : &idata, len > 4 ? len : 4, writeflag == MEM_WRITE);
@@ -125,7 +127,7 @@ int io_pass(struct cpu *cpu, struct eagle_data *d, int writeflag, bool io_space,
     if (target_addr) {
       cpu->memory_rw(cpu, cpu->mem, target_addr, data_buf, len, MEM_WRITE, PHYSICAL | NO_EXCEPTIONS | CACHE_NONE);
     } else {
-      fprintf(stderr, "[ eagle: PCI %s passthrough write %08x = %08x @ %08x ]\n", io_space ? "io" : "mem", real_addr, idata, (unsigned int)cpu->pc);
+      TRACE(TRACE_EAGLE, TRACE_DEBUG, "[ eagle: PCI %s passthrough write %08x = %08x @ %08x ]\n", io_space ? "io" : "mem", real_addr, idata, (unsigned int)cpu->pc);
     }
 	} else {
     cpu->memory_rw(cpu, cpu->mem, target_addr, data_buf, len, MEM_READ, PHYSICAL | NO_EXCEPTIONS | CACHE_NONE);
@@ -134,7 +136,7 @@ int io_pass(struct cpu *cpu, struct eagle_data *d, int writeflag, bool io_space,
       memory_writemax64(cpu, data, len|MEM_PCI_LITTLE_ENDIAN, odata);
     } else {
       odata = 0;
-      fprintf(stderr, "[ eagle: PCI %s passthrough read %08x -> %08x ]\n", io_space ? "io" : "mem", real_addr, odata);
+      TRACE(TRACE_EAGLE, TRACE_DEBUG, "[ eagle: PCI %s passthrough read %08x -> %08x ]\n", io_space ? "io" : "mem", real_addr, odata);
     }
 	}
 
@@ -157,7 +159,7 @@ DEVICE_ACCESS(eagle_pci_config_space)
 
 	if (writeflag == MEM_WRITE) {
 		idata = memory_readmax64(cpu, data, len|MEM_PCI_LITTLE_ENDIAN);
-    fprintf(stderr, "[ eagle pci config space mapped access at %08x (write %08x) ]\n", relative_addr, (uint32_t)idata);
+    TRACE(TRACE_EAGLE, TRACE_DEBUG, "[ eagle pci config space mapped access at %08x (write %08x) ]\n", relative_addr, (uint32_t)idata);
   }
 
 
@@ -166,11 +168,11 @@ DEVICE_ACCESS(eagle_pci_config_space)
   // Special handling for scsi which is 'builtin device 1'
   // This address starts at +0x800, so these addresses here are odd.
   if (relative_addr < 0x800) {
-    fprintf(stderr, "[ eagle: sio pass %08x ]\n", (unsigned int)relative_addr);
+    TRACE(TRACE_EAGLE, TRACE_DEBUG, "[ eagle: sio pass %08x ]\n", (unsigned int)relative_addr);
     bus = 0;
     dev = 11;
   } else if (relative_addr < 0x1000) {
-    fprintf(stderr, "[ eagle: scsi pass %08x ]\n", (unsigned int)relative_addr);
+    TRACE(TRACE_EAGLE, TRACE_DEBUG, "[ eagle: scsi pass %08x ]\n", (unsigned int)relative_addr);
     bus = 0;
     dev = 13;
   }
@@ -180,7 +182,7 @@ DEVICE_ACCESS(eagle_pci_config_space)
                       &odata : &idata, len, writeflag);
 
 	if (writeflag == MEM_READ) {
-    fprintf(stderr, "[ eagle pci config space mapped access at %08x (read %08x) ]\n", relative_addr, (uint32_t)odata);
+    TRACE(TRACE_EAGLE, TRACE_DEBUG, "[ eagle pci config space mapped access at %08x (read %08x) ]\n", relative_addr, (uint32_t)odata);
     memory_writemax64(cpu, data, len|MEM_PCI_LITTLE_ENDIAN, odata);
   }
 
@@ -193,15 +195,15 @@ DEVICE_ACCESS(eagle_8mb)
 	uint64_t real_addr = relative_addr, idata = 0xffffff00;
 
   if (!d->discontiguous && (real_addr >= 0x10000)) {
-    fprintf(stderr, "[ eagle: discontiguous access on %x ]\n", (unsigned int)real_addr);
+    TRACE(TRACE_EAGLE, TRACE_DEBUG, "[ eagle: discontiguous access on %x ]\n", (unsigned int)real_addr);
     d->discontiguous = 1;
   }
   if (d->discontiguous && !(real_addr >= 0xcf8 && real_addr <= 0xcff)) {
     uint64_t page = (relative_addr >> 12) & 0x1fff;
     uint64_t subaddr = relative_addr & 0x1f;
-    fprintf(stderr, "[ eagle: d-io %x %x ]\n", (unsigned int)page, (unsigned int)subaddr);
+    TRACE(TRACE_EAGLE, TRACE_DEBUG, "[ eagle: d-io %x %x ]\n", (unsigned int)page, (unsigned int)subaddr);
     real_addr = VIRTUAL_ISA_PORTBASE | 0x80000000 | (page << 5) | subaddr;
-    fprintf(stderr, "[ eagle: non contig %" PRIx64 "x ]\n", real_addr);
+    TRACE(TRACE_EAGLE, TRACE_DEBUG, "[ eagle: non contig %" PRIx64 "x ]\n", real_addr);
   } else {
     real_addr = VIRTUAL_ISA_PORTBASE | 0x80000000 | relative_addr;
   }
@@ -230,7 +232,7 @@ DEVICE_ACCESS(eagle_92)
     struct eagle_data *d = (struct eagle_data *) extra;
     if (writeflag == MEM_WRITE) {
         uint64_t write_data = memory_readmax64(cpu, data, len|MEM_PCI_LITTLE_ENDIAN);
-        fprintf(stderr, "%s %08x: port 92\n", "write", (unsigned int)cpu->pc);
+        TRACE(TRACE_EAGLE, TRACE_DEBUG, "%s %08x: port 92\n", "write", (unsigned int)cpu->pc);
         cpu->cd.ppc.bytelane_swap_latch = (write_data & 2) >> 1;
         cpu->invalidate_translation_caches(cpu, cpu->pc, INVALIDATE_ALL);
     } else {
@@ -297,7 +299,7 @@ DEVICE_ACCESS(eagle_800)
       break;
     }
 
-    fprintf(stderr, "[ unknown-800 %s %x -> %x (pc %08x) ]\n", writeflag == MEM_WRITE ? "write" : "read", relative_addr, odata, (unsigned int)cpu->pc);
+    TRACE(TRACE_EAGLE, TRACE_WARN, "[ unknown-800 %s %x -> %x (pc %08x) ]\n", writeflag == MEM_WRITE ? "write" : "read", relative_addr, odata, (unsigned int)cpu->pc);
 
     if (writeflag == MEM_READ)
         memory_writemax64(cpu, data, len|MEM_PCI_LITTLE_ENDIAN, odata);
@@ -319,146 +321,6 @@ DEVICE_ACCESS(eagle_680)
 }
 
 
-DEVICE_ACCESS(eagle_dma_1)
-{
-    struct eagle_data *d = (struct eagle_data *) extra;
-    uint64_t idata = 0;
-
-    if (writeflag == MEM_WRITE) {
-        idata = memory_readmax64(cpu, data, len|MEM_PCI_LITTLE_ENDIAN);
-    }
-
-    /*
-      [ APIC-4d0 write 14 -> 0 ]
-      [ eagle:dma20 write a -> 6 ]
-      [ eagle:dma20 write b -> 56 ]
-      [ memory_rw(): write data={22} paddr=0x8000040b >= physical_max; pc=0x00006df4 <out8> ]
-      [ eagle:dma20 write c -> 0 ]
-      [ eagle:dma20 write 4 -> 80 ]
-      [ eagle:dma20 write 4 -> 1f ]
-      [ eagle:dma80 write 1 -> 20 ]
-      [ memory_rw(): write data={80} paddr=0x80000481 >= physical_max; pc=0x00006df4 <out8> ]
-      [ eagle:dma20 write c -> 0 ]
-      [ eagle:dma20 write 5 -> ff ]
-      [ eagle:dma20 write 5 -> 1 ]
-      [ eagle:dma20 write a -> 2 ]
-    */
-    switch (relative_addr) {
-    case 12:
-      if (writeflag == MEM_WRITE) {
-        d->addr_low_high_latch = 0;
-        d->len_low_high_latch = 0;
-      }
-      break;
-
-    case 4:
-      if (writeflag == MEM_WRITE) {
-        if (!d->addr_low_high_latch) {
-            eagle_comm.eagle_comm_area[0] = idata;
-        } else {
-            eagle_comm.eagle_comm_area[1] = idata;
-        }
-        d->addr_low_high_latch = !d->addr_low_high_latch;
-      } else {
-        if (!d->addr_low_high_latch) {
-            idata = eagle_comm.eagle_comm_area[0];
-        } else {
-            idata = eagle_comm.eagle_comm_area[1];
-        }
-      }
-      break;
-
-    case 5:
-      if (writeflag == MEM_WRITE) {
-        if (!d->len_low_high_latch) {
-            eagle_comm.eagle_comm_area[4] = idata;
-        } else {
-            eagle_comm.eagle_comm_area[5] = idata;
-        }
-        d->len_low_high_latch = !d->len_low_high_latch;
-      } else {
-        if (!d->len_low_high_latch) {
-          idata = eagle_comm.eagle_comm_area[4];
-        } else {
-          idata = eagle_comm.eagle_comm_area[5];
-        }
-      }
-      break;
-
-    case 8:
-      if (writeflag != MEM_WRITE) {
-        INTERRUPT_DEASSERT(d->irq);
-        idata = eagle_comm.eagle_comm_area[7] | d->fin_mask;
-        eagle_comm.eagle_comm_area[7] = 0;
-        d->fin_mask = 0;
-      }
-      break;
-
-    case 10:
-      /*
-      if (writeflag == MEM_WRITE) {
-        if (idata & 4) {
-          eagle_comm_area[7] = 0;
-        } else {
-          if (eagle_comm_area[7]) {
-            INTERRUPT_ASSERT(d->irq);
-          }
-        }
-      }
-      */
-      break;
-    }
-
-    fprintf(stderr, "[ eagle:dma1 %s %x -> %x ]\n", writeflag == MEM_WRITE ? "write" : "read", relative_addr, idata);
-
-    if (writeflag != MEM_WRITE) {
-      memory_writemax64(cpu, data, len|MEM_PCI_LITTLE_ENDIAN, idata);
-    }
-
-    return 1;
-}
-
-
-DEVICE_ACCESS(eagle_dma_2)
-{
-  struct eagle_data *d = (struct eagle_data *) extra;
-  uint64_t idata = 0;
-
-  if (writeflag == MEM_WRITE) {
-    idata = memory_readmax64(cpu, data, len|MEM_PCI_LITTLE_ENDIAN);
-    if (relative_addr < 4) {
-      d->dma_page[relative_addr] = idata;
-    }
-    if (relative_addr == 1) {
-        eagle_comm.eagle_comm_area[2] = idata;
-    }
-  }
-
-  fprintf(stderr, "[ eagle:dma2 %s %x -> %x ]\n", writeflag == MEM_WRITE ? "write" : "read", relative_addr, idata);
-
-  return 1;
-}
-
-
-DEVICE_ACCESS(eagle_dma_80)
-{
-  struct eagle_data *d = (struct eagle_data *) extra;
-  uint64_t idata = 0;
-
-  if (writeflag == MEM_WRITE) {
-    idata = memory_readmax64(cpu, data, len|MEM_PCI_LITTLE_ENDIAN);
-    d->dma_page[relative_addr] = idata;
-    if (relative_addr == 1) {
-        eagle_comm.eagle_comm_area[2] = idata;
-    }
-  }
-
-  fprintf(stderr, "[ eagle:dma80 %s %x -> %x ]\n", writeflag == MEM_WRITE ? "write" : "read", relative_addr, idata);
-
-  return 1;
-}
-
-
 DEVICE_ACCESS(eagle_398)
 {
     struct eagle_data *d = (struct eagle_data *) extra;
@@ -468,27 +330,7 @@ DEVICE_ACCESS(eagle_398)
         idata = memory_readmax64(cpu, data, len|MEM_PCI_LITTLE_ENDIAN);
     }
 
-    fprintf(stderr, "[ unknown-398: %s %x -> %x ]\n", writeflag == MEM_WRITE ? "write" : "read", relative_addr, idata);
-
-    return 1;
-}
-
-DEVICE_ACCESS(eagle_480)
-{
-    struct eagle_data *d = (struct eagle_data *) extra;
-    uint64_t idata = 0;
-
-    if (writeflag == MEM_WRITE) {
-        idata = memory_readmax64(cpu, data, len|MEM_PCI_LITTLE_ENDIAN);
-        d->dma_high[relative_addr] = idata;
-        if (relative_addr == 1) {
-            eagle_comm.eagle_comm_area[3] = idata;
-        }
-    } else {
-        idata = d->dma_high[relative_addr];
-    }
-
-    fprintf(stderr, "[ dma high: %s %x -> %x ]\n", writeflag == MEM_WRITE ? "write" : "read", relative_addr, idata);
+    TRACE(TRACE_EAGLE, TRACE_WARN, "[ unknown-398: %s %x -> %x ]\n", writeflag == MEM_WRITE ? "write" : "read", relative_addr, idata);
 
     return 1;
 }
@@ -629,9 +471,9 @@ DEVICE_ACCESS(eagle_830)
   }
 
   if (register_name) {
-    fprintf(stderr, "[ cs4231: %s %x %s -> %x (pc %08x) ]\n", writeflag == MEM_WRITE ? "write" : "read", relative_addr, register_name, idata, (unsigned int)cpu->pc);
+    TRACE(TRACE_EAGLE, TRACE_DEBUG, "[ cs4231: %s %x %s -> %x (pc %08x) ]\n", writeflag == MEM_WRITE ? "write" : "read", relative_addr, register_name, idata, (unsigned int)cpu->pc);
   } else {
-    fprintf(stderr, "[ unknown-830: %s %x -> %x (pc %08x) ]\n", writeflag == MEM_WRITE ? "write" : "read", relative_addr, idata, (unsigned int)cpu->pc);
+    TRACE(TRACE_EAGLE, TRACE_WARN, "[ unknown-830: %s %x -> %x (pc %08x) ]\n", writeflag == MEM_WRITE ? "write" : "read", relative_addr, idata, (unsigned int)cpu->pc);
   }
 
   return 1;
@@ -646,7 +488,7 @@ DEVICE_ACCESS(eagle_850)
     idata = memory_readmax64(cpu, data, len|MEM_PCI_LITTLE_ENDIAN);
   }
 
-  fprintf(stderr, "[ unknown-850: %s %x -> %x ]\n", writeflag == MEM_WRITE ? "write" : "read", relative_addr, idata);
+  TRACE(TRACE_EAGLE, TRACE_WARN, "[ unknown-850: %s %x -> %x ]\n", writeflag == MEM_WRITE ? "write" : "read", relative_addr, idata);
 
   if (writeflag == MEM_READ) {
     if (relative_addr == 0) {
@@ -659,7 +501,7 @@ DEVICE_ACCESS(eagle_850)
   } else {
     if (relative_addr == 0) {
       d->discontiguous = !(idata & 1);
-      fprintf(stderr, "[ eagle: discontiguous io %d ]\n", d->discontiguous);
+      TRACE(TRACE_EAGLE, TRACE_DEBUG, "[ eagle: discontiguous io %d ]\n", d->discontiguous);
     }
   }
 
@@ -716,7 +558,7 @@ DEVICE_ACCESS(eagle_880)
         break;
     }
 
-    fprintf(stderr, "[ unknown-880: %s %x -> %x ]\n", writeflag == MEM_WRITE ? "write" : "read", relative_addr, odata);
+    TRACE(TRACE_EAGLE, TRACE_WARN, "[ unknown-880: %s %x -> %x ]\n", writeflag == MEM_WRITE ? "write" : "read", relative_addr, odata);
 
     if (writeflag == MEM_READ)
         memory_writemax64(cpu, data, len|MEM_PCI_LITTLE_ENDIAN, odata);
@@ -743,7 +585,7 @@ DEVICE_ACCESS(eagle_8a0)
         break;
     }
 
-    fprintf(stderr, "[ unknown-8a0: %s %x -> %x ]\n", writeflag == MEM_WRITE ? "write" : "read", relative_addr, odata);
+    TRACE(TRACE_EAGLE, TRACE_WARN, "[ unknown-8a0: %s %x -> %x ]\n", writeflag == MEM_WRITE ? "write" : "read", relative_addr, odata);
 
     if (writeflag == MEM_READ)
       memory_writemax64(cpu, data, len|MEM_PCI_LITTLE_ENDIAN, odata);
@@ -770,7 +612,7 @@ DEVICE_ACCESS(eagle_d00)
     break;
   }
 
-  fprintf(stderr, "[ unknown-d00: %s %x -> %x ]\n", writeflag == MEM_WRITE ? "write" : "read", relative_addr, odata);
+  TRACE(TRACE_EAGLE, TRACE_WARN, "[ unknown-d00: %s %x -> %x ]\n", writeflag == MEM_WRITE ? "write" : "read", relative_addr, odata);
 
   if (writeflag == MEM_READ)
     memory_writemax64(cpu, data, len|MEM_PCI_LITTLE_ENDIAN, odata);
@@ -789,7 +631,7 @@ DEVICE_ACCESS(eagle_dma_scatter_gather) {
         eagle_comm.eagle_comm_area[8] = 0;
     }
 
-    fprintf(stderr, "[ dma scatter gather: %s %x -> %x ]\n", writeflag == MEM_WRITE ? "write" : "read", relative_addr, idata);
+    TRACE(TRACE_EAGLE, TRACE_DEBUG, "[ dma scatter gather: %s %x -> %x ]\n", writeflag == MEM_WRITE ? "write" : "read", relative_addr, idata);
 
     return 1;
 }
@@ -802,7 +644,7 @@ DEVICE_ACCESS(eagle_4d0)
   if (writeflag == MEM_WRITE)
     idata = memory_readmax64(cpu, data, len|MEM_PCI_LITTLE_ENDIAN);
 
-  fprintf(stderr, "[ APIC-4d0 %s %x -> %x ]\n", writeflag == MEM_WRITE ? "write" : "read", relative_addr, idata);
+  TRACE(TRACE_EAGLE, TRACE_DEBUG, "[ APIC-4d0 %s %x -> %x ]\n", writeflag == MEM_WRITE ? "write" : "read", relative_addr, idata);
 
   return 1;
 }
@@ -844,6 +686,31 @@ DEVICE_TICK(eagle) {
   struct eagle_data *d = (struct eagle_data *) extra;
 }
 
+DEVICE_CHECKPOINT(eagle) {
+  struct eagle_data *d = (struct eagle_data *) extra;
+
+  CHECKPOINT_VAR(ckpt, d->stage);
+  CHECKPOINT_VAR(ckpt, d->err_reg);
+  CHECKPOINT_VAR(ckpt, d->want_error);
+  CHECKPOINT_VAR(ckpt, d->l2_cache);
+  CHECKPOINT_VAR(ckpt, d->discontiguous);
+  CHECKPOINT_VAR(ckpt, d->bg_data_8mb);
+  CHECKPOINT_VAR(ckpt, d->cs4231_index);
+  CHECKPOINT_VAR(ckpt, d->cs4231_status);
+  CHECKPOINT_VAR(ckpt, d->cs4231_registers);
+  CHECKPOINT_VAR(ckpt, d->game_timer);
+  CHECKPOINT_VAR(ckpt, d->pci_status);
+  CHECKPOINT_VAR(ckpt, d->pci_command);
+  CHECKPOINT_VAR(ckpt, d->error_enabling_1);
+  CHECKPOINT_VAR(ckpt, d->error_detection_1);
+  CHECKPOINT_VAR(ckpt, d->bus_status_60x);
+
+  // Shared with the other motherboard devices
+  CHECKPOINT_VAR(ckpt, eagle_comm);
+
+  bus_pci_checkpoint(ckpt, d->pci_data);
+}
+
 
 DEVINIT(eagle)
 {
@@ -942,6 +809,10 @@ DEVINIT(eagle)
                          isa_portbase + 0x92, 4, dev_eagle_92_access, d,
                          DM_DEFAULT, NULL);
 
+  /*  Port 92 can switch bytelanes, so stores must be remembered:  */
+  for (int i = 0; i < devinit->machine->ncpus; i++)
+    devinit->machine->cpus[i]->cd.ppc.bytelane_swap_tracking = 1;
+
   memory_device_register(devinit->machine->memory, "eagle feature control",
         isa_portbase + 0x800, 0x20, dev_eagle_800_access, d,
         DM_DEFAULT, NULL);
@@ -954,26 +825,19 @@ DEVINIT(eagle)
         isa_portbase + 0x4d0, 2, dev_eagle_4d0_access, d,
         DM_DEFAULT, NULL);
 
-    memory_device_register(devinit->machine->memory, "DMA 1",
-        isa_portbase + 0, 0x20, dev_eagle_dma_1_access, d,
-        DM_DEFAULT, NULL);
-
-    memory_device_register(devinit->machine->memory, "DMA 2",
-        isa_portbase + 0xc0, 0x20, dev_eagle_dma_2_access, d,
-        DM_DEFAULT, NULL);
-
-    memory_device_register(devinit->machine->memory, "legacy DMA 1 (floppy) 0x80 range",
-        isa_portbase + 0x80, 4, dev_eagle_dma_80_access, d,
-        DM_DEFAULT, NULL);
+    /*  ISA DMA; this may already have been added along with the fdc:  */
+    if (devinit->machine->isa_dma == NULL) {
+        char tmpstr[100];
+        snprintf(tmpstr, sizeof(tmpstr), "8237 addr=0x%llx",
+            (long long)isa_portbase);
+        devinit->machine->isa_dma = (struct dma8237_data *)
+            device_add(devinit->machine, tmpstr);
+    }
 
     memory_device_register(devinit->machine->memory, "DMA Scatter/Gather",
         isa_portbase + 0x40a, 22, dev_eagle_dma_scatter_gather_access, d,
         DM_DEFAULT, NULL);
 
-    memory_device_register(devinit->machine->memory, "DMA page address",
-        isa_portbase + 0x480, 4, dev_eagle_480_access, d,
-        DM_DEFAULT, NULL);
-
     memory_device_register(devinit->machine->memory, "8a0",
         isa_portbase + 0x8a0, 0x20, dev_eagle_8a0_access, d,
         DM_DEFAULT, NULL);
@@ -1008,6 +872,8 @@ DEVINIT(eagle)
        dev_eagle_pci_config_access, d, DM_DEFAULT, NULL);
 
     machine_add_tickfunction(devinit->machine, dev_eagle_tick, d, 19);
+    machine_add_checkpoint_function(devinit->machine, "eagle",
+        dev_eagle_checkpoint, d);
 
   switch (devinit->machine->machine_type) {
 
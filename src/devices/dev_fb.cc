@@ -51,6 +51,7 @@
 #include "machine.h"
 #include "memory.h"
 #include "misc.h"
+#include "trace.h"
 #include "x11.h"
 
 #ifndef _WIN32
@@ -112,6 +113,105 @@ static void set_title(struct vfb_data *d)
 }
 
 
+static int rect_area(int x1, int y1, int x2, int y2)
+{
+	return (x2 - x1 + 1) * (y2 - y1 + 1);
+}
+
+
+/*
+ *  dev_fb_damage():
+ *
+ *  Marks a rectangle of the framebuffer (inclusive pixel coordinates) as
+ *  needing to be presented. Rectangles which overlap or touch, or whose
+ *  union is not larger than the two of them together, are merged. When
+ *  the list is full, the new rectangle is merged with the existing one
+ *  whose union grows the least.
+ */
+void dev_fb_damage(struct vfb_data *d, int x1, int y1, int x2, int y2)
+{
+	if (x1 < 0)		x1 = 0;
+	if (y1 < 0)		y1 = 0;
+	if (x2 >= d->xsize)	x2 = d->xsize - 1;
+	if (y2 >= d->ysize)	y2 = d->ysize - 1;
+	if (x1 > x2 || y1 > y2)
+		return;
+
+	for (;;) {
+		int best = -1, best_growth = 0;
+
+		for (int i = 0; i < d->n_damage; i++) {
+			struct vfb_rect *r = &d->damage[i];
+			int ux1 = std::min(x1, r->x1), uy1 = std::min(y1, r->y1);
+			int ux2 = std::max(x2, r->x2), uy2 = std::max(y2, r->y2);
+			int growth = rect_area(ux1, uy1, ux2, uy2) -
+			    rect_area(x1, y1, x2, y2) -
+			    rect_area(r->x1, r->y1, r->x2, r->y2);
+
+			/*  Touching rectangles have a growth <= 0:  */
+			if (growth <= 0 || (d->n_damage == VFB_MAX_DAMAGE &&
+			    (best == -1 || growth < best_growth))) {
+				best = i;
+				best_growth = growth;
+				if (growth <= 0)
+					break;
+			}
+		}
+
+		if (best == -1)
+			break;
+
+		/*  Take the union out of the list, and try again:  */
+		x1 = std::min(x1, d->damage[best].x1);
+		y1 = std::min(y1, d->damage[best].y1);
+		x2 = std::max(x2, d->damage[best].x2);
+		y2 = std::max(y2, d->damage[best].y2);
+		d->damage[best] = d->damage[-- d->n_damage];
+	}
+
+	d->damage[d->n_damage].x1 = x1;
+	d->damage[d->n_damage].y1 = y1;
+	d->damage[d->n_damage].x2 = x2;
+	d->damage[d->n_damage].y2 = y2;
+	d->n_damage ++;
+}
+
+
+/*
+ *  fb_damage_bytes():
+ *
+ *  Marks the pixels of framebuffer bytes first..last as damaged. A range
+ *  covering more than one line damages all of those lines.
+ */
+static void fb_damage_bytes(struct vfb_data *d, uint64_t first, uint64_t last)
+{
+	int y1 = first / d->bytes_per_line, y2 = last / d->bytes_per_line;
+
+	if (y1 != y2)
+		dev_fb_damage(d, 0, y1, d->xsize - 1, y2);
+	else
+		dev_fb_damage(d,
+		    (first % d->bytes_per_line) * 8 / d->bit_depth, y1,
+		    (last % d->bytes_per_line) * 8 / d->bit_depth, y2);
+}
+
+
+#ifdef WITH_X11
+/*
+ *  fb_alloc_x11_pixels():
+ *
+ *  (Re)allocates the host copy of the window contents. Damaged areas are
+ *  redrawn into it, and then uploaded to the window texture.
+ */
+static void fb_alloc_x11_pixels(struct vfb_data *d)
+{
+	free(d->x11_pixels);
+	CHECK_ALLOCATION(d->x11_pixels = (unsigned char *)
+	    calloc((size_t) d->x11_xsize * d->x11_ysize, 4));
+}
+#endif
+
+
 /*
  *  dev_fb_resize():
  *
@@ -163,16 +263,14 @@ void dev_fb_resize(struct vfb_data *d, int new_xsize, int new_ysize)
 	d->framebuffer = new_framebuffer;
 	d->framebuffer_size = size;
 
-	if (new_xsize > d->xsize || new_ysize > d->ysize) {
-		d->update_x1 = d->update_y1 = 0;
-		d->update_x2 = new_xsize - 1;
-		d->update_y2 = new_ysize - 1;
-	}
-
 	d->bytes_per_line = new_bytes_per_line;
 	d->xsize = d->visible_xsize = new_xsize;
 	d->ysize = d->visible_ysize = new_ysize;
 
+	/*  Old damage may be outside the new size; redraw everything:  */
+	d->n_damage = 0;
+	dev_fb_damage(d, 0, 0, new_xsize - 1, new_ysize - 1);
+
 	d->x11_xsize = d->xsize / d->vfb_scaledown;
 	d->x11_ysize = d->ysize / d->vfb_scaledown;
 
@@ -184,6 +282,7 @@ void dev_fb_resize(struct vfb_data *d, int new_xsize, int new_ysize)
 	if (d->fb_window != NULL) {
 		x11_fb_resize(d->fb_window, new_xsize, new_ysize);
 		x11_set_standard_properties(d->fb_window, d->title);
+		fb_alloc_x11_pixels(d);
 	}
 #endif
 }
@@ -269,15 +368,8 @@ void framebuffer_blockcopyfill(struct vfb_data *d, int fillflag, int fill_r,
 		}
 	}
 
-	if (x1 < d->update_x1 || d->update_x1 == -1)	d->update_x1 = x1;
-	if (x1 > d->update_x2 || d->update_x2 == -1)	d->update_x2 = x1;
-	if (x2 < d->update_x1 || d->update_x1 == -1)	d->update_x1 = x2;
-	if (x2 > d->update_x2 || d->update_x2 == -1)	d->update_x2 = x2;
-
-	if (y1 < d->update_y1 || d->update_y1 == -1)	d->update_y1 = y1;
-	if (y1 > d->update_y2 || d->update_y2 == -1)	d->update_y2 = y1;
-	if (y2 < d->update_y1 || d->update_y1 == -1)	d->update_y1 = y2;
-	if (y2 > d->update_y2 || d->update_y2 == -1)	d->update_y2 = y2;
+	dev_fb_damage(d, std::min(x1, x2), std::min(y1, y2),
+	    std::max(x1, x2), std::max(y1, y2));
 }
 
 
@@ -383,26 +475,12 @@ struct cursor_buffer {
 DEVICE_TICK(fb)
 {
 	struct vfb_data *d = (struct vfb_data *) extra;
-	void *pixels = nullptr;
-	int pitch;
-
-#ifdef WITH_X11
-	SDL_LockTexture(d->fb_window->fb_data, nullptr, &pixels, &pitch);
-	if (!pixels) {
-    return;
-	}
-#endif
 
-#ifdef WITH_X11
-	int need_to_flush_x11 = 0;
-#endif
-
-	if (!cpu->machine->x11_md.in_use)
+	if (!cpu->machine->x11_md.in_use || d->fb_window == NULL)
 		return;
 
 	do {
 		uint64_t high, low = (uint64_t)(int64_t) -1;
-		int x, y;
 
 		memory_device_dyntrans_access(cpu, cpu->mem,
 		    extra, &low, &high);
@@ -412,118 +490,82 @@ DEVICE_TICK(fb)
 		/*  printf("low=%016llx high=%016llx\n",
 		    (long long)low, (long long)high);  */
 
-		x = (low % d->bytes_per_line) * 8 / d->bit_depth;
-		y = low / d->bytes_per_line;
-		if (x < d->update_x1 || d->update_x1 == -1)
-			d->update_x1 = x;
-		if (x > d->update_x2 || d->update_x2 == -1)
-			d->update_x2 = x;
-		if (y < d->update_y1 || d->update_y1 == -1)
-			d->update_y1 = y;
-		if (y > d->update_y2 || d->update_y2 == -1)
-			d->update_y2 = y;
-
-		x = ((low+7) % d->bytes_per_line) * 8 / d->bit_depth;
-		y = (low+7) / d->bytes_per_line;
-		if (x < d->update_x1 || d->update_x1 == -1)
-			d->update_x1 = x;
-		if (x > d->update_x2 || d->update_x2 == -1)
-			d->update_x2 = x;
-		if (y < d->update_y1 || d->update_y1 == -1)
-			d->update_y1 = y;
-		if (y > d->update_y2 || d->update_y2 == -1)
-			d->update_y2 = y;
-
-		x = (high % d->bytes_per_line) * 8 / d->bit_depth;
-		y = high / d->bytes_per_line;
-		if (x < d->update_x1 || d->update_x1 == -1)
-			d->update_x1 = x;
-		if (x > d->update_x2 || d->update_x2 == -1)
-			d->update_x2 = x;
-		if (y < d->update_y1 || d->update_y1 == -1)
-			d->update_y1 = y;
-		if (y > d->update_y2 || d->update_y2 == -1)
-			d->update_y2 = y;
-
-		x = ((high+7) % d->bytes_per_line) * 8 / d->bit_depth;
-		y = (high+7) / d->bytes_per_line;
-		if (x < d->update_x1 || d->update_x1 == -1)
-			d->update_x1 = x;
-		if (x > d->update_x2 || d->update_x2 == -1)
-			d->update_x2 = x;
-		if (y < d->update_y1 || d->update_y1 == -1)
-			d->update_y1 = y;
-		if (y > d->update_y2 || d->update_y2 == -1)
-			d->update_y2 = y;
-
 		/*
-		 *  An update covering more than one line will automatically
-		 *  force an update of all the affected lines:
+		 *  The dyntrans system only keeps track of the lowest and
+		 *  highest written addresses, so this becomes one rectangle.
 		 */
-		if (d->update_y1 != d->update_y2) {
-			d->update_x1 = 0;
-			d->update_x2 = d->xsize-1;
-		}
+		fb_damage_bytes(d, low, high + 7);
 	} while (0);
 
+	/*  Devices which update the framebuffer on their own:  */
 	if (d->update_x2 != -1) {
-#ifdef WITH_X11
-		int y;
-#endif
-		int addr, addr2, q = d->vfb_scaledown;
-
-		if (d->update_x1 >= d->visible_xsize)
-			d->update_x1 = d->visible_xsize - 1;
-		if (d->update_x2 >= d->visible_xsize)
-			d->update_x2 = d->visible_xsize - 1;
-		if (d->update_y1 >= d->visible_ysize)
-			d->update_y1 = d->visible_ysize - 1;
-		if (d->update_y2 >= d->visible_ysize)
-			d->update_y2 = d->visible_ysize - 1;
-
-		/*  Without these, we might miss the rightmost/bottom pixel:  */
-		d->update_x2 += (q - 1);
-		d->update_y2 += (q - 1);
-
-		d->update_x1 = d->update_x1 / q * q;
-		d->update_x2 = d->update_x2 / q * q;
-		d->update_y1 = d->update_y1 / q * q;
-		d->update_y2 = d->update_y2 / q * q;
-
-		addr  = d->update_y1 * d->bytes_per_line +
-		    d->update_x1 * d->bit_depth / 8;
-		addr2 = d->update_y1 * d->bytes_per_line +
-		    d->update_x2 * d->bit_depth / 8;
+		dev_fb_damage(d, d->update_x1, d->update_y1,
+		    d->update_x2, d->update_y2);
+		d->update_x1 = d->update_y1 = 99999;
+		d->update_x2 = d->update_y2 = -1;
+	}
 
 #ifdef WITH_X11
-		for (y=d->update_y1; y<=d->update_y2; y+=q) {
-			d->redraw_func(d, addr, addr2 - addr, pixels, pitch);
-			addr  += d->bytes_per_line * q;
-			addr2 += d->bytes_per_line * q;
-		}
+	struct fb_window *fbw = d->fb_window;
+	int i, q = d->vfb_scaledown;
 
-    for (int y = d->update_y1; y < d->update_y2; y++) {
-      int start_addr = (y * d->xsize + d->update_x1) / (d->bit_depth * 8);
-      int end_addr = (y * d->xsize + d->update_x2 + std::min(1, d->bit_depth / 8)) / (d->bit_depth * 8);
-      d->redraw_func(d, start_addr, end_addr - start_addr, pixels, pitch);
-    }
+	if (d->n_damage == 0 && !fbw->needs_present)
+		return;
 
-		need_to_flush_x11 = 1;
-#endif
+	/*
+	 *  Redraw each damaged rectangle into the host copy of the window,
+	 *  and upload only that rectangle to the window texture.
+	 */
+	int pitch = d->x11_xsize * 4;
+
+	for (i = 0; i < d->n_damage; i++) {
+		struct vfb_rect r = d->damage[i];
+		SDL_Rect tex_rect;
+		int y, addr, sx, npixels, len;
+
+		if (r.x2 >= d->visible_xsize)
+			r.x2 = d->visible_xsize - 1;
+		if (r.y2 >= d->visible_ysize)
+			r.y2 = d->visible_ysize - 1;
+		if (r.x1 > r.x2 || r.y1 > r.y2)
+			continue;
+
+		r.x1 = r.x1 / q * q;
+		r.y1 = r.y1 / q * q;
+		r.x2 = (r.x2 + q - 1) / q * q;
+		r.y2 = (r.y2 + q - 1) / q * q;
+
+		/*  Redrawing starts at a byte boundary:  */
+		addr = r.y1 * d->bytes_per_line + r.x1 * d->bit_depth / 8;
+		sx = (addr % d->bytes_per_line) * 8 / d->bit_depth;
+		npixels = r.x2 + q - sx;
+		len = (npixels * d->bit_depth + 7) / 8;
+
+		tex_rect.x = sx / q;
+		tex_rect.y = r.y1 / q;
+		tex_rect.w = std::min(npixels / q, d->x11_xsize - tex_rect.x);
+		tex_rect.h = std::min((r.y2 - r.y1) / q + 1,
+		    d->x11_ysize - tex_rect.y);
+		if (tex_rect.w <= 0 || tex_rect.h <= 0)
+			continue;
+
+		for (y = r.y1; y <= r.y2; y += q) {
+			d->redraw_func(d, addr, len, d->x11_pixels, pitch);
+			addr += d->bytes_per_line * q;
+		}
 
-		d->update_x1 = d->update_y1 = 99999;
-		d->update_x2 = d->update_y2 = -1;
+		SDL_UpdateTexture(fbw->fb_data, &tex_rect, d->x11_pixels +
+		    tex_rect.y * pitch + tex_rect.x * 4, pitch);
 	}
 
-#ifdef WITH_X11
-  SDL_Rect cursor_rect;
-  cursor_rect.x = 0;
-  cursor_rect.y = 0;
-  cursor_rect.w = d->fb_window->x11_fb_winxsize;
-  cursor_rect.h = d->fb_window->x11_fb_winysize;
-  SDL_RenderCopy(d->fb_window->x11_fb_render, d->fb_window->fb_data, &cursor_rect, &cursor_rect);
-
-  for (auto c = d->fb_window->cursors.begin(); c != d->fb_window->cursors.end(); c++) {
+	SDL_Rect win_rect;
+	win_rect.x = 0;
+	win_rect.y = 0;
+	win_rect.w = fbw->x11_fb_winxsize;
+	win_rect.h = fbw->x11_fb_winysize;
+	SDL_RenderCopy(fbw->x11_fb_render, fbw->fb_data, &win_rect, &win_rect);
+
+  for (auto c = fbw->cursors.begin(); c != fbw->cursors.end(); c++) {
     // Handle cursor.
     if (c->on && c->render) {
       auto height = c->data.size() / c->width;
@@ -537,11 +579,17 @@ DEVICE_TICK(fb)
       dest_rect.w = c->width;
       dest_rect.h = height;
 
+      // The window contents under the cursor come from the host copy.
+      auto max_x = std::min(std::min(win_rect.w, d->x11_xsize), dest_x + c->width);
+      auto max_y = std::min(win_rect.h, d->x11_ysize);
+      auto skip = std::max(0, -dest_x);
+      auto count = max_x - (dest_x + skip);
+
       void *cpixels_void = nullptr;
       uint8_t *cpixels;
       int cpitch;
       SDL_LockTexture(c->render, nullptr, &cpixels_void, &cpitch);
-      if (!cpixels) {
+      if (!cpixels_void) {
         continue;
       }
 
@@ -549,11 +597,8 @@ DEVICE_TICK(fb)
       // Draw the cursor itself onto its buffer texture.
       for (int y = 0, row = 0; row < c->data.size(); y++, row += c->width) {
         auto target_y = dest_y + y;
-        if (target_y >= 0 && target_y < cursor_rect.h) {
-          auto real_y_row = ((uint8_t *)pixels) + pitch * target_y;
-          auto skip = std::max(0, -std::max(dest_x, 0));
-          auto max_x = std::min(dest_x + 64, cursor_rect.w);
-          auto count = std::min(64, skip ? 64 - skip : max_x - dest_x);
+        if (count > 0 && target_y >= 0 && target_y < max_y) {
+          auto real_y_row = d->x11_pixels + pitch * target_y;
           memcpy(cpixels + y * cpitch + 4 * skip, real_y_row + (dest_x + skip) * 4, count * 4);
         }
         for (int x = 0; x < c->width; x++) {
@@ -577,15 +622,18 @@ DEVICE_TICK(fb)
       }
       SDL_UnlockTexture(c->render);
 
-      fprintf(stderr, "[ fb: cursor render to display coords %dx%d ]\n", dest_rect.x, dest_rect.y);
-      SDL_RenderCopy(d->fb_window->x11_fb_render, c->render, nullptr, &dest_rect);
+      TRACE(TRACE_VGA, TRACE_DEBUG, "fb: cursor render to display coords %ix%i",
+          dest_rect.x, dest_rect.y);
+      SDL_RenderCopy(fbw->x11_fb_render, c->render, nullptr, &dest_rect);
     }
   }
 
-  SDL_RenderPresent(d->fb_window->x11_fb_render);
-  SDL_UnlockTexture(d->fb_window->fb_data);
+  SDL_RenderPresent(fbw->x11_fb_render);
+	fbw->needs_present = false;
 #endif
 
+	d->n_damage = 0;
+
 #if 0
 
 This is a hack used to produce raw ppm image dumps, which can then be
@@ -730,44 +778,8 @@ DEVICE_ACCESS(fb)
 	 *  of which area(s) we modify, so that the display isn't updated
 	 *  unnecessarily.
 	 */
-	if (writeflag == MEM_WRITE && cpu->machine->x11_md.in_use) {
-		int x, y, x2,y2;
-
-		x = (relative_addr % d->bytes_per_line) * 8 / d->bit_depth;
-		y = relative_addr / d->bytes_per_line;
-		x2 = ((relative_addr + len) % d->bytes_per_line)
-		    * 8 / d->bit_depth;
-		y2 = (relative_addr + len) / d->bytes_per_line;
-
-		if (x < d->update_x1 || d->update_x1 == -1)
-			d->update_x1 = x;
-		if (x > d->update_x2 || d->update_x2 == -1)
-			d->update_x2 = x;
-
-		if (y < d->update_y1 || d->update_y1 == -1)
-			d->update_y1 = y;
-		if (y > d->update_y2 || d->update_y2 == -1)
-			d->update_y2 = y;
-
-		if (x2 < d->update_x1 || d->update_x1 == -1)
-			d->update_x1 = x2;
-		if (x2 > d->update_x2 || d->update_x2 == -1)
-			d->update_x2 = x2;
-
-		if (y2 < d->update_y1 || d->update_y1 == -1)
-			d->update_y1 = y2;
-		if (y2 > d->update_y2 || d->update_y2 == -1)
-			d->update_y2 = y2;
-
-		/*
-		 *  An update covering more than one line will automatically
-		 *  force an update of all the affected lines:
-		 */
-		if (y != y2) {
-			d->update_x1 = 0;
-			d->update_x2 = d->xsize-1;
-		}
-	}
+	if (writeflag == MEM_WRITE && cpu->machine->x11_md.in_use)
+		fb_damage_bytes(d, relative_addr, relative_addr + len - 1);
 
 	/*
 	 *  Read from/write to the framebuffer:
@@ -919,6 +931,7 @@ struct vfb_data *dev_fb_init(struct machine *machine, struct memory *mem,
 		int i = 0;
 		d->fb_window = x11_fb_init(d->x11_xsize, d->x11_ysize,
 		    d->title, machine->x11_md.scaledown, machine);
+		fb_alloc_x11_pixels(d);
 		switch (d->fb_window->x11_screen_depth) {
 		case 15: i = 2; break;
 		case 16: i = 4; break;
@@ -48,12 +48,14 @@
 #include "machine.h"
 #include "memory.h"
 #include "misc.h"
+#include "trace.h"
 
 #define MIN(x,y) (((x) < (y)) ? (x) : (y))
 
 
 #define FDC_TICK_SHIFT   20
 #define	DEV_FDC_LENGTH		6	/*  TODO 8, but collision with wdc  */
+#define	FDC_DMA_CHANNEL		2
 
 #define STATE_CMD_BYTES 0x8000
 #define STATE_CMD_QUEUE 0x4000
@@ -127,15 +129,15 @@ static int st0_state(struct fdc_data *d)
 DEVICE_ACCESS(fdc)
 {
 	struct fdc_data *d = (struct fdc_data *) extra;
-	uint64_t idata = 0, read_addr = 0, read_len = 0, offset = 0;
+	struct dma8237_data *dma = cpu->machine->isa_dma;
+	uint64_t idata = 0, read_len = 0, offset = 0;
 	int oldstate = d->state;
 	size_t i;
   int was_interrupt = 0;
-  unsigned char eagle_dma_2[8], sector[512];
 
   if (d->asserting_interrupt) {
     was_interrupt = 1;
-    fprintf(stderr, "[ fdc: %s (%x) access while interrupt asserted ]\n", writeflag == MEM_WRITE ? "write" : "read", relative_addr);
+    TRACE(TRACE_FDC, TRACE_DEBUG, "[ fdc: %s (%x) access while interrupt asserted ]\n", writeflag == MEM_WRITE ? "write" : "read", relative_addr);
   }
 
   deassert_interrupt(d);
@@ -145,7 +147,7 @@ DEVICE_ACCESS(fdc)
 	if (writeflag == MEM_WRITE) {
     idata = memory_readmax64(cpu, data, len);
 		d->reg[relative_addr] = (uint8_t)idata;
-    fprintf(stderr, "[ fdc: %x <- %x ]\n", relative_addr, (unsigned int)idata);
+    TRACE(TRACE_FDC, TRACE_DEBUG, "[ fdc: %x <- %x ]\n", relative_addr, (unsigned int)idata);
   }
 
 	switch (relative_addr) {
@@ -153,14 +155,14 @@ DEVICE_ACCESS(fdc)
   case 0x03:
     if (writeflag == MEM_READ) {
       idata = 0x80;
-      fprintf(stderr, "[ fdc: read %02x from TDR ]\n", (unsigned int)idata);
+      TRACE(TRACE_FDC, TRACE_DEBUG, "[ fdc: read %02x from TDR ]\n", (unsigned int)idata);
       memory_writemax64(cpu, data, len, idata);
     }
     break;
 
 	case 0x04:
 		if (writeflag == MEM_WRITE) {
-			fprintf(stderr, "[ fdc: Status write %02x ]\n", (int)idata);
+			TRACE(TRACE_FDC, TRACE_DEBUG, "[ fdc: Status write %02x ]\n", (int)idata);
 		} else {
 			if (oldstate & STATE_CMD_QUEUE) {
 				idata = 0xd0; /* STATUS_DIR | STATUS_READY | STATUS_BUSY */
@@ -169,7 +171,7 @@ DEVICE_ACCESS(fdc)
 			}
 			d->state = oldstate & ~(STATE_CMD_BUSY | STATE_CMD_DMA);
 			if (d->status_read != (int)idata) {
-				fprintf(stderr, "[ fdc: Status read %02x ]\n", (int)idata);
+				TRACE(TRACE_FDC, TRACE_DEBUG, "[ fdc: Status read %02x ]\n", (int)idata);
         d->status_read = idata;
 			}
 			memory_writemax64(cpu, data, len, idata);
@@ -179,16 +181,15 @@ DEVICE_ACCESS(fdc)
 
 	case 0x05:
 		if (writeflag == MEM_WRITE) {
-			fprintf(stderr, "[ fdc: FIFO write %02x cq %d state %04x ]\n", (int)idata, d->command_size, oldstate);
+			TRACE(TRACE_FDC, TRACE_DEBUG, "[ fdc: FIFO write %02x cq %d state %04x ]\n", (int)idata, d->command_size, oldstate);
 			if (oldstate & STATE_CMD_BYTES) {
 				d->command_size--;
 				d->command_bytes[d->command_size] = idata;
 				if (!d->command_size) {
 					int command = oldstate & 0xff;
-          int low16_dma_addr;
 
 					oldstate = (oldstate & ~STATE_CMD_BYTES) | STATE_CMD_BUSY;
-					fprintf(stderr, "execute command %02x (reg2 %02x)\n", oldstate & 0xff, d->reg[2] & 0xff);
+					TRACE(TRACE_FDC, TRACE_DEBUG, "execute command %02x (reg2 %02x)\n", oldstate & 0xff, d->reg[2] & 0xff);
 					switch (command) {
 					case STATE_SEEK:
             d->recent_seek = true;
@@ -238,7 +239,7 @@ DEVICE_ACCESS(fdc)
             break;
 
 					case STATE_READ_ID:
-            fprintf(stderr, "[ fdc: read id with spt = %d ]\n", d->assumed_spt);
+            TRACE(TRACE_FDC, TRACE_DEBUG, "[ fdc: read id with spt = %d ]\n", d->assumed_spt);
             d->seek_head = !!(d->command_bytes[0] & 4);
 						d->state = STATE_READ_ID | STATE_CMD_QUEUE;
 						d->command_result = 7;
@@ -259,7 +260,7 @@ DEVICE_ACCESS(fdc)
 						d->seek_head = d->command_bytes[5];
 						d->read_sector = d->command_bytes[4];
 						d->eot_sector = d->command_bytes[2];
-						fprintf(stderr, "[ fdc: read C%d H%d S%d ]\n", d->seek_track, d->seek_head, d->read_sector);
+						TRACE(TRACE_FDC, TRACE_DEBUG, "[ fdc: read C%d H%d S%d ]\n", d->seek_track, d->seek_head, d->read_sector);
 						d->command_result = 7;
 						d->command_bytes[6] = st0_state(d);
 						d->command_bytes[5] = 0;
@@ -269,52 +270,28 @@ DEVICE_ACCESS(fdc)
 						d->command_bytes[1] = d->read_sector;
 						d->command_bytes[0] = 2;
 
-            // Ask the DMA system where to send the data in memory.
-            memcpy(eagle_dma_2, eagle_comm.eagle_comm_area, 8);
-            eagle_comm.eagle_comm_area[7] = 4;
+            // Ask the DMA system how much data it wants.
             eagle_comm.eagle_comm_area[8] = 0xff;
+            read_len = dma == NULL ? 0 :
+                dev_8237_remaining(dma, FDC_DMA_CHANNEL);
 
-            // Read addr programmed into DMA 2
-            // Note: lower 16 bits are shifted left 1 because dma is in
-            // 16 bit chunks.
-            low16_dma_addr = (eagle_dma_2[0] | (eagle_dma_2[1] << 8));
-            read_addr = (low16_dma_addr | (eagle_dma_2[2] << 16) | (eagle_dma_2[3] << 24)) & 0x7fffffff;
-            // Read len programmed into DMA 2
-            read_len = (((eagle_dma_2[4] & 0xff) | ((eagle_dma_2[5] & 0xff) << 8)) + 1) & ~1;
+            if (read_len > 0 && diskimage_exist(cpu->machine, 0, DISKIMAGE_FLOPPY)) {
+              unsigned char *buf;
+              size_t n_sectors = (read_len + 511) / 512;
 
-            fprintf(stderr, "[ fdc: read to %08" PRIx64" len %08" PRIx64" ]\n", read_addr, read_len);
-            if (diskimage_exist(cpu->machine, 0, DISKIMAGE_FLOPPY)) {
               // LBA = (cylinder * number_of_heads + head) * sectors_per_track + sector - 1
-              // offset = 512 * ((((d->seek_track * 2) + d->seek_head) * 18) + d->read_sector - 1);
               offset = 512 * ((((d->seek_track * 2) + d->seek_head) * d->assumed_spt) + (d->read_sector - 1));
 
-              while (read_len > 0) {
-                fprintf(stderr, "[ fdc: read diskette from %08x to addr %08" PRIx64" len %08" PRIx64" ]\n", offset, read_addr, read_len);
-                diskimage_access(cpu->machine, 0, DISKIMAGE_FLOPPY, 0, offset, sector, 512);
-                fprintf(stderr, "[ sector: %02x %02x %02x %02x ... %02x %02x %02x %02x ]\n", sector[0], sector[1], sector[2], sector[3], sector[508], sector[509], sector[510], sector[511]);
-
-                /*
-                for (i = 0; i < 128; i++) {
-                  unsigned char buf[4];
-                  buf[0] = sector[i * 4 + 3];
-                  buf[1] = sector[i * 4 + 2];
-                  buf[2] = sector[i * 4 + 1];
-                  buf[3] = sector[i * 4 + 0];
-                  memcpy(sector + i * 4, buf, 4);
-                }
-                */
-
-                cpu->memory_rw(cpu, cpu->mem, read_addr, sector, 512, MEM_WRITE, PHYSICAL | NO_EXCEPTIONS);
-
-                // XXX Check that we read it
-                cpu->memory_rw(cpu, cpu->mem, read_addr, eagle_dma_2, 8, MEM_READ, PHYSICAL | NO_EXCEPTIONS);
-                fprintf(stderr, "[ read back %02x %02x %02x %02x ... ]\n", eagle_dma_2[0], eagle_dma_2[1], eagle_dma_2[2], eagle_dma_2[3]);
-
-                read_addr += 512;
-                offset += 512;
-                read_len -= 512;
-                d->command_bytes[1] += 1;
-              }
+              TRACE(TRACE_FDC, TRACE_DEBUG, "[ fdc: read diskette from %08" PRIx64" len %08" PRIx64" ]\n", offset, read_len);
+
+              // Read all sectors at once, and let the DMA controller
+              // copy them into memory.
+              CHECK_ALLOCATION(buf = (unsigned char *) malloc(n_sectors * 512));
+              diskimage_access(cpu->machine, 0, DISKIMAGE_FLOPPY, 0, offset, buf, n_sectors * 512);
+              dev_8237_transfer(cpu, dma, FDC_DMA_CHANNEL, buf, read_len, MEM_WRITE);
+              free(buf);
+
+              d->command_bytes[1] += n_sectors;
             }
             maybe_interrupt(d);
             break;
@@ -324,29 +301,29 @@ DEVICE_ACCESS(fdc)
 				}
 			} else {
 				// New command
-        fprintf(stderr, "[ fdc: new command %02x ]\n", idata);
+        TRACE(TRACE_FDC, TRACE_DEBUG, "[ fdc: new command %02x ]\n", idata);
 
 				switch (idata & 0x1f) {
 				case STATE_SPECIFY:
-					fprintf(stderr, "[ fdc: specify, NDMA=%d ]\n", d->command_bytes[1] & 1);
+					TRACE(TRACE_FDC, TRACE_DEBUG, "[ fdc: specify, NDMA=%d ]\n", d->command_bytes[1] & 1);
 					d->command_size = 2;
 					d->state = STATE_CMD_BYTES | STATE_CMD_BUSY | STATE_SPECIFY;
 					break;
 
         case STATE_CHECK_DRIVE_STATUS:
-          fprintf(stderr, "[ fdc: check drive status ]\n");
+          TRACE(TRACE_FDC, TRACE_DEBUG, "[ fdc: check drive status ]\n");
           d->command_size = 1;
           d->state = STATE_CMD_BYTES | STATE_CMD_BUSY | STATE_CHECK_DRIVE_STATUS;
           break;
 
 				case STATE_RECAL:
-					fprintf(stderr, "[ fdc: recalibrate ]\n");
+					TRACE(TRACE_FDC, TRACE_DEBUG, "[ fdc: recalibrate ]\n");
 					d->state = STATE_CMD_BYTES | STATE_CMD_BUSY | STATE_RECAL;
 					d->command_size = 1;
 					break;
 
 				case SENSE_INTERRUPT:
-					fprintf(stderr, "[ fdc: sense interrupt ]\n");
+					TRACE(TRACE_FDC, TRACE_DEBUG, "[ fdc: sense interrupt ]\n");
 					d->command_size = 0;
 					d->command_result = 2;
           d->command_bytes[1] = 0x20;
@@ -356,13 +333,13 @@ DEVICE_ACCESS(fdc)
 					break;
 
 				case STATE_SEEK:
-					fprintf(stderr, "[ fdc: seek ]\n");
+					TRACE(TRACE_FDC, TRACE_DEBUG, "[ fdc: seek ]\n");
 					d->state = STATE_CMD_BYTES | STATE_CMD_BUSY | STATE_SEEK;
 					d->command_size = 2;
 					break;
 
 				case STATE_VERSION:
-					fprintf(stderr, "[ fdc: version ]\n");
+					TRACE(TRACE_FDC, TRACE_DEBUG, "[ fdc: version ]\n");
 					d->command_result = 1;
 					d->command_bytes[0] = 0x90;
 					d->state = STATE_VERSION | STATE_CMD_QUEUE;
@@ -370,30 +347,30 @@ DEVICE_ACCESS(fdc)
 					break;
 
 				case STATE_CONFIGURE:
-					fprintf(stderr, "[ fdc: configure ]\n");
+					TRACE(TRACE_FDC, TRACE_DEBUG, "[ fdc: configure ]\n");
 					d->command_size = 3;
 					d->state = STATE_CMD_BYTES | STATE_CMD_BUSY | STATE_CONFIGURE;
 					break;
 
 				case STATE_READ_ID:
-					fprintf(stderr, "[ fdc: read id ]\n");
+					TRACE(TRACE_FDC, TRACE_DEBUG, "[ fdc: read id ]\n");
 					d->command_size = 1;
 					d->state = STATE_CMD_BYTES | STATE_CMD_BUSY | STATE_READ_ID;
 					break;
 
         case STATE_PERPMODE:
-          fprintf(stderr, "[ fdc: perpendicular mode ]\n");
+          TRACE(TRACE_FDC, TRACE_DEBUG, "[ fdc: perpendicular mode ]\n");
           d->command_size = 1;
           d->state = STATE_CMD_BYTES | STATE_CMD_BUSY | STATE_PERPMODE;
           break;
 
 				case STATE_READ_NORMAL_DATA:
-					fprintf(stderr, "[ fdc: read normal data ]\n");
+					TRACE(TRACE_FDC, TRACE_DEBUG, "[ fdc: read normal data ]\n");
 					d->command_size = 8;
 					d->state = STATE_CMD_BYTES | STATE_CMD_BUSY | STATE_READ_NORMAL_DATA;
 					break;
         default:
-          fprintf(stderr, "[ fdc: UNKNOWN COMMAND %02x ]\n", idata & 0x1f);
+          TRACE(TRACE_FDC, TRACE_WARN, "[ fdc: UNKNOWN COMMAND %02x ]\n", idata & 0x1f);
           break;
 				}
 			}
@@ -402,7 +379,7 @@ DEVICE_ACCESS(fdc)
 				d->command_result--;
 				idata = d->command_bytes[d->command_result];
 				memory_writemax64(cpu, data, len, idata);
-				fprintf(stderr, "[ fdc: command result %02x (rem %02x) from %d ]\n", (int)idata, d->command_result, d->state & 0xff);
+				TRACE(TRACE_FDC, TRACE_DEBUG, "[ fdc: command result %02x (rem %02x) from %d ]\n", (int)idata, d->command_result, d->state & 0xff);
 				if (!d->command_result) {
           if ((oldstate & 0xff) == STATE_READ_NORMAL_DATA) {
             d->state = STATE_READ_NORMAL_DATA | STATE_CMD_DMA | STATE_CMD_BUSY;
@@ -416,18 +393,18 @@ DEVICE_ACCESS(fdc)
 				}
         return 1;
 			} else {
-				fprintf(stderr, "[ fdc: FIFO READ ]\n");
+				TRACE(TRACE_FDC, TRACE_DEBUG, "[ fdc: FIFO READ ]\n");
 			}
 		}
 		break;
 
 	case 0x02:
 		if (writeflag == MEM_WRITE) {
-      fprintf(stderr, "[ fdc: DOR write %02x ]\n", (int)idata);
+      TRACE(TRACE_FDC, TRACE_DEBUG, "[ fdc: DOR write %02x ]\n", (int)idata);
       d->command_size = 0;
       if (idata & 4) {
         if (d->dor_reset) {
-          fprintf(stderr, "[ fdc: DOR reset done ]\n");
+          TRACE(TRACE_FDC, TRACE_DEBUG, "[ fdc: DOR reset done ]\n");
           d->state = STATE_EMPTY;
 					maybe_interrupt(d);
         } else {
@@ -440,7 +417,7 @@ DEVICE_ACCESS(fdc)
       }
 		} else {
 			d->state = oldstate;
-      fprintf(stderr, "[ fdc: read DOR ]\n");
+      TRACE(TRACE_FDC, TRACE_DEBUG, "[ fdc: read DOR ]\n");
       memory_writemax64(cpu, data, len, 0);
 		}
 		break;
@@ -487,11 +464,11 @@ DEVICE_ACCESS(fdc_3f7)
 	idata = memory_readmax64(cpu, data, len);
 
 	if (writeflag == MEM_WRITE) {
-      fprintf(stderr, "[ fdc: write 3f7 %02x ]\n", (int)idata);
+      TRACE(TRACE_FDC, TRACE_DEBUG, "[ fdc: write 3f7 %02x ]\n", (int)idata);
       d->assumed_spt = (idata & 3) == 3 ? 36 : 18;
 	} else {
 	    idata = 0;
-	    fprintf(stderr, "[ fdc: read 3f7 -> %02x ]\n", (int)idata);
+	    TRACE(TRACE_FDC, TRACE_DEBUG, "[ fdc: read 3f7 -> %02x ]\n", (int)idata);
 	    memory_writemax64(cpu, data, len, idata);
 	}
 
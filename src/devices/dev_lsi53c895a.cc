@@ -18,6 +18,7 @@
 #include <string.h>
 #include <assert.h>
 
+#include "checkpoint.h"
 #include "cpu.h"
 #include "device.h"
 #include "devices.h"
@@ -793,7 +794,7 @@ static int scsi_req_enqueue(struct cpu *cpu, SCSIRequest *req) {
       return 1;
 
     default:
-      fprintf(stderr, "lsi: unknown opcode %02x\n", req->cmd.buf[0]);
+      TRACE(TRACE_SCSI, TRACE_WARN, "lsi: unknown opcode %02x\n", req->cmd.buf[0]);
         ABORT();
     }
 }
@@ -3247,6 +3248,112 @@ DEVICE_TICK(lsi53c895a)
   }
 }
 
+DEVICE_CHECKPOINT(lsi53c895a)
+{
+    LSIState *s = (LSIState *) extra;
+
+    /*
+     * Like QEMU's vmstate for this device, only an idle controller can be
+     * saved; in-flight requests point into host buffers and disk state.
+     */
+    if (ckpt->writeflag == MEM_WRITE && (s->current != NULL ||
+        !QTAILQ_EMPTY(&s->queue) || !QTAILQ_EMPTY(&s->bus.queue))) {
+        fatal("[ lsi53c895a: SCSI requests in flight, can't checkpoint"
+              " now; try again later ]\n");
+        ckpt->error = 1;
+        return;
+    }
+
+    CHECKPOINT_VAR(ckpt, s->config);
+    CHECKPOINT_VAR(ckpt, s->asserted);
+    CHECKPOINT_VAR(ckpt, s->pending_bad);
+    CHECKPOINT_VAR(ckpt, s->pending_gen);
+    CHECKPOINT_VAR(ckpt, s->carry);
+    CHECKPOINT_VAR(ckpt, s->status);
+    CHECKPOINT_VAR(ckpt, s->msg_action);
+    CHECKPOINT_VAR(ckpt, s->msg_len);
+    CHECKPOINT_VAR(ckpt, s->msg);
+    CHECKPOINT_VAR(ckpt, s->waiting);
+    CHECKPOINT_VAR(ckpt, s->current_lun);
+    CHECKPOINT_VAR(ckpt, s->select_tag);
+    CHECKPOINT_VAR(ckpt, s->command_complete);
+    CHECKPOINT_VAR(ckpt, s->dsa);
+    CHECKPOINT_VAR(ckpt, s->temp);
+    CHECKPOINT_VAR(ckpt, s->dnad);
+    CHECKPOINT_VAR(ckpt, s->dbc);
+    CHECKPOINT_VAR(ckpt, s->istat0);
+    CHECKPOINT_VAR(ckpt, s->istat1);
+    CHECKPOINT_VAR(ckpt, s->dcmd);
+    CHECKPOINT_VAR(ckpt, s->dstat);
+    CHECKPOINT_VAR(ckpt, s->dien);
+    CHECKPOINT_VAR(ckpt, s->sist0);
+    CHECKPOINT_VAR(ckpt, s->sist1);
+    CHECKPOINT_VAR(ckpt, s->sien0);
+    CHECKPOINT_VAR(ckpt, s->sien1);
+    CHECKPOINT_VAR(ckpt, s->mbox0);
+    CHECKPOINT_VAR(ckpt, s->mbox1);
+    CHECKPOINT_VAR(ckpt, s->dfifo);
+    CHECKPOINT_VAR(ckpt, s->ctest2);
+    CHECKPOINT_VAR(ckpt, s->ctest3);
+    CHECKPOINT_VAR(ckpt, s->ctest4);
+    CHECKPOINT_VAR(ckpt, s->ctest5);
+    CHECKPOINT_VAR(ckpt, s->ccntl0);
+    CHECKPOINT_VAR(ckpt, s->ccntl1);
+    CHECKPOINT_VAR(ckpt, s->dsp);
+    CHECKPOINT_VAR(ckpt, s->dsps);
+    CHECKPOINT_VAR(ckpt, s->dmode);
+    CHECKPOINT_VAR(ckpt, s->dcntl);
+    CHECKPOINT_VAR(ckpt, s->scntl0);
+    CHECKPOINT_VAR(ckpt, s->scntl1);
+    CHECKPOINT_VAR(ckpt, s->scntl2);
+    CHECKPOINT_VAR(ckpt, s->scntl3);
+    CHECKPOINT_VAR(ckpt, s->sstat0);
+    CHECKPOINT_VAR(ckpt, s->sstat1);
+    CHECKPOINT_VAR(ckpt, s->scid);
+    CHECKPOINT_VAR(ckpt, s->sxfer);
+    CHECKPOINT_VAR(ckpt, s->socl);
+    CHECKPOINT_VAR(ckpt, s->sdid);
+    CHECKPOINT_VAR(ckpt, s->gpreg);
+    CHECKPOINT_VAR(ckpt, s->ssid);
+    CHECKPOINT_VAR(ckpt, s->sfbr);
+    CHECKPOINT_VAR(ckpt, s->sbcl);
+    CHECKPOINT_VAR(ckpt, s->stest1);
+    CHECKPOINT_VAR(ckpt, s->stest2);
+    CHECKPOINT_VAR(ckpt, s->stest3);
+    CHECKPOINT_VAR(ckpt, s->sidl);
+    CHECKPOINT_VAR(ckpt, s->macntl);
+    CHECKPOINT_VAR(ckpt, s->stime0);
+    CHECKPOINT_VAR(ckpt, s->stime1);
+    CHECKPOINT_VAR(ckpt, s->respid0);
+    CHECKPOINT_VAR(ckpt, s->respid1);
+    CHECKPOINT_VAR(ckpt, s->mmrs);
+    CHECKPOINT_VAR(ckpt, s->mmws);
+    CHECKPOINT_VAR(ckpt, s->sfs);
+    CHECKPOINT_VAR(ckpt, s->drs);
+    CHECKPOINT_VAR(ckpt, s->sbms);
+    CHECKPOINT_VAR(ckpt, s->dbms);
+    CHECKPOINT_VAR(ckpt, s->dnad64);
+    CHECKPOINT_VAR(ckpt, s->pmjad1);
+    CHECKPOINT_VAR(ckpt, s->pmjad2);
+    CHECKPOINT_VAR(ckpt, s->rbc);
+    CHECKPOINT_VAR(ckpt, s->ua);
+    CHECKPOINT_VAR(ckpt, s->ia);
+    CHECKPOINT_VAR(ckpt, s->sbc);
+    CHECKPOINT_VAR(ckpt, s->csbc);
+    CHECKPOINT_VAR(ckpt, s->scratch);
+    CHECKPOINT_VAR(ckpt, s->sbr);
+    CHECKPOINT_VAR(ckpt, s->adder);
+    CHECKPOINT_VAR(ckpt, s->script_ram);
+
+    if (ckpt->writeflag == MEM_WRITE)
+        return;
+
+    if (s->asserted)
+        INTERRUPT_ASSERT(s->ext_irq);
+    else
+        INTERRUPT_DEASSERT(s->ext_irq);
+}
+
 DEVINIT(lsi53c895a)
 {
     struct lsi53c895a_data *d;
@@ -3280,6 +3387,8 @@ DEVINIT(lsi53c895a)
 
     machine_add_tickfunction(devinit->machine, dev_lsi53c895a_tick,
                              d, LSI_TICK_SHIFT);
+    machine_add_checkpoint_function(devinit->machine, "lsi53c895a",
+                                    dev_lsi53c895a_checkpoint, d);
 
    return 1;
 }
@@ -42,12 +42,13 @@
 #include <string.h>
 #include <time.h>
 
+#include "checkpoint.h"
 #include "cpu.h"
 #include "devices.h"
 #include "machine.h"
 #include "memory.h"
 #include "misc.h"
-#include "timer.h"
+#include "trace.h"
 
 #include "thirdparty/mc146818reg.h"
 
@@ -57,12 +58,27 @@
 
 // #define MC146818_DEBUG  1
 
-#define	MC146818_TICK_SHIFT	14
+/*
+ *  The time of day is not advanced by a tick function. Instead, the time
+ *  the registers show (reg_time) is brought up to date whenever the guest
+ *  accesses the chip, from either emulated time (base_time plus executed
+ *  instructions, by default) or the host's clock (the -G option).
+ *
+ *  The tick function is only scheduled while the guest has periodic,
+ *  alarm or update-ended interrupts enabled.
+ */
+
+/*  Emulated instructions per RTC second, unless -I is used:  */
+#define	MC146818_DEFAULT_IPS	(1 << 26)
+
+/*  The date the RTC starts at when it follows emulated time:  */
+#define	MC146818_EMULATED_EPOCH	1733775436
 
 
 /*  256 on DECstation, SGI uses reg at 72*4 as the Century  */
 #define	N_REGISTERS	1024
 struct mc_data {
+	struct machine	*machine;
 	int		access_style;
 	int		last_addr;
 
@@ -74,19 +90,18 @@ struct mc_data {
 
 	int		timebase_hz;
 	int		interrupt_hz;
-	int		old_interrupt_hz;
 	struct interrupt irq;
-	struct timer	*timer;
-	volatile int	pending_timer_interrupts;
 
-  int   updating;
+	int		updating;
 
-	int		previous_second;
+	int64_t		previous_second;
 	int		n_seconds_elapsed;
 	int		uip_threshold;
 
-  time_t time;
-  int   ticks;
+	int		host_time;	/*  follow the host's clock  */
+	int64_t		base_time;	/*  RTC time at base_ninstrs  */
+	uint64_t	base_ninstrs;
+	int64_t		reg_time;	/*  time shown by the registers  */
 };
 
 /*
@@ -103,86 +118,213 @@ struct mc_data {
 const int month_days[] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
 
 
+static int mc146818_ips(struct mc_data *d)
+{
+	return d->machine->emulated_hz > 0?
+	    d->machine->emulated_hz : MC146818_DEFAULT_IPS;
+}
+
+
 /*
- *  timer_tick():
+ *  mc146818_now():
  *
- *  Called d->interrupt_hz times per (real-world) second.
+ *  Returns the current RTC time, in seconds since the epoch.
  */
-static void timer_tick(struct timer *timer, void *extra)
+static int64_t mc146818_now(struct mc_data *d)
 {
-	struct mc_data *d = (struct mc_data *) extra;
-	d->pending_timer_interrupts ++;
+	if (d->host_time)
+		return time(NULL);
+
+	return d->base_time + (int64_t) ((d->machine->cpus[0]->ninstrs -
+	    d->base_ninstrs) / mc146818_ips(d));
 }
 
-static bool mc146818_increment_carry(int *field, int bound) {
-  *field += 1;
-  if (*field >= bound) {
-    *field = 0;
-    return true;
-  }
 
-  return false;
+static int mc146818_get(struct mc_data *d, int r)
+{
+	return d->use_bcd? from_bcd(d->reg[4 * r]) : d->reg[4 * r];
 }
 
-static void mc146818_cascade_time(struct mc_data *d) {
-  // Advance the clock chip by 1 second the hard way
-  d->updating = false;
-  auto next_min = mc146818_increment_carry(&d->reg[4 * MC_SEC], 60);
-  auto next_hour = next_min ? mc146818_increment_carry(&d->reg[4 * MC_MIN], 60) : false;
-  auto next_day = next_hour && mc146818_increment_carry(&d->reg[4 * MC_HOUR], 24);
-  if (!next_day) {
-    return;
-  }
-
-  int use_month = d->reg[4 * MC_MONTH] - 1;
-  if (use_month >= 12) {
-    use_month = 0;
-  }
-  int use_month_days = month_days[use_month];
-  auto next_month = mc146818_increment_carry(&d->reg[4 * MC_DOM], use_month_days);
-  d->reg[MC_DOW] = (((d->reg[MC_DOW] - 1) + 1) % 7) + 1;
-  if (next_month && mc146818_increment_carry(&d->reg[4 * MC_MONTH], 12)) {
-    ++d->reg[MC_YEAR];
-  }
-
-  // Alarm?
-  if ((d->reg[MC_REGB * 4] & MC_REGB_AIE) && d->reg[MC_ASEC * 4] == d->reg[MC_SEC * 4] && d->reg[MC_AMIN * 4] == d->reg[MC_MIN * 4] && d->reg[MC_AHOUR * 4] == d->reg[MC_HOUR * 4]) {
-    d->reg[MC_REGB * 4] |= MC_REGC_AF;
-    d->reg[MC_REGC * 4] |= MC_REGC_IRQF;
-		INTERRUPT_ASSERT(d->irq);
-  }
+
+static void mc146818_set(struct mc_data *d, int r, int value)
+{
+	d->reg[4 * r] = d->use_bcd? to_bcd(value % 100) : value;
+}
+
+
+/*
+ *  mc146818_advance():
+ *
+ *  Moves the date and time registers n seconds forward.
+ *
+ *  NOTE: The year register is stored in a different way on different
+ *  machines (see mc146818_initial_update_time()), so leap years are just
+ *  assumed to be those where the register value is a multiple of 4.
+ */
+static void mc146818_advance(struct mc_data *d, int64_t n)
+{
+	int64_t sec = mc146818_get(d, MC_SEC) + n;
+	int64_t min = mc146818_get(d, MC_MIN) + sec / 60;
+	int64_t hour = mc146818_get(d, MC_HOUR) + min / 60;
+	int64_t days = hour / 24;
+	int dom, month, year;
+
+	mc146818_set(d, MC_SEC, sec % 60);
+	mc146818_set(d, MC_MIN, min % 60);
+	mc146818_set(d, MC_HOUR, hour % 24);
+
+	if (days == 0)
+		return;
+
+	mc146818_set(d, MC_DOW,
+	    (mc146818_get(d, MC_DOW) - 1 + days) % 7 + 1);
+
+	dom = mc146818_get(d, MC_DOM);
+	month = mc146818_get(d, MC_MONTH);
+	year = mc146818_get(d, MC_YEAR);
+	if (month < 1 || month > 12)
+		month = 1;
+
+	while (days > 0) {
+		int left = month_days[month - 1] - dom +
+		    (month == 2 && (year & 3) == 0);
+
+		if (days <= left) {
+			dom += days;
+			break;
+		}
+
+		days -= left + 1;
+		dom = 1;
+		if (++month > 12) {
+			month = 1;
+			year ++;
+		}
+	}
+
+	mc146818_set(d, MC_DOM, dom);
+	mc146818_set(d, MC_MONTH, month);
+	mc146818_set(d, MC_YEAR, year);
+}
+
+
+/*
+ *  mc146818_alarm_matches():
+ *
+ *  Returns 1 if the alarm registers match the current time. Alarm register
+ *  values 0xc0..0xff are "don't care".
+ */
+static int mc146818_alarm_matches(struct mc_data *d)
+{
+	static const int regs[3][2] = {
+	    { MC_ASEC, MC_SEC }, { MC_AMIN, MC_MIN }, { MC_AHOUR, MC_HOUR } };
+
+	for (int i = 0; i < 3; i++) {
+		int alarm = d->reg[4 * regs[i][0]];
+		if ((alarm & 0xc0) != 0xc0 && alarm != d->reg[4 * regs[i][1]])
+			return 0;
+	}
+
+	return 1;
+}
+
+
+/*
+ *  mc146818_update():
+ *
+ *  Brings the date and time registers up to date. Unless the guest has set
+ *  the SET bit, in which case they are frozen. Update-ended and alarm flags
+ *  are raised for the seconds that have passed.
+ */
+static void mc146818_update(struct mc_data *d)
+{
+	int64_t now = mc146818_now(d), n = now - d->reg_time;
+	int regb = d->reg[MC_REGB * 4];
+
+	if (n == 0)
+		return;
+
+	d->reg_time = now;
+	if (n < 0 || (regb & MC_REGB_SET))
+		return;
+
+	if ((regb & MC_REGB_AIE) && n <= 24 * 60 * 60) {
+		/*  Step one second at a time, so that no alarm is missed:  */
+		while (n-- > 0) {
+			mc146818_advance(d, 1);
+			if (mc146818_alarm_matches(d))
+				d->reg[MC_REGC * 4] |= MC_REGC_AF;
+		}
+	} else {
+		mc146818_advance(d, n);
+	}
+
+	if (regb & MC_REGB_UIE)
+		d->reg[MC_REGC * 4] |= MC_REGC_UF;
 }
 
+
+/*
+ *  mc146818_schedule():
+ *
+ *  Sets the rate of the tick function from the enabled interrupts: the
+ *  programmed periodic rate, once per (emulated) second for alarm and
+ *  update-ended interrupts, or not at all.
+ */
+static void mc146818_schedule(struct mc_data *d)
+{
+	int regb = d->reg[MC_REGB * 4];
+	int interval = 0;
+
+	if ((regb & MC_REGB_PIE) && d->interrupt_hz > 0)
+		interval = mc146818_ips(d) / d->interrupt_hz;
+	else if (regb & (MC_REGB_AIE | MC_REGB_UIE))
+		interval = mc146818_ips(d);
+
+	machine_set_tickfunction_interval(d->machine, dev_mc146818_tick,
+	    d, interval);
+}
+
+
 DEVICE_TICK(mc146818)
 {
 	struct mc_data *d = (struct mc_data *) extra;
-	int pti = d->pending_timer_interrupts;
-
-  if (eagle_comm.want_timer_int) {
-    fprintf(stderr, "mc146818: want timer int: %d\n", eagle_comm.want_timer_int);
-    if (--eagle_comm.want_timer_int == 0) {
-      pti++;
-    }
-  }
-
-  if (d->ticks++ >= 0x1000) {
-    d->ticks = 0;
-    d->time++;
-    // fprintf(stderr, "mc146818: +1sec\n");
-    pti++;
-    mc146818_cascade_time(d);
-  }
-
-	if ((d->reg[MC_REGB * 4] & MC_REGB_PIE) && pti > 0) {
-		INTERRUPT_ASSERT(d->irq);
+	int regb = d->reg[MC_REGB * 4];
+
+	mc146818_update(d);
 
+	if ((regb & MC_REGB_PIE) && d->interrupt_hz > 0)
 		d->reg[MC_REGC * 4] |= MC_REGC_PF;
-	}
 
-	if (d->reg[MC_REGC * 4] & MC_REGC_UF ||
-	    d->reg[MC_REGC * 4] & MC_REGC_AF ||
-	    d->reg[MC_REGC * 4] & MC_REGC_PF)
+	if (((regb & MC_REGB_PIE) && (d->reg[MC_REGC * 4] & MC_REGC_PF)) ||
+	    ((regb & MC_REGB_AIE) && (d->reg[MC_REGC * 4] & MC_REGC_AF)) ||
+	    ((regb & MC_REGB_UIE) && (d->reg[MC_REGC * 4] & MC_REGC_UF))) {
 		d->reg[MC_REGC * 4] |= MC_REGC_IRQF;
+		INTERRUPT_ASSERT(d->irq);
+	}
+}
+
+
+DEVICE_CHECKPOINT(mc146818)
+{
+	struct mc_data *d = (struct mc_data *) extra;
+
+	CHECKPOINT_VAR(ckpt, d->last_addr);
+	CHECKPOINT_VAR(ckpt, d->register_choice);
+	CHECKPOINT_VAR(ckpt, d->reg);
+	CHECKPOINT_VAR(ckpt, d->timebase_hz);
+	CHECKPOINT_VAR(ckpt, d->interrupt_hz);
+	CHECKPOINT_VAR(ckpt, d->updating);
+	CHECKPOINT_VAR(ckpt, d->previous_second);
+	CHECKPOINT_VAR(ckpt, d->n_seconds_elapsed);
+	CHECKPOINT_VAR(ckpt, d->base_time);
+	CHECKPOINT_VAR(ckpt, d->base_ninstrs);
+	CHECKPOINT_VAR(ckpt, d->reg_time);
+
+	if (ckpt->writeflag == MEM_WRITE)
+		return;
+
+	mc146818_schedule(d);
 }
 
 
@@ -222,17 +364,14 @@ DEVICE_ACCESS(mc146818_jazz)
 /*
  *  mc146818_initial_update_time():
  *
- *  This function updates the MC146818 registers by using a host
- *  clock reading and setting the date and time based on it.
- *
- *  this isn't possible to use for every second because the guest
- *  code might be doing wacky stuff.
- *
+ *  This function sets the MC146818 date and time registers from reg_time.
+ *  After this, they are only moved forward by mc146818_advance(), since the
+ *  guest code might be doing wacky stuff with them.
  */
 static void mc146818_initial_update_time(struct mc_data *d)
 {
 	struct tm *tmp;
-	time_t timet = d->time;
+	time_t timet = d->reg_time;
 
 	tmp = gmtime(&timet);
 
@@ -323,8 +462,6 @@ static void mc146818_initial_update_time(struct mc_data *d)
 DEVICE_ACCESS(mc146818)
 {
 	struct mc_data *d = (struct mc_data *) extra;
-	struct tm *tmp;
-	time_t timet;
 	size_t i;
 
 	/*  NOTE/TODO: This access function only handles 8-bit accesses!  */
@@ -406,13 +543,14 @@ DEVICE_ACCESS(mc146818)
 	 *  Linux on at least sgimips and evbmips (Malta) wants the UIP bit
 	 *  in REGA to be updated once a second.
 	 */
+	mc146818_update(d);
+
 	if (relative_addr == MC_REGA*4 || relative_addr == MC_REGC*4) {
-		timet = d->time;
-		tmp = gmtime(&timet);
-		d->reg[MC_REGC * 4] &= ~MC_REGC_UF;
-		if (tmp->tm_sec != d->previous_second) {
+		if (!(d->reg[MC_REGB * 4] & MC_REGB_UIE))
+			d->reg[MC_REGC * 4] &= ~MC_REGC_UF;
+		if (d->reg_time != d->previous_second) {
 			d->n_seconds_elapsed ++;
-			d->previous_second = tmp->tm_sec;
+			d->previous_second = d->reg_time;
 		}
 		if (d->n_seconds_elapsed > d->uip_threshold) {
 			d->n_seconds_elapsed = 0;
@@ -484,28 +622,19 @@ DEVICE_ACCESS(mc146818)
 				;
 			}
 
-			if (d->interrupt_hz != d->old_interrupt_hz) {
-				debug("[ rtc changed to interrupt at %i Hz ]\n",
-				    d->interrupt_hz);
-
-				d->old_interrupt_hz = d->interrupt_hz;
-
-				if (d->timer == NULL)
-					d->timer = timer_add(d->interrupt_hz,
-					    timer_tick, d);
-				else
-					timer_update_frequency(d->timer,
-					    d->interrupt_hz);
-			}
+			TRACE(TRACE_RTC, TRACE_DEBUG, "[ mc146818: periodic "
+			    "rate %i Hz ]\n", d->interrupt_hz);
 
 			d->reg[MC_REGA * 4] =
 			    data[0] & (MC_REGA_RSMASK | MC_REGA_DVMASK);
+			mc146818_schedule(d);
 			break;
 		case MC_REGB*4:
 			d->reg[MC_REGB*4] = data[0];
 			if (!(data[0] & MC_REGB_PIE)) {
 				INTERRUPT_DEASSERT(d->irq);
 			}
+			mc146818_schedule(d);
 
 			/*  debug("[ mc146818: write to MC_REGB, data[0] "
 			    "= 0x%02x ]\n", data[0]);  */
@@ -530,50 +659,30 @@ DEVICE_ACCESS(mc146818)
 			break;
     case MC_SEC * 4:
     case MC_MIN * 4:
-      d->reg[relative_addr] = data[0] % 60;
-      d->updating = true;
-      break;
-
     case MC_HOUR * 4:
-      d->reg[relative_addr] = data[0] % 24;
-      d->updating = true;
-      break;
-
     case MC_MONTH * 4:
-      d->reg[relative_addr] = 1 + ((data[0] - 1) % 12);
-      d->updating = true;
-      break;
-
     case MC_DOW * 4:
-      d->reg[relative_addr] = 1 + ((data[0] - 1) % 7);
-      d->updating = true;
-      break;
-
     case MC_DOM * 4:
-      {
-        auto month = (d->reg[MC_MONTH * 4] - 1) % 12;
-        d->reg[relative_addr] = data[0] % month_days[month];
-        d->updating = true;
-      }
-      break;
-
     case MC_YEAR * 4:
+      /*  Stored as written (BCD or binary); mc146818_advance() moves
+          on from here.  */
+      d->reg[relative_addr] = data[0];
       d->updating = true;
       break;
 
     case MC_ASEC * 4:
       d->reg[relative_addr] = data[0];
-      fprintf(stderr, "[ mc146818: alarm secs %d ]\n", d->reg[relative_addr]);
+      TRACE(TRACE_RTC, TRACE_DEBUG, "[ mc146818: alarm secs %d ]\n", d->reg[relative_addr]);
       break;
 
     case MC_AMIN * 4:
       d->reg[relative_addr] = data[0];
-      fprintf(stderr, "[ mc146818: alarm min %d ]\n", d->reg[relative_addr]);
+      TRACE(TRACE_RTC, TRACE_DEBUG, "[ mc146818: alarm min %d ]\n", d->reg[relative_addr]);
       break;
 
     case MC_AHOUR * 4:
       d->reg[relative_addr] = data[0];
-      fprintf(stderr, "[ mc146818: alarm hour: %d ]\n", d->reg[relative_addr]);
+      TRACE(TRACE_RTC, TRACE_DEBUG, "[ mc146818: alarm hour: %d ]\n", d->reg[relative_addr]);
       break;
 
     default:
@@ -635,15 +744,6 @@ DEVICE_ACCESS(mc146818)
 
 		if (relative_addr == MC_REGC*4) {
 			INTERRUPT_DEASSERT(d->irq);
-
-			/*
-			 *  Acknowledging an interrupt decreases the
-			 *  number of pending "real world" timer ticks.
-			 */
-			if (d->reg[MC_REGC * 4] & MC_REGC_PF &&
-			    d->pending_timer_interrupts > 0)
-				d->pending_timer_interrupts --;
-
 			d->reg[MC_REGC * 4] = 0x00;
 		}
 	}
@@ -678,6 +778,7 @@ void dev_mc146818_init(struct machine *machine, struct memory *mem,
 	CHECK_ALLOCATION(d = (struct mc_data *) malloc(sizeof(struct mc_data)));
 	memset(d, 0, sizeof(struct mc_data));
 
+	d->machine       = machine;
 	d->access_style  = access_style;
 	d->addrdiv       = addrdiv;
 
@@ -758,10 +859,17 @@ void dev_mc146818_init(struct machine *machine, struct memory *mem,
 	    dev_len * addrdiv, dev_mc146818_access,
 	    d, DM_DEFAULT, NULL);
 
-	d->time = 1733775436;
+	d->host_time = machine->rtc_host_time;
+	d->base_time = d->host_time? time(NULL) : MC146818_EMULATED_EPOCH;
+	d->base_ninstrs = machine->cpus[0]->ninstrs;
+	d->reg_time = d->base_time;
 	mc146818_initial_update_time(d);
 
+	/*  Not scheduled until the guest enables an interrupt:  */
 	machine_add_tickfunction(machine, dev_mc146818_tick, d,
-	    MC146818_TICK_SHIFT);
+	    N_SAFE_DYNTRANS_LIMIT_SHIFT);
+	mc146818_schedule(d);
+	machine_add_checkpoint_function(machine, "mc146818",
+	    dev_mc146818_checkpoint, d);
 }
 
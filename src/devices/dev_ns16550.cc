@@ -27,7 +27,20 @@
  *
  *  COMMENT: NS16550 serial controller
  *
- *  TODO: Implement the FIFO.
+ *  A 16550A with its 16 byte receive and transmit FIFOs, programmable
+ *  receive trigger levels, and character timeout interrupts. Without the
+ *  FIFOs enabled, it behaves like a 16450 (i.e. FIFOs of depth 1).
+ *
+ *  If the machine has an emulated_hz, characters are sent and received at
+ *  the rate given by the divisor latch and line control register, in
+ *  emulated time. Otherwise, sent characters go to the console directly,
+ *  and a whole FIFO of characters may be received per tick.
+ *
+ *  Sent characters are handed to the console a FIFO at a time, not one by
+ *  one, and interrupts are only taken when the guest has asked for them in
+ *  the IER.
+ *
+ *  TODO: Loopback mode, line status (error) and modem status interrupts.
  */
 
 #include <deque>
@@ -35,6 +48,7 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "checkpoint.h"
 #include "console.h"
 #include "cpu.h"
 #include "device.h"
@@ -47,301 +61,394 @@
 
 std::deque<uint8_t> debug_serial0_chars;
 
-/*  #define debug fatal  */
+/*  #define NS16550_DEBUG  */
 
 #define	TICK_SHIFT		11
 #define	DEV_NS16550_LENGTH	8
 
-#define com_fcr DEV_NS16550_LENGTH
-#define com_dlow (DEV_NS16550_LENGTH + 1)
-#define com_dhi (DEV_NS16550_LENGTH + 2)
-#define com_thr (DEV_NS16550_LENGTH + 3)
-#define com_lcr 3
+#define	NS_FIFO_SIZE		16
 
-#define INT_QUEUE_RXNOW 1
-#define INT_QUEUE_RXWAT 2
-#define INT_QUEUE_TXWAT 4
-#define INT_QUEUE_TXTIMEOUT 8
-#define INT_QUEUE_RXTIMEOUT 16
+/*  Character times without receive activity before a timeout interrupt:  */
+#define	NS_RX_TIMEOUT_CHARS	4
 
 struct ns_fifo {
-  int head, count;
-  uint8_t data[14];
+	int		head, count;
+	uint8_t		data[NS_FIFO_SIZE];
 };
 
-void fifo_push(struct ns_fifo *f, uint8_t data) {
-  if (f->count < 14) {
-    f->data[(f->head + f->count) % 14] = data;
-    f->count++;
-  }
+static void fifo_push(struct ns_fifo *f, uint8_t data)
+{
+	if (f->count < NS_FIFO_SIZE) {
+		f->data[(f->head + f->count) % NS_FIFO_SIZE] = data;
+		f->count++;
+	}
 }
 
-int fifo_have(struct ns_fifo *f) {
-  return f->count;
-}
+static int fifo_take(struct ns_fifo *f)
+{
+	int result;
 
-int fifo_take(struct ns_fifo *f) {
-  if (f->count > 0) {
-    auto result = f->data[f->head];
-    f->head = (f->head + 1) % 14;
-    f->count--;
-    return result;
-  }
+	if (f->count == 0)
+		return 0;
 
-  return 0;
+	result = f->data[f->head];
+	f->head = (f->head + 1) % NS_FIFO_SIZE;
+	f->count--;
+	return result;
 }
 
 struct ns_data {
 	int		addrmult;
 	int		in_use;
 	const char	*name;
-  bool  interrupt_asserted;
-  int   queued_int;
 	int		console_handle;
-	int		enable_fifo;
-  struct ns_fifo recv_f;
-  struct ns_fifo send_f;
+	struct machine	*machine;
 
 	struct interrupt irq;
+	bool		interrupt_asserted;
+
+	unsigned char	reg[DEV_NS16550_LENGTH];
+	uint8_t		fcr;
+	uint16_t	divisor;
+
+	struct ns_fifo	recv_f;
+	struct ns_fifo	send_f;
 
-	unsigned char	reg[DEV_NS16550_LENGTH + 4];
-  bool  pending_timeout;
+	bool		thre_pending;	/*  THR empty interrupt  */
+	int		rx_idle;	/*  character times  */
+	uint64_t	char_credit;
 };
 
-static void clear_fifo(struct ns_data *d) {
-  memset(&d->recv_f, 0, sizeof(d->recv_f));
-  memset(&d->send_f, 0, sizeof(d->send_f));
+static const int trigger_levels[4] = { 1, 4, 8, 14 };
+
+
+static bool fifo_ena(struct ns_data *d)
+{
+	return d->fcr & FIFO_ENABLE;
 }
 
-#define QUEUED_RECV 1
-#define QUEUED_SEND 2
-#define QUEUED_THR_EMPTY 4
-#define QUEUED_SEND_INT 8
 
-int trigger_levels[4] = { 1, 4, 8, 14 };
+/*  The number of characters the FIFOs can hold; 1 in 16450 mode.  */
+static int fifo_depth(struct ns_data *d)
+{
+	return fifo_ena(d)? NS_FIFO_SIZE : 1;
+}
 
- static int trigger_level(struct ns_data *d) {
-   return trigger_levels[d->reg[com_fcr] >> 6];
+
+static int trigger_level(struct ns_data *d)
+{
+	return fifo_ena(d)? trigger_levels[d->fcr >> 6] : 1;
 }
 
-static bool fifo_ena(struct ns_data *d) {
-  return d->reg[com_fcr] & 1;
+
+/*
+ *  char_times():
+ *
+ *  Returns the number of character times which have passed during one tick,
+ *  at the programmed baud rate and character format. Fractions of a
+ *  character are carried over to the next tick.
+ *
+ *  Without an emulated_hz, there is no emulated time to go by, and a whole
+ *  FIFO's worth is returned.
+ */
+static int char_times(struct ns_data *d)
+{
+	uint64_t hz = d->machine->emulated_hz, cost, n;
+	int lcr = d->reg[com_lctl], bits, baud;
+
+	if (hz == 0)
+		return NS_FIFO_SIZE;
+
+	/*  Start bit, data bits, parity, and stop bit(s):  */
+	bits = 1 + 5 + (lcr & LCR_8BITS) + ((lcr & LCR_PENAB)? 1 : 0) +
+	    ((lcr & LCR_STOPB)? 2 : 1);
+	baud = COM_FREQ / 16 / (d->divisor == 0? 1 : d->divisor);
+
+	/*  credit is in units of 1/baud cycles:  */
+	d->char_credit += (uint64_t) baud << TICK_SHIFT;
+	cost = hz * bits;
+	n = d->char_credit / cost;
+	d->char_credit -= n * cost;
+
+	/*  Don't let an idle line build up credit:  */
+	if (n > NS_FIFO_SIZE) {
+		n = NS_FIFO_SIZE;
+		d->char_credit = 0;
+	}
+
+	return n;
 }
 
-static int device_tick(struct ns_data *d) {
-  // Don't allow overrun even though real life would.
-  if (fifo_ena(d) && fifo_have(&d->recv_f) > 13) {
-    return 0;
-  }
-
-  // Don't allow overrun in non fifo mode either.
-  if (!fifo_ena(d) && d->queued_int & QUEUED_RECV) {
-    return 0;
-  }
-
-  // Handle a pending character if available.
-  while (console_charavail(d->console_handle)) {
-    auto ch = console_readchar(d->console_handle);
-    if (ch >= 0x100) {
-      continue;
-    }
-
-    if (isprint(ch)) {
-      fprintf(stderr, "[ ns16550: making char '%c' available ]\n", ch);
-    } else {
-      fprintf(stderr, "[ ns16550: making byte '%02x' available ]\n", ch);
-    }
-
-    if (fifo_ena(d)) {
-      fifo_push(&d->recv_f, ch);
-      d->reg[com_lsr] |= LSR_RXRDY;
-      d->queued_int |= QUEUED_RECV;
-      return 0;
-    }
-
-    d->reg[0] = ch;
-    d->reg[com_lsr] |= LSR_RXRDY;
-    d->queued_int |= QUEUED_RECV;
-    return 0;
-  }
-
-  return 0;
+
+/*
+ *  current_iir():
+ *
+ *  Returns the highest priority pending interrupt which is enabled in the
+ *  IER, or IIR_NOPEND.
+ */
+static int current_iir(struct ns_data *d)
+{
+	int ier = d->reg[com_ier];
+
+	if (ier & IER_ERXRDY) {
+		if (d->recv_f.count >= trigger_level(d))
+			return IIR_RXRDY;
+		if (fifo_ena(d) && d->recv_f.count > 0 &&
+		    d->rx_idle >= NS_RX_TIMEOUT_CHARS)
+			return IIR_RXTOUT;
+	}
+
+	if ((ier & IER_ETXRDY) && d->thre_pending)
+		return IIR_TXRDY;
+
+	return IIR_NOPEND;
 }
 
-static bool deassert_condition(struct ns_data *d, int iir, int queue_mask) {
-  if (d->reg[com_iir] == iir) {
-    d->interrupt_asserted = false;
-    INTERRUPT_DEASSERT(d->irq);
-    d->reg[com_iir] = 1;
-    d->queued_int = (d->queued_int | queue_mask) ^ queue_mask;
-    return true;
-  }
 
-  return false;
+static void update_interrupt(struct ns_data *d)
+{
+	bool assert = current_iir(d) != IIR_NOPEND;
+
+	if (assert == d->interrupt_asserted)
+		return;
+
+	d->interrupt_asserted = assert;
+	if (assert)
+		INTERRUPT_ASSERT(d->irq);
+	else
+		INTERRUPT_DEASSERT(d->irq);
 }
 
-static void redo_interrupt(struct ns_data *d) {
-  // Always drain transmitter.
-  if (fifo_have(&d->send_f) && fifo_ena(d)) {
-    d->reg[com_thr] = fifo_take(&d->send_f);
-    d->reg[com_lsr] |= LSR_TXRDY | LSR_TSRE;
-    d->queued_int &= ~QUEUED_THR_EMPTY;
-    d->queued_int |= QUEUED_SEND_INT;
-  } else if (!fifo_ena(d) && (d->queued_int & QUEUED_SEND)) {
-    d->queued_int = ((d->queued_int | QUEUED_SEND) ^ QUEUED_SEND) | QUEUED_THR_EMPTY;
-    d->queued_int |= QUEUED_SEND_INT;
-    d->reg[com_lsr] |= LSR_TXRDY | LSR_TSRE;
-  }
-
-  // Handle things that can cause interrupts one at a time.
-  if (fifo_have(&d->recv_f) && fifo_ena(d)) {
-    d->queued_int = (d->queued_int | QUEUED_RECV) ^ QUEUED_RECV;
-    d->reg[com_lsr] |= LSR_RXRDY;
-    d->reg[com_iir] = 12;
-  } else if (d->queued_int & QUEUED_RECV && !fifo_ena(d)) {
-    d->queued_int = (d->queued_int | QUEUED_RECV) ^ QUEUED_RECV;
-    d->reg[com_iir] = 4;
-  } else if ((d->queued_int & (QUEUED_THR_EMPTY | QUEUED_SEND_INT)) && (d->reg[com_iir] == 1)) {
-    d->queued_int = (d->queued_int | (QUEUED_THR_EMPTY | QUEUED_SEND_INT)) ^ (QUEUED_THR_EMPTY | QUEUED_SEND_INT);
-    d->reg[com_lsr] |= LSR_TXRDY | LSR_TSRE;
-    d->reg[com_iir] = 2;
-  } else {
-    d->reg[com_lsr] |= LSR_TXRDY | LSR_TSRE;
-    d->reg[com_iir] = 1;
-  }
-
-  if ((d->reg[com_iir] != 1) && !d->interrupt_asserted) {
-    fprintf(stderr, "[ ns16550: iir %02x assert interrupt ]\n", d->reg[com_iir]);
-    INTERRUPT_ASSERT(d->irq);
-    d->interrupt_asserted = true;
-    return;
-  }
-  if ((d->reg[com_iir] == 1) && d->interrupt_asserted) {
-    fprintf(stderr, "[ ns16550: iir 01 deassert interrupt ]\n", d->reg[com_iir]);
-    INTERRUPT_DEASSERT(d->irq);
-    d->interrupt_asserted = false;
-    return;
-  }
+
+/*
+ *  transmit():
+ *
+ *  Sends up to n characters from the transmit FIFO to the console, in one
+ *  go. When the FIFO runs empty, a THR empty interrupt becomes pending.
+ */
+static void transmit(struct ns_data *d, int n)
+{
+	unsigned char buf[NS_FIFO_SIZE];
+	int i;
+
+	if (n > d->send_f.count)
+		n = d->send_f.count;
+	if (n == 0)
+		return;
+
+	for (i = 0; i < n; i++)
+		buf[i] = fifo_take(&d->send_f);
+
+	console_putstr(d->console_handle, buf, n);
+
+	if (d->send_f.count == 0)
+		d->thre_pending = true;
 }
 
+
+/*
+ *  receive():
+ *
+ *  Moves up to n characters from the console into the receive FIFO. If the
+ *  FIFO is full, characters are left in the console's buffer, so that
+ *  nothing is lost. Idle character times count towards a timeout.
+ */
+static void receive(struct ns_data *d, int n)
+{
+	int received = 0;
+
+	while (received < n && d->recv_f.count < fifo_depth(d) &&
+	    console_charavail(d->console_handle)) {
+		int ch = console_readchar(d->console_handle);
+		if (ch < 0 || ch >= 0x100)
+			continue;
+
+		fifo_push(&d->recv_f, ch);
+		received ++;
+	}
+
+	if (received > 0)
+		d->rx_idle = 0;
+	else if (d->recv_f.count > 0 && d->rx_idle < NS_RX_TIMEOUT_CHARS)
+		d->rx_idle += n;
+}
+
+
 DEVICE_TICK(ns16550)
 {
 	struct ns_data *d = (struct ns_data *) extra;
+	int n = char_times(d);
 
-  device_tick(d);
-  redo_interrupt(d);
+	transmit(d, n);
+	receive(d, n);
+	update_interrupt(d);
 }
 
-static void data_output(struct ns_data *d, uint8_t data) {
-  console_putchar(d->console_handle, data);
-  if (fifo_ena(d)) {
-    d->reg[com_lsr] |= LSR_TSRE;
-    fifo_push(&d->send_f, data);
-    if (fifo_have(&d->send_f) < 14) {
-      d->reg[com_lsr] |= LSR_TXRDY | LSR_TSRE;
-    } else {
-      d->reg[com_lsr] = (d->reg[com_lsr] | LSR_TXRDY | LSR_TSRE) ^ (LSR_TXRDY | LSR_TSRE);
-    }
-    return;
-  }
-
-
-  d->reg[com_thr] = data;
-  d->reg[com_lsr] |= LSR_TSRE;
-  if (!deassert_condition(d, 2, QUEUED_THR_EMPTY)) {
-    d->queued_int |= QUEUED_THR_EMPTY;
-  }
+
+static void write_thr(struct ns_data *d, uint8_t data)
+{
+	d->thre_pending = false;
+
+	if (d->send_f.count >= fifo_depth(d)) {
+		/*  A real UART would overwrite; drop the character.  */
+		return;
+	}
+
+	fifo_push(&d->send_f, data);
+
+	/*  Without emulated time, sending takes no time:  */
+	if (d->machine->emulated_hz == 0)
+		transmit(d, d->send_f.count);
 }
 
-static uint8_t data_input(struct ns_data *d) {
-  if (fifo_ena(d)) {
-    if (fifo_have(&d->recv_f)) {
-      d->reg[0] = fifo_take(&d->recv_f);
-      if (!fifo_have(&d->recv_f)) {
-        d->reg[com_lsr] = (d->reg[com_lsr] | LSR_RXRDY) ^ LSR_RXRDY;
-      }
-      deassert_condition(d, 12, QUEUED_RECV);
-    }
 
-    return d->reg[0];
-  }
+static uint8_t read_rbr(struct ns_data *d)
+{
+	if (d->recv_f.count == 0)
+		return d->reg[com_data];
 
-  d->reg[com_lsr] = (d->reg[com_lsr] | LSR_RXRDY) ^ LSR_RXRDY;
-  if (!fifo_ena(d)) {
-    deassert_condition(d, 4, QUEUED_RECV);
-  }
+	d->reg[com_data] = fifo_take(&d->recv_f);
+	d->rx_idle = 0;
 
-  redo_interrupt(d);
+	return d->reg[com_data];
+}
 
-  return d->reg[0];
+
+static uint8_t read_lsr(struct ns_data *d)
+{
+	uint8_t lsr = 0;
+
+	if (d->recv_f.count > 0)
+		lsr |= LSR_RXRDY;
+	if (d->send_f.count == 0)
+		lsr |= LSR_TXRDY | LSR_TSRE;
+
+	return lsr;
 }
 
+
+static void write_fcr(struct ns_data *d, uint8_t idata)
+{
+	/*  Toggling the FIFO enable bit clears both FIFOs:  */
+	if ((idata ^ d->fcr) & FIFO_ENABLE)
+		idata |= FIFO_RCV_RST | FIFO_XMT_RST;
+
+	if (idata & FIFO_RCV_RST) {
+		memset(&d->recv_f, 0, sizeof(d->recv_f));
+		d->rx_idle = 0;
+	}
+	if (idata & FIFO_XMT_RST) {
+		memset(&d->send_f, 0, sizeof(d->send_f));
+		d->thre_pending = true;
+	}
+
+	d->fcr = idata & (FIFO_ENABLE | FIFO_DMA_MODE | FIFO_TRIGGER_14);
+}
+
+
 DEVICE_ACCESS(ns16550)
 {
 	uint64_t idata = 0, odata=0;
-	size_t i;
 	struct ns_data *d = (struct ns_data *) extra;
+	int dlab = d->reg[com_lctl] & LCR_DLAB;
 
-	if (writeflag == MEM_WRITE) {
+	/*  Always ignore the least significant bits:  */
+	relative_addr /= d->addrmult;
+
+	if (writeflag == MEM_WRITE)
 		idata = memory_readmax64(cpu, data, len);
-    fprintf(stderr, "[ ns16550 (%s): write %02x <- %02x ]\n", d->name, (unsigned int)relative_addr, (unsigned int)idata);
-  }
-
-  int dlab = !!(d->reg[com_lcr] & LCR_DLAB);
-  if (relative_addr == com_iir && writeflag == MEM_WRITE) {
-    relative_addr = com_fcr;
-  } else if (relative_addr == 0 && dlab) {
-    relative_addr = com_dlow;
-  } else if (relative_addr == 1 && dlab) {
-    relative_addr = com_dhi;
-  } else if (relative_addr == 0 && writeflag == MEM_WRITE) {
-    relative_addr = com_thr;
-  }
-
-  if (writeflag == MEM_WRITE) {
-    switch (relative_addr) {
-    case com_thr:
-      data_output(d, idata);
-      break;
-
-    default:
-      d->reg[relative_addr] = idata;
-      break;
-    }
-  } else {
-    odata = d->reg[relative_addr];
-    switch (relative_addr) {
-    case 0:
-      odata = d->reg[relative_addr] = data_input(d);
-      break;
-
-    case com_lsr:
-      d->reg[com_lsr] = (d->reg[com_lsr] | LSR_RXRDY) ^ LSR_RXRDY;
-      if (fifo_ena(d)) {
-        deassert_condition(d, 12, QUEUED_RECV);
-      } else {
-        deassert_condition(d, 4, QUEUED_RECV);
-      }
-      break;
-
-    case com_iir:
-      odata |= d->reg[com_fcr] & 0xc0;
-      d->reg[com_iir] = 1;
-      d->interrupt_asserted = false;
-      INTERRUPT_DEASSERT(d->irq);
-      break;
-    }
-  }
-
-	if (writeflag == MEM_READ) {
-    fprintf(stderr, "[ ns16550 (%s): read %08x -> %08x ]\n", d->name, relative_addr, (unsigned int)odata);
+
+	switch (relative_addr) {
+
+	case com_data:
+		if (writeflag == MEM_WRITE) {
+			if (dlab)
+				d->divisor = (d->divisor & 0xff00) | idata;
+			else
+				write_thr(d, idata);
+		} else
+			odata = dlab? (d->divisor & 0xff) : read_rbr(d);
+		break;
+
+	case com_ier:
+		if (writeflag == MEM_WRITE) {
+			if (dlab)
+				d->divisor = (d->divisor & 0xff) | (idata << 8);
+			else {
+				/*  Enabling the THRE interrupt while the
+				    THR is empty causes an interrupt:  */
+				if ((idata & IER_ETXRDY) &&
+				    !(d->reg[com_ier] & IER_ETXRDY) &&
+				    d->send_f.count == 0)
+					d->thre_pending = true;
+				d->reg[com_ier] = idata & 0x0f;
+			}
+		} else
+			odata = dlab? (d->divisor >> 8) : d->reg[com_ier];
+		break;
+
+	case com_iir:
+		if (writeflag == MEM_WRITE)
+			write_fcr(d, idata);
+		else {
+			odata = current_iir(d);
+			if (odata == IIR_TXRDY)
+				d->thre_pending = false;
+			if (fifo_ena(d))
+				odata |= IIR_FIFO_MASK;
+		}
+		break;
+
+	case com_lsr:
+		if (writeflag == MEM_READ)
+			odata = read_lsr(d);
+		break;
+
+	default:if (writeflag == MEM_WRITE)
+			d->reg[relative_addr] = idata;
+		else
+			odata = d->reg[relative_addr];
+	}
+
+	update_interrupt(d);
+
+#ifdef NS16550_DEBUG
+	fprintf(stderr, "[ ns16550 (%s): %s %i: %02x ]\n", d->name,
+	    writeflag == MEM_WRITE? "write" : "read", (int) relative_addr,
+	    (int) (writeflag == MEM_WRITE? idata : odata));
+#endif
+
+	if (writeflag == MEM_READ)
 		memory_writemax64(cpu, data, len, odata);
-  }
 
 	return 1;
 }
 
 
+DEVICE_CHECKPOINT(ns16550)
+{
+	struct ns_data *d = (struct ns_data *) extra;
+
+	CHECKPOINT_VAR(ckpt, d->interrupt_asserted);
+	CHECKPOINT_VAR(ckpt, d->reg);
+	CHECKPOINT_VAR(ckpt, d->fcr);
+	CHECKPOINT_VAR(ckpt, d->divisor);
+	CHECKPOINT_VAR(ckpt, d->recv_f);
+	CHECKPOINT_VAR(ckpt, d->send_f);
+	CHECKPOINT_VAR(ckpt, d->thre_pending);
+	CHECKPOINT_VAR(ckpt, d->rx_idle);
+	CHECKPOINT_VAR(ckpt, d->char_credit);
+
+	if (ckpt->writeflag == MEM_WRITE)
+		return;
+
+	if (d->interrupt_asserted)
+		INTERRUPT_ASSERT(d->irq);
+	else
+		INTERRUPT_DEASSERT(d->irq);
+}
+
+
 DEVINIT(ns16550)
 {
 	struct ns_data *d;
@@ -354,12 +461,14 @@ DEVINIT(ns16550)
 	d->addrmult	= devinit->addr_mult;
 	d->in_use	= devinit->in_use;
 	d->name		= devinit->name2 != NULL? devinit->name2 : "";
+	d->machine	= devinit->machine;
 	d->console_handle =
 	    console_start_slave(devinit->machine, devinit->name2 != NULL?
 	    devinit->name2 : devinit->name, d->in_use);
 
-  // THR empty
-  d->reg[com_lsr] = LSR_TXRDY | LSR_TSRE;
+	/*  115200 bps, 8N1:  */
+	d->divisor = 1;
+	d->reg[com_lctl] = LCR_8BITS;
 
 	INTERRUPT_CONNECT(devinit->interrupt_path, d->irq);
 
@@ -377,6 +486,8 @@ DEVINIT(ns16550)
 	    DM_DEFAULT, NULL);
 	machine_add_tickfunction(devinit->machine,
 	    dev_ns16550_tick, d, TICK_SHIFT);
+	machine_add_checkpoint_function(devinit->machine, name,
+	    dev_ns16550_checkpoint, d);
 
 	/*
 	 *  NOTE:  Ugly cast into a pointer, because this is a convenient way
@@ -41,6 +41,7 @@
 #include <string.h>
 #include <deque>
 
+#include "checkpoint.h"
 #include "console.h"
 #include "cpu.h"
 #include "devices.h"
@@ -48,10 +49,12 @@
 #include "memory.h"
 #include "misc.h"
 #include "debugger.h"
+#include "trace.h"
 
 #include "thirdparty/kbdreg.h"
 
-std::deque<keyboard_event_t> keyboard_debug_events;
+/*  Raw scancodes from the debugger's "kbd" command:  */
+static std::deque<int> keyboard_debug_events;
 
 /*  #define PCKBC_DEBUG  */
 /*  #define debug fatal  */
@@ -70,8 +73,16 @@ std::deque<keyboard_event_t> keyboard_debug_events;
 
 #define	PS2	100
 
+/*
+ *  The tick function only runs while there is something to do: host input
+ *  waiting in the console fifo (see console_set_input_notify()), or bytes
+ *  waiting in the 8042 queues. Otherwise it is switched off.
+ */
 #define	PCKBC_TICKSHIFT		11
 
+/*  Leave room for a full make/break sequence when draining the console:  */
+#define	PCKBC_QUEUE_RESERVE	8
+
 static inline bool port_enabled(int port, int cmdbyte) {
   if (port) {
     return !(cmdbyte & KC8_MDISABLE);
@@ -89,6 +100,11 @@ static inline bool port_int_enabled(int port, int cmdbyte) {
 }
 
 struct pckbc_data {
+	struct pckbc_data *next;	/*  see pckbc_list  */
+	struct machine	*machine;
+	int		ticking;	/*  Both accessed atomically,  */
+	int		wakeup_pending;	/*  see pckbc_wakeup()  */
+
 	int		console_handle;
 	int		in_use;
 
@@ -130,6 +146,8 @@ struct pckbc_data {
   int rst_order;
 };
 
+static struct pckbc_data *pckbc_list = NULL;
+
 #define	STATE_NORMAL			0
 #define	STATE_LDCMDBYTE			1
 #define	STATE_RDCMDBYTE			2
@@ -431,6 +449,68 @@ KeynameToPCKeyboardTable translation_tables[] = {
   { }
 };
 
+/*
+ *  pckbc_start_ticking():
+ *
+ *  Gives the tick function its interval back, unless it is already running.
+ */
+static void pckbc_start_ticking(struct pckbc_data *d)
+{
+	if (__atomic_exchange_n(&d->ticking, 1, __ATOMIC_SEQ_CST))
+		return;
+
+	machine_set_tickfunction_interval(d->machine, dev_pckbc_tick, d,
+	    1 << PCKBC_TICKSHIFT);
+}
+
+
+/*
+ *  pckbc_wakeup():
+ *
+ *  Makes sure that the tick function runs, because there is input to
+ *  deliver or queued data which may need an interrupt.
+ *
+ *  This is also the console's input notification, which may come from
+ *  another thread than the one running the tick function. The pending flag
+ *  is re-checked by the tick function after it has gone to sleep, so a
+ *  wakeup which races with it is never lost.
+ */
+static void pckbc_wakeup(void *extra)
+{
+	struct pckbc_data *d = (struct pckbc_data *) extra;
+
+	__atomic_store_n(&d->wakeup_pending, 1, __ATOMIC_SEQ_CST);
+	pckbc_start_ticking(d);
+}
+
+
+/*
+ *  dev_pckbc_inject():
+ *
+ *  Queues a raw scancode for the keyboard port of every pckbc (used by the
+ *  debugger's "kbd" command).
+ */
+void dev_pckbc_inject(int code)
+{
+	keyboard_debug_events.push_back(code);
+
+	for (struct pckbc_data *d = pckbc_list; d != NULL; d = d->next)
+		pckbc_wakeup(d);
+}
+
+
+/*
+ *  pckbc_queue_free():
+ *
+ *  Returns the number of bytes which can be added to a port's queue.
+ */
+static int pckbc_queue_free(struct pckbc_data *d, int port)
+{
+	return (d->tail[port] - d->head[port] - 1 + MAX_8042_QUEUELEN) %
+	    MAX_8042_QUEUELEN;
+}
+
+
 /*
  *  pckbc_add_code():
  *
@@ -438,7 +518,9 @@ KeynameToPCKeyboardTable translation_tables[] = {
  */
 void pckbc_add_code(struct pckbc_data *d, int code, int port)
 {
-  fprintf(stderr, "[ pckbc: %s enqueue %02x (asserted %d) ]\n", port ? "mouse" : "kbd", (uint8_t)code, d->currently_asserted[port]);
+	pckbc_wakeup(d);
+
+  TRACE(TRACE_KBD, TRACE_DEBUG, "[ pckbc: %s enqueue %02x (asserted %d) ]\n", port ? "mouse" : "kbd", (uint8_t)code, d->currently_asserted[port]);
 	/*  Add at the head, read at the tail:  */
 	d->head[port] = (d->head[port]+1) % MAX_8042_QUEUELEN;
 	if (d->head[port] == d->tail[port])
@@ -446,7 +528,7 @@ void pckbc_add_code(struct pckbc_data *d, int code, int port)
 
 	d->key_queue[port][d->head[port]] = code;
   if (port_enabled(port, d->cmdbyte) && !d->currently_asserted[port]) {
-    fprintf(stderr, "[ pckbc: interrupt port %d ]\n", port);
+    TRACE(TRACE_KBD, TRACE_DEBUG, "[ pckbc: interrupt port %d ]\n", port);
     if (port_int_enabled(port, d->cmdbyte)) {
       if (port == 0) {
         INTERRUPT_ASSERT(d->irq_keyboard);
@@ -492,59 +574,81 @@ int pckbc_get_code(struct pckbc_data *d, int port)
 }
 
 
+/*
+ *  pckbc_translate_key():
+ *
+ *  Adds the scancodes for a console key event (keyname << 8, possibly
+ *  with KEY_RELEASE) to the keyboard queue, using the current translation
+ *  table.
+ */
+static void pckbc_translate_key(struct pckbc_data *d, int ch)
+{
+  int key = (ch >> 8) & 0xff;
+  int release = ch & KEY_RELEASE;
+  KeynameToPCKeyboard *found = nullptr;
+
+  for (int t = 0; translation_tables[t].table; t++) {
+    if (translation_tables[t].type == d->translation_table) {
+      TRACE(TRACE_KBD, TRACE_DEBUG, "[ pckbc: using table %d (%d) ]\n", t, d->translation_table);
+      KeynameToPCKeyboard *table = translation_tables[t].table;
+      for (int i = 0; table[i].make_prefix; i++) {
+        if (table[i].keyname_idx == key) {
+          TRACE(TRACE_KBD, TRACE_DEBUG, "[ pckbc: using table entry %d ]\n", i);
+          found = &table[i];
+          break;
+        }
+      }
+      break;
+    }
+  }
+
+  if (!found)
+    return;
+
+  TRACE(TRACE_KBD, TRACE_DEBUG, "sending key %c%d -> %s\n", release ? '^' : '.', key, keynames[key]);
+  int or_break_code = 0;
+  if (release) {
+    for (int j = 0; found->break_prefix[j]; j++) {
+      pckbc_add_code(d, found->break_prefix[j], 0);
+    }
+    or_break_code = found->high_bit_break ? 0x80 : 0;
+  } else {
+    for (int j = 0; found->make_prefix[j]; j++) {
+      pckbc_add_code(d, found->make_prefix[j], 0);
+    }
+  }
+  pckbc_add_code(d, found->native_code | or_break_code, 0);
+}
+
+
 DEVICE_TICK(pckbc)
 {
 	struct pckbc_data *d = (struct pckbc_data *) extra;
-	int key, release, ints_enabled;
+	int ints_enabled, input_left = 0;
   int mouse_x, mouse_y, mouse_but, fb_nr;
-  KeynameToPCKeyboard *table = nullptr;
-  KeynameToPCKeyboard *found = nullptr;
 
 	ints_enabled = d->rx_int_enable;
 
+	__atomic_store_n(&d->wakeup_pending, 0, __ATOMIC_SEQ_CST);
+
   while (keyboard_debug_events.size()) {
-    auto event = keyboard_debug_events.front();
-    pckbc_add_code(d, event.code, 0);
+    pckbc_add_code(d, keyboard_debug_events.front(), 0);
     keyboard_debug_events.pop_front();
   }
 
-  if ((d->in_use & 1) && console_charavail(d->console_handle)) {
-    auto ch = console_readchar(d->console_handle);
-    if (ch >= 0x100) {
-      key = (ch >> 8) & 0xff;
-      release = ch & KEY_RELEASE;
-
-      for (int t = 0; translation_tables[t].table; t++) {
-        if (translation_tables[t].type == d->translation_table) {
-          fprintf(stderr, "[ pckbc: using table %d (%d) ]\n", t, d->translation_table);
-          table = translation_tables[t].table;
-          for (int i = 0; table[i].make_prefix; i++) {
-            if (table[i].keyname_idx == key) {
-              fprintf(stderr, "[ pckbc: using table entry %d ]\n", i);
-              found = &table[i];
-              break;
-            }
-          }
-          break;
-        }
-      }
+  /*
+   *  Deliver all keys waiting in the console fifo, as long as there is room
+   *  in the 8042 queue. Whatever is left is delivered on the next tick.
+   */
+  while ((d->in_use & 1) && console_charavail(d->console_handle)) {
+    if (pckbc_queue_free(d, 0) < PCKBC_QUEUE_RESERVE) {
+      input_left = 1;
+      break;
     }
-  }
 
-  if (found) {
-    fprintf(stderr, "sending key %c%d -> %s\n", release ? '^' : '.', key, keynames[key]);
-    int or_break_code = 0;
-    if (release) {
-      for (int j = 0; found->break_prefix[j]; j++) {
-        pckbc_add_code(d, found->break_prefix[j], 0);
-      }
-      or_break_code = found->high_bit_break ? 0x80 : 0;
-    } else {
-      for (int j = 0; found->make_prefix[j]; j++) {
-        pckbc_add_code(d, found->make_prefix[j], 0);
-      }
-    }
-    pckbc_add_code(d, found->native_code | or_break_code, 0);
+    auto ch = console_readchar(d->console_handle);
+    if (ch >= 0x100)
+      pckbc_translate_key(d, ch);
   }
 
   console_getmouse(&mouse_x, &mouse_y, &mouse_but, &fb_nr);
@@ -573,6 +677,17 @@ DEVICE_TICK(pckbc)
     d->mouse_last_but = mouse_but;
   }
 
+  /*  Nothing left to deliver? Then sleep until the next input:  */
+  if (!input_left && d->head[0] == d->tail[0] && d->head[1] == d->tail[1]) {
+    machine_set_tickfunction_interval(d->machine, dev_pckbc_tick, d, 0);
+    __atomic_store_n(&d->ticking, 0, __ATOMIC_SEQ_CST);
+
+    /*  Woken up in the meantime?  */
+    if (__atomic_load_n(&d->wakeup_pending, __ATOMIC_SEQ_CST))
+      pckbc_start_ticking(d);
+    return;
+  }
+
   if (d->cmdbyte & KC8_KDISABLE) {
     ints_enabled = 0;
   }
@@ -583,7 +698,7 @@ DEVICE_TICK(pckbc)
 
   for (int port = 0; port < 1; port++) {
     if (port_enabled(port, d->cmdbyte) && (d->head[port] != d->tail[port])) {
-      fprintf(stderr, "[ pckbc: tick interrupt port %d ]\n", port);
+      TRACE(TRACE_KBD, TRACE_DEBUG, "[ pckbc: tick interrupt port %d ]\n", port);
       if (port_int_enabled(port, d->cmdbyte)) {
         if (port == 0) {
           INTERRUPT_ASSERT(d->irq_keyboard);
@@ -729,7 +844,7 @@ static void dev_pckbc_command(struct cpu *cpu, struct pckbc_data *d, int port_nr
         break;
 
       default:
-        fprintf(stderr, "[ pckbc: unknown command %02x to mouse ]\n", cmd);
+        TRACE(TRACE_KBD, TRACE_WARN, "[ pckbc: unknown command %02x to mouse ]\n", cmd);
       }
       break;
 
@@ -1012,9 +1127,9 @@ DEVICE_ACCESS(pckbc)
           d->state == STATE_RDCMDBYTE ||
           d->state == STATE_RDOUTPUT) {
         odata |= KBS_DIB;
-        fprintf(stderr, "[ pckbc: keyboard output ring %d-%d ]\n", d->head[0], d->tail[0]);
+        TRACE(TRACE_KBD, TRACE_DEBUG, "[ pckbc: keyboard output ring %d-%d ]\n", d->head[0], d->tail[0]);
       } else if (d->head[1] != d->tail[1]) {
-        fprintf(stderr, "[ pckbc: mouse output ring %d-%d ]\n", d->head[1], d->tail[1]);
+        TRACE(TRACE_KBD, TRACE_DEBUG, "[ pckbc: mouse output ring %d-%d ]\n", d->head[1], d->tail[1]);
         odata |= KBS_DIB | 0x20;
       }
 
@@ -1192,6 +1307,58 @@ DEVICE_ACCESS(pckbc)
 }
 
 
+DEVICE_CHECKPOINT(pckbc)
+{
+	struct pckbc_data *d = (struct pckbc_data *) extra;
+
+	CHECKPOINT_VAR(ckpt, d->reg);
+	CHECKPOINT_VAR(ckpt, d->currently_asserted);
+	CHECKPOINT_VAR(ckpt, d->clocksignal);
+	CHECKPOINT_VAR(ckpt, d->rx_int_enable);
+	CHECKPOINT_VAR(ckpt, d->tx_int_enable);
+	CHECKPOINT_VAR(ckpt, d->keyscanning_enabled);
+	CHECKPOINT_VAR(ckpt, d->translation_table);
+	CHECKPOINT_VAR(ckpt, d->state);
+	CHECKPOINT_VAR(ckpt, d->cmdbyte);
+	CHECKPOINT_VAR(ckpt, d->output_byte);
+	CHECKPOINT_VAR(ckpt, d->last_scancode);
+	CHECKPOINT_VAR(ckpt, d->key_queue);
+	CHECKPOINT_VAR(ckpt, d->head);
+	CHECKPOINT_VAR(ckpt, d->tail);
+	CHECKPOINT_VAR(ckpt, d->mouse_cmd);
+	CHECKPOINT_VAR(ckpt, d->flex_id);
+	CHECKPOINT_VAR(ckpt, d->flex_code);
+	CHECKPOINT_VAR(ckpt, d->mouse_remote);
+	CHECKPOINT_VAR(ckpt, d->mouse_reporting);
+	CHECKPOINT_VAR(ckpt, d->mouse_scaling);
+	CHECKPOINT_VAR(ckpt, d->mouse_resolution);
+	CHECKPOINT_VAR(ckpt, d->mouse_sample_rate);
+	CHECKPOINT_VAR(ckpt, d->mouse_ena);
+	CHECKPOINT_VAR(ckpt, d->mouse_last_x);
+	CHECKPOINT_VAR(ckpt, d->mouse_last_y);
+	CHECKPOINT_VAR(ckpt, d->mouse_last_but);
+	CHECKPOINT_VAR(ckpt, d->mouse_timeout);
+	CHECKPOINT_VAR(ckpt, d->rst_order);
+
+	if (ckpt->writeflag == MEM_WRITE)
+		return;
+
+	if (d->currently_asserted[0])
+		INTERRUPT_ASSERT(d->irq_keyboard);
+	else
+		INTERRUPT_DEASSERT(d->irq_keyboard);
+
+	if (d->currently_asserted[1])
+		INTERRUPT_ASSERT(d->irq_mouse);
+	else
+		INTERRUPT_DEASSERT(d->irq_mouse);
+
+	/*  The tick function decides whether it is still needed:  */
+	__atomic_store_n(&d->ticking, 0, __ATOMIC_SEQ_CST);
+	pckbc_wakeup(d);
+}
+
+
 /*
  *  dev_pckbc_init():
  *
@@ -1218,6 +1385,7 @@ int dev_pckbc_init(struct machine *machine, struct memory *mem,
 	INTERRUPT_CONNECT(keyboard_irqpath, d->irq_keyboard);
 	INTERRUPT_CONNECT(mouse_irqpath, d->irq_mouse);
 
+	d->machine           = machine;
 	d->type              = type;
 	d->in_use            = in_use;
 	d->pc_style_flag     = pc_style_flag;
@@ -1237,6 +1405,15 @@ int dev_pckbc_init(struct machine *machine, struct memory *mem,
 	    len, dev_pckbc_access, d, DM_DEFAULT, NULL);
 	machine_add_tickfunction(machine, dev_pckbc_tick, d,
 	    PCKBC_TICKSHIFT);
+	machine_add_checkpoint_function(machine, "pckbc",
+	    dev_pckbc_checkpoint, d);
+
+	/*  Start ticking when there is input:  */
+	machine_set_tickfunction_interval(machine, dev_pckbc_tick, d, 0);
+	console_set_input_notify(d->console_handle, pckbc_wakeup, d);
+
+	d->next = pckbc_list;
+	pckbc_list = d;
 
 	return d->console_handle;
 }
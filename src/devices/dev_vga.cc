@@ -57,6 +57,9 @@
 #define	MAX_RETRACE_SCANLINES	420
 #define	N_IS1_READ_THRESHOLD	50
 
+/*  Number of pre-rendered glyphs to cache (must be a power of 2):  */
+#define	N_VGA_GLYPHS		1024
+
 #define	GFX_ADDR_WINDOW		0x18000
 
 #define	VGA_FB_ADDR	0x1c00000000ULL
@@ -141,6 +144,15 @@ struct vga_data {
 	int		update_y1;
 	int		update_x2;
 	int		update_y2;
+
+	/*  Glyph cache (see vga_glyph()). Each glyph is font_height rows of
+	    RGB pixels, replicated horizontally but not vertically:  */
+	uint32_t	glyph_generation;
+	size_t		glyph_size;
+	int		glyph_max_x;
+	uint64_t	*glyph_key;
+	unsigned char	*glyph_rgb;		/*  N_VGA_GLYPHS + 1 scratch  */
+	unsigned char	*glyph_line;		/*  one row of cells  */
 };
 
 
@@ -191,8 +203,8 @@ static void register_reset(struct vga_data *d)
 
 static void c_putstr(struct vga_data *d, const char *s)
 {
-	while (*s)
-		console_putchar(d->console_handle, *s++);
+	console_putstr(d->console_handle, (const unsigned char *) s,
+	    strlen(s));
 }
 
 
@@ -372,6 +384,175 @@ static void vga_update_graphics(struct machine *machine, struct vga_data *d,
 }
 
 
+/*
+ *  vga_render_glyph():
+ *
+ *  Renders the character ch in colors fg/bg into dst, as font_height rows
+ *  of font_width * pixel_repx RGB pixels. y is the character's first
+ *  scanline, only used when there is a palette per scanline.
+ */
+static void vga_render_glyph(struct vga_data *d, int ch, int fg, int bg,
+	int y, unsigned char *dst)
+{
+	unsigned char *pal = d->fb->rgb_palette;
+	int line, subx, ix;
+
+	for (line = 0; line < d->font_height; line++) {
+		unsigned char bits = d->font[ch * d->font_height + line];
+
+		if (d->use_palette_per_line) {
+			int sline = d->pixel_repy * (line + y);
+			if (sline < MAX_RETRACE_SCANLINES)
+				pal = d->retrace_palette + sline * 256*3;
+			else
+				pal = d->fb->rgb_palette;
+		}
+
+		for (subx = 0; subx < d->font_width; subx++) {
+			unsigned char *rgb = &pal[((bits & (128 >> subx))?
+			    fg : bg) * 3];
+
+			for (ix = 0; ix < d->pixel_repx; ix++) {
+				dst[0] = rgb[0];
+				dst[1] = rgb[1];
+				dst[2] = rgb[2];
+				dst += 3;
+			}
+		}
+	}
+}
+
+
+/*
+ *  vga_glyph():
+ *
+ *  Returns a pre-rendered glyph (see vga_render_glyph()), from the glyph
+ *  cache if possible. The cache is keyed on the character, the colors, and
+ *  the glyph generation, which is bumped whenever the palette or the video
+ *  mode changes. A change of size (e.g. of pixel_repx) flushes the cache.
+ */
+static unsigned char *vga_glyph(struct vga_data *d, int ch, int fg, int bg)
+{
+	size_t size = d->font_height * d->font_width * d->pixel_repx * 3;
+	uint64_t key = ((uint64_t) d->glyph_generation << 16) |
+	    (bg << 12) | (fg << 8) | ch;
+	int slot = (ch ^ (((bg << 4) | fg) * 37)) & (N_VGA_GLYPHS - 1);
+	unsigned char *glyph;
+
+	if (size != d->glyph_size || d->max_x != d->glyph_max_x) {
+		free(d->glyph_key);
+		free(d->glyph_rgb);
+		free(d->glyph_line);
+		CHECK_ALLOCATION(d->glyph_key = (uint64_t *)
+		    malloc(N_VGA_GLYPHS * sizeof(uint64_t)));
+		CHECK_ALLOCATION(d->glyph_rgb = (unsigned char *)
+		    malloc((N_VGA_GLYPHS + 1) * size));
+		CHECK_ALLOCATION(d->glyph_line = (unsigned char *)
+		    malloc(d->max_x * size));
+		memset(d->glyph_key, 0xff, N_VGA_GLYPHS * sizeof(uint64_t));
+		d->glyph_size = size;
+		d->glyph_max_x = d->max_x;
+	}
+
+	glyph = d->glyph_rgb + slot * size;
+	if (d->glyph_key[slot] != key) {
+		vga_render_glyph(d, ch, fg, bg, 0, glyph);
+		d->glyph_key[slot] = key;
+	}
+
+	return glyph;
+}
+
+
+/*
+ *  vga_scroll():
+ *
+ *  If the text at base is what was last drawn, moved up by one or more rows
+ *  (i.e. the guest scrolled the screen), then the framebuffer is moved up as
+ *  one block, and charcells_drawn is moved to match. Only the rows which
+ *  were scrolled in then need to be redrawn.
+ */
+static void vga_scroll(struct vga_data *d, size_t base)
+{
+	size_t rowlen = d->max_x * 2, screen = rowlen * d->max_y;
+	int n, r, changed_rows = 0, rowpixels = d->font_height * d->pixel_repy;
+
+	if (base + screen > d->charcells_size)
+		return;
+
+	for (r = 0; r < d->max_y; r++)
+		if (memcmp(d->charcells + base + r * rowlen,
+		    d->charcells_drawn + r * rowlen, rowlen) != 0)
+			changed_rows ++;
+
+	/*  Only worth it if fewer rows have to be redrawn after scrolling:  */
+	for (n = 1; n < changed_rows; n++)
+		if (memcmp(d->charcells + base, d->charcells_drawn + n * rowlen,
+		    screen - n * rowlen) == 0)
+			break;
+
+	if (n >= changed_rows)
+		return;
+
+	framebuffer_blockcopyfill(d->fb, 0, 0,0,0, 0, 0, d->fb->xsize - 1,
+	    (d->max_y - n) * rowpixels - 1, 0, n * rowpixels);
+	memmove(d->charcells_drawn, d->charcells_drawn + n * rowlen,
+	    screen - n * rowlen);
+}
+
+
+/*
+ *  vga_draw_cells():
+ *
+ *  Draws n character cells, starting at cell i (counted from the start of
+ *  the screen), which must all be on the same row. Each scanline of the
+ *  cells is written to the framebuffer in one go.
+ */
+static void vga_draw_cells(struct machine *machine, struct vga_data *d,
+	size_t base, size_t i, int n)
+{
+	size_t rowbytes = d->font_width * d->pixel_repx * 3;
+	int x = (i % d->max_x) * d->font_width;
+	int y = (i / d->max_x) * d->font_height;
+	int c, line, iy;
+
+	for (c = 0; c < n; c++) {
+		unsigned char ch = d->charcells[base + (i+c)*2];
+		unsigned char attr = d->charcells[base + (i+c)*2 + 1];
+		int fg = attr & 15, bg = (attr >> 4) & 7;
+		unsigned char *glyph;
+
+		/*  Blink is hard to do :-), but inversion might be ok too:  */
+		if (attr & 128) {
+			int tmp = fg; fg = bg; bg = tmp;
+		}
+
+		/*  With a palette per scanline, glyphs can't be cached:  */
+		if (d->use_palette_per_line) {
+			glyph = d->glyph_rgb + N_VGA_GLYPHS * d->glyph_size;
+			vga_render_glyph(d, ch, fg, bg, y, glyph);
+		} else
+			glyph = vga_glyph(d, ch, fg, bg);
+
+		for (line = 0; line < d->font_height; line++)
+			memcpy(d->glyph_line + (line * n + c) * rowbytes,
+			    glyph + line * rowbytes, rowbytes);
+	}
+
+	for (line = 0; line < d->font_height; line++) {
+		for (iy = 0; iy < d->pixel_repy; iy++) {
+			uint32_t addr = (d->fb_max_x * (d->pixel_repy *
+			    (line+y) + iy) + x * d->pixel_repx) * 3;
+			if (addr >= d->fb_size)
+				continue;
+			dev_fb_access(machine->cpus[0], machine->memory, addr,
+			    d->glyph_line + line * n * rowbytes, n * rowbytes,
+			    MEM_WRITE, d->fb);
+		}
+	}
+}
+
+
 /*
  *  vga_update_text():
  *
@@ -382,13 +563,10 @@ static void vga_update_graphics(struct machine *machine, struct vga_data *d,
 static void vga_update_text(struct machine *machine, struct vga_data *d,
 	int x1, int y1, int x2, int y2)
 {
-	int fg, bg, x,y, subx, line;
-	size_t i, start, end, base;
-	int font_size = d->font_height;
-	int font_width = d->font_width;
-	unsigned char *pal = d->fb->rgb_palette;
+	size_t i, start, end, base, run_start = 0;
+	int run_len = 0;
 
-	if (d->pixel_repx * font_width > 8*8) {
+	if (d->pixel_repx * d->font_width > 8*8) {
 		fatal("[ too large font ]\n");
 		return;
 	}
@@ -409,68 +587,41 @@ static void vga_update_text(struct machine *machine, struct vga_data *d,
 	if (!machine->x11_md.in_use)
 		vga_update_textmode(machine, d, base, start, end);
 
-	for (i=start; i<=end; i+=2) {
-		unsigned char ch = d->charcells[i + base];
+	if (d->palette_modified)
+		d->glyph_generation ++;
 
-		if (!d->palette_modified && d->charcells_drawn[i] == ch &&
-		    d->charcells_drawn[i+1] == d->charcells[i+base+1])
-			continue;
+	/*  Make sure that the glyph cache and buffers are allocated:  */
+	vga_glyph(d, ' ', 7, 0);
 
-		d->charcells_drawn[i] = ch;
-		d->charcells_drawn[i+1] = d->charcells[i + base + 1];
+	if (start == 0 && end + 1 >= (size_t) d->max_x * d->max_y * 2 &&
+	    !d->palette_modified && !d->use_palette_per_line)
+		vga_scroll(d, base);
 
-		fg = d->charcells[i+base + 1] & 15;
-		bg = (d->charcells[i+base + 1] >> 4) & 7;
+	/*  Draw runs of changed cells within each row:  */
+	for (i=start; i<=end; i+=2) {
+		unsigned char ch = d->charcells[i + base];
+		int changed = d->palette_modified ||
+		    d->charcells_drawn[i] != ch ||
+		    d->charcells_drawn[i+1] != d->charcells[i+base+1];
 
-		/*  Blink is hard to do :-), but inversion might be ok too:  */
-		if (d->charcells[i+base + 1] & 128) {
-			int tmp = fg; fg = bg; bg = tmp;
+		if (run_len > 0 && (!changed || (i/2) % d->max_x == 0)) {
+			vga_draw_cells(machine, d, base, run_start, run_len);
+			run_len = 0;
 		}
 
-		x = (i/2) % d->max_x; x *= font_width;
-		y = (i/2) / d->max_x; y *= font_size;
-
-		/*  Draw the character:  */
-		for (line = 0; line < font_size; line++) {
-			/*  hardcoded for max 8 scaleup... :-)  */
-			unsigned char rgb_line[3 * 8 * 8];
-			int iy;
-
-			for (subx = 0; subx < font_width; subx++) {
-				int ix, color_index;
-
-				if (d->use_palette_per_line) {
-					int sline = d->pixel_repy * (line+y);
-					if (sline < MAX_RETRACE_SCANLINES)
-						pal = d->retrace_palette
-						    + sline * 256*3;
-					else
-						pal = d->fb->rgb_palette;
-				}
-
-				if (d->font[ch * font_size + line] &
-				    (128 >> subx))
-					color_index = fg;
-				else
-					color_index = bg;
+		if (!changed)
+			continue;
 
-				for (ix=0; ix<d->pixel_repx; ix++)
-					memcpy(rgb_line + (subx*d->pixel_repx +
-					    ix) * 3, &pal[color_index * 3], 3);
-			}
+		d->charcells_drawn[i] = ch;
+		d->charcells_drawn[i+1] = d->charcells[i + base + 1];
 
-			for (iy=0; iy<d->pixel_repy; iy++) {
-				uint32_t addr = (d->fb_max_x * (d->pixel_repy *
-				    (line+y) + iy) + x * d->pixel_repx) * 3;
-				if (addr >= d->fb_size)
-					continue;
-				dev_fb_access(machine->cpus[0],
-				    machine->memory, addr, rgb_line,
-				    3 * machine->x11_md.scaleup * font_width,
-				    MEM_WRITE, d->fb);
-			}
-		}
+		if (run_len == 0)
+			run_start = i/2;
+		run_len ++;
 	}
+
+	if (run_len > 0)
+		vga_draw_cells(machine, d, base, run_start, run_len);
 }
 
 
@@ -874,6 +1025,7 @@ static void vga_crtc_reg_write(struct machine *machine, struct vga_data *d,
 		CHECK_ALLOCATION(d->gfx_mem = (unsigned char *) malloc(d->gfx_mem_size));
 
 		/*  Clear screen and reset the palette:  */
+		d->glyph_generation ++;
 		memset(d->charcells_outputed, 0, d->charcells_size);
 		memset(d->charcells_drawn, 0, d->charcells_size);
 		memset(d->gfx_mem, 0, d->gfx_mem_size);
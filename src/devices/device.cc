@@ -36,6 +36,7 @@
 #include "machine.h"
 #include "memory.h"
 #include "misc.h"
+#include "trace.h"
 
 
 static struct device_entry *device_entries = NULL;
@@ -374,8 +375,9 @@ void *device_add(struct machine *machine, const char *name_and_params)
 		}
 	}
 
-  fprintf(stderr, "%s irq %s addr %llx\n", name_and_params, devinit.interrupt_path, devinit.addr);
+  TRACE(TRACE_DEV, TRACE_INFO, "%s irq %s addr %llx\n", name_and_params, devinit.interrupt_path, (unsigned long long)devinit.addr);
   if (!strcmp(name_and_params, "wdc irq=machine[0].cpu[0].isa.13 addr=0x8086800001f0")) {
+    fprintf(stderr, "%s irq %s addr %llx\n", name_and_params, devinit.interrupt_path, (unsigned long long)devinit.addr);
     abort();
   }
 
@@ -139,6 +139,32 @@ public:
 	 *	because of a timeout).
 	 */
 	virtual bool WriteData(const uint64_t& data, Endianness endianness) = 0;
+
+	/**
+	 * \brief Looks up a direct host memory pointer for an address.
+	 *
+	 * Components backed by plain host memory (i.e. RAM) may implement
+	 * this, to let e.g. CPUs access memory directly instead of going
+	 * through AddressSelect(), ReadData() and WriteData(). The memory
+	 * contains data in the same byte order as used by ReadData() and
+	 * WriteData().
+	 *
+	 * Returned pointers are cached state; they may become invalid when
+	 * the component tree is modified, and should be forgotten in
+	 * Component::FlushCachedStateForComponent().
+	 *
+	 * \param address The address to look up.
+	 * \param length Set to the number of bytes, starting at address,
+	 *	that may be accessed using the returned pointer.
+	 * \param writable True if the memory is going to be written to.
+	 * \return A pointer to the host memory for the address, or NULL
+	 *	if direct access is not possible.
+	 */
+	virtual uint8_t* LookupHostMemory(uint64_t address, uint64_t& length,
+		bool writable)
+	{
+		return NULL;
+	}
 };
 
 
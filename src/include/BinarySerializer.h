@@ -0,0 +1,246 @@
+#ifndef BINARYSERIALIZER_H
+#define	BINARYSERIALIZER_H
+
+/*
+ *  Binary serialization of component trees.
+ *
+ *  See BinarySerializer and BinaryDeserializer below, and
+ *  Component::SerializeBinary.
+ */
+
+#include "misc.h"
+
+
+/**
+ * \brief Alignment (in bytes) of blobs in a binary serialization.
+ *
+ * Large blobs (e.g. RAM blocks) are aligned to this boundary within the
+ * serialized stream, so that they can be mapped directly from a file. It
+ * is larger than the page size of most hosts.
+ */
+#define	BINARYSERIALIZER_BLOB_ALIGNMENT		65536
+
+
+/**
+ * \brief Writer for the binary serialization format.
+ *
+ * The binary format is used for saving and loading of component trees
+ * (see Component::SerializeBinary). It consists of a header, followed by
+ * little-endian integers, length-prefixed strings, length-prefixed records
+ * and aligned raw blobs.
+ *
+ * Small items are accumulated in an internal buffer. Blobs are not copied;
+ * only a pointer to the data is kept, and the data is written directly from
+ * its original location by WriteToFile() using writev(2). The caller must
+ * therefore keep blob data alive and unmodified until the serializer has
+ * been written out.
+ */
+class BinarySerializer
+{
+public:
+	/**
+	 * \brief Constructs an empty BinarySerializer.
+	 */
+	BinarySerializer();
+
+	/**
+	 * \brief Writes the file header (magic and version).
+	 */
+	void WriteHeader();
+
+	void WriteUInt8(uint8_t value);
+	void WriteUInt32(uint32_t value);
+	void WriteUInt64(uint64_t value);
+
+	/**
+	 * \brief Writes a length-prefixed string.
+	 *
+	 * @param str The string to write.
+	 */
+	void WriteString(const string& str);
+
+	/**
+	 * \brief Writes (copies) a number of bytes into the stream.
+	 *
+	 * @param data Pointer to the data.
+	 * @param len Number of bytes.
+	 */
+	void WriteBytes(const void *data, size_t len);
+
+	/**
+	 * \brief Writes a blob, aligned to BINARYSERIALIZER_BLOB_ALIGNMENT.
+	 *
+	 * The data is not copied; see the class description.
+	 *
+	 * @param data Pointer to the data.
+	 * @param len Number of bytes.
+	 */
+	void WriteBlob(const void *data, size_t len);
+
+	/**
+	 * \brief Starts a length-prefixed record.
+	 *
+	 * @return A handle which should be passed to EndRecord().
+	 */
+	size_t BeginRecord();
+
+	/**
+	 * \brief Ends a length-prefixed record, by filling in its length.
+	 *
+	 * @param record The handle returned by BeginRecord().
+	 */
+	void EndRecord(size_t record);
+
+	/**
+	 * \brief Gets the total number of bytes serialized so far.
+	 *
+	 * @return The current size of the stream, in bytes.
+	 */
+	uint64_t GetSize() const;
+
+	/**
+	 * \brief Writes the serialized stream to a file descriptor.
+	 *
+	 * @param fd A file descriptor, open for writing.
+	 * @return true if all data was written, false on error.
+	 */
+	bool WriteToFile(int fd) const;
+
+	/**
+	 * \brief Copies the serialized stream into a vector.
+	 *
+	 * @param data The vector to fill with the serialized data.
+	 */
+	void GetData(vector<uint8_t>& data) const;
+
+private:
+	struct Segment {
+		const uint8_t*	external;	// NULL if in m_buffer
+		size_t		offset;		// Offset within m_buffer
+		size_t		length;
+	};
+
+	uint8_t* Append(size_t len);
+
+private:
+	vector<uint8_t>		m_buffer;
+	vector<Segment>		m_segments;
+	uint64_t		m_size;
+};
+
+
+/**
+ * \brief Reader for the binary serialization format.
+ *
+ * The data to read is either given as a memory buffer, or a file which is
+ * mapped into memory with Open(). For a mapped file, blobs may be mapped
+ * copy-on-write directly from the file, using MapBlob().
+ *
+ * Reading past the end of the data makes all subsequent reads fail; this
+ * can be checked with Failed().
+ */
+class BinaryDeserializer
+{
+public:
+	/**
+	 * \brief Constructs a BinaryDeserializer for a memory buffer.
+	 *
+	 * @param data Pointer to the serialized data.
+	 * @param len Length of the data, in bytes.
+	 */
+	BinaryDeserializer(const uint8_t *data = NULL, size_t len = 0);
+
+	~BinaryDeserializer();
+
+	/**
+	 * \brief Maps a file into memory, for deserialization.
+	 *
+	 * @param filename The name of the file.
+	 * @return true if the file could be opened and mapped.
+	 */
+	bool Open(const string& filename);
+
+	/**
+	 * \brief Reads and checks the file header.
+	 *
+	 * @return true if the header was valid, false otherwise.
+	 */
+	bool ReadHeader();
+
+	/**
+	 * \brief Checks whether a buffer starts with a binary serialization
+	 *	header.
+	 *
+	 * @param data Pointer to the first bytes of a file.
+	 * @param len Number of bytes available.
+	 * @return true if the data looks like a binary serialization.
+	 */
+	static bool IsBinarySerialization(const char *data, size_t len);
+
+	bool ReadUInt8(uint8_t& value);
+	bool ReadUInt32(uint32_t& value);
+	bool ReadUInt64(uint64_t& value);
+	bool ReadString(string& str);
+	bool ReadBytes(void *data, size_t len);
+
+	/**
+	 * \brief Reads a blob written by BinarySerializer::WriteBlob.
+	 *
+	 * @param len The length of the blob.
+	 * @return A pointer to the blob data within the deserialized
+	 *	buffer, or NULL on error.
+	 */
+	const uint8_t* ReadBlob(size_t len);
+
+	/**
+	 * \brief Maps a blob copy-on-write from the underlying file.
+	 *
+	 * The returned memory is private and writable, and must be released
+	 * using munmap(2). It stays valid after the %BinaryDeserializer
+	 * has been destroyed.
+	 *
+	 * @param blob A pointer returned by ReadBlob().
+	 * @param len The length of the blob.
+	 * @return A pointer to the mapped memory, or NULL if the data
+	 *	was not read from a file, or if mapping failed. In that
+	 *	case, the caller should copy the data instead.
+	 */
+	void* MapBlob(const uint8_t *blob, size_t len);
+
+	/**
+	 * \brief Starts reading a length-prefixed record.
+	 *
+	 * @return The position of the end of the record.
+	 */
+	size_t BeginRecord();
+
+	/**
+	 * \brief Skips to the end of a record.
+	 *
+	 * @param end The value returned by BeginRecord().
+	 */
+	void EndRecord(size_t end);
+
+	/**
+	 * \brief Checks whether any read has failed.
+	 *
+	 * @return true if the deserializer has run out of data.
+	 */
+	bool Failed() const;
+
+private:
+	const uint8_t* Consume(size_t len);
+
+private:
+	const uint8_t*	m_data;
+	size_t		m_length;
+	size_t		m_pos;
+	bool		m_failed;
+
+	// For mapped files:
+	int		m_fd;
+	void*		m_mapping;
+};
+
+
+#endif	// BINARYSERIALIZER_H
@@ -30,6 +30,7 @@
 
 #include "misc.h"
 
+#include "BinarySerializer.h"
 #include "Checksum.h"
 #include "SerializationContext.h"
 #include "StateVariable.h"
@@ -528,9 +529,35 @@ public:
 	static refcount_ptr<Component> Deserialize(ostream& messages,
 	    const string& str, size_t& pos);
 
+	/**
+	 * \brief Serializes the %Component into a binary stream.
+	 *
+	 * The binary format is much faster and more compact than the text
+	 * format, especially for large RAM contents, which are written as
+	 * raw blobs. The text format produced by Serialize() is mostly
+	 * useful for debugging.
+	 *
+	 * @param serializer A BinarySerializer which the %Component will
+	 *	be serialized to.
+	 */
+	void SerializeBinary(BinarySerializer& serializer) const;
+
+	/**
+	 * \brief Deserializes a binary stream into a component tree.
+	 *
+	 * @param messages A stream where errors/warnings may be reported.
+	 * @param deserializer The BinaryDeserializer to read from.
+	 * @return If deserialization was successful, the
+	 *	reference counted pointer will point to a component tree;
+	 *	on error, it will be set to NULL
+	 */
+	static refcount_ptr<Component> DeserializeBinary(ostream& messages,
+	    BinaryDeserializer& deserializer);
+
 	/**
 	 * \brief Checks consistency by serializing and deserializing the
-	 *	component (including all its child components), and comparing
+	 *	component (including all its child components), in both the
+	 *	text and the binary format, and comparing
 	 *	the checksum of the original tree with the deserialized tree.
 	 *
 	 * @return true if the serialization/deserialization was correct,
@@ -34,6 +34,7 @@
 
 #include "misc.h"
 
+#include "BinarySerializer.h"
 #include "SerializationContext.h"
 #include "UnitTest.h"
 
@@ -56,6 +57,31 @@ public:
 	virtual void Serialize(ostream& ss) const = 0;
 	virtual bool Deserialize(const string& value) = 0;
 	virtual void CopyValueFrom(CustomStateVariableHandler* other) = 0;
+
+	/**
+	 * \brief Serializes the value in binary form.
+	 *
+	 * The default implementation stores the text serialization as a
+	 * string. Handlers for large amounts of data should override this.
+	 */
+	virtual void SerializeBinary(BinarySerializer& serializer) const
+	{
+		stringstream ss;
+		Serialize(ss);
+		serializer.WriteString(ss.str());
+	}
+
+	/**
+	 * \brief Deserializes a value written by SerializeBinary.
+	 */
+	virtual bool DeserializeBinary(BinaryDeserializer& deserializer)
+	{
+		string value;
+		if (!deserializer.ReadString(value))
+			return false;
+
+		return Deserialize(value);
+	}
 };
 
 
@@ -221,6 +247,26 @@ public:
 	 */
 	void Serialize(ostream& ss, SerializationContext& context) const;
 
+	/**
+	 * \brief Serializes the variable's type and value in binary form.
+	 *
+	 * The type and value are written as one length-prefixed record.
+	 *
+	 * @param serializer The binary serializer to write to.
+	 */
+	void SerializeBinary(BinarySerializer& serializer) const;
+
+	/**
+	 * \brief Deserializes a record written by SerializeBinary.
+	 *
+	 * If the type of the record does not match the type of the
+	 * variable, the record is skipped.
+	 *
+	 * @param deserializer The binary deserializer to read from.
+	 * @return True if the value was set, false otherwise.
+	 */
+	bool DeserializeBinary(BinaryDeserializer& deserializer);
+
 	/**
 	 * \brief Copy the value from another variable into this variable.
 	 *
@@ -35,6 +35,7 @@
 
 #include "thirdparty/pcireg.h"
 
+struct checkpoint;
 struct machine;
 struct memory;
 
@@ -84,7 +85,19 @@ struct pci_data {
 	int		cur_bus, cur_device, cur_func, cur_reg;
 	int		last_was_write_ffffffff;
 
+	/*  The device selected by cur_bus etc. (NULL if there is none):  */
+	struct pci_device *cur_dev;
+
 	struct pci_device *first_device;
+
+	/*
+	 *  BAR decode table, sorted on space and then bus address. It is
+	 *  rebuilt from the configuration registers (by bus_pci_get_io_target)
+	 *  after a BAR or command register has been written.
+	 */
+	struct pci_bar_window *bar_windows;
+	int		n_bar_windows;
+	int		bar_windows_valid;
 };
 
 #define	PCI_CFG_MEM_SIZE	0x100
@@ -156,6 +169,9 @@ struct pci_data *bus_pci_init(struct machine *machine, const char *irq_path,
 	uint64_t pci_portbase, uint64_t pci_membase, const char *pci_irqbase,
 	uint64_t isa_portbase, uint64_t isa_membase, const char *isa_irqbase);
 
+/*  Save/restore configuration registers, see checkpoint.cc:  */
+void bus_pci_checkpoint(struct checkpoint *ckpt, struct pci_data *pci_data);
+
 /*  Add a PCI device to a PCI bus:  */
 void bus_pci_add(struct machine *machine, struct pci_data *pci_data,
 	struct memory *mem, int bus, int device, int function,
@@ -0,0 +1,46 @@
+#ifndef	CHECKPOINT_H
+#define	CHECKPOINT_H
+
+/*
+ *  Machine checkpoints (save/restore of a complete legacy machine).
+ *
+ *  A checkpoint file consists of a fixed header followed by tagged,
+ *  length-prefixed sections: CPU state, tick function counters, one section
+ *  per registered device, disk image positions, and finally guest RAM.
+ *  RAM memblocks are stored page aligned, so that a restore can map them
+ *  copy-on-write directly from the file instead of reading them in.
+ *
+ *  Devices take part by registering a DEVICE_CHECKPOINT function with
+ *  machine_add_checkpoint_function().  The same function is used in both
+ *  directions; CHECKPOINT_VAR() writes the variable when saving and reads
+ *  it back when restoring, so a device only has to list its state once.
+ */
+
+#include <stdio.h>
+#include <sys/types.h>
+
+struct machine;
+
+
+struct checkpoint {
+	FILE		*f;
+	const char	*filename;
+	int		writeflag;	/*  MEM_WRITE when saving  */
+	int		error;
+};
+
+#define	CHECKPOINT_MAGIC	"GXCKPT01"
+#define	CHECKPOINT_VERSION	1
+
+#define	DEVICE_CHECKPOINT(x)	void dev_ ## x ## _checkpoint(		\
+	struct checkpoint *ckpt, void *extra)
+
+#define	CHECKPOINT_VAR(ckpt,v)	checkpoint_data((ckpt), &(v), sizeof(v))
+
+/*  checkpoint.cc:  */
+void checkpoint_data(struct checkpoint *ckpt, void *data, size_t len);
+int machine_checkpoint_save(struct machine *machine, const char *fname);
+int machine_checkpoint_restore(struct machine *machine, const char *fname);
+
+
+#endif	/*  CHECKPOINT_H  */
@@ -187,6 +187,7 @@ protected:
 
 private:
 	bool LookupAddressDataBus(GXemul* gxemul = NULL);
+	uint8_t* DirectHostMemory(uint64_t paddr, size_t len, bool writable);
 
 protected:
 	/*
@@ -228,6 +229,10 @@ protected:
 	 */
 	AddressDataBus *	m_addressDataBus;
 	uint64_t		m_addressSelect;
+	uint8_t *		m_hostMemory;	// Direct access to RAM, if
+	uint64_t		m_hostMemoryPaddr;	// non-NULL.
+	uint64_t		m_hostMemoryLength;
+	bool			m_hostMemoryWritable;
 	bool			m_exceptionOrAbortInDelaySlot;
 
 private:
@@ -87,6 +87,8 @@ public:
 	virtual bool WriteData(const uint16_t& data, Endianness endianness);
 	virtual bool WriteData(const uint32_t& data, Endianness endianness);
 	virtual bool WriteData(const uint64_t& data, Endianness endianness);
+	virtual uint8_t* LookupHostMemory(uint64_t address, uint64_t& length,
+		bool writable);
 
 
 	/********************************************************************/
@@ -106,17 +108,27 @@ private:
 		uint64_t		size;
 		uint64_t		addrMul;
 		AddressDataBus *	addressDataBus;
+		Component *		component;
+
+		bool operator < (const MemoryMapEntry& other) const
+		{
+			return base < other.base;
+		}
 	};
 
 	typedef vector<MemoryMapEntry> MemoryMap;
+
+	const MemoryMapEntry* LookupMemoryMapEntry(uint64_t address);
+
+private:
+	// Sorted by base address, without overlaps.
 	MemoryMap			m_memoryMap;
 	bool				m_memoryMapFailed;
 	bool				m_memoryMapValid;
+	size_t				m_lastHitEntry;
 
 	// For the currently selected address:
 	AddressDataBus *	m_currentAddressDataBus;
-
-	// TODO: direct page access...
 };
 
 
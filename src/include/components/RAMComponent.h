@@ -37,6 +37,7 @@
 #include "UnitTest.h"
 
 #include <string.h>
+#include <sys/mman.h>
 #include <iomanip>
 
 
@@ -127,17 +128,28 @@ public:
 	virtual bool WriteData(const uint16_t& data, Endianness endianness);
 	virtual bool WriteData(const uint32_t& data, Endianness endianness);
 	virtual bool WriteData(const uint64_t& data, Endianness endianness);
+	virtual uint8_t* LookupHostMemory(uint64_t address, uint64_t& length,
+		bool writable);
 
 
 	/********************************************************************/
 
 	static void RunUnitTests(int& nSucceeded, int& nFailures);
 
+protected:
+	virtual bool CheckVariableWrite(StateVariable& var, const string& oldValue);
+
 private:
+	void FreeBlocks();
 	void ReleaseAllBlocks();
+	void FlushHostMemoryUsers();
 
 	void* AllocateBlock();
 
+	void SetBlock(size_t blockNr, void *block, bool mapped);
+
+	uint64_t GetMemorySize() const;
+
 	class RAMDataHandler : public CustomStateVariableHandler
 	{
 	public:
@@ -240,11 +252,106 @@ private:
 		
 		virtual void CopyValueFrom(CustomStateVariableHandler* other)
 		{
-			// NOTE/TODO: Not space efficient, but works for now.
+			const RAMComponent& otherRAM =
+			    ((RAMDataHandler*) other)->m_ram;
+
+			m_ram.ReleaseAllBlocks();
+
+			for (size_t i=0; i<otherRAM.m_memoryBlocks.size(); ++i) {
+				if (otherRAM.m_memoryBlocks[i] == NULL)
+					continue;
+
+				void *p = malloc(m_ram.m_blockSize);
+				if (p == NULL) {
+					std::cerr << "RAMComponent: out of memory\n";
+					throw std::exception();
+				}
+
+				memcpy(p, otherRAM.m_memoryBlocks[i],
+				    m_ram.m_blockSize);
+				m_ram.SetBlock(i, p, false);
+			}
+		}
+
+		// Binary format: block size, RAM size, number of blocks, and
+		// then for each allocated block its number followed by the raw
+		// block contents as an aligned blob. When loading from a file,
+		// the blocks are mapped copy-on-write instead of being read.
+		virtual void SerializeBinary(BinarySerializer& serializer) const
+		{
+			uint32_t nBlocks = 0;
+			for (size_t i=0; i<m_ram.m_memoryBlocks.size(); ++i)
+				if (m_ram.m_memoryBlocks[i] != NULL)
+					++ nBlocks;
+
+			serializer.WriteUInt64(m_ram.m_blockSize);
+			serializer.WriteUInt64(m_ram.GetMemorySize());
+			serializer.WriteUInt32(nBlocks);
 
-			stringstream ss;
-			other->Serialize(ss);
-			Deserialize(ss.str());
+			for (size_t i=0; i<m_ram.m_memoryBlocks.size(); ++i) {
+				if (m_ram.m_memoryBlocks[i] == NULL)
+					continue;
+
+				serializer.WriteUInt64(i);
+				serializer.WriteBlob(m_ram.m_memoryBlocks[i],
+				    m_ram.m_blockSize);
+			}
+		}
+
+		virtual bool DeserializeBinary(BinaryDeserializer& deserializer)
+		{
+			m_ram.ReleaseAllBlocks();
+
+			uint64_t blockSize, memorySize;
+			uint32_t nBlocks;
+			if (!deserializer.ReadUInt64(blockSize) ||
+			    !deserializer.ReadUInt64(memorySize) ||
+			    !deserializer.ReadUInt32(nBlocks) ||
+			    blockSize != m_ram.m_blockSize)
+				return false;
+
+			// The state variables are not deserialized in any
+			// particular order, so the RAM size is stored here
+			// too. Blocks outside of it are rejected, so that a
+			// corrupt file cannot grow the block table. (A RAM
+			// component which has not been given a size yet is
+			// limited to a 32-bit address space.)
+			if (memorySize == 0)
+				memorySize = (uint64_t) 1 << 32;
+
+			uint64_t maxBlocks = memorySize >> m_ram.m_blockSizeShift;
+			if (memorySize & (m_ram.m_blockSize - 1))
+				++ maxBlocks;
+
+			for (uint32_t n=0; n<nBlocks; ++n) {
+				uint64_t blockNr;
+				if (!deserializer.ReadUInt64(blockNr) ||
+				    blockNr >= maxBlocks)
+					return false;
+
+				const uint8_t *blob =
+				    deserializer.ReadBlob(m_ram.m_blockSize);
+				if (blob == NULL)
+					return false;
+
+				void *p = deserializer.MapBlob(blob,
+				    m_ram.m_blockSize);
+				if (p != NULL) {
+					m_ram.SetBlock(blockNr, p, true);
+					continue;
+				}
+
+				p = malloc(m_ram.m_blockSize);
+				if (p == NULL) {
+					std::cerr << "RAMComponent: out of memory\n";
+					throw std::exception();
+				}
+
+				memcpy(p, blob, m_ram.m_blockSize);
+				m_ram.SetBlock(blockNr, p, false);
+			}
+
+			return true;
 		}
 
 	private:
@@ -300,6 +407,7 @@ private:
 	// State:
 	typedef vector<void *> BlockNrToMemoryBlockVector;
 	BlockNrToMemoryBlockVector	m_memoryBlocks;
+	vector<bool>			m_mappedBlocks;	// munmap, not free
 	bool				m_writeProtected;
 	uint64_t			m_lastDumpAddr;
 
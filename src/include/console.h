@@ -133,10 +133,13 @@ void console_makeavail(int handle, int ch);
 int console_charavail(int handle);
 int console_readchar(int handle);
 void console_putchar(int handle, int ch);
+void console_putstr(int handle, const unsigned char *buf, size_t len);
 void console_flush(void);
 void console_mouse_coordinates(int x, int y, int fb_nr);
 void console_mouse_button(int, int);
 void console_getmouse(int *x, int *y, int *buttons, int *fb_nr);
+void console_set_input_notify(int handle, void (*func)(void *), void *extra);
+void console_poll_input(void);
 void console_slave(const char *arg);
 int console_are_slaves_allowed(void);
 int console_warn_if_slaves_are_needed(int init);
@@ -34,6 +34,7 @@
 #include "misc.h"
 #include "cpu_traits.h"
 
+struct checkpoint;
 struct cpu_family;
 
 #define	MODE_PPC		0
@@ -89,7 +90,10 @@ struct ppc_cpu_type_def {
 #define	PPC_NVRS		32
 #define	PPC_N_TGPRS		4
 
-#define	PPC_N_IC_ARGS			3
+/*  lwarx/stwcx. reservations are tracked per physical granule:  */
+#define	PPC_RESERVATION_GRANULE	32
+
+#define	PPC_N_IC_ARGS			5	/*  3, + a link for branches  */
 #define	PPC_INSTR_ALIGNMENT_SHIFT	2
 #define	PPC_IC_ENTRIES_SHIFT		10
 #define	PPC_IC_ENTRIES_PER_PAGE		(1 << PPC_IC_ENTRIES_SHIFT)
@@ -106,6 +110,48 @@ DYNTRANS_MISC64_DECLARATIONS(ppc,PPC,uint8_t)
 
 #define	PPC_MAX_VPH_TLB_ENTRIES		128
 
+/*  Pre-decoded BAT register pair, see ppc_bat():  */
+struct ppc_bat_decoded {
+	uint32_t	mask;		/*  Offset within the block  */
+	uint32_t	bepi;		/*  Effective block start  */
+	uint32_t	phys;		/*  Physical block start  */
+	uint8_t		vs_vp;		/*  BAT_Vs | BAT_Vu  */
+	uint8_t		pp;
+};
+
+/*
+ *  Host-side shadow of a page table entry group, decoded from guest
+ *  memory by ppc_vtp32(). Entries are dropped when the guest (or a device)
+ *  stores into the PTEG, on tlbie, and when SDR1 changes. The R and C bits
+ *  in the shadowed lower words are not kept up to date; they are always
+ *  updated directly in guest memory.
+ */
+#define	PPC_N_PTEG_SHADOW	256
+struct ppc_pteg_shadow {
+	unsigned char	*host;		/*  NULL if the entry is unused  */
+	uint32_t	pteg_addr;
+	int		swizzle;
+	uint32_t	upper[8];
+	uint32_t	lower[8];
+};
+
+/*
+ *  tlbie, tlbia and icbi also invalidate the translations of the other cpus
+ *  in the machine. When the cpus run in host threads of their own, the
+ *  invalidations are queued, and each cpu handles its queue before it runs
+ *  its next slice of instructions (see ppc_tlb_broadcast()).
+ */
+#define	PPC_TLB_MSG_TLBIE	1
+#define	PPC_TLB_MSG_TLBIA	2
+#define	PPC_TLB_MSG_ICBI	3
+#define	PPC_N_TLB_MSGS		64
+struct ppc_tlb_msg {
+	int		type;
+	uint64_t	addr;
+};
+
+struct ppc_native_cache;
+
 struct ppc_cpu {
 	struct ppc_cpu_type_def cpu_type;
 
@@ -120,6 +166,9 @@ struct ppc_cpu {
 
 	uint32_t	cr;		/*  Condition Register  */
 	uint32_t	fpscr;		/*  FP Status and Control Register  */
+	uint8_t		fpu_debug;	/*  FPU trace/cross-check level  */
+	uint8_t		native;		/*  Native code: 0=off 1=on 2=check  */
+	struct ppc_native_cache *native_cache;
 	uint64_t	gpr[PPC_NGPRS];	/*  General Purpose Registers  */
 	uint64_t	fpr[PPC_NFPRS];	/*  Floating-Point Registers  */
 
@@ -133,13 +182,30 @@ struct ppc_cpu {
 	uint64_t	spr[1024];
 
 	uint64_t	ll_addr;	/*  Load-linked / store-conditional  */
-	int		ll_bit;
+	int		ll_bit;		/*  (ll_addr is a physical granule)  */
+	uint64_t	ll_value;	/*  Raw loaded data, for threaded cpus  */
 
   int   bytelane_swap_latch;
   int   bytelane_swap[2];
+  int   bytelane_swap_tracking; /* Remember stores for stwbrx_cache_spill */
+  uint32_t ***stwbrx_cache; /* Stores remembered while tracking (bitmap) */
 
   int   icount; /* Number of instructions executed since the most recent dyntrans stride */
 
+	/*  MMU lookup caches, see memory_ppc.cc:  */
+	int		bat_decoded_ok;
+	struct ppc_bat_decoded bat_decoded[8];	/*  IBAT0..3, DBAT0..3  */
+	uint8_t		bat_candidates[2][16];	/*  [data][ea >> 28]  */
+	struct ppc_pteg_shadow pteg_shadow[PPC_N_PTEG_SHADOW];
+	uint64_t	pteg_shadow_lo;		/*  Physical range covered  */
+	uint64_t	pteg_shadow_hi;		/*  by pteg_shadow[]  */
+
+	/*  Invalidations queued by other cpus:  */
+	int		tlb_msg_lock;
+	int		tlb_msg_pending;	/*  Sent, but not yet handled  */
+	int		n_tlb_msgs;		/*  May be > PPC_N_TLB_MSGS  */
+	struct ppc_tlb_msg tlb_msgs[PPC_N_TLB_MSGS];
+
 	/*
 	 *  Instruction translation cache and Virtual->Physical->Host
 	 *  address translation:
@@ -196,6 +262,10 @@ struct ppc_record_buf {
 #define	PPC_MSR_RI	(1 << 1)	/*  Recoverable Interrupt  */
 #define	PPC_MSR_LE	(1)		/*  Little-Endian Mode  */
 
+/*  Little-endian mode with swapped bytelanes, i.e. plain byte reversal:  */
+#define	PPC_LE_BYTELANE_SWAP(cpu)	(((cpu)->cd.ppc.msr & PPC_MSR_LE) \
+					    && (cpu)->cd.ppc.bytelane_swap[0])
+
 /*  Floating-point Status:  */
 #define	PPC_FPSCR_FX	(1 << 31)	/*  Exception summary  */
 #define	PPC_FPSCR_FEX	(1 << 30)	/*  Enabled Exception summary  */
@@ -229,6 +299,7 @@ struct ppc_record_buf {
 #define PPC_FPSCR_XE (1 << 3) /* Enable exactness tracking */
 #define PPC_FPSCR_NI (1 << 2) /* Non-ieee mode */
 
+#define PPC_FPSCR_RN_MASK 3 /* Rounding mode */
 #define PPC_FPSCR_ROUND_NEAREST 0
 #define PPC_FPSCR_ROUND_TO_ZERO 1
 #define PPC_FPSCR_ROUND_TO_PINF 2
@@ -274,10 +345,69 @@ void ppc_init_64bit_dummy_tables(struct cpu *cpu);
 int ppc_memory_rw(struct cpu *cpu, struct memory *mem, uint64_t vaddr,
 	unsigned char *data, size_t len, int writeflag, int cache_flags);
 int ppc_cpu_family_init(struct cpu_family *);
+void ppc_cpu_checkpoint(struct cpu *cpu, struct checkpoint *ckpt);
+void ppc_cpu_registers_written(struct cpu *cpu);
 
 /*  memory_ppc.c:  */
 int ppc_translate_v2p(struct cpu *cpu, uint64_t vaddr,
 	uint64_t *return_addr, int flags);
+void ppc_mmu_flush_pteg_shadow(struct cpu *cpu);
+void ppc_mmu_invalidate_pteg_shadow(struct cpu *cpu, uint64_t paddr, size_t len);
+void ppc_mmu_tlbie(struct cpu *cpu, uint64_t vaddr);
+
+void ppc_ram_store(struct cpu *cpu, uint64_t paddr, size_t len);
+void ppc_tlb_invalidate(struct cpu *cpu, int type, uint64_t addr);
+void ppc_tlb_broadcast(struct cpu *cpu, int type, uint64_t addr);
+void ppc_tlb_receive(struct cpu *cpu);
+int ppc_tlb_sync_pending(struct cpu *cpu);
+
+/*  cpu_ppc_native.cc:  */
+#define	PPC_NATIVE_THRESHOLD	256	/*  Executions before compiling  */
+#define	PPC_NATIVE_MAX_OPS	64	/*  Instructions per native block  */
+#define	PPC_NATIVE_CACHE_SIZE	(4 * 1048576)
+
+#define	PPC_NATIVE_NOP		0
+#define	PPC_NATIVE_LI		1	/*  d = imm  */
+#define	PPC_NATIVE_ADDI		2	/*  d = a + imm  */
+#define	PPC_NATIVE_ORI		3	/*  d = a | imm  */
+#define	PPC_NATIVE_XORI		4	/*  d = a ^ imm  */
+#define	PPC_NATIVE_MR		5	/*  d = a  */
+#define	PPC_NATIVE_ADD		6	/*  d = a + b  */
+#define	PPC_NATIVE_SUBF		7	/*  d = b - a  */
+#define	PPC_NATIVE_AND		8	/*  d = a & b  */
+#define	PPC_NATIVE_OR		9	/*  d = a | b  */
+#define	PPC_NATIVE_XOR		10	/*  d = a ^ b  */
+#define	PPC_NATIVE_ANDC		11	/*  d = a & ~b  */
+#define	PPC_NATIVE_NOR		12	/*  d = ~(a | b)  */
+#define	PPC_NATIVE_NEG		13	/*  d = -a  */
+#define	PPC_NATIVE_EXTSB	14	/*  d = (int8_t) a  */
+#define	PPC_NATIVE_EXTSH	15	/*  d = (int16_t) a  */
+#define	PPC_NATIVE_RLWINM	16	/*  d = rotl(a, sh) & imm  */
+#define	PPC_NATIVE_CMPW		17	/*  cr field at bit sh = a <=> b  */
+#define	PPC_NATIVE_CMPLW	18
+#define	PPC_NATIVE_CMPWI	19	/*  cr field at bit sh = a <=> imm  */
+#define	PPC_NATIVE_CMPLWI	20
+#define	PPC_NATIVE_B		21	/*  goto target  */
+#define	PPC_NATIVE_BT		22	/*  goto target if cr bit sh is set  */
+#define	PPC_NATIVE_BF		23	/*  goto target if cr bit sh is clear  */
+
+/*  One decoded instruction. Registers are byte offsets within struct cpu.  */
+struct ppc_native_op {
+	int		op;
+	int32_t		d, a, b;
+	uint32_t	imm;
+	int		sh;
+	struct ppc_instr_call *target;
+};
+
+struct ppc_native_block {
+	struct ppc_instr_call *(*code)(struct cpu *);
+	int		n_instrs;
+};
+
+int ppc_native_available(void);
+struct ppc_native_block *ppc_native_compile(struct cpu *cpu,
+	struct ppc_native_op *ops, int n_ops, struct ppc_instr_call *next);
 
 void cpu_ppc_swizzle_offset(struct cpu *cpu, int size, int code, int *swizzle, int *offset);
 
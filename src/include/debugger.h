@@ -52,11 +52,6 @@ void debugger_reset(void);
 void debugger_init(struct emul *emul);
 int  debugger_get_name(struct cpu *c, uint64_t addr, uint64_t max_addr, struct ibm_name *name);
 
-typedef struct _keyboard_event_t {
-  int code;
-} keyboard_event_t;
-
-extern std::deque<keyboard_event_t> keyboard_debug_events;
 extern std::deque<uint8_t> debug_serial0_chars;
 
 struct dump_register_state_t {
@@ -90,6 +85,7 @@ extern void GdblibSetup();
 extern int GdblibActive();
 extern void GdblibTakeException(struct cpu *cpu, int n);
 extern int GdblibCheckWaiting(struct cpu *cpu);
+extern int GdblibHandleEvents(struct cpu *cpu);
 extern bool GdblibSerialInterrupt(struct cpu *cpu);
 
 extern void debugger_step(struct machine *m, int steps);
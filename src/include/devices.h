@@ -59,6 +59,12 @@ struct timer;
 #include <X11/Xlib.h>
 #endif */
 
+/*  dev_8237.c:  */
+struct dma8237_data;
+size_t dev_8237_remaining(struct dma8237_data *d, int channel);
+size_t dev_8237_transfer(struct cpu *cpu, struct dma8237_data *d,
+	int channel, unsigned char *buf, size_t len, int writeflag);
+
 /*  dev_8259.c:  */
 struct pic8259_data {
 	struct interrupt irq;
@@ -182,14 +188,6 @@ struct eagle_data {
 	struct pci_data	*pci_data;
 
 	int stage;
-  int addr_low_high_latch;
-  int len_low_high_latch;
-
-  int fin_mask;
-
-  unsigned char dma_page[4];
-  unsigned char dma_high[4];
-
   uint8_t err_reg[2];
 
   int want_error;
@@ -220,8 +218,6 @@ struct eagle_glob {
 
   uint16_t password_protect_1;
   uint16_t password_protect_2;
-
-  int want_timer_int;
 };
 
 extern struct eagle_glob eagle_comm;
@@ -239,6 +235,11 @@ extern struct eagle_glob eagle_comm;
 #define	VFB_PLAYSTATION2	5
 /*  Extra flags:  */
 #define	VFB_REVERSE_START	0x10000
+#define	VFB_MAX_DAMAGE		16
+struct vfb_rect {
+	int		x1, y1, x2, y2;
+};
+
 struct vfb_data {
 	struct memory	*memory;
 	int		vfb_type;
@@ -261,7 +262,14 @@ struct vfb_data {
 	size_t		framebuffer_size;
 	int		x11_xsize, x11_ysize;
 
+	/*
+	 *  Areas (in framebuffer pixels, inclusive) which have changed since
+	 *  they were last presented. Other devices may also extend the
+	 *  update_* bounding box, which is added to the list at each tick.
+	 */
 	int		update_x1, update_y1, update_x2, update_y2;
+	struct vfb_rect	damage[VFB_MAX_DAMAGE];
+	int		n_damage;
 
 	/*  RGB palette for <= 8 bit modes:  (r,g,b bytes for each)  */
 	unsigned char	rgb_palette[256 * 3];
@@ -274,6 +282,10 @@ struct vfb_data {
 	/*  These should always be in sync:  */
 	unsigned char	*framebuffer;
 	struct fb_window *fb_window;
+
+	/*  Host copy of the window contents (32-bit pixels, x11_xsize wide),
+	    see fb_alloc_x11_pixels():  */
+	unsigned char	*x11_pixels;
 };
 #define	VFB_MFB_BT455			0x100000
 #define	VFB_MFB_BT431			0x180000
@@ -284,6 +296,7 @@ struct vfb_data {
 
 void set_grayscale_palette(struct vfb_data *d, int ncolors);
 void dev_fb_resize(struct vfb_data *d, int new_xsize, int new_ysize);
+void dev_fb_damage(struct vfb_data *d, int x1, int y1, int x2, int y2);
 void dev_fb_setcursor(struct vfb_data *d, int cursor_x, int cursor_y, int on, 
         int cursor_xsize, int cursor_ysize);
 void framebuffer_blockcopyfill(struct vfb_data *d, int fillflag, int fill_r,
@@ -370,9 +383,11 @@ void dev_mc146818_init(struct machine *machine, struct memory *mem,
 int dev_pckbc_access(struct cpu *cpu, struct memory *mem,
 	uint64_t relative_addr, unsigned char *data, size_t len,
 	int writeflag, void *);
+void dev_pckbc_tick(struct cpu *cpu, void *);
 int dev_pckbc_init(struct machine *machine, struct memory *mem,
 	uint64_t baseaddr, int type, char *keyboard_irqpath,
 	char *mouse_irqpath, int in_use, int pc_style_flag);
+void dev_pckbc_inject(int code);
 
 /*  dev_pmagja.c:  */
 #define	DEV_PMAGJA_LENGTH		0x3c0000
@@ -34,6 +34,8 @@ struct machine;
 struct net;
 struct settings;
 
+struct emul_machine_threads;
+
 struct emul {
 	struct settings	*settings;
 
@@ -45,6 +47,9 @@ struct emul {
 	int		n_machines;
 	struct machine	**machines;
 
+	/*  Host threads for the machines, see emul_run():  */
+	struct emul_machine_threads *machine_threads;
+
 	/*  Additional debugger commands to run before
 	    starting the simulation:  */
 	int		n_debugger_cmds;
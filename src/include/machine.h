@@ -33,8 +33,10 @@
 #include "symbol.h"
 #include "mem_passthrough.h"
 
+struct checkpoint;
 struct cpu_family;
 struct diskimage;
+struct dma8237_data;
 struct emul;
 struct fb_window;
 struct machine_arcbios;
@@ -85,6 +87,17 @@ struct tick_functions {
 	void	**extra;
 };
 
+struct machine_cpu_threads;
+
+struct checkpoint_functions {
+	int	n_entries;
+
+	/*  Arrays, with one element for each entry:  */
+	const char **name;
+	void	(**f)(struct checkpoint *, void *);
+	void	**extra;
+};
+
 struct x11_md {
 	/*  X11/framebuffer stuff:  */
 	int	in_use;
@@ -138,6 +151,9 @@ struct machine {
 	/*  Tick functions (e.g. hardware devices):  */
 	struct tick_functions tick_functions;
 
+	/*  Devices which can save/restore their state:  */
+	struct checkpoint_functions checkpoint_functions;
+
 	char	*cpu_name;  /*  TODO: remove this, there could be several
 				cpus with different names in a machine  */
 	int	byte_order_override;
@@ -147,11 +163,17 @@ struct machine {
 	int	ncpus;
 	struct cpu **cpus;
 
+	/*  Host threads for the cpus, see machine_run():  */
+	int	threaded_cpus;
+	int	cpu_threads_running;
+	struct machine_cpu_threads *cpu_threads;
+
 	struct diskimage *first_diskimage;
 
 	struct symbol_context symbol_context;
 
 	int	random_mem_contents;
+	int	reserve_ram;		/*  See memory_reserve_ram()  */
 	int	physical_ram_in_mb;
 	int	memory_offset_in_mb;
 	int	prom_emulation;
@@ -171,6 +193,7 @@ struct machine {
 	int	show_nr_of_instructions;
 	int	show_trace_tree;
 	int	emulated_hz;
+	int	rtc_host_time;
 	int	allow_instruction_combinations;
 	int	force_netboot;
 	int	slow_serial_interrupts_hack_for_linux;
@@ -197,6 +220,9 @@ struct machine {
 	/*  TODO: Remove!  */
 	struct isa_pic_data isa_pic_data;
 
+	/*  ISA DMA controllers, shared by the ISA devices:  */
+	struct dma8237_data *isa_dma;
+
   /* memory hole passthrough */
   IMemoryHolePassthrough *hole;
 };
@@ -390,6 +416,11 @@ int machine_name_to_type(char *stype, char *ssubtype,
 void machine_add_breakpoint_string(struct machine *machine, char *str);
 void machine_add_tickfunction(struct machine *machine,
 	void (*func)(struct cpu *, void *), void *extra, int clockshift);
+void machine_set_tickfunction_interval(struct machine *machine,
+	void (*func)(struct cpu *, void *), void *extra, int n_instrs);
+void machine_add_checkpoint_function(struct machine *machine,
+	const char *name, void (*func)(struct checkpoint *, void *),
+	void *extra);
 void machine_statistics_init(struct machine *, char *fname);
 void machine_register(char *name, MACHINE_SETUP_TYPE(setup));
 void machine_setup(struct machine *);
@@ -397,6 +428,9 @@ void machine_memsize_fix(struct machine *);
 void machine_default_cputype(struct machine *);
 void machine_dumpinfo(struct machine *);
 int machine_run(struct machine *machine);
+void machine_lock_devices(struct machine *machine);
+void machine_unlock_devices(struct machine *machine);
+void machine_stop_cpu_threads(struct machine *machine);
 void machine_list_available_types_and_cpus(void);
 struct machine_entry *machine_entry_new(const char *name, 
 	int arch, int oldstyle_type);
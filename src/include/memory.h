@@ -86,6 +86,14 @@ struct memory {
 	uint64_t	mmap_dev_maxaddr;
 
 	struct memory_device *devices;
+
+	/*  Non-zero for memblocks mapped from a checkpoint file:  */
+	unsigned char	*mapped_blocks;
+
+	/*  Guest RAM reserved in one host mapping (see memory_reserve_ram()),
+	    or NULL and 0 if memblocks are allocated on demand:  */
+	unsigned char	*ram;
+	uint64_t	ram_len;
 };
 
 #define	BITS_PER_PAGETABLE	20
@@ -102,6 +110,7 @@ void memory_writemax64(struct cpu *cpu, unsigned char *buf, int len,
 void *zeroed_alloc(size_t s);
 
 struct memory *memory_new(uint64_t physical_max, int arch);
+int memory_reserve_ram(struct memory *mem, uint64_t len);
 
 int memory_points_to_string(struct cpu *cpu, struct memory *mem,
                             uint64_t addr, int min_string_length);
@@ -111,6 +120,18 @@ char *memory_conv_to_string(struct cpu *cpu, struct memory *mem,
 unsigned char *memory_paddr_to_hostaddr(struct memory *mem,
                                         uint64_t paddr, int writeflag);
 
+/*
+ *  memory_ram_hostaddr():
+ *
+ *  Returns the host address of paddr if it is within reserved guest RAM,
+ *  NULL otherwise. No memblock table walk is needed.
+ */
+static inline unsigned char *memory_ram_hostaddr(struct memory *mem,
+	uint64_t paddr)
+{
+	return paddr < mem->ram_len ? mem->ram + paddr : NULL;
+}
+
 #include "mem_flags.h"
 
 void memory_device_dyntrans_access(struct cpu *, struct memory *mem,
@@ -100,11 +100,14 @@ mapping_result_t determine_paddr
        *  3)  If this was a Write, then invalidate any code translations
        *      in that page.
        */
-      mapping.host_pages.host_load =
-        memory_paddr_to_hostaddr
-        (mem,
-         mapping.host_pages.physaddr & ~mapping.offset_mask,
-         writeflag);
+      mapping.host_pages.host_load = memory_ram_hostaddr
+        (mem, mapping.host_pages.physaddr & ~mapping.offset_mask);
+      if (mapping.host_pages.host_load == NULL)
+        mapping.host_pages.host_load =
+          memory_paddr_to_hostaddr
+          (mem,
+           mapping.host_pages.physaddr & ~mapping.offset_mask,
+           writeflag);
 
       mapping.offset = mapping.host_pages.physaddr & mapping.offset_mask;
     } else {
@@ -115,6 +118,21 @@ mapping_result_t determine_paddr
   return mapping;
 }
 
+/*
+ *  A write to physical RAM clears any lwarx reservation (on any cpu) on
+ *  the reservation granule(s) it touches, and drops shadowed page table
+ *  entry groups which it overlaps.
+ */
+template <class TcPhyspage>
+static inline void ram_store_hook(struct cpu *cpu, uint64_t paddr, size_t len)
+{
+  if (is_ppc<TcPhyspage>() &&
+      (cpu->cd.ppc.ll_bit || cpu->machine->ncpus > 1 ||
+       (paddr < cpu->cd.ppc.pteg_shadow_hi &&
+        paddr + len > cpu->cd.ppc.pteg_shadow_lo)))
+    ppc_ram_store(cpu, paddr, len);
+}
+
 template <class TcPhyspage, bool NoExceptions>
 int gen_memory_rw(struct cpu *cpu, struct memory *mem, uint64_t vaddr,
                   unsigned char *data, size_t len, int writeflag, int misc_flags)
@@ -129,10 +147,7 @@ int gen_memory_rw(struct cpu *cpu, struct memory *mem, uint64_t vaddr,
 
   if (mapping.early_success) {
     if (writeflag) {
-      if (is_ppc<TcPhyspage>() && cpu->cd.ppc.ll_bit && ((mapping.host_pages.physaddr | mapping.offset) == cpu->cd.ppc.ll_addr)) {
-        cpu->cd.ppc.ll_bit = 0;
-        cpu->cd.ppc.ll_addr = 0;
-      }
+      ram_store_hook<TcPhyspage>(cpu, mapping.host_pages.physaddr | mapping.offset, len);
       memcpy(mapping.host_pages.host_load + mapping.offset, data, len);
     } else {
       memcpy(data, mapping.host_pages.host_load + mapping.offset, len);
@@ -172,6 +187,7 @@ int gen_memory_rw(struct cpu *cpu, struct memory *mem, uint64_t vaddr,
     if (mapping.host_pages.host_load) {
       /*  And finally, read or write the data:  */
       if (writeflag == MEM_WRITE) {
+        ram_store_hook<TcPhyspage>(cpu, mapping.host_pages.physaddr, len);
         memcpy(mapping.host_pages.host_load + mapping.offset, data, len);
       } else {
         memcpy(data, mapping.host_pages.host_load + mapping.offset, len);
@@ -201,8 +217,14 @@ int gen_memory_rw(struct cpu *cpu, struct memory *mem, uint64_t vaddr,
       int wf = writeflag == MEM_WRITE? 1 : 0;
       unsigned char *host_addr;
 
+      /*
+       *  Direct writes are tracked in dyntrans_write_low/high, which
+       *  the device reads (and only write-protects the pages of one
+       *  cpu) under the device lock. Threaded cpus write through the
+       *  device function instead.
+       */
       if (!(access_result.device->flags &
-            DM_DYNTRANS_WRITE_OK))
+            DM_DYNTRANS_WRITE_OK) || cpu->machine->cpu_threads_running)
         wf = 0;
 
       if (writeflag && wf) {
@@ -245,9 +267,11 @@ int gen_memory_rw(struct cpu *cpu, struct memory *mem, uint64_t vaddr,
       }
     }
 
+    machine_lock_devices(cpu->machine);
     res = access_result.device->f(cpu, mem, access_result.device_offset,
                                   data, len, writeflag,
                                   access_result.device->extra);
+    machine_unlock_devices(cpu->machine);
     
     if (res < 1) {
       memset(data, 0, len);
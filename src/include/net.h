@@ -41,10 +41,12 @@
 #include <arpa/inet.h>
 #include <netdb.h>
 #endif
+#include <pthread.h>
 
 struct emul;
 struct ethernet_packet_link;
 struct remote_net;
+struct pollfd;
 
 
 /*  Default emulated "simple" IPv4 network, if nothing else is specified:  */
@@ -71,6 +73,7 @@ struct remote_net;
 struct udp_connection {
 	int		in_use;
 	int64_t		last_used_timestamp;
+	void		*extra;		/*  the NIC which owns the connection  */
 
 	/*  Inside:  */
 	unsigned char	ethernet_address[6];
@@ -90,6 +93,7 @@ struct udp_connection {
 struct tcp_connection {
 	int		in_use;
 	int64_t		last_used_timestamp;
+	void		*extra;		/*  the NIC which owns the connection  */
 
 	/*  Inside:  */
 	unsigned char	ethernet_address[6];
@@ -99,7 +103,7 @@ struct tcp_connection {
 
 	/*  TODO:  tx and rx buffers?  */
 	unsigned char	*incoming_buf;
-	int		incoming_buf_rounds;
+	int64_t		incoming_buf_time;	/*  msecs, for resending  */
 	int		incoming_buf_len;
 	uint32_t	incoming_buf_seqnr;
 
@@ -123,6 +127,26 @@ struct tcp_connection {
 #define	MAX_TCP_CONNECTIONS	100
 #define	MAX_UDP_CONNECTIONS	100
 
+/*
+ *  Each NIC has a ring of packets on their way to the emulated controller.
+ *  Packets are produced (with net->lock held) either by the emulator thread
+ *  or by the network helper thread, and consumed by the NIC device without
+ *  any locking.  NET_NIC_RING_LEN must be a power of two.
+ */
+#define	NET_NIC_RING_LEN	256
+
+struct net_nic {
+	struct net_nic	*next;
+	void		*extra;
+
+	uint32_t	head;		/*  consumer index  */
+	uint32_t	tail;		/*  producer index, published  */
+	uint32_t	pending_tail;	/*  producer index, not yet published  */
+	int		throttled;	/*  the helper thread waits for room  */
+
+	struct ethernet_packet_link *slots;
+};
+
 struct net {
 	/*  The emul struct which this net belong to:  */
 	struct emul	*emul;
@@ -133,7 +157,7 @@ struct net {
 
 	/*  NICs connected to this network:  */
 	int		n_nics;
-	void		**nic_extra;	/*  one void * per NIC  */
+	struct net_nic	*first_nic;
 
 	/*  The "special machine":  */
 	unsigned char	gateway_ipv4_addr[4];
@@ -146,8 +170,13 @@ struct net {
 
 	int64_t		timestamp;
 
-	struct ethernet_packet_link *first_ethernet_packet;
-	struct ethernet_packet_link *last_ethernet_packet;
+	/*  Where packets go when a NIC's ring is full:  */
+	struct ethernet_packet_link *dropped_packet;
+
+	/*  Helper thread, which waits for traffic on the host's sockets:  */
+	pthread_mutex_t	lock;
+	int		poll_thread_running;
+	int		wakeup_pipe[2];
 
 	struct udp_connection udp_connections[MAX_UDP_CONNECTIONS];
 	struct tcp_connection tcp_connections[MAX_TCP_CONNECTIONS];
@@ -174,12 +203,15 @@ void net_ip_tcp_connectionreply(struct net *net, void *extra,
 void net_ip_broadcast(struct net *net, void *extra,
         unsigned char *packet, int len);
 void net_ip(struct net *net, void *extra, unsigned char *packet, int len);
-void net_udp_rx_avail(struct net *net, void *extra);
-void net_tcp_rx_avail(struct net *net, void *extra);
+int net_ip_poll_setup(struct net *net, struct pollfd *fds, int *con_ids,
+	int *retransmit_pending);
+void net_ip_poll_handle(struct net *net, struct pollfd *fds, int *con_ids,
+	int n);
 
 /*  net.c:  */
 struct ethernet_packet_link *net_allocate_ethernet_packet_link(
 	struct net *net, void *extra, size_t len);
+int net_nic_has_room(struct net *net, void *extra, int n);
 int net_ethernet_rx_avail(struct net *net, void *extra);
 int net_ethernet_rx(struct net *net, void *extra,
 	unsigned char **packetp, int *lenp);
@@ -199,9 +231,6 @@ struct net *net_init(struct emul *emul, int init_flags,
  *  This is for internal use in src/net.c:
  */
 struct ethernet_packet_link {
-	struct ethernet_packet_link *prev;
-	struct ethernet_packet_link *next;
-
 	void		*extra;
 	unsigned char	*data;
 	int		len;
@@ -222,6 +251,15 @@ struct remote_net {
 
 #define	TCP_INCOMING_BUF_LEN	2000
 
+/*  Unacknowledged incoming TCP data is resent after this many msecs:  */
+#define	TCP_RESEND_MSEC		250
+
+/*  Ring slots needed for the largest (fragmented) incoming UDP packet:  */
+#define	NET_UDP_MAX_FRAGMENTS	48
+
+/*  Poll timeout for the helper thread, when something needs resending:  */
+#define	NET_POLL_TIMEOUT_MSEC	50
+
 #define	NET_ADDR_IPV4		1
 #define	NET_ADDR_IPV6		2
 #define	NET_ADDR_ETHERNET	3
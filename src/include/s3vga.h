@@ -0,0 +1,220 @@
+#ifndef	S3VGA_H
+#define	S3VGA_H
+
+/*
+ *  Copyright (C) 2004-2009  Anders Gavare.  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright  
+ *     notice, this list of conditions and the following disclaimer in the 
+ *     documentation and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ *  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE   
+ *  FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ *  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ *  OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ *  HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ *  OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ *  SUCH DAMAGE.
+ *
+ *
+ *  Shared core of the S3-family VGA devices, see src/devices/s3vga.cc.
+ */
+
+#include "misc.h"
+#include "x11.h"
+
+struct cpu;
+struct machine;
+struct memory;
+struct vfb_data;
+struct vga_data;
+
+#define	MODE_CHARCELL		1
+#define	MODE_GRAPHICS		2
+
+#define	GRAPHICS_MODE_8BIT	1
+#define	GRAPHICS_MODE_4BIT	2
+
+#define S3_PIO_SEQ_LEN 11
+
+
+/*
+ *  Chip front end.
+ *
+ *  crtc_read() returns the value of a CRTC register, or -1 to use the
+ *  stored value. crtc_write() is called after a CRTC register has been
+ *  stored, and returns 1 if the write needs no further handling by the
+ *  core. reset() is called at the end of s3vga_register_reset(),
+ *  vram_write() after the CPU has written to the graphics aperture, and
+ *  restore() after the core state has been restored from a checkpoint.
+ *  All of them are optional.
+ */
+#define	S3VGA_APERTURE_WRAPS	1	/*  aperture aliases gfx_mem  */
+#define	S3VGA_FAST_RETRACE	2	/*  toggle retrace on each read  */
+
+struct s3vga_chip {
+	const char	*gfx_name;
+	const char	*ctrl_name;
+	const char	*fb_name;
+	int		flags;
+
+	int		(*crtc_read)(struct vga_data *d, int regnr);
+	int		(*crtc_write)(struct machine *machine,
+			    struct cpu *cpu, struct vga_data *d,
+			    int regnr, int idata);
+	void		(*reset)(struct vga_data *d);
+	void		(*vram_write)(struct machine *machine,
+			    struct vga_data *d, uint64_t addr, size_t len);
+	void		(*restore)(struct vga_data *d);
+};
+
+struct vga_data {
+	const struct s3vga_chip *chip;
+
+	uint64_t	videomem_base;
+	uint64_t	control_base;
+
+	struct vfb_data *fb;
+	uint32_t	fb_size;
+
+	int		fb_max_x;		/*  pixels  */
+	int		fb_max_y;		/*  pixels  */
+	int		max_x;			/*  charcells or pixels  */
+	int		max_y;			/*  charcells or pixels  */
+
+	/*  Selects charcell mode or graphics mode:  */
+	int		cur_mode;
+
+	/*  Common for text and graphics modes:  */
+	int		pixel_repx, pixel_repy;
+
+	/*  Textmode:  */
+	int		font_width;
+	int		font_height;
+	unsigned char	*font;
+	size_t		charcells_size;
+	unsigned char	*charcells;		/*  2 bytes per char  */
+	unsigned char	*charcells_outputed;	/*  text  */
+	unsigned char	*charcells_drawn;	/*  framebuffer  */
+
+	/*  Graphics:  */
+	int		graphics_mode;
+	int		bits_per_pixel;
+	unsigned char	*gfx_mem;
+	uint32_t	gfx_mem_size;
+
+	/*  Registers:  */
+	int		attribute_state;	/*  0 or 1  */
+	unsigned char	attribute_reg_select;
+	unsigned char	attribute_reg[256];
+
+	unsigned char	misc_output_reg;
+
+	unsigned char	sequencer_reg_select;
+	unsigned char	sequencer_reg[256];
+
+	unsigned char	graphcontr_reg_select;
+	unsigned char	graphcontr_reg[256];
+
+	unsigned char	crtc_reg_select;
+	unsigned char	crtc_reg[256];
+
+	unsigned char	palette_read_index;
+	char		palette_read_subindex;
+	unsigned char	palette_write_index;
+	char		palette_write_subindex;
+
+	int		current_retrace_line;
+	int		input_status_1;
+	bool		retrace;
+
+	/*  Palette per scanline during retrace:  */
+	unsigned char	*retrace_palette;
+	int		use_palette_per_line;
+	int64_t		n_is1_reads;
+
+  uint16_t  hend, vend, helast, velast;
+
+	/*  Misc.:  */
+	int		console_handle;
+
+	int		cursor_x;
+	int		cursor_y;
+
+	int		modified;
+	int		palette_modified;
+	int		update_x1;
+	int		update_y1;
+	int		update_x2;
+	int		update_y2;
+
+	/* S3 */
+  int   s3_pio_select;
+  int   s3_src_x, s3_src_y;
+  int   s3_pix_x, s3_pix_y;
+  int   s3_fg_color, s3_bg_color;
+  int   s3_fg_color_mix, s3_bg_color_mix;
+  int   s3_v_dir, s3_h_dir, s3_pixel_bit;
+  bool  s3_y_major, s3_last_pof, s3_no_draw, s3_bit_order;
+  int   s3_rect_width, s3_rect_height;
+  int   s3_curr_x, s3_curr_y;
+  int   s3_dest_x, s3_dest_y;
+  int   s3_current_command;
+  uint32_t s3_pixel_xfer;
+  uint32_t s3_color_compare;
+
+  /* S3 hardware cursor */
+  uint32_t s3_cursor_address;
+
+  /* BEE8H */
+  uint16_t bee8_regs[16];
+
+  /* Command */
+  int s3_cmd_mx, s3_cmd_bus_size, s3_cmd_swap, s3_cmd_pxtrans;
+  uint8_t s3_color_stack;
+  struct x11_cursor gfx_cursor;
+
+  /* Ext sequencer */
+  bool ext_seq_unlock;
+
+  /* Mapping */
+  bool window_mapped;
+  int window_address;
+  int fifo_in_progress;
+  bool odd_fifo;
+
+  uint32_t plane_read_mask, plane_write_mask;
+  uint32_t adv_fun_4ae8, short_stroke_transfer;
+  uint16_t line_errorterm, line_axial_step, line_diagonal_step;
+
+  uint8_t reg_ff00_data[0x100];
+};
+
+
+/*  s3vga.cc:  */
+struct vga_data *s3vga_new(struct machine *machine,
+	const struct s3vga_chip *chip);
+void s3vga_attach(struct machine *machine, struct memory *mem,
+	struct vga_data *d, uint64_t videomem_base, uint64_t control_base);
+void s3vga_register_engine(struct machine *machine, struct memory *mem,
+	struct vga_data *d);
+void s3vga_recalc_cursor_position(struct vga_data *d);
+void s3vga_register_reset(struct vga_data *d);
+void s3vga_reset_palette(struct vga_data *d, int grayscale);
+void s3vga_mode_reset(struct machine *machine, struct vga_data *d,
+	int grayscale);
+void s3vga_update_cursor(struct machine *machine, struct vga_data *d);
+
+
+#endif	/*  S3VGA_H  */
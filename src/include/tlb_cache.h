@@ -123,6 +123,9 @@ private:
   int max_tlb_entries;
 
 protected:
+  /*  Bumped whenever a cached translation goes away, see itlb_impl:  */
+  uint64_t link_generation;
+
   host_load_store_t &get_host_page_ref(Cpu *cpu, uint64_t addr, bool instr) {
     auto index = get_page_index(cpu, addr, instr);
     return pages[index];
@@ -135,6 +138,7 @@ protected:
   int clear_cache(int index) {
     assert(index < 2 * N_VPH32_ENTRIES);
     pages[index] = host_load_store_t { };
+    link_generation ++;
     auto found = vaddr_to_tlbindex->find(index);
     int result = 0;
     if (found != vaddr_to_tlbindex->end()) {
@@ -215,6 +219,7 @@ public:
 
   void initialize() {
     max_tlb_entries = std::min(SMALL_ENTRIES, max_vph_tlb_entries<TcPhyspage>());
+    link_generation = 1;
     vph_tlb_entry = (VpgTlbEntry*)calloc(max_vph_tlb_entries<TcPhyspage>(), sizeof(VpgTlbEntry));
     vaddr_to_tlbindex = new std::map<uint64_t, VaddrToTlb>();
     pages = (host_load_store_t *)calloc(2 * N_VPH32_ENTRIES, sizeof(host_load_store_t));
@@ -296,6 +301,7 @@ public:
       }
 
       pages[index].ppp = nullptr;
+      link_generation ++;
       if (is_arm<TcPhyspage>()) {
         is_userpage[index>>5] &= ~(1<<(index&31));
         if (useraccess)
@@ -319,6 +325,8 @@ public:
     int r;
     uint64_t addr_page = addr & ~(pagesize<TcPhyspage>() - 1);
 
+    link_generation ++;
+
     /*  fatal("invalidate(): ");  */
 
     /*  Invalidate everything:  */
@@ -385,6 +393,7 @@ protected:
   }
 
   void clear_physpage(typename T::physpage_t *ppp) {
+    this->link_generation ++;
     for (auto i = 0; i < ic_entries_per_page<typename T::physpage_t>(); i++) {
       ppp->ics[i].f = physpage_template->ics[0].f;
     }
@@ -408,7 +417,11 @@ public:
   }
 
   void set_tlb_physpage(typename T::cpu_t *cpu, uint64_t addr, typename T::physpage_t *ppp) {
-    this->get_host_page_ref(cpu, addr, true).ppp = ppp;
+    auto &page = this->get_host_page_ref(cpu, addr, true);
+    if (page.ppp != ppp) {
+      this->link_generation ++;
+    }
+    page.ppp = ppp;
   }
 
   decltype(&((typename T::physpage_t *)0)->ics[0]) get_ic_page() const {
@@ -433,6 +446,10 @@ public:
     next_ic = nothing_call;
   }
 
+  void jump_to_ic(decltype(&((typename T::physpage_t*)0)->ics[0]) ic) {
+    next_ic = ic;
+  }
+
   decltype(&((typename T::physpage_t*)0)->ics[0]) bad_translation(decltype(&((typename T::physpage_t*)0)->ics[0]) nothing_call) {
     do_nothing(nothing_call);
     return next_ic ++;
@@ -568,6 +585,39 @@ public:
     next_ic = get_ic_page() + pc_to_ic_entry<typename T::physpage_t>(cached_pc);
   }
 
+  /*
+   *  move_to_physpage_linked():
+   *
+   *  Like move_to_physpage(), for a branch site whose target never changes
+   *  (e.g. a relative branch, or the end of a page). link[0] remembers the
+   *  ic which the target resolved to, and link[1] the link generation at
+   *  that time. Anything which could make the target resolve differently
+   *  (TLB changes, invalidated or retargeted code pages) bumps the
+   *  generation, which makes all links stale at once.
+   *
+   *  A link is only made when the target was found through the TLB, i.e.
+   *  when the next move_to_physpage() would have found the same page.
+   */
+  void move_to_physpage_linked(typename T::cpu_t *cpu, size_t *link) {
+    uint64_t target_pc = cpu->pc;
+
+    if (link[1] == this->link_generation) {
+      next_ic = (decltype(next_ic))link[0];
+      this->cur_physpage = (typename T::physpage_t *)
+        (next_ic - pc_to_ic_entry<typename T::physpage_t>(target_pc));
+      this->cur_ic_virt = target_pc & ~(pagesize<typename T::physpage_t>() - 1);
+      return;
+    }
+
+    move_to_physpage(cpu);
+
+    if (cpu->pc == target_pc &&
+        this->get_cached_tlb_pages(cpu, target_pc, true).ppp == this->cur_physpage) {
+      link[0] = (size_t)next_ic;
+      link[1] = this->link_generation;
+    }
+  }
+
   void set_next_ic(uint64_t pc) {
     next_ic = get_ic_page() + pc_to_ic_entry<typename T::physpage_t>(pc);
   }
@@ -581,6 +631,7 @@ public:
     uint32_t vaddr_page, paddr_page;
 
     addr &= ~(pagesize<typename T::physpage_t>()-1);
+    this->link_generation ++;
 
     /*  printf("DYNTRANS_INVALIDATE_TC_CODE addr=0x%08x flags=%i\n",
         (int)addr, flags);  */
@@ -600,6 +651,15 @@ public:
       }
     }
 
+    /*  Forget all translated code, e.g. after RAM has been replaced:  */
+    if (flags & INVALIDATE_ALL) {
+      for (auto &entry : *physpage_map) {
+        if (!entry.second.translations_bitmap.empty()) {
+          clear_physpage(&entry.second);
+        }
+      }
+    }
+
     /*  Invalidate entries in the VPH table:  */
     for (r = 0; r < this->max_entries(); r ++) {
       auto tlb_entry = this->get_tlb_entry(r);
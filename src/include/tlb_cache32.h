@@ -47,6 +47,10 @@ public:
     itlb.move_to_physpage(cpu);
   }
 
+  void move_to_physpage_linked(Cpu *cpu, size_t *link) {
+    itlb.move_to_physpage_linked(cpu, link);
+  }
+
   void set_next_ic(uint64_t pc) {
     itlb.set_next_ic(pc);
   }
@@ -95,6 +99,10 @@ public:
     itlb.do_nothing(nothing_call);
   }
 
+  void jump_to_ic(decltype(&((TcPhyspage*)0)->ics[0]) ic) {
+    itlb.jump_to_ic(ic);
+  }
+
   decltype(&((TcPhyspage*)0)->ics[0]) bad_translation(decltype(&((TcPhyspage*)0)->ics[0]) nothing_call) {
     return itlb.bad_translation(nothing_call);
   }
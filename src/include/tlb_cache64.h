@@ -379,6 +379,19 @@ public:
       }
     }
 
+    /*  Forget all translated code, e.g. after RAM has been replaced:  */
+    if (flags & INVALIDATE_ALL) {
+      for (auto &entry : *physpage_map) {
+        TcPhyspage *ppp = &entry.second;
+        if (ppp->translations_bitmap.empty())
+          continue;
+        for (auto i = 0; i < ic_entries_per_page<TcPhyspage>(); i++) {
+          ppp->ics[i].f = physpage_template->ics[0].f;
+        }
+        memset(&ppp->translations_bitmap, 0, sizeof(ppp->translations_bitmap));
+      }
+    }
+
     /*  Invalidate entries in the VPH table:  */
     for (r = 0; r < max_vph_tlb_entries<TcPhyspage>(); r ++) {
       if (vph_tlb_entry[r].valid) {
@@ -568,6 +581,11 @@ public:
     next_ic = get_ic_page() + pc_to_ic_entry<TcPhyspage>(cached_pc);
   }
 
+  /*  Links between pages are not implemented for 64-bit tables:  */
+  void move_to_physpage_linked(Cpu *cpu, size_t *link) {
+    move_to_physpage(cpu);
+  }
+
   void nothing() {
     next_ic --;
   }
@@ -0,0 +1,77 @@
+#ifndef	TRACE_H
+#define	TRACE_H
+
+/*
+ *  Tracing of device and CPU events.
+ *
+ *  TRACE(category, level, format, ...) records an event if the category's
+ *  runtime level is at least level. When it is not, the cost is one load
+ *  and one (predicted not taken) branch. Levels above TRACE_MAX_LEVEL are
+ *  removed at compile time.
+ *
+ *  Records are not formatted when they are taken. The format string pointer
+ *  and the raw argument values are stored in a ring buffer in memory, and
+ *  are only turned into text when the buffer is dumped (from the debugger's
+ *  "tracelog dump" command, or at exit). Because of this, the format must be
+ *  a string literal. %s arguments are copied, up to TRACE_STRING_SPACE bytes
+ *  per record.
+ */
+
+#include <stdio.h>
+#include <inttypes.h>
+
+
+enum trace_category {
+	TRACE_CPU = 0,
+	TRACE_PPC,
+	TRACE_MEM,
+	TRACE_PCI,
+	TRACE_ISA,
+	TRACE_EAGLE,
+	TRACE_FDC,
+	TRACE_VGA,
+	TRACE_KBD,
+	TRACE_RTC,
+	TRACE_SCSI,
+	TRACE_DEV,
+	N_TRACE_CATEGORIES
+};
+
+#define	TRACE_OFF		0
+#define	TRACE_ERROR		1
+#define	TRACE_WARN		2
+#define	TRACE_INFO		3
+#define	TRACE_DEBUG		4
+
+#ifndef	TRACE_MAX_LEVEL
+#define	TRACE_MAX_LEVEL		TRACE_DEBUG
+#endif
+
+#define	TRACE_MAX_ARGS		10
+#define	TRACE_STRING_SPACE	160
+#define	TRACE_RING_LEN		16384	/*  records, must be a power of 2  */
+
+extern uint8_t trace_levels[N_TRACE_CATEGORIES];
+
+#define	TRACE_ENABLED(cat, level)					\
+	((level) <= TRACE_MAX_LEVEL &&					\
+	    __builtin_expect(trace_levels[cat] >= (level), 0))
+
+#define	TRACE(cat, level, ...)	do {					\
+		if (TRACE_ENABLED(cat, level))				\
+			trace_record(cat, level, __VA_ARGS__);		\
+	} while (0)
+
+void trace_record(int cat, int level, const char *fmt, ...)
+#ifdef __GNUC__
+	__attribute__((format(printf, 3, 4)))
+#endif
+	;
+
+int trace_set_levels(const char *spec);
+void trace_show_levels(void);
+void trace_dump(FILE *f, int only_new);
+void trace_clear(void);
+
+
+#endif	/*  TRACE_H  */
@@ -98,6 +98,9 @@ struct fb_window {
 
   std::vector<struct x11_cursor> cursors;
 
+	/*  Set when the window must be presented even without new damage:  */
+	bool		needs_present;
+
 	/*  Host's X11 cursor:  */
   SDL_Texture *pixel;
   uint32_t window_id;
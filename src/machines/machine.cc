@@ -34,8 +34,11 @@
 #include <string.h>
 #include <time.h>
 #include <unistd.h>
+#include <pthread.h>
+#include <signal.h>
 
 #include "cpu.h"
+#include "debugger.h"
 #include "device.h"
 #include "diskimage.h"
 #include "emul.h"
@@ -46,6 +49,9 @@
 #include "symbol.h"
 
 
+extern uint64_t single_step;
+
+
 /*  This is initialized by machine_init():  */
 struct machine_entry *first_machine_entry = NULL;
 
@@ -312,6 +318,73 @@ void machine_add_tickfunction(struct machine *machine, void (*func)
 }
 
 
+/*
+ *  machine_set_tickfunction_interval():
+ *
+ *  Changes how often a tick function added by machine_add_tickfunction()
+ *  is called, to every n_instrs instructions. Intervals shorter than
+ *  1 << N_SAFE_DYNTRANS_LIMIT_SHIFT are rounded up. An n_instrs of zero
+ *  disables the tick function until it is given an interval again.
+ *
+ *  A tick which is already due within the new interval is kept, so that
+ *  restoring a checkpoint does not move it.
+ */
+void machine_set_tickfunction_interval(struct machine *machine, void (*func)
+	(struct cpu *, void *), void *extra, int n_instrs)
+{
+	struct tick_functions *tf = &machine->tick_functions;
+
+	for (int te=0; te<tf->n_entries; te++) {
+		if (tf->f[te] != func || tf->extra[te] != extra)
+			continue;
+
+		if (n_instrs > 0 && n_instrs < (1 << N_SAFE_DYNTRANS_LIMIT_SHIFT))
+			n_instrs = 1 << N_SAFE_DYNTRANS_LIMIT_SHIFT;
+
+		tf->ticks_reset_value[te] = n_instrs;
+		if (tf->ticks_till_next[te] <= 0 ||
+		    tf->ticks_till_next[te] > n_instrs)
+			tf->ticks_till_next[te] = n_instrs;
+		return;
+	}
+
+	fatal("machine_set_tickfunction_interval: no such tick function\n");
+	exit(1);
+}
+
+
+/*
+ *  machine_add_checkpoint_function():
+ *
+ *  Adds a function which saves or restores a device's state when a machine
+ *  checkpoint is written or read (see checkpoint.cc). Functions are called
+ *  in registration order, and the name is stored in the checkpoint file so
+ *  that a restore into a differently configured machine can be detected.
+ */
+void machine_add_checkpoint_function(struct machine *machine,
+	const char *name, void (*func)(struct checkpoint *, void *),
+	void *extra)
+{
+	int n = machine->checkpoint_functions.n_entries;
+
+	CHECK_ALLOCATION(machine->checkpoint_functions.name = (const char **)
+	    realloc(machine->checkpoint_functions.name,
+	    (n+1) * sizeof(char *)));
+	CHECK_ALLOCATION(machine->checkpoint_functions.f =
+	    (void (**)(checkpoint*,void*)) realloc(
+	    machine->checkpoint_functions.f, (n+1) * sizeof(void *)));
+	CHECK_ALLOCATION(machine->checkpoint_functions.extra = (void **)
+	    realloc(machine->checkpoint_functions.extra,
+	    (n+1) * sizeof(void *)));
+
+	machine->checkpoint_functions.name[n]  = name;
+	machine->checkpoint_functions.f[n]     = func;
+	machine->checkpoint_functions.extra[n] = extra;
+
+	machine->checkpoint_functions.n_entries = n + 1;
+}
+
+
 /*
  *  machine_statistics_init():
  *
@@ -604,6 +677,322 @@ void machine_default_cputype(struct machine *m)
 /*****************************************************************************/
 
 
+/*
+ *  machine_tick():
+ *
+ *  Runs the hardware 'ticks' (clocks, interrupt sources...), after
+ *  n_instrs instructions have been executed.
+ *
+ *  TODO: This should be redesigned into some "mainbus" stuff instead!
+ */
+static void machine_tick(struct machine *machine, int n_instrs)
+{
+	for (int te=0; te<machine->tick_functions.n_entries; te++) {
+		/*  Disabled by machine_set_tickfunction_interval():  */
+		if (machine->tick_functions.ticks_reset_value[te] == 0)
+			continue;
+
+		machine->tick_functions.ticks_till_next[te] -= n_instrs;
+		if (machine->tick_functions.ticks_till_next[te] <= 0) {
+			while (machine->tick_functions.ticks_till_next[te]<=0) {
+				machine->tick_functions.ticks_till_next[te] +=
+				    machine->tick_functions.
+				    ticks_reset_value[te];
+			}
+
+			machine->tick_functions.f[te](machine->cpus[0],
+			    machine->tick_functions.extra[te]);
+		}
+	}
+}
+
+
+/*
+ *  Threaded cpus:
+ *
+ *  When machine->threaded_cpus is set (the -P command line option), each
+ *  cpu of an SMP machine runs in a host thread of its own. Everything else
+ *  is serialized by the device lock: device accesses, tick functions, and
+ *  whatever the main loop does between calls to machine_run(). The main
+ *  thread holds the device lock at all times, except while it sleeps in
+ *  machine_run(). The tick functions are only called from cpu0's thread,
+ *  with cpu0's instruction count, so that emulated time does not run
+ *  faster with more cpus.
+ *
+ *  When single-stepping, tracing, or gathering statistics, the cpu threads
+ *  are paused, and the main thread runs the cpus one after another instead.
+ */
+
+/*  Nr of instructions a cpu thread runs between calls to machine_tick():  */
+#define	CPU_THREAD_TICK_BATCH	1024
+
+/*  How long the main thread sleeps in machine_run(), in microseconds:  */
+#define	CPU_THREAD_MAIN_SLEEP	1000
+
+struct machine_cpu_threads {
+	pthread_t	*threads;
+	pthread_mutex_t	device_lock;	/*  Recursive  */
+
+	/*  Protected by lock:  */
+	pthread_mutex_t	lock;
+	pthread_cond_t	cond;
+	int		paused;
+	int		n_idle;
+	int		exiting;
+};
+
+
+void machine_lock_devices(struct machine *machine)
+{
+	if (machine->cpu_threads != NULL)
+		pthread_mutex_lock(&machine->cpu_threads->device_lock);
+}
+
+
+void machine_unlock_devices(struct machine *machine)
+{
+	if (machine->cpu_threads != NULL)
+		pthread_mutex_unlock(&machine->cpu_threads->device_lock);
+}
+
+
+/*
+ *  machine_cpu_thread():
+ *
+ *  Runs one cpu, until the machine's cpu threads are stopped. The thread
+ *  sleeps while the threads are paused or the cpu is not running.
+ */
+static void *machine_cpu_thread(void *arg)
+{
+	struct cpu *cpu = (struct cpu *) arg;
+	struct machine *machine = cpu->machine;
+	struct machine_cpu_threads *t = machine->cpu_threads;
+	int n_instrs = 0;
+
+	for (;;) {
+		if (__atomic_load_n(&t->paused, __ATOMIC_ACQUIRE) ||
+		    !cpu->running) {
+			pthread_mutex_lock(&t->lock);
+			t->n_idle ++;
+			pthread_cond_broadcast(&t->cond);
+			while ((t->paused || !cpu->running) && !t->exiting) {
+				struct timespec ts;
+				clock_gettime(CLOCK_REALTIME, &ts);
+				ts.tv_nsec += CPU_THREAD_MAIN_SLEEP * 1000;
+				if (ts.tv_nsec >= 1000000000) {
+					ts.tv_sec ++;
+					ts.tv_nsec -= 1000000000;
+				}
+				pthread_cond_timedwait(&t->cond, &t->lock, &ts);
+			}
+			t->n_idle --;
+			pthread_mutex_unlock(&t->lock);
+		}
+
+		if (__atomic_load_n(&t->exiting, __ATOMIC_ACQUIRE))
+			break;
+
+		int n = cpu->run_instr(cpu);
+
+		/*  Emulated time follows cpu0, and the tick functions (which
+		    are given cpu0) run in its thread:  */
+		if (cpu != machine->cpus[0])
+			continue;
+
+		n_instrs += n;
+		if (n_instrs >= CPU_THREAD_TICK_BATCH) {
+			machine_lock_devices(machine);
+			machine_tick(machine, n_instrs);
+			machine_unlock_devices(machine);
+			n_instrs = 0;
+		}
+	}
+
+	return NULL;
+}
+
+
+/*
+ *  machine_start_cpu_threads():
+ *
+ *  Creates one host thread per cpu. Signals are blocked in the new threads,
+ *  so that e.g. CTRL-C is handled by the main thread.
+ */
+static void machine_start_cpu_threads(struct machine *machine)
+{
+	struct machine_cpu_threads *t;
+	pthread_mutexattr_t attr;
+	sigset_t all, old;
+
+	CHECK_ALLOCATION(t = (struct machine_cpu_threads *)
+	    calloc(1, sizeof(struct machine_cpu_threads)));
+	CHECK_ALLOCATION(t->threads = (pthread_t *)
+	    calloc(machine->ncpus, sizeof(pthread_t)));
+
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&t->device_lock, &attr);
+	pthread_mutexattr_destroy(&attr);
+	pthread_mutex_init(&t->lock, NULL);
+	pthread_cond_init(&t->cond, NULL);
+
+	machine->cpu_threads = t;
+	machine->cpu_threads_running = 1;
+	machine_lock_devices(machine);
+
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+
+	for (int i=0; i<machine->ncpus; i++) {
+		if (pthread_create(&t->threads[i], NULL, machine_cpu_thread,
+		    machine->cpus[i]) != 0) {
+			fprintf(stderr, "machine: could not create cpu thread\n");
+			exit(1);
+		}
+	}
+
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+}
+
+
+/*
+ *  machine_pause_cpu_threads():
+ *
+ *  Waits until all cpu threads are idle. The caller must not hold the
+ *  device lock, since a cpu thread may be waiting for it.
+ */
+static void machine_pause_cpu_threads(struct machine *machine)
+{
+	struct machine_cpu_threads *t = machine->cpu_threads;
+
+	pthread_mutex_lock(&t->lock);
+	__atomic_store_n(&t->paused, 1, __ATOMIC_RELEASE);
+	while (t->n_idle < machine->ncpus)
+		pthread_cond_wait(&t->cond, &t->lock);
+	pthread_mutex_unlock(&t->lock);
+
+	machine->cpu_threads_running = 0;
+
+	/*  Invalidations queued for a cpu which stopped, and PTEG shadows
+	    which may have been missed by stores from other threads:  */
+	for (int i=0; i<machine->ncpus; i++) {
+		ppc_tlb_receive(machine->cpus[i]);
+		ppc_mmu_flush_pteg_shadow(machine->cpus[i]);
+	}
+}
+
+
+static void machine_resume_cpu_threads(struct machine *machine)
+{
+	struct machine_cpu_threads *t = machine->cpu_threads;
+
+	/*  Writable mappings of device memory may have been made while
+	    paused; threaded cpus must not have any (see memory_rw.h):  */
+	for (int i=0; i<machine->ncpus; i++) {
+		struct cpu *cpu = machine->cpus[i];
+		cpu->invalidate_translation_caches(cpu, 0, INVALIDATE_ALL);
+	}
+
+	machine->cpu_threads_running = 1;
+
+	pthread_mutex_lock(&t->lock);
+	__atomic_store_n(&t->paused, 0, __ATOMIC_RELEASE);
+	pthread_cond_broadcast(&t->cond);
+	pthread_mutex_unlock(&t->lock);
+}
+
+
+/*
+ *  machine_stop_cpu_threads():
+ *
+ *  Stops and joins the cpu threads (if any). Called when the emulation ends.
+ */
+void machine_stop_cpu_threads(struct machine *machine)
+{
+	struct machine_cpu_threads *t = machine->cpu_threads;
+
+	if (t == NULL)
+		return;
+
+	pthread_mutex_lock(&t->lock);
+	__atomic_store_n(&t->exiting, 1, __ATOMIC_RELEASE);
+	pthread_cond_broadcast(&t->cond);
+	pthread_mutex_unlock(&t->lock);
+
+	machine_unlock_devices(machine);
+
+	for (int i=0; i<machine->ncpus; i++)
+		pthread_join(t->threads[i], NULL);
+
+	machine->cpu_threads = NULL;
+	machine->cpu_threads_running = 0;
+
+	pthread_mutex_destroy(&t->device_lock);
+	pthread_mutex_destroy(&t->lock);
+	pthread_cond_destroy(&t->cond);
+	free(t->threads);
+	free(t);
+}
+
+
+/*
+ *  machine_run_threaded():
+ *
+ *  machine_run() for threaded cpus. Lets the cpu threads run for a while,
+ *  or runs the cpus in the main thread, if they have to be run one after
+ *  another right now.
+ */
+static int machine_run_threaded(struct machine *machine)
+{
+	struct cpu **cpus = machine->cpus;
+	int ncpus = machine->ncpus;
+	bool serial = single_step || machine->instruction_trace ||
+	    machine->show_trace_tree || machine->statistics.enabled ||
+	    ppc_recording != NULL;
+
+	if (machine->cpu_threads == NULL)
+		machine_start_cpu_threads(machine);
+
+	if (serial) {
+		if (machine->cpu_threads_running) {
+			machine_unlock_devices(machine);
+			machine_pause_cpu_threads(machine);
+			machine_lock_devices(machine);
+		}
+
+		int cpu0instrs = 0;
+		for (int i = 0; i < ncpus; i++) {
+			if (cpus[i]->running) {
+				int n = cpus[i]->run_instr(cpus[i]);
+				if (i == 0)
+					cpu0instrs = n;
+			}
+		}
+
+		machine_tick(machine, cpu0instrs);
+	} else {
+		if (!machine->cpu_threads_running)
+			machine_resume_cpu_threads(machine);
+
+		machine_unlock_devices(machine);
+		usleep(CPU_THREAD_MAIN_SLEEP);
+
+		/*  CTRL-C etc.: the debugger needs the cpus to stand still.  */
+		if (single_step)
+			machine_pause_cpu_threads(machine);
+
+		machine_lock_devices(machine);
+	}
+
+	/*  Is any CPU still alive?  */
+	for (int i=0; i<ncpus; i++)
+		if (cpus[i]->running)
+			return 1;
+
+	return 0;
+}
+
+
 /*
  *  machine_run():
  *
@@ -619,6 +1008,10 @@ int machine_run(struct machine *machine)
 	struct cpu **cpus = machine->cpus;
 	int ncpus = machine->ncpus, cpu0instrs = 0;
 
+	/*  Only PowerPC cpus can (so far) run in threads of their own:  */
+	if (machine->threaded_cpus && ncpus > 1 && machine->arch == ARCH_PPC)
+		return machine_run_threaded(machine);
+
   	for (int i = 0; i < ncpus; i++) {
 		if (cpus[i]->running) {
 			cpu0instrs += cpus[i]->run_instr(cpus[i]);
@@ -631,23 +1024,8 @@ int machine_run(struct machine *machine)
 	 *  Hardware 'ticks':  (clocks, interrupt sources...)
 	 *
 	 *  Here, cpu0instrs is the number of instructions executed on cpu0.
-	 *
-	 *  TODO: This should be redesigned into some "mainbus" stuff instead!
 	 */
-
-	for (int te=0; te<machine->tick_functions.n_entries; te++) {
-		machine->tick_functions.ticks_till_next[te] -= cpu0instrs;
-		if (machine->tick_functions.ticks_till_next[te] <= 0) {
-			while (machine->tick_functions.ticks_till_next[te]<=0) {
-				machine->tick_functions.ticks_till_next[te] +=
-				    machine->tick_functions.
-				    ticks_reset_value[te];
-			}
-
-			machine->tick_functions.f[te](cpus[0],
-			    machine->tick_functions.extra[te]);
-		}
-	}
+	machine_tick(machine, cpu0instrs);
 
 	/*  Is any CPU still alive?  */
 	for (int i=0; i<ncpus; i++)
@@ -0,0 +1,423 @@
+/*
+ *  Binary serialization of component trees: the writer (BinarySerializer),
+ *  and the reader (BinaryDeserializer), which maps files instead of reading
+ *  them in whenever possible. The format is described in BinarySerializer.h.
+ */
+
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "BinarySerializer.h"
+
+
+static const char binarySerializationMagic[8] =
+	{ 'G', 'X', 'e', 'm', 'u', 'l', 'B', 'S' };
+static const uint32_t binarySerializationVersion = 1;
+
+
+BinarySerializer::BinarySerializer()
+	: m_size(0)
+{
+}
+
+
+uint8_t* BinarySerializer::Append(size_t len)
+{
+	size_t offset = m_buffer.size();
+	m_buffer.resize(offset + len);
+
+	// Extend the last segment, if it is also in the internal buffer.
+	if (m_segments.size() > 0 && m_segments.back().external == NULL)
+		m_segments.back().length += len;
+	else {
+		Segment segment;
+		segment.external = NULL;
+		segment.offset = offset;
+		segment.length = len;
+		m_segments.push_back(segment);
+	}
+
+	m_size += len;
+	return &m_buffer[offset];
+}
+
+
+void BinarySerializer::WriteHeader()
+{
+	WriteBytes(binarySerializationMagic, sizeof(binarySerializationMagic));
+	WriteUInt32(binarySerializationVersion);
+}
+
+
+void BinarySerializer::WriteUInt8(uint8_t value)
+{
+	*Append(1) = value;
+}
+
+
+void BinarySerializer::WriteUInt32(uint32_t value)
+{
+	uint8_t *p = Append(sizeof(value));
+	for (size_t i=0; i<sizeof(value); ++i)
+		p[i] = value >> (i * 8);
+}
+
+
+void BinarySerializer::WriteUInt64(uint64_t value)
+{
+	uint8_t *p = Append(sizeof(value));
+	for (size_t i=0; i<sizeof(value); ++i)
+		p[i] = value >> (i * 8);
+}
+
+
+void BinarySerializer::WriteString(const string& str)
+{
+	WriteUInt32(str.length());
+	WriteBytes(str.c_str(), str.length());
+}
+
+
+void BinarySerializer::WriteBytes(const void *data, size_t len)
+{
+	if (len > 0)
+		memcpy(Append(len), data, len);
+}
+
+
+void BinarySerializer::WriteBlob(const void *data, size_t len)
+{
+	size_t misalignment = m_size % BINARYSERIALIZER_BLOB_ALIGNMENT;
+	if (misalignment != 0)
+		memset(Append(BINARYSERIALIZER_BLOB_ALIGNMENT - misalignment),
+		    0, BINARYSERIALIZER_BLOB_ALIGNMENT - misalignment);
+
+	Segment segment;
+	segment.external = (const uint8_t *) data;
+	segment.offset = 0;
+	segment.length = len;
+	m_segments.push_back(segment);
+
+	m_size += len;
+}
+
+
+size_t BinarySerializer::BeginRecord()
+{
+	// The length is filled in by EndRecord. Since the placeholder is
+	// in the internal buffer, its offset stays valid even if the
+	// buffer is reallocated.
+	Append(sizeof(uint64_t));
+	size_t record = m_buffer.size() - sizeof(uint64_t);
+
+	// Remember the stream position of the start of the record's
+	// contents in the placeholder itself, until the record ends.
+	uint64_t start = m_size;
+	memcpy(&m_buffer[record], &start, sizeof(start));
+
+	return record;
+}
+
+
+void BinarySerializer::EndRecord(size_t record)
+{
+	uint64_t start;
+	memcpy(&start, &m_buffer[record], sizeof(start));
+
+	uint64_t len = m_size - start;
+	for (size_t i=0; i<sizeof(len); ++i)
+		m_buffer[record + i] = len >> (i * 8);
+}
+
+
+uint64_t BinarySerializer::GetSize() const
+{
+	return m_size;
+}
+
+
+bool BinarySerializer::WriteToFile(int fd) const
+{
+	vector<struct iovec> iov;
+	iov.reserve(m_segments.size());
+
+	for (size_t i=0; i<m_segments.size(); ++i) {
+		const Segment& segment = m_segments[i];
+		struct iovec v;
+		v.iov_base = (void *) (segment.external != NULL?
+		    segment.external : &m_buffer[segment.offset]);
+		v.iov_len = segment.length;
+		if (v.iov_len > 0)
+			iov.push_back(v);
+	}
+
+	// writev may write less than requested, and can only handle
+	// IOV_MAX entries per call.
+	size_t first = 0;
+	while (first < iov.size()) {
+		if (iov[first].iov_len == 0) {
+			++ first;
+			continue;
+		}
+
+		size_t n = iov.size() - first;
+		if (n > IOV_MAX)
+			n = IOV_MAX;
+
+		// A non-empty write that writes nothing would never
+		// finish, so it is treated as an error.
+		ssize_t written = writev(fd, &iov[first], n);
+		if (written < 0) {
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+		if (written == 0)
+			return false;
+
+		while (written > 0 && first < iov.size()) {
+			if ((size_t) written >= iov[first].iov_len) {
+				written -= iov[first].iov_len;
+				++ first;
+			} else {
+				iov[first].iov_base =
+				    (uint8_t *) iov[first].iov_base + written;
+				iov[first].iov_len -= written;
+				written = 0;
+			}
+		}
+	}
+
+	return true;
+}
+
+
+void BinarySerializer::GetData(vector<uint8_t>& data) const
+{
+	data.resize(m_size);
+
+	size_t pos = 0;
+	for (size_t i=0; i<m_segments.size(); ++i) {
+		const Segment& segment = m_segments[i];
+		if (segment.length == 0)
+			continue;
+
+		memcpy(&data[pos], segment.external != NULL? segment.external
+		    : &m_buffer[segment.offset], segment.length);
+		pos += segment.length;
+	}
+}
+
+
+/*****************************************************************************/
+
+
+BinaryDeserializer::BinaryDeserializer(const uint8_t *data, size_t len)
+	: m_data(data)
+	, m_length(len)
+	, m_pos(0)
+	, m_failed(false)
+	, m_fd(-1)
+	, m_mapping(NULL)
+{
+}
+
+
+BinaryDeserializer::~BinaryDeserializer()
+{
+	if (m_mapping != NULL)
+		munmap(m_mapping, m_length);
+
+	if (m_fd >= 0)
+		close(m_fd);
+}
+
+
+bool BinaryDeserializer::Open(const string& filename)
+{
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0) {
+		close(fd);
+		return false;
+	}
+
+	void *p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (p == MAP_FAILED) {
+		close(fd);
+		return false;
+	}
+
+	m_fd = fd;
+	m_mapping = p;
+	m_data = (const uint8_t *) p;
+	m_length = st.st_size;
+	m_pos = 0;
+	m_failed = false;
+
+	return true;
+}
+
+
+bool BinaryDeserializer::IsBinarySerialization(const char *data, size_t len)
+{
+	return len >= sizeof(binarySerializationMagic) &&
+	    memcmp(data, binarySerializationMagic,
+	    sizeof(binarySerializationMagic)) == 0;
+}
+
+
+bool BinaryDeserializer::ReadHeader()
+{
+	const uint8_t *magic = Consume(sizeof(binarySerializationMagic));
+	if (magic == NULL || !IsBinarySerialization((const char *) magic,
+	    sizeof(binarySerializationMagic)))
+		return false;
+
+	uint32_t version;
+	if (!ReadUInt32(version))
+		return false;
+
+	return version == binarySerializationVersion;
+}
+
+
+const uint8_t* BinaryDeserializer::Consume(size_t len)
+{
+	if (m_failed || len > m_length - m_pos) {
+		m_failed = true;
+		return NULL;
+	}
+
+	const uint8_t *p = m_data + m_pos;
+	m_pos += len;
+	return p;
+}
+
+
+bool BinaryDeserializer::ReadUInt8(uint8_t& value)
+{
+	const uint8_t *p = Consume(1);
+	if (p == NULL)
+		return false;
+
+	value = *p;
+	return true;
+}
+
+
+bool BinaryDeserializer::ReadUInt32(uint32_t& value)
+{
+	const uint8_t *p = Consume(sizeof(value));
+	if (p == NULL)
+		return false;
+
+	value = 0;
+	for (size_t i=0; i<sizeof(value); ++i)
+		value |= (uint32_t) p[i] << (i * 8);
+
+	return true;
+}
+
+
+bool BinaryDeserializer::ReadUInt64(uint64_t& value)
+{
+	const uint8_t *p = Consume(sizeof(value));
+	if (p == NULL)
+		return false;
+
+	value = 0;
+	for (size_t i=0; i<sizeof(value); ++i)
+		value |= (uint64_t) p[i] << (i * 8);
+
+	return true;
+}
+
+
+bool BinaryDeserializer::ReadString(string& str)
+{
+	uint32_t len;
+	if (!ReadUInt32(len))
+		return false;
+
+	const uint8_t *p = Consume(len);
+	if (p == NULL)
+		return false;
+
+	str = string((const char *) p, len);
+	return true;
+}
+
+
+bool BinaryDeserializer::ReadBytes(void *data, size_t len)
+{
+	const uint8_t *p = Consume(len);
+	if (p == NULL)
+		return false;
+
+	memcpy(data, p, len);
+	return true;
+}
+
+
+const uint8_t* BinaryDeserializer::ReadBlob(size_t len)
+{
+	size_t misalignment = m_pos % BINARYSERIALIZER_BLOB_ALIGNMENT;
+	if (misalignment != 0 && Consume(BINARYSERIALIZER_BLOB_ALIGNMENT -
+	    misalignment) == NULL)
+		return NULL;
+
+	return Consume(len);
+}
+
+
+void* BinaryDeserializer::MapBlob(const uint8_t *blob, size_t len)
+{
+	if (m_mapping == NULL || blob < m_data || blob + len > m_data + m_length)
+		return NULL;
+
+	off_t offset = blob - m_data;
+	if (offset % sysconf(_SC_PAGESIZE) != 0)
+		return NULL;
+
+	void *p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+	    m_fd, offset);
+
+	return p == MAP_FAILED? NULL : p;
+}
+
+
+size_t BinaryDeserializer::BeginRecord()
+{
+	uint64_t len;
+	if (!ReadUInt64(len) || len > m_length - m_pos) {
+		m_failed = true;
+		return m_pos;
+	}
+
+	return m_pos + len;
+}
+
+
+void BinaryDeserializer::EndRecord(size_t end)
+{
+	if (!m_failed && end <= m_length)
+		m_pos = end;
+}
+
+
+bool BinaryDeserializer::Failed() const
+{
+	return m_failed;
+}
+
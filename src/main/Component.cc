@@ -1223,6 +1223,107 @@ refcount_ptr<Component> Component::Deserialize(ostream& messages, const string&
 }
 
 
+void Component::SerializeBinary(BinarySerializer& serializer) const
+{
+	size_t record = serializer.BeginRecord();
+
+	serializer.WriteString(m_className);
+
+	serializer.WriteUInt32(m_stateVariables.size());
+	for (StateVariableMap::const_iterator it = m_stateVariables.begin();
+	    it != m_stateVariables.end(); ++it) {
+		serializer.WriteString(it->first);
+		(it->second).SerializeBinary(serializer);
+	}
+
+	serializer.WriteUInt32(m_childComponents.size());
+	for (size_t i = 0, n = m_childComponents.size(); i < n; ++ i)
+		m_childComponents[i]->SerializeBinary(serializer);
+
+	serializer.EndRecord(record);
+}
+
+
+refcount_ptr<Component> Component::DeserializeBinary(ostream& messages,
+	BinaryDeserializer& deserializer)
+{
+	refcount_ptr<Component> deserializedTree = NULL;
+
+	size_t end = deserializer.BeginRecord();
+
+	string className;
+	if (!deserializer.ReadString(className)) {
+		messages << "Expecting a class name.\n";
+		return deserializedTree;
+	}
+
+	// root is a special case (cannot be created by the factory). All other
+	// class types should be possible to create using the factory.
+	if (className == "root") {
+		deserializedTree = new RootComponent;
+	} else {
+		deserializedTree = ComponentFactory::CreateComponent(className);
+		if (deserializedTree.IsNULL()) {
+			messages << "Could not create a '" << className << "' component.\n";
+			return deserializedTree;
+		}
+	}
+
+	uint32_t nVariables;
+	if (!deserializer.ReadUInt32(nVariables)) {
+		messages << "Failure. (0)\n";
+		return NULL;
+	}
+
+	for (uint32_t i = 0; i < nVariables; ++ i) {
+		string name;
+		if (!deserializer.ReadString(name)) {
+			messages << "Failure. (1)\n";
+			return NULL;
+		}
+
+		StateVariableMap::iterator it =
+		    deserializedTree->m_stateVariables.find(name);
+		bool success = false;
+		if (it == deserializedTree->m_stateVariables.end())
+			deserializer.EndRecord(deserializer.BeginRecord());
+		else
+			success = (it->second).DeserializeBinary(deserializer);
+
+		if (deserializer.Failed()) {
+			messages << "Failure. (2)\n";
+			return NULL;
+		}
+
+		if (!success)
+			messages << "Warning: variable '" << name <<
+			    "' for component class " << className <<
+			    " could not be deserialized; skipping.\n";
+	}
+
+	uint32_t nChildren;
+	if (!deserializer.ReadUInt32(nChildren)) {
+		messages << "Failure. (3)\n";
+		return NULL;
+	}
+
+	for (uint32_t i = 0; i < nChildren; ++ i) {
+		refcount_ptr<Component> child =
+		    Component::DeserializeBinary(messages, deserializer);
+		if (child.IsNULL()) {
+			messages << "Failure. (4)\n";
+			return NULL;
+		}
+
+		deserializedTree->AddChild(child);
+	}
+
+	deserializer.EndRecord(end);
+
+	return deserializedTree;
+}
+
+
 bool Component::CheckConsistency() const
 {
 	// Serialize
@@ -1246,7 +1347,25 @@ bool Component::CheckConsistency() const
 	tmpDeserializedTree->AddChecksum(checksumDeserialized);
 
 	// ... and compare the checksums:
-	return checksumOriginal == checksumDeserialized;
+	if (checksumOriginal != checksumDeserialized)
+		return false;
+
+	// Do the same for the binary format:
+	BinarySerializer serializer;
+	SerializeBinary(serializer);
+
+	vector<uint8_t> data;
+	serializer.GetData(data);
+
+	BinaryDeserializer deserializer(&data[0], data.size());
+	tmpDeserializedTree = DeserializeBinary(messages, deserializer);
+	if (tmpDeserializedTree.IsNULL())
+		return false;
+
+	Checksum checksumBinary;
+	tmpDeserializedTree->AddChecksum(checksumBinary);
+
+	return checksumOriginal == checksumBinary;
 }
 
 
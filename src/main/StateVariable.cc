@@ -27,6 +27,7 @@
 
 #include <assert.h>
 #include <math.h>
+#include <string.h>
 
 #include "EscapedString.h"
 #include "StateVariable.h"
@@ -388,6 +389,92 @@ void StateVariable::Serialize(ostream& ss, SerializationContext& context) const
 }
 
 
+void StateVariable::SerializeBinary(BinarySerializer& serializer) const
+{
+	size_t record = serializer.BeginRecord();
+	serializer.WriteUInt8(m_type);
+
+	switch (m_type) {
+
+	case String:
+		serializer.WriteString(*m_value.pstr);
+		break;
+
+	case Bool:
+		serializer.WriteUInt8(*m_value.pbool);
+		break;
+
+	case Double:
+		{
+			uint64_t bits;
+			memcpy(&bits, m_value.pdouble, sizeof(bits));
+			serializer.WriteUInt64(bits);
+		}
+		break;
+
+	case Custom:
+		m_value.phandler->SerializeBinary(serializer);
+		break;
+
+	default:
+		// All integer types are stored as 64-bit values.
+		serializer.WriteUInt64(ToInteger());
+	}
+
+	serializer.EndRecord(record);
+}
+
+
+bool StateVariable::DeserializeBinary(BinaryDeserializer& deserializer)
+{
+	size_t end = deserializer.BeginRecord();
+
+	uint8_t type;
+	bool success = deserializer.ReadUInt8(type) && type == m_type;
+
+	if (success) {
+		switch (m_type) {
+
+		case String:
+			success = deserializer.ReadString(*m_value.pstr);
+			break;
+
+		case Bool:
+			{
+				uint8_t value;
+				success = deserializer.ReadUInt8(value);
+				if (success)
+					*m_value.pbool = value != 0;
+			}
+			break;
+
+		case Double:
+			{
+				uint64_t bits;
+				success = deserializer.ReadUInt64(bits);
+				if (success)
+					memcpy(m_value.pdouble, &bits, sizeof(bits));
+			}
+			break;
+
+		case Custom:
+			success = m_value.phandler->DeserializeBinary(deserializer);
+			break;
+
+		default:
+			{
+				uint64_t value;
+				success = deserializer.ReadUInt64(value) &&
+				    SetValue(value);
+			}
+		}
+	}
+
+	deserializer.EndRecord(end);
+	return success && !deserializer.Failed();
+}
+
+
 string StateVariable::EvaluateExpression(const string& expression,
 	bool& success) const
 {
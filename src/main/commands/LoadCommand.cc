@@ -30,6 +30,7 @@
 #include <string.h>
 
 #include "commands/LoadCommand.h"
+#include "BinarySerializer.h"
 #include "FileLoader.h"
 #include "GXemul.h"
 
@@ -62,8 +63,10 @@ bool LoadCommand::IsComponentTree(GXemul& gxemul, const string& filename) const
 	if (file.gcount() < 10)
 		return false;
 
-	// Saved component trees start with the string "component ".
-	return (strncmp(buf, "component ", 10) == 0);
+	// Saved component trees start with the string "component ",
+	// or with the binary serialization header.
+	return (strncmp(buf, "component ", 10) == 0) ||
+	    BinaryDeserializer::IsBinarySerialization(buf, file.gcount());
 }
 
 
@@ -77,41 +80,48 @@ bool LoadCommand::LoadComponentTree(GXemul& gxemul, const string&filename,
 		    " does not have a .gxemul extension. Continuing anyway.\n");
 
 	refcount_ptr<Component> component;
+	stringstream messages;
 
-	// Load from the file
-	std::ifstream file(filename.c_str());
-	if (file.fail()) {
-		ShowMsg(gxemul, "Unable to open " + filename + " for reading.\n");
-		return false;
-	}
+	BinaryDeserializer deserializer;
+	if (deserializer.Open(filename) && deserializer.ReadHeader()) {
+		// The binary format is read directly from the mapped file.
+		component = Component::DeserializeBinary(messages,
+		    deserializer);
+	} else {
+		// Load the text format from the file
+		std::ifstream file(filename.c_str());
+		if (file.fail()) {
+			ShowMsg(gxemul, "Unable to open " + filename + " for reading.\n");
+			return false;
+		}
 
-	// Figure out the file's size:
-	file.seekg(0, std::ios::end);
-	std::streampos fileSize = file.tellg();
-	file.seekg(0, std::ios::beg);
-
-	// Read the entire file into a string.
-	// TODO: This is wasteful, of course. It actually takes twice the
-	// size of the file, since the string constructor generates a _copy_.
-	// But string takes care of unicode and such (if compiled as ustring).
-	vector<char> buf;
-	buf.resize((size_t)fileSize + 1);
-
-	memset(&buf[0], 0, fileSize);
-	file.read(&buf[0], fileSize);
-	if (file.gcount() != fileSize) {
-		ShowMsg(gxemul, "Loading from " + filename + " failed; "
-		    "could not read all of the file?\n");
-		return false;
-	}
+		// Figure out the file's size:
+		file.seekg(0, std::ios::end);
+		std::streampos fileSize = file.tellg();
+		file.seekg(0, std::ios::beg);
+
+		// Read the entire file into a string.
+		// TODO: This is wasteful, of course. It actually takes twice the
+		// size of the file, since the string constructor generates a _copy_.
+		// But string takes care of unicode and such (if compiled as ustring).
+		vector<char> buf;
+		buf.resize((size_t)fileSize + 1);
+
+		memset(&buf[0], 0, fileSize);
+		file.read(&buf[0], fileSize);
+		if (file.gcount() != fileSize) {
+			ShowMsg(gxemul, "Loading from " + filename + " failed; "
+			    "could not read all of the file?\n");
+			return false;
+		}
 
-	string str(&buf[0], fileSize);
+		string str(&buf[0], fileSize);
 
-	file.close();
+		file.close();
 
-	size_t strPos = 0;
-	stringstream messages;
-	component = Component::Deserialize(messages, str, strPos);
+		size_t strPos = 0;
+		component = Component::Deserialize(messages, str, strPos);
+	}
 
 	if (messages.str().length() > 0)
 		ShowMsg(gxemul, messages.str());
@@ -26,13 +26,19 @@
  */
 
 #include "commands/SaveCommand.h"
+#include "BinarySerializer.h"
 #include "GXemul.h"
 
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <fstream>
 
 
 SaveCommand::SaveCommand()
-	: Command("save", "[filename [component-path]]")
+	: Command("save", "[filename [component-path [format]]]")
 {
 }
 
@@ -52,8 +58,9 @@ bool SaveCommand::Execute(GXemul& gxemul, const vector<string>& arguments)
 {
 	string filename = gxemul.GetEmulationFilename();
 	string path = "root";
+	bool binary = true;
 
-	if (arguments.size() > 2) {
+	if (arguments.size() > 3) {
 		ShowMsg(gxemul, "Too many arguments.\n");
 		return false;
 	}
@@ -69,6 +76,16 @@ bool SaveCommand::Execute(GXemul& gxemul, const vector<string>& arguments)
 	if (arguments.size() > 1)
 		path = arguments[1];
 
+	if (arguments.size() > 2) {
+		if (arguments[2] == "text")
+			binary = false;
+		else if (arguments[2] != "binary") {
+			ShowMsg(gxemul, "Unknown format " + arguments[2] +
+			    "; should be binary or text.\n");
+			return false;
+		}
+	}
+
 	vector<string> matches = gxemul.GetRootComponent()->
 	    FindPathByPartialMatch(path);
 	if (matches.size() == 0) {
@@ -95,18 +112,54 @@ bool SaveCommand::Execute(GXemul& gxemul, const vector<string>& arguments)
 		ShowMsg(gxemul, "Warning: the name "+filename+" does not have"
 		    " a .gxemul extension. Continuing anyway.\n");
 
-	// Write to the file:
-	{
-		std::fstream outputstream(filename.c_str(),
-		    std::ios::out | std::ios::trunc);
-		if (outputstream.fail()) {
-			ShowMsg(gxemul, "Error: Could not open " + filename +
-			    " for writing.\n");
-			return false;
-		}
+	// Write to a temporary file next to the target, and rename it over
+	// the target when done. A file loaded earlier may still be mapped
+	// (the binary format maps RAM blocks directly from the file), so the
+	// target must not be truncated in place.
+	vector<char> tmpname(filename.begin(), filename.end());
+	const char* suffix = ".XXXXXX";
+	tmpname.insert(tmpname.end(), suffix, suffix + strlen(suffix) + 1);
+
+	int fd = mkstemp(&tmpname[0]);
+	if (fd < 0) {
+		ShowMsg(gxemul, "Error: Could not open " + filename +
+		    " for writing.\n");
+		return false;
+	}
+
+	// mkstemp() creates the file 0600; use the usual mode instead.
+	mode_t mask = umask(0);
+	umask(mask);
+	fchmod(fd, 0666 & ~mask);
 
+	bool success;
+	if (binary) {
+		BinarySerializer serializer;
+		serializer.WriteHeader();
+		component->SerializeBinary(serializer);
+
+		success = serializer.WriteToFile(fd);
+		if (close(fd) != 0)
+			success = false;
+	} else {
+		close(fd);
+
+		std::fstream outputstream(&tmpname[0],
+		    std::ios::out | std::ios::trunc);
 		SerializationContext context;
 		component->Serialize(outputstream, context);
+		outputstream.close();
+		success = !outputstream.fail();
+	}
+
+	if (success && rename(&tmpname[0], filename.c_str()) != 0)
+		success = false;
+
+	if (!success) {
+		unlink(&tmpname[0]);
+		ShowMsg(gxemul, "Error: Could not write to " +
+		    filename + ".\n");
+		return false;
 	}
 
 	// Check that the file exists:
@@ -143,6 +196,10 @@ string SaveCommand::GetLongDescription() const
 	    "\n"
 	    "The filename extension should usually be .gxemul.\n"
 	    "\n"
+	    "The format may be 'binary' (the default) or 'text'. The text format is\n"
+	    "human readable, and mostly useful for debugging; the binary format is\n"
+	    "much faster to save and load, especially for large amounts of RAM.\n"
+	    "\n"
 	    "See also:  load    (to load an emulation setup)\n";
 }
 
@@ -54,6 +54,11 @@
 #endif
 #include <fcntl.h>
 #include <signal.h>
+#ifdef _WIN32
+#define	poll	WSAPoll
+#else
+#include <poll.h>
+#endif
 
 #include "machine.h"
 #include "misc.h"
@@ -63,12 +68,112 @@
 /*  #define debug fatal  */
 
 
+/*
+ *  The NIC rings are shared between the emulator thread(s) and the network
+ *  helper thread.  Producers (the helper thread, and the NICs of all
+ *  machines, which may run in threads of their own) always hold net->lock;
+ *  the consumer (the emulated NIC) only moves the head index, and doesn't
+ *  lock anything.
+ */
+#define	LOAD_ACQUIRE(p)		__atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define	STORE_RELEASE(p, v)	__atomic_store_n((p), (v), __ATOMIC_RELEASE)
+
+
+/*
+ *  net_find_nic():
+ *
+ *  Returns the net_nic struct for a specific 'extra' pointer, or NULL if
+ *  there is no such NIC.  (NICs are never removed, and new ones are
+ *  appended to the list atomically, so no locking is needed.)
+ */
+static struct net_nic *net_find_nic(struct net *net, void *extra)
+{
+	struct net_nic *nic = LOAD_ACQUIRE(&net->first_nic);
+
+	while (nic != NULL && nic->extra != extra)
+		nic = LOAD_ACQUIRE(&nic->next);
+
+	return nic;
+}
+
+
+/*
+ *  net_wakeup():
+ *
+ *  Wakes up the helper thread, so that it can recalculate which sockets
+ *  to wait for.
+ */
+static void net_wakeup(struct net *net)
+{
+	char c = 0;
+
+	if (net->poll_thread_running && net->wakeup_pipe[1] >= 0 &&
+	    write(net->wakeup_pipe[1], &c, 1) < 0) {
+		/*  The pipe is full, so a wakeup is already pending.  */
+	}
+}
+
+
+static void net_lock(struct net *net)
+{
+	pthread_mutex_lock(&net->lock);
+}
+
+
+/*
+ *  net_unlock():
+ *
+ *  Publishes all packets which were allocated while the lock was held, and
+ *  releases the lock.
+ */
+static void net_unlock(struct net *net)
+{
+	struct net_nic *nic;
+
+	for (nic = net->first_nic; nic != NULL; nic = nic->next)
+		if (nic->pending_tail != nic->tail)
+			STORE_RELEASE(&nic->tail, nic->pending_tail);
+
+	pthread_mutex_unlock(&net->lock);
+}
+
+
+/*
+ *  net_nic_has_room():
+ *
+ *  Returns 1 if there are at least n free slots in the ring of a NIC.
+ *  Otherwise, 0 is returned, and the helper thread will be woken up as soon
+ *  as the NIC has received a packet.  Must be called with net->lock held.
+ */
+int net_nic_has_room(struct net *net, void *extra, int n)
+{
+	struct net_nic *nic = net_find_nic(net, extra);
+
+	if (nic == NULL)
+		return 1;	/*  Packets will be dropped anyway.  */
+
+	if (NET_NIC_RING_LEN - (nic->pending_tail -
+	    LOAD_ACQUIRE(&nic->head)) >= (uint32_t) n)
+		return 1;
+
+	STORE_RELEASE(&nic->throttled, 1);
+
+	/*  Re-check, in case the NIC consumed packets in the meantime:  */
+	return NET_NIC_RING_LEN - (nic->pending_tail -
+	    LOAD_ACQUIRE(&nic->head)) >= (uint32_t) n;
+}
+
+
 /*
  *  net_allocate_ethernet_packet_link():
  *
- *  This routine allocates an ethernet_packet_link struct, and adds it at
- *  the end of the packet chain.  A data buffer is allocated, and the data,
- *  extra, and len fields of the link are set.
+ *  This routine takes the next free slot in the packet ring of the NIC
+ *  given by 'extra'.  A data buffer is allocated, and the data, extra, and
+ *  len fields of the link are set.  The packet becomes visible to the NIC
+ *  when net->lock is released.
+ *
+ *  If the ring is full, the packet is silently dropped (as on a real
+ *  network), but a valid link is still returned to the caller.
  *
  *  Note: The data buffer is not zeroed.
  *
@@ -78,26 +183,200 @@
 struct ethernet_packet_link *net_allocate_ethernet_packet_link(
 	struct net *net, void *extra, size_t len)
 {
+	struct net_nic *nic = net_find_nic(net, extra);
 	struct ethernet_packet_link *lp;
 
-	CHECK_ALLOCATION(lp = (struct ethernet_packet_link *)
-	    malloc(sizeof(struct ethernet_packet_link)));
+	if (nic != NULL && nic->pending_tail - LOAD_ACQUIRE(&nic->head)
+	    < NET_NIC_RING_LEN) {
+		lp = &nic->slots[nic->pending_tail & (NET_NIC_RING_LEN-1)];
+		nic->pending_tail ++;
+	} else {
+		debug("[ net: NIC ring full; dropping packet ]\n");
+		lp = net->dropped_packet;
+		free(lp->data);
+	}
 
 	lp->len = len;
 	lp->extra = extra;
 	CHECK_ALLOCATION(lp->data = (unsigned char *) malloc(len));
 
-	lp->next = NULL;
+	return lp;
+}
 
-	/*  Add last in the link chain:  */
-	lp->prev = net->last_ethernet_packet;
-	if (lp->prev != NULL)
-		lp->prev->next = lp;
-	else
-		net->first_ethernet_packet = lp;
-	net->last_ethernet_packet = lp;
 
-	return lp;
+/*
+ *  net_distributed_rx():
+ *
+ *  If the network is distributed across multiple emulator processes, then
+ *  receive incoming packets from those processes.  Called by the helper
+ *  thread, with net->lock held.
+ */
+static void net_distributed_rx(struct net *net)
+{
+	struct sockaddr_in si;
+	socklen_t si_len = sizeof(si);
+	int res, nreceived = 0;
+	unsigned char buf[60000];
+	struct net_nic *nic;
+
+	do {
+		for (nic = net->first_nic; nic != NULL; nic = nic->next)
+			if (!net_nic_has_room(net, nic->extra, 1))
+				return;
+
+		res = recvfrom(net->local_port_socket, (char*)buf,
+		    sizeof(buf), 0, (struct sockaddr *)&si, &si_len);
+
+		if (res != -1) {
+			nreceived ++;
+
+			/*  fatal("[ incoming DISTRIBUTED packet, %i "
+			    "bytes from %s:%d\n", res,
+			    inet_ntoa(si.sin_addr),
+			    ntohs(si.sin_port));  */
+
+			/*  Add the packet to all "our" NICs on this
+			    network:  */
+			for (nic = net->first_nic; nic != NULL; nic = nic->next) {
+				struct ethernet_packet_link *lp;
+				lp = net_allocate_ethernet_packet_link(
+				    net, nic->extra, res);
+				memcpy(lp->data, buf, res);
+			}
+		}
+	} while (res != -1 && nreceived < 100);
+}
+
+
+/*
+ *  net_poll_thread():
+ *
+ *  The network helper thread. It waits (using a single poll() call) for
+ *  incoming traffic on the distributed network socket and on all outgoing
+ *  UDP and TCP connections, and converts that traffic into ethernet packets
+ *  in the rings of the NICs.  Sockets are only waited for while the NIC
+ *  which owns them has room for more packets.
+ *
+ *  The thread is woken up through a pipe when something changes which may
+ *  affect the set of sockets to wait for.
+ */
+static void *net_poll_thread(void *arg)
+{
+	struct net *net = (struct net *) arg;
+	struct pollfd fds[2 + MAX_UDP_CONNECTIONS + MAX_TCP_CONNECTIONS];
+	int con_ids[2 + MAX_UDP_CONNECTIONS + MAX_TCP_CONNECTIONS];
+
+	for (;;) {
+		int n = 0, ip_first, pipe_index = -1, local_index = -1;
+		int retransmit_pending = 0, timeout, res;
+		struct net_nic *nic;
+
+		net_lock(net);
+
+		if (net->wakeup_pipe[0] >= 0) {
+			pipe_index = n;
+			fds[n].fd = net->wakeup_pipe[0];
+			fds[n].events = POLLIN;
+			fds[n].revents = 0;
+			con_ids[n++] = -1;
+		}
+
+		if (net->local_port != 0) {
+			for (nic = net->first_nic; nic != NULL; nic = nic->next)
+				if (!net_nic_has_room(net, nic->extra, 1))
+					break;
+			if (nic == NULL) {
+				local_index = n;
+				fds[n].fd = net->local_port_socket;
+				fds[n].events = POLLIN;
+				fds[n].revents = 0;
+				con_ids[n++] = -1;
+			}
+		}
+
+		ip_first = n;
+		n += net_ip_poll_setup(net, fds + n, con_ids + n,
+		    &retransmit_pending);
+
+		net_unlock(net);
+
+		timeout = -1;
+		if (retransmit_pending || net->wakeup_pipe[0] < 0)
+			timeout = NET_POLL_TIMEOUT_MSEC;
+
+		res = poll(fds, n, timeout);
+		if (res < 0) {
+			if (errno != EINTR) {
+				perror("net_poll_thread: poll");
+				usleep(NET_POLL_TIMEOUT_MSEC * 1000);
+			}
+			continue;
+		}
+
+		if (pipe_index >= 0 && fds[pipe_index].revents != 0) {
+			char buf[64];
+			while (read(net->wakeup_pipe[0], buf, sizeof(buf)) > 0)
+				;
+		}
+
+		net_lock(net);
+
+		if (local_index >= 0 && fds[local_index].revents != 0)
+			net_distributed_rx(net);
+
+		net_ip_poll_handle(net, fds + ip_first, con_ids + ip_first,
+		    n - ip_first);
+
+		net_unlock(net);
+	}
+
+	return NULL;
+}
+
+
+/*
+ *  net_start_poll_thread():
+ *
+ *  Starts the helper thread. Signals are blocked in the helper thread, so
+ *  that they are always delivered to the emulator itself.
+ */
+static void net_start_poll_thread(struct net *net)
+{
+	pthread_t thread;
+	int res;
+
+#ifdef _WIN32
+	net->wakeup_pipe[0] = net->wakeup_pipe[1] = -1;
+#else
+	sigset_t all, old;
+
+	if (pipe(net->wakeup_pipe) != 0) {
+		perror("pipe");
+		exit(1);
+	}
+
+	res = fcntl(net->wakeup_pipe[0], F_GETFL);
+	fcntl(net->wakeup_pipe[0], F_SETFL, res | O_NONBLOCK);
+	res = fcntl(net->wakeup_pipe[1], F_GETFL);
+	fcntl(net->wakeup_pipe[1], F_SETFL, res | O_NONBLOCK);
+
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+#endif
+
+	res = pthread_create(&thread, NULL, net_poll_thread, net);
+
+#ifndef _WIN32
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+#endif
+
+	if (res != 0) {
+		fprintf(stderr, "net: could not create the helper thread\n");
+		exit(1);
+	}
+
+	pthread_detach(thread);
+	net->poll_thread_running = 1;
 }
 
 
@@ -251,54 +530,11 @@ static void net_arp(struct net *net, void *extra,
  *  Return 1 if there is a packet available for this 'extra' pointer, otherwise
  *  return 0.
  *
- *  Appart from actually checking for incoming packets from the outside world,
- *  this function basically works like net_ethernet_rx() but it only receives
- *  a return value telling us whether there is a packet or not, we don't
- *  actually get the packet.
+ *  Incoming packets from the outside world are received by the helper
+ *  thread, so this only needs to check the NIC's ring.
  */
 int net_ethernet_rx_avail(struct net *net, void *extra)
 {
-	if (net == NULL)
-		return 0;
-
-	/*
-	 *  If the network is distributed across multiple emulator processes,
-	 *  then receive incoming packets from those processes.
-	 */
-	if (net->local_port != 0) {
-		struct sockaddr_in si;
-		socklen_t si_len = sizeof(si);
-		int res, i, nreceived = 0;
-		unsigned char buf[60000];
-
-		do {
-			res = recvfrom(net->local_port_socket, (char*)buf,
-			    sizeof(buf), 0, (struct sockaddr *)&si, &si_len);
-
-			if (res != -1) {
-				nreceived ++;
-
-				/*  fatal("[ incoming DISTRIBUTED packet, %i "
-				    "bytes from %s:%d\n", res,
-				    inet_ntoa(si.sin_addr),
-				    ntohs(si.sin_port));  */
-
-				/*  Add the packet to all "our" NICs on this
-				    network:  */
-				for (i=0; i<net->n_nics; i++) {
-					struct ethernet_packet_link *lp;
-					lp = net_allocate_ethernet_packet_link(
-					    net, net->nic_extra[i], res);
-					memcpy(lp->data, buf, res);
-				}
-			}
-		} while (res != -1 && nreceived < 100);
-	}
-
-	/*  IP protocol specific:  */
-	net_udp_rx_avail(net, extra);
-	net_tcp_rx_avail(net, extra);
-
 	return net_ethernet_rx(net, extra, NULL, NULL);
 }
 
@@ -311,78 +547,63 @@ int net_ethernet_rx_avail(struct net *net, void *extra)
  *
  *  Return value is 1 if there was a packet available. *packetp and *lenp
  *  will be set to the packet's data pointer and length, respectively, and
- *  the packet will be removed from the linked list). If there was no packet
- *  available, 0 is returned.
+ *  the packet will be removed from the NIC's ring. The caller is responsible
+ *  for free()-ing the packet data. If there was no packet available, 0 is
+ *  returned.
  *
- *  If packetp is NULL, then the search is aborted as soon as a packet with
- *  the correct 'extra' field is found, and a 1 is returned, but as packetp
- *  is NULL we can't return the actual packet. (This is the internal form
- *  if net_ethernet_rx_avail().)
+ *  If packetp is NULL, then 1 is returned if there is a packet, but as
+ *  packetp is NULL we can't return the actual packet. (This is the internal
+ *  form of net_ethernet_rx_avail().)
  */
 int net_ethernet_rx(struct net *net, void *extra,
 	unsigned char **packetp, int *lenp)
 {
-	struct ethernet_packet_link *lp, *prev;
+	struct ethernet_packet_link *lp;
+	struct net_nic *nic;
+	uint32_t head;
 
 	if (net == NULL)
 		return 0;
 
-	/*  Find the first packet which has the right 'extra' field.  */
-
-	lp = net->first_ethernet_packet;
-	prev = NULL;
-	while (lp != NULL) {
-		if (lp->extra == extra) {
-			/*  We found a packet for this controller!  */
-			if (packetp == NULL || lenp == NULL)
-				return 1;
+	nic = net_find_nic(net, extra);
+	if (nic == NULL)
+		return 0;
 
-			/*  Let's return it:  */
-			(*packetp) = lp->data;
-			(*lenp) = lp->len;
+	head = nic->head;
+	if (LOAD_ACQUIRE(&nic->tail) == head)
+		return 0;
 
-			/*  Remove this link from the linked list:  */
-			if (prev == NULL)
-				net->first_ethernet_packet = lp->next;
-			else
-				prev->next = lp->next;
+	if (packetp == NULL || lenp == NULL)
+		return 1;
 
-			if (lp->next == NULL)
-				net->last_ethernet_packet = prev;
-			else
-				lp->next->prev = prev;
+	/*  Let's return it:  */
+	lp = &nic->slots[head & (NET_NIC_RING_LEN-1)];
+	(*packetp) = lp->data;
+	(*lenp) = lp->len;
+	lp->data = NULL;
 
-			free(lp);
+	STORE_RELEASE(&nic->head, head + 1);
 
-			/*  ... and return successfully:  */
-			return 1;
-		}
+	/*  Was the helper thread waiting for room in this ring?  */
+	if (__atomic_exchange_n(&nic->throttled, 0, __ATOMIC_ACQ_REL))
+		net_wakeup(net);
 
-		prev = lp;
-		lp = lp->next;
-	}
-
-	/*  No packet found. :-(  */
-	return 0;
+	return 1;
 }
 
 
 /*
- *  net_ethernet_tx():
+ *  net_ethernet_tx_locked():
  *
  *  Transmit an ethernet packet, as seen from the emulated ethernet controller.
  *  If the packet can be handled here, it will not necessarily be transmitted
- *  to the outside world.
+ *  to the outside world.  Called with net->lock held.
  */
-void net_ethernet_tx(struct net *net, void *extra,
-	unsigned char *packet, int len)
+static void net_ethernet_tx_locked(struct net *net, void *extra,
+	unsigned char *packet, int len, int for_the_gateway)
 {
-	int i, eth_type, for_the_gateway;
-
-	if (net == NULL)
-		return;
-
-	for_the_gateway = !memcmp(packet, net->gateway_ethernet_addr, 6);
+	struct net_nic *nic;
+	int i, eth_type;
 
 	/*  Drop too small packets:  */
 	if (len < 20) {
@@ -396,11 +617,11 @@ void net_ethernet_tx(struct net *net, void *extra,
 	 *  it is aimed specifically at the gateway's ethernet address):
 	 */
 	if (!for_the_gateway && extra != NULL && net->n_nics > 0) {
-		for (i=0; i<net->n_nics; i++)
-			if (extra != net->nic_extra[i]) {
+		for (nic = net->first_nic; nic != NULL; nic = nic->next)
+			if (extra != nic->extra) {
 				struct ethernet_packet_link *lp;
 				lp = net_allocate_ethernet_packet_link(net,
-				    net->nic_extra[i], len);
+				    nic->extra, len);
 
 				/*  Copy the entire packet:  */
 				memcpy(lp->data, packet, len);
@@ -500,6 +721,33 @@ void net_ethernet_tx(struct net *net, void *extra,
 }
 
 
+/*
+ *  net_ethernet_tx():
+ *
+ *  Transmit an ethernet packet, as seen from the emulated ethernet controller.
+ *  (See net_ethernet_tx_locked() above.)
+ */
+void net_ethernet_tx(struct net *net, void *extra,
+	unsigned char *packet, int len)
+{
+	int for_the_gateway;
+
+	if (net == NULL)
+		return;
+
+	for_the_gateway = !memcmp(packet, net->gateway_ethernet_addr, 6);
+
+	net_lock(net);
+	net_ethernet_tx_locked(net, extra, packet, len, for_the_gateway);
+	net_unlock(net);
+
+	/*  Traffic to the gateway may have changed which host sockets
+	    the helper thread should wait for:  */
+	if (for_the_gateway)
+		net_wakeup(net);
+}
+
+
 /*
  *  parse_resolvconf():
  *
@@ -603,6 +851,8 @@ static void parse_resolvconf(struct net *net)
  */
 void net_add_nic(struct net *net, void *extra, unsigned char *macaddr)
 {
+	struct net_nic *nic, **pp;
+
 	if (net == NULL)
 		return;
 
@@ -611,11 +861,28 @@ void net_add_nic(struct net *net, void *extra, unsigned char *macaddr)
 		exit(1);
 	}
 
+	CHECK_ALLOCATION(nic = (struct net_nic *) malloc(sizeof(struct net_nic)));
+	memset(nic, 0, sizeof(struct net_nic));
+	CHECK_ALLOCATION(nic->slots = (struct ethernet_packet_link *)
+	    malloc(sizeof(struct ethernet_packet_link) * NET_NIC_RING_LEN));
+	memset(nic->slots, 0,
+	    sizeof(struct ethernet_packet_link) * NET_NIC_RING_LEN);
+	nic->extra = extra;
+
+	net_lock(net);
+
+	/*  Add last in the list of NICs:  */
+	pp = &net->first_nic;
+	while (*pp != NULL)
+		pp = &(*pp)->next;
+	STORE_RELEASE(pp, nic);
+
 	net->n_nics ++;
-	CHECK_ALLOCATION(net->nic_extra = (void **)
-	    realloc(net->nic_extra, sizeof(void *) * net->n_nics));
 
-	net->nic_extra[net->n_nics - 1] = extra;
+	net_unlock(net);
+
+	if (!net->poll_thread_running)
+		net_start_poll_thread(net);
 }
 
 
@@ -739,7 +1006,13 @@ struct net *net_init(struct emul *emul, int init_flags,
 
 	/*  Sane defaults:  */
 	net->timestamp = 0;
-	net->first_ethernet_packet = net->last_ethernet_packet = NULL;
+	net->first_nic = NULL;
+	net->wakeup_pipe[0] = net->wakeup_pipe[1] = -1;
+	pthread_mutex_init(&net->lock, NULL);
+
+	CHECK_ALLOCATION(net->dropped_packet = (struct ethernet_packet_link *)
+	    malloc(sizeof(struct ethernet_packet_link)));
+	memset(net->dropped_packet, 0, sizeof(struct ethernet_packet_link));
 
 #ifdef HAVE_INET_PTON
 	res = inet_pton(AF_INET, ipv4addr, &net->netmask_ipv4);
@@ -43,6 +43,11 @@
 #include <sys/types.h>
 #include <errno.h>
 #include <fcntl.h>
+#ifdef _WIN32
+#define	poll	WSAPoll
+#else
+#include <poll.h>
+#endif
 
 #include "misc.h"
 #include "net.h"
@@ -563,6 +568,7 @@ static void net_ip_tcp(struct net *net, void *extra,
 		    net->tcp_connections[con_id].socket);
 
 		net->tcp_connections[con_id].in_use = 1;
+		net->tcp_connections[con_id].extra = extra;
 
 		/*  Set the socket to non-blocking:  */
 #ifdef _WIN32
@@ -845,6 +851,7 @@ static void net_ip_udp(struct net *net, void *extra,
 		debug(" {socket=%i}", net->udp_connections[con_id].socket);
 
 		net->udp_connections[con_id].in_use = 1;
+		net->udp_connections[con_id].extra = extra;
 
 		/*  Set the socket to non-blocking:  */
 #ifdef _WIN32
@@ -1234,17 +1241,33 @@ void net_ip_broadcast(struct net *net, void *extra,
 
 
 /*
- *  net_udp_rx_avail():
+ *  net_ip_msecs():
  *
- *  Receive any available UDP packets (from the outside world).
+ *  Returns the current host time in milliseconds, for TCP resending.
  */
-void net_udp_rx_avail(struct net *net, void *extra)
+static int64_t net_ip_msecs(void)
 {
-	int received_packets_this_tick = 0;
-	int max_packets_this_tick = 200;
-	int con_id;
+	struct timeval tv;
 
-	for (con_id=0; con_id<MAX_UDP_CONNECTIONS; con_id++) {
+	gettimeofday(&tv, NULL);
+	return (int64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+
+/*
+ *  net_udp_rx():
+ *
+ *  Receive available UDP packets (from the outside world) on a connection,
+ *  as long as the NIC which owns the connection has room for them.
+ */
+static void net_udp_rx(struct net *net, int con_id)
+{
+	int received_packets_this_round = 0;
+	int max_packets_this_round = 200;
+	void *extra = net->udp_connections[con_id].extra;
+
+	while (received_packets_this_round < max_packets_this_round &&
+	    net_nic_has_room(net, extra, NET_UDP_MAX_FRAGMENTS)) {
 		ssize_t res;
 		unsigned char buf[66000];
 		unsigned char udp_data[66008];
@@ -1257,24 +1280,12 @@ void net_udp_rx_avail(struct net *net, void *extra)
 		int this_packets_data_length;
 		int fragment_ofs = 0;
 
-		if (received_packets_this_tick > max_packets_this_tick)
-			break;
-
-		if (!net->udp_connections[con_id].in_use)
-			continue;
-
-		if (net->udp_connections[con_id].socket < 0) {
-			fatal("INTERNAL ERROR in net.c, udp socket < 0 "
-			    "but in use?\n");
-			continue;
-		}
-
 		res = recvfrom(net->udp_connections[con_id].socket, (char*)buf,
 		    sizeof(buf), 0, (struct sockaddr *)&from, &from_len);
 
 		/*  No more incoming UDP on this connection?  */
 		if (res < 0)
-			continue;
+			break;
 
 		net->timestamp ++;
 		net->udp_connections[con_id].last_used_timestamp =
@@ -1381,182 +1392,238 @@ void net_udp_rx_avail(struct net *net, void *extra)
 			bytes_converted += this_packets_data_length;
 			fragment_ofs = bytes_converted / 8;
 
-			received_packets_this_tick ++;
+			received_packets_this_round ++;
+		}
+	}
+}
+
+
+/*
+ *  net_tcp_rx():
+ *
+ *  Handle a TCP connection whose socket has become ready, either for output
+ *  (when trying to connect) or for input.
+ */
+static void net_tcp_rx(struct net *net, int con_id)
+{
+	struct tcp_connection *con = &net->tcp_connections[con_id];
+	unsigned char buf[66000];
+	ssize_t res;
+
+	if (con->state == TCP_OUTSIDE_TRYINGTOCONNECT) {
+		int err = 0;
+		socklen_t err_len = sizeof(err);
+
+		if (getsockopt(con->socket, SOL_SOCKET, SO_ERROR,
+		    (char *) &err, &err_len) < 0)
+			err = errno;
+
+		if (err == ECONNREFUSED) {
+			fatal("[ ECONNREFUSED: TODO ]\n");
+			con->state = TCP_OUTSIDE_DISCONNECTED;
+			fatal("CHANGING TO TCP_OUTSIDE_DISCONNECTED "
+			    "(refused connection)\n");
+			return;
 		}
 
-		/*  This makes sure we check this connection AGAIN
-		    for more incoming UDP packets, before moving to the
-		    next connection:  */
-		con_id --;
+		if (err != 0) {
+			fatal("[ connect: errno %i: TODO ]\n", err);
+			/*  TODO  */
+			con->state = TCP_OUTSIDE_DISCONNECTED;
+			fatal("CHANGING TO TCP_OUTSIDE_DISCONNECTED "
+			    "(timeout)\n");
+			return;
+		}
+
+		con->state = TCP_OUTSIDE_CONNECTED;
+		debug("CHANGING TO TCP_OUTSIDE_CONNECTED\n");
+		net_ip_tcp_connectionreply(net, con->extra, con_id, 1,
+		    NULL, 0, 0);
+		return;
 	}
+
+	if (con->incoming_buf == NULL)
+		CHECK_ALLOCATION(con->incoming_buf =
+		    (unsigned char *) malloc(TCP_INCOMING_BUF_LEN));
+
+	res = read(con->socket, buf, 1400);
+	if (res > 0) {
+		/*  debug("\n -{- %lli -}-\n", (long long)res);  */
+		con->incoming_buf_len = res;
+		con->incoming_buf_time = net_ip_msecs();
+		con->incoming_buf_seqnr = con->outside_seqnr;
+		debug("  putting %i bytes (seqnr %u) in the incoming "
+		    "buf\n", res, con->incoming_buf_seqnr);
+		memcpy(con->incoming_buf, buf, res);
+
+		net_ip_tcp_connectionreply(net, con->extra, con_id, 0,
+		    buf, res, 0);
+	} else if (res == 0) {
+		con->state = TCP_OUTSIDE_DISCONNECTED;
+		debug("CHANGING TO TCP_OUTSIDE_DISCONNECTED, read"
+		    " res=0\n");
+		net_ip_tcp_connectionreply(net, con->extra, con_id, 0,
+		    NULL, 0, 0);
+	} else if (errno == EAGAIN || errno == EINTR) {
+		return;
+	} else {
+		con->state = TCP_OUTSIDE_DISCONNECTED;
+		fatal("CHANGING TO TCP_OUTSIDE_DISCONNECTED, "
+		    "read res<=0, errno = %i\n", errno);
+		net_ip_tcp_connectionreply(net, con->extra, con_id, 0,
+		    NULL, 0, 0);
+	}
+
+	net->timestamp ++;
+	con->last_used_timestamp = net->timestamp;
 }
 
 
 /*
- *  net_tcp_rx_avail():
+ *  net_tcp_resend():
  *
- *  Receive any available TCP packets (from the outside world).
+ *  Does a connection have unacknowledged data?  Then, if enough time has
+ *  passed, try to resend it using the old value of seqnr.
  */
-void net_tcp_rx_avail(struct net *net, void *extra)
+static void net_tcp_resend(struct net *net, int con_id)
 {
-	int received_packets_this_tick = 0;
-	int max_packets_this_tick = 200;
-	int con_id;
+	struct tcp_connection *con = &net->tcp_connections[con_id];
 
-	for (con_id=0; con_id<MAX_TCP_CONNECTIONS; con_id++) {
-		unsigned char buf[66000];
-		ssize_t res, res2;
-		fd_set rfds;
-		struct timeval tv;
+	if (net_ip_msecs() - con->incoming_buf_time < TCP_RESEND_MSEC ||
+	    !net_nic_has_room(net, con->extra, 1))
+		return;
 
-		if (received_packets_this_tick > max_packets_this_tick)
-			break;
+	debug("  at seqnr %u but backing back to %u, resending %i bytes\n",
+	    con->outside_seqnr, con->incoming_buf_seqnr,
+	    con->incoming_buf_len);
 
-		if (!net->tcp_connections[con_id].in_use)
+	con->incoming_buf_time = net_ip_msecs();
+	con->outside_seqnr = con->incoming_buf_seqnr;
+
+	net_ip_tcp_connectionreply(net, con->extra, con_id, 0,
+	    con->incoming_buf, con->incoming_buf_len, 0);
+}
+
+
+/*
+ *  net_ip_poll_setup():
+ *
+ *  Fills in pollfd entries for all UDP and TCP connections which the network
+ *  helper thread should wait for. For each entry, con_ids[] is set to the
+ *  UDP connection id, or MAX_UDP_CONNECTIONS + the TCP connection id.
+ *  *retransmit_pending is set if some TCP connection has unacknowledged
+ *  data, i.e. if net_ip_poll_handle() should be called again soon even if
+ *  nothing happens on the sockets.
+ *
+ *  Returns the number of entries filled in. Called with net->lock held.
+ */
+int net_ip_poll_setup(struct net *net, struct pollfd *fds, int *con_ids,
+	int *retransmit_pending)
+{
+	int con_id, n = 0;
+
+	for (con_id=0; con_id<MAX_UDP_CONNECTIONS; con_id++) {
+		struct udp_connection *con = &net->udp_connections[con_id];
+
+		if (!con->in_use)
 			continue;
 
-		if (net->tcp_connections[con_id].socket < 0) {
-			fatal("INTERNAL ERROR in net.c, tcp socket < 0"
-			    " but in use?\n");
+		if (con->socket < 0) {
+			fatal("INTERNAL ERROR in net.c, udp socket < 0 "
+			    "but in use?\n");
 			continue;
 		}
 
-		if (net->tcp_connections[con_id].incoming_buf == NULL)
-			CHECK_ALLOCATION(net->tcp_connections[con_id].
-			    incoming_buf = (unsigned char *) malloc(TCP_INCOMING_BUF_LEN));
-
-		if (net->tcp_connections[con_id].state >=
-		    TCP_OUTSIDE_DISCONNECTED)
+		/*  Room for a maximally fragmented incoming packet?  */
+		if (!net_nic_has_room(net, con->extra, NET_UDP_MAX_FRAGMENTS))
 			continue;
 
-		/*  Is the socket available for output?  */
-		FD_ZERO(&rfds);		/*  write  */
-		FD_SET(net->tcp_connections[con_id].socket, &rfds);
-		tv.tv_sec = tv.tv_usec = 0;
-		errno = 0;
-		res = select(net->tcp_connections[con_id].socket+1,
-		    NULL, &rfds, NULL, &tv);
+		fds[n].fd = con->socket;
+		fds[n].events = POLLIN;
+		fds[n].revents = 0;
+		con_ids[n++] = con_id;
+	}
 
-		if (errno == ECONNREFUSED) {
-			fatal("[ ECONNREFUSED: TODO ]\n");
-			net->tcp_connections[con_id].state =
-			    TCP_OUTSIDE_DISCONNECTED;
-			fatal("CHANGING TO TCP_OUTSIDE_DISCONNECTED "
-			    "(refused connection)\n");
-			continue;
-		}
+	for (con_id=0; con_id<MAX_TCP_CONNECTIONS; con_id++) {
+		struct tcp_connection *con = &net->tcp_connections[con_id];
+		int events = POLLIN;
 
-		if (errno == ETIMEDOUT) {
-			fatal("[ ETIMEDOUT: TODO ]\n");
-			/*  TODO  */
-			net->tcp_connections[con_id].state =
-			    TCP_OUTSIDE_DISCONNECTED;
-			fatal("CHANGING TO TCP_OUTSIDE_DISCONNECTED "
-			    "(timeout)\n");
+		if (!con->in_use)
 			continue;
-		}
 
-		if (net->tcp_connections[con_id].state ==
-		    TCP_OUTSIDE_TRYINGTOCONNECT && res > 0) {
-			net->tcp_connections[con_id].state =
-			    TCP_OUTSIDE_CONNECTED;
-			debug("CHANGING TO TCP_OUTSIDE_CONNECTED\n");
-			net_ip_tcp_connectionreply(net, extra, con_id, 1,
-			    NULL, 0, 0);
+		if (con->socket < 0) {
+			fatal("INTERNAL ERROR in net.c, tcp socket < 0"
+			    " but in use?\n");
+			continue;
 		}
 
-		if (net->tcp_connections[con_id].state ==
-		    TCP_OUTSIDE_CONNECTED && res < 1) {
+		if (con->state >= TCP_OUTSIDE_DISCONNECTED)
 			continue;
-		}
 
-		/*
-		 *  Does this connection have unacknowledged data?  Then, if
-		 *  enough number of rounds have passed, try to resend it using
-		 *  the old value of seqnr.
-		 */
-		if (net->tcp_connections[con_id].incoming_buf_len != 0) {
-			net->tcp_connections[con_id].incoming_buf_rounds ++;
-			if (net->tcp_connections[con_id].incoming_buf_rounds >
-			    10000) {
-				debug("  at seqnr %u but backing back to %u,"
-				    " resending %i bytes\n",
-				    net->tcp_connections[con_id].outside_seqnr,
-				    net->tcp_connections[con_id].
-				    incoming_buf_seqnr,
-				    net->tcp_connections[con_id].
-				    incoming_buf_len);
-
-				net->tcp_connections[con_id].
-				    incoming_buf_rounds = 0;
-				net->tcp_connections[con_id].outside_seqnr =
-				    net->tcp_connections[con_id].
-				    incoming_buf_seqnr;
-
-				net_ip_tcp_connectionreply(net, extra, con_id,
-				    0, net->tcp_connections[con_id].
-				    incoming_buf,
-				    net->tcp_connections[con_id].
-				    incoming_buf_len, 0);
-			}
+		if (con->state == TCP_OUTSIDE_TRYINGTOCONNECT)
+			events = POLLOUT;
+		else if (con->incoming_buf_len != 0) {
+			/*  Resent by net_ip_poll_handle().  */
+			(*retransmit_pending) = 1;
+			continue;
+		} else if (((int32_t)con->outside_seqnr -
+		    (int32_t)con->inside_acknr) > 0) {
+			/*  Don't receive unless the guest OS is ready!  */
 			continue;
 		}
 
-		/*  Don't receive unless the guest OS is ready!  */
-		if (((int32_t)net->tcp_connections[con_id].outside_seqnr -
-		    (int32_t)net->tcp_connections[con_id].inside_acknr) > 0) {
-/*			fatal("YOYO 1! outside_seqnr - inside_acknr = %i\n",
-			    net->tcp_connections[con_id].outside_seqnr -
-			    net->tcp_connections[con_id].inside_acknr);  */
+		if (!net_nic_has_room(net, con->extra, 1))
 			continue;
-		}
 
-		/*  Is there incoming data available on the socket?  */
-		FD_ZERO(&rfds);		/*  read  */
-		FD_SET(net->tcp_connections[con_id].socket, &rfds);
-		tv.tv_sec = tv.tv_usec = 0;
-		res2 = select(net->tcp_connections[con_id].socket+1, &rfds,
-		    NULL, NULL, &tv);
+		fds[n].fd = con->socket;
+		fds[n].events = events;
+		fds[n].revents = 0;
+		con_ids[n++] = MAX_UDP_CONNECTIONS + con_id;
+	}
+
+	return n;
+}
+
+
+/*
+ *  net_ip_poll_handle():
+ *
+ *  Receives traffic from the outside world, for the sockets which poll()
+ *  reported as ready, and resends unacknowledged TCP data. (fds and con_ids
+ *  are as filled in by net_ip_poll_setup().) Called with net->lock held.
+ *
+ *  Connections may have been closed or reused between the two calls, so
+ *  entries whose socket no longer matches the connection are ignored.
+ */
+void net_ip_poll_handle(struct net *net, struct pollfd *fds, int *con_ids,
+	int n)
+{
+	int i, con_id;
 
-		/*  No more incoming TCP data on this connection?  */
-		if (res2 < 1)
+	for (i=0; i<n; i++) {
+		if (fds[i].revents == 0)
 			continue;
 
-		res = read(net->tcp_connections[con_id].socket, buf, 1400);
-		if (res > 0) {
-			/*  debug("\n -{- %lli -}-\n", (long long)res);  */
-			net->tcp_connections[con_id].incoming_buf_len = res;
-			net->tcp_connections[con_id].incoming_buf_rounds = 0;
-			net->tcp_connections[con_id].incoming_buf_seqnr = 
-			    net->tcp_connections[con_id].outside_seqnr;
-			debug("  putting %i bytes (seqnr %u) in the incoming "
-			    "buf\n", res, net->tcp_connections[con_id].
-			    incoming_buf_seqnr);
-			memcpy(net->tcp_connections[con_id].incoming_buf,
-			    buf, res);
-
-			net_ip_tcp_connectionreply(net, extra, con_id, 0,
-			    buf, res, 0);
-		} else if (res == 0) {
-			net->tcp_connections[con_id].state =
-			    TCP_OUTSIDE_DISCONNECTED;
-			debug("CHANGING TO TCP_OUTSIDE_DISCONNECTED, read"
-			    " res=0\n");
-			net_ip_tcp_connectionreply(net, extra, con_id, 0,
-			    NULL, 0, 0);
+		if (con_ids[i] < MAX_UDP_CONNECTIONS) {
+			con_id = con_ids[i];
+			if (net->udp_connections[con_id].in_use &&
+			    net->udp_connections[con_id].socket == fds[i].fd)
+				net_udp_rx(net, con_id);
 		} else {
-			net->tcp_connections[con_id].state =
-			    TCP_OUTSIDE_DISCONNECTED;
-			fatal("CHANGING TO TCP_OUTSIDE_DISCONNECTED, "
-			    "read res<=0, errno = %i\n", errno);
-			net_ip_tcp_connectionreply(net, extra, con_id, 0,
-			    NULL, 0, 0);
+			con_id = con_ids[i] - MAX_UDP_CONNECTIONS;
+			if (net->tcp_connections[con_id].in_use &&
+			    net->tcp_connections[con_id].socket == fds[i].fd &&
+			    net->tcp_connections[con_id].state <
+			    TCP_OUTSIDE_DISCONNECTED &&
+			    net->tcp_connections[con_id].incoming_buf_len == 0)
+				net_tcp_rx(net, con_id);
 		}
-
-		net->timestamp ++;
-		net->tcp_connections[con_id].last_used_timestamp =
-		    net->timestamp;
 	}
-}
-
 
+	for (con_id=0; con_id<MAX_TCP_CONNECTIONS; con_id++)
+		if (net->tcp_connections[con_id].in_use &&
+		    net->tcp_connections[con_id].state ==
+		    TCP_OUTSIDE_CONNECTED &&
+		    net->tcp_connections[con_id].incoming_buf_len != 0)
+			net_tcp_resend(net, con_id);
+}
@@ -0,0 +1,629 @@
+/*
+ *  Machine checkpoints.
+ *
+ *  machine_checkpoint_save() writes the complete state of a (legacy) machine
+ *  to a binary file, and machine_checkpoint_restore() reads it back into a
+ *  machine which has been set up with the same command line options. See
+ *  checkpoint.h for an overview of the file layout.
+ *
+ *  Only state that cannot be recreated by the normal machine setup is
+ *  stored: device mappings, interrupt paths, timers etc. are created as
+ *  usual, and each device's checkpoint function then overwrites its
+ *  run-time registers. Guest RAM memblocks are mmap()ed MAP_PRIVATE from
+ *  the checkpoint file on restore, so restoring a machine with lots of RAM
+ *  is cheap, and the file itself is never modified by the guest.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "checkpoint.h"
+#include "cpu.h"
+#include "diskimage.h"
+#include "machine.h"
+#include "memory.h"
+#include "misc.h"
+
+
+/*  RAM blobs are aligned to this in the file, so that they can be mmapped.  */
+#define	CHECKPOINT_RAM_ALIGN	65536
+
+#define	CHECKPOINT_ENDIAN_MARKER	0x01020304
+
+struct checkpoint_header {
+	char		magic[8];
+	uint32_t	version;
+	uint32_t	endian_marker;
+	int32_t		arch;
+	int32_t		machine_type;
+	int32_t		machine_subtype;
+	int32_t		physical_ram_in_mb;
+	int32_t		ncpus;
+	int32_t		n_tick_functions;
+	int32_t		n_checkpoint_functions;
+	int32_t		reserved;
+};
+
+struct checkpoint_section {
+	char		tag[4];
+	uint32_t	reserved;
+	uint64_t	length;
+};
+
+
+/*
+ *  checkpoint_data():
+ *
+ *  Writes len bytes from data to the checkpoint file, or reads len bytes
+ *  into data, depending on the direction of the checkpoint. Errors are
+ *  sticky; once something has failed, nothing more is transferred.
+ */
+void checkpoint_data(struct checkpoint *ckpt, void *data, size_t len)
+{
+	size_t res;
+
+	if (ckpt->error)
+		return;
+
+	if (ckpt->writeflag == MEM_WRITE)
+		res = fwrite(data, 1, len, ckpt->f);
+	else
+		res = fread(data, 1, len, ckpt->f);
+
+	if (res != len) {
+		fatal("[ checkpoint: %s of %s failed ]\n", ckpt->writeflag ==
+		    MEM_WRITE? "write" : "read", ckpt->filename);
+		ckpt->error = 1;
+	}
+}
+
+
+/*
+ *  Section helpers. A section is written with a zero length first, which
+ *  is patched when the section is ended. On restore, the tag is verified
+ *  and the section length is returned.
+ */
+static off_t section_begin(struct checkpoint *ckpt, const char *tag)
+{
+	struct checkpoint_section sec;
+
+	memset(&sec, 0, sizeof(sec));
+	memcpy(sec.tag, tag, sizeof(sec.tag));
+	checkpoint_data(ckpt, &sec, sizeof(sec));
+
+	return ftello(ckpt->f);
+}
+
+static void section_end(struct checkpoint *ckpt, off_t start)
+{
+	off_t end = ftello(ckpt->f);
+	uint64_t length = end - start;
+
+	if (ckpt->error)
+		return;
+
+	fseeko(ckpt->f, start - sizeof(uint64_t), SEEK_SET);
+	checkpoint_data(ckpt, &length, sizeof(length));
+	fseeko(ckpt->f, end, SEEK_SET);
+}
+
+static off_t section_expect(struct checkpoint *ckpt, const char *tag,
+	uint64_t *lengthp)
+{
+	struct checkpoint_section sec;
+
+	checkpoint_data(ckpt, &sec, sizeof(sec));
+	if (ckpt->error)
+		return 0;
+
+	if (memcmp(sec.tag, tag, sizeof(sec.tag)) != 0) {
+		fatal("[ checkpoint: expected section '%.4s', found '%.4s' ]\n",
+		    tag, sec.tag);
+		ckpt->error = 1;
+		return 0;
+	}
+
+	*lengthp = sec.length;
+	return ftello(ckpt->f);
+}
+
+static void section_check_length(struct checkpoint *ckpt, off_t start,
+	uint64_t length, const char *what)
+{
+	if (ckpt->error)
+		return;
+
+	if ((uint64_t)(ftello(ckpt->f) - start) != length) {
+		fatal("[ checkpoint: size mismatch for %s; the checkpoint was"
+		    " probably written by a different version ]\n", what);
+		ckpt->error = 1;
+	}
+}
+
+
+/*
+ *  checkpoint_cpu():
+ *
+ *  Generic cpu fields, followed by the architecture specific state.
+ */
+static void checkpoint_cpu(struct checkpoint *ckpt, struct cpu *cpu)
+{
+	CHECKPOINT_VAR(ckpt, cpu->ninstrs);
+	CHECKPOINT_VAR(ckpt, cpu->ninstrs_async);
+	CHECKPOINT_VAR(ckpt, cpu->ninstrs_syncpc);
+	CHECKPOINT_VAR(ckpt, cpu->pc);
+	CHECKPOINT_VAR(ckpt, cpu->byte_order);
+	CHECKPOINT_VAR(ckpt, cpu->running);
+	CHECKPOINT_VAR(ckpt, cpu->is_halted);
+
+	switch (cpu->machine->arch) {
+	case ARCH_PPC:
+		ppc_cpu_checkpoint(cpu, ckpt);
+		break;
+	default:
+		fatal("[ checkpoint: unimplemented arch ]\n");
+		ckpt->error = 1;
+	}
+}
+
+
+/*
+ *  checkpoint_disks():
+ *
+ *  Disk contents are not part of the checkpoint (they live in the image
+ *  files and their overlays), but positions and media change state are.
+ *  Overlay data sizes are recorded so that a restore can warn if the guest
+ *  has written to a disk after the checkpoint was taken.
+ */
+static void checkpoint_disks(struct checkpoint *ckpt, struct machine *machine)
+{
+	struct diskimage *d;
+
+	for (d = machine->first_diskimage; d != NULL; d = d->next) {
+		int type = d->type, id = d->id;
+		int nr_of_overlays = d->nr_of_overlays, i;
+
+		CHECKPOINT_VAR(ckpt, type);
+		CHECKPOINT_VAR(ckpt, id);
+		CHECKPOINT_VAR(ckpt, nr_of_overlays);
+
+		if (ckpt->writeflag != MEM_WRITE && (type != d->type ||
+		    id != d->id || nr_of_overlays != d->nr_of_overlays)) {
+			fatal("[ checkpoint: disk image configuration differs"
+			    " from when the checkpoint was saved ]\n");
+			ckpt->error = 1;
+			return;
+		}
+
+		CHECKPOINT_VAR(ckpt, d->change);
+		CHECKPOINT_VAR(ckpt, d->tape_offset);
+		CHECKPOINT_VAR(ckpt, d->tape_filenr);
+		CHECKPOINT_VAR(ckpt, d->filemark);
+
+		for (i = 0; i < nr_of_overlays; i++) {
+			struct stat st;
+			int64_t size = 0, saved_size;
+
+			fflush(d->overlays[i].f_data);
+			if (fstat(fileno(d->overlays[i].f_data), &st) == 0)
+				size = st.st_size;
+
+			saved_size = size;
+			CHECKPOINT_VAR(ckpt, saved_size);
+
+			if (ckpt->writeflag != MEM_WRITE && saved_size != size)
+				fatal("[ checkpoint: WARNING: overlay %s has "
+				    "changed since the checkpoint was saved ]\n",
+				    d->overlays[i].overlay_basename);
+		}
+	}
+}
+
+
+/*
+ *  checkpoint_save_ram():
+ *
+ *  Writes the index of every allocated memblock, followed by the memblocks
+ *  themselves at an aligned file offset.
+ */
+static void checkpoint_save_ram(struct checkpoint *ckpt, struct memory *mem)
+{
+	void **table = (void **) mem->pagetable;
+	const int entries = 1 << BITS_PER_PAGETABLE;
+	const size_t blocksize = 1 << BITS_PER_MEMBLOCK;
+	uint32_t n_blocks = 0;
+	off_t pos;
+	int i;
+
+	for (i = 0; i < entries; i++)
+		if (table[i] != NULL)
+			n_blocks ++;
+
+	CHECKPOINT_VAR(ckpt, n_blocks);
+	for (i = 0; i < entries; i++) {
+		uint32_t entry = i;
+		if (table[i] != NULL)
+			CHECKPOINT_VAR(ckpt, entry);
+	}
+
+	/*  Pad up to the alignment:  */
+	pos = ftello(ckpt->f);
+	while ((pos % CHECKPOINT_RAM_ALIGN) != 0 && !ckpt->error) {
+		char zero = 0;
+		CHECKPOINT_VAR(ckpt, zero);
+		pos ++;
+	}
+
+	for (i = 0; i < entries; i++)
+		if (table[i] != NULL)
+			checkpoint_data(ckpt, table[i], blocksize);
+}
+
+
+/*
+ *  in_reserved_ram():
+ *
+ *  Returns 1 if a memblock is part of RAM reserved by memory_reserve_ram().
+ *  Such memblocks are never freed; they are replaced in place.
+ */
+static int in_reserved_ram(struct memory *mem, uint32_t entry)
+{
+	return ((uint64_t) entry << BITS_PER_MEMBLOCK) < mem->ram_len;
+}
+
+
+/*
+ *  release_memblock():
+ */
+static void release_memblock(struct memory *mem, int entry)
+{
+	void **table = (void **) mem->pagetable;
+
+	if (table[entry] == NULL)
+		return;
+
+	/*  Replace reserved RAM with fresh zero-filled pages, or at least
+	    clear it if that is not possible:  */
+	if (in_reserved_ram(mem, entry)) {
+		if (mmap(table[entry], 1 << BITS_PER_MEMBLOCK,
+		    PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS |
+		    MAP_NORESERVE | MAP_FIXED, -1, 0) == MAP_FAILED)
+			memset(table[entry], 0, 1 << BITS_PER_MEMBLOCK);
+		return;
+	}
+
+	if (mem->mapped_blocks != NULL && mem->mapped_blocks[entry]) {
+		munmap(table[entry], 1 << BITS_PER_MEMBLOCK);
+		mem->mapped_blocks[entry] = 0;
+	} else
+		free(table[entry]);
+
+	table[entry] = NULL;
+}
+
+
+/*
+ *  checkpoint_restore_ram():
+ *
+ *  Replaces all of the machine's memblocks with the ones in the checkpoint.
+ *  Memblocks are mapped copy-on-write from the file when the file offset
+ *  allows it, otherwise they are read into newly allocated memory.
+ */
+static void checkpoint_restore_ram(struct checkpoint *ckpt, struct memory *mem)
+{
+	void **table = (void **) mem->pagetable;
+	const int entries = 1 << BITS_PER_PAGETABLE;
+	const size_t blocksize = 1 << BITS_PER_MEMBLOCK;
+	uint32_t n_blocks, *index;
+	long pagesize = sysconf(_SC_PAGESIZE);
+	off_t pos;
+	uint32_t i;
+
+	CHECKPOINT_VAR(ckpt, n_blocks);
+	if (ckpt->error || n_blocks > (uint32_t) entries) {
+		ckpt->error = 1;
+		return;
+	}
+
+	CHECK_ALLOCATION(index = (uint32_t *) malloc(
+	    (n_blocks + 1) * sizeof(uint32_t)));
+	checkpoint_data(ckpt, index, n_blocks * sizeof(uint32_t));
+
+	pos = ftello(ckpt->f);
+	pos = (pos + CHECKPOINT_RAM_ALIGN - 1) & ~(off_t)(CHECKPOINT_RAM_ALIGN-1);
+	fseeko(ckpt->f, pos, SEEK_SET);
+
+	if (ckpt->error) {
+		free(index);
+		return;
+	}
+
+	if (mem->mapped_blocks == NULL)
+		CHECK_ALLOCATION(mem->mapped_blocks = (unsigned char *)
+		    calloc(entries, 1));
+
+	for (i = 0; i < (uint32_t) entries; i++)
+		release_memblock(mem, i);
+
+	for (i = 0; i < n_blocks; i++) {
+		uint32_t entry = index[i] & (entries - 1);
+		off_t ofs = pos + (off_t) i * blocksize;
+		int reserved = in_reserved_ram(mem, entry);
+		void *p = MAP_FAILED;
+
+		if ((ofs % pagesize) == 0)
+			p = mmap(reserved ? table[entry] : NULL, blocksize,
+			    PROT_READ | PROT_WRITE, MAP_PRIVATE |
+			    (reserved ? MAP_FIXED : 0), fileno(ckpt->f), ofs);
+
+		if (p != MAP_FAILED) {
+			if (!reserved)
+				mem->mapped_blocks[entry] = 1;
+		} else if (reserved) {
+			p = table[entry];
+			fseeko(ckpt->f, ofs, SEEK_SET);
+			checkpoint_data(ckpt, p, blocksize);
+		} else {
+			CHECK_ALLOCATION(p = malloc(blocksize));
+			fseeko(ckpt->f, ofs, SEEK_SET);
+			checkpoint_data(ckpt, p, blocksize);
+		}
+
+		table[entry] = p;
+	}
+
+	fseeko(ckpt->f, pos + (off_t) n_blocks * blocksize, SEEK_SET);
+	free(index);
+}
+
+
+/*
+ *  machine_checkpoint_save():
+ *
+ *  Saves the state of a machine to a file. Should be called between calls
+ *  to machine_run(), i.e. when all cpus have a synched pc.
+ *
+ *  The checkpoint is written to a temporary file in the same directory,
+ *  which is then renamed over fname. RAM restored from an earlier checkpoint
+ *  may still be mapped from fname, and truncating it in place would pull
+ *  the pages not yet touched by the guest out from under the RAM section.
+ *
+ *  Returns 1 on success, 0 on failure.
+ */
+int machine_checkpoint_save(struct machine *machine, const char *fname)
+{
+	struct checkpoint ckpt;
+	struct checkpoint_header hdr;
+	char *tmpname;
+	size_t tmplen;
+	off_t start;
+	mode_t mask;
+	int i, fd;
+
+	if (machine->arch != ARCH_PPC) {
+		fatal("Checkpoints are only implemented for PPC machines.\n");
+		return 0;
+	}
+
+	tmplen = strlen(fname) + 8;
+	CHECK_ALLOCATION(tmpname = (char *) malloc(tmplen));
+	snprintf(tmpname, tmplen, "%s.XXXXXX", fname);
+
+	fd = mkstemp(tmpname);
+	if (fd < 0) {
+		perror(tmpname);
+		free(tmpname);
+		return 0;
+	}
+
+	/*  mkstemp() creates the file 0600; use the usual mode instead.  */
+	mask = umask(0);
+	umask(mask);
+	fchmod(fd, 0666 & ~mask);
+
+	memset(&ckpt, 0, sizeof(ckpt));
+	ckpt.filename = fname;
+	ckpt.writeflag = MEM_WRITE;
+	ckpt.f = fdopen(fd, "wb");
+	if (ckpt.f == NULL) {
+		perror(tmpname);
+		close(fd);
+		remove(tmpname);
+		free(tmpname);
+		return 0;
+	}
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, CHECKPOINT_MAGIC, sizeof(hdr.magic));
+	hdr.version = CHECKPOINT_VERSION;
+	hdr.endian_marker = CHECKPOINT_ENDIAN_MARKER;
+	hdr.arch = machine->arch;
+	hdr.machine_type = machine->machine_type;
+	hdr.machine_subtype = machine->machine_subtype;
+	hdr.physical_ram_in_mb = machine->physical_ram_in_mb;
+	hdr.ncpus = machine->ncpus;
+	hdr.n_tick_functions = machine->tick_functions.n_entries;
+	hdr.n_checkpoint_functions = machine->checkpoint_functions.n_entries;
+	CHECKPOINT_VAR(&ckpt, hdr);
+
+	for (i = 0; i < machine->ncpus; i++) {
+		start = section_begin(&ckpt, "CPU ");
+		checkpoint_cpu(&ckpt, machine->cpus[i]);
+		section_end(&ckpt, start);
+	}
+
+	start = section_begin(&ckpt, "TICK");
+	checkpoint_data(&ckpt, machine->tick_functions.ticks_till_next,
+	    machine->tick_functions.n_entries * sizeof(int));
+	section_end(&ckpt, start);
+
+	for (i = 0; i < machine->checkpoint_functions.n_entries; i++) {
+		const char *name = machine->checkpoint_functions.name[i];
+		uint32_t len = strlen(name);
+
+		start = section_begin(&ckpt, "DEV ");
+		CHECKPOINT_VAR(&ckpt, len);
+		checkpoint_data(&ckpt, (void *) name, len);
+		machine->checkpoint_functions.f[i](&ckpt,
+		    machine->checkpoint_functions.extra[i]);
+		section_end(&ckpt, start);
+	}
+
+	start = section_begin(&ckpt, "DISK");
+	checkpoint_disks(&ckpt, machine);
+	section_end(&ckpt, start);
+
+	start = section_begin(&ckpt, "RAM ");
+	checkpoint_save_ram(&ckpt, machine->memory);
+	section_end(&ckpt, start);
+
+	if (fclose(ckpt.f) != 0)
+		ckpt.error = 1;
+
+	if (!ckpt.error && rename(tmpname, fname) != 0) {
+		perror(fname);
+		ckpt.error = 1;
+	}
+
+	if (ckpt.error) {
+		fatal("Could not save checkpoint to %s.\n", fname);
+		remove(tmpname);
+		free(tmpname);
+		return 0;
+	}
+
+	free(tmpname);
+	debug("checkpoint saved to %s\n", fname);
+	return 1;
+}
+
+
+/*
+ *  machine_checkpoint_restore():
+ *
+ *  Restores a machine from a checkpoint file. The machine must already be
+ *  set up the same way as when the checkpoint was saved (same machine type,
+ *  amount of RAM, nr of cpus, disk images, and devices).
+ *
+ *  RAM mappings stay valid after the file is closed, but the file must not
+ *  be modified in place while the restored machine is running. (Saving a
+ *  new checkpoint under the same name is fine; see machine_checkpoint_save.)
+ *
+ *  Returns 1 on success, 0 on failure. On failure, the state of the machine
+ *  is undefined if the failure happened after the header had been verified.
+ */
+int machine_checkpoint_restore(struct machine *machine, const char *fname)
+{
+	struct checkpoint ckpt;
+	struct checkpoint_header hdr;
+	uint64_t length;
+	off_t start;
+	int i;
+
+	memset(&ckpt, 0, sizeof(ckpt));
+	ckpt.filename = fname;
+	ckpt.writeflag = MEM_READ;
+	ckpt.f = fopen(fname, "rb");
+	if (ckpt.f == NULL) {
+		perror(fname);
+		return 0;
+	}
+
+	CHECKPOINT_VAR(&ckpt, hdr);
+	if (ckpt.error || memcmp(hdr.magic, CHECKPOINT_MAGIC,
+	    sizeof(hdr.magic)) != 0 || hdr.version != CHECKPOINT_VERSION ||
+	    hdr.endian_marker != CHECKPOINT_ENDIAN_MARKER) {
+		fatal("%s is not a checkpoint file for this version of the "
+		    "emulator, or it was saved on a host with a different "
+		    "byte order.\n", fname);
+		fclose(ckpt.f);
+		return 0;
+	}
+
+	if (hdr.arch != machine->arch ||
+	    hdr.machine_type != machine->machine_type ||
+	    hdr.machine_subtype != machine->machine_subtype ||
+	    hdr.physical_ram_in_mb != machine->physical_ram_in_mb ||
+	    hdr.ncpus != machine->ncpus ||
+	    hdr.n_tick_functions != machine->tick_functions.n_entries ||
+	    hdr.n_checkpoint_functions !=
+	    machine->checkpoint_functions.n_entries) {
+		fatal("The checkpoint in %s was saved from a differently "
+		    "configured machine (%i MB RAM, %i cpus, %i devices).\n",
+		    fname, hdr.physical_ram_in_mb, hdr.ncpus,
+		    hdr.n_checkpoint_functions);
+		fclose(ckpt.f);
+		return 0;
+	}
+
+	for (i = 0; i < machine->ncpus && !ckpt.error; i++) {
+		start = section_expect(&ckpt, "CPU ", &length);
+		checkpoint_cpu(&ckpt, machine->cpus[i]);
+		section_check_length(&ckpt, start, length, "cpu state");
+	}
+
+	start = section_expect(&ckpt, "TICK", &length);
+	checkpoint_data(&ckpt, machine->tick_functions.ticks_till_next,
+	    machine->tick_functions.n_entries * sizeof(int));
+	section_check_length(&ckpt, start, length, "tick functions");
+
+	for (i = 0; i < machine->checkpoint_functions.n_entries; i++) {
+		const char *name = machine->checkpoint_functions.name[i];
+		char saved_name[256];
+		uint32_t len;
+
+		start = section_expect(&ckpt, "DEV ", &length);
+		CHECKPOINT_VAR(&ckpt, len);
+		if (ckpt.error)
+			break;
+
+		if (len >= sizeof(saved_name)) {
+			ckpt.error = 1;
+			break;
+		}
+
+		checkpoint_data(&ckpt, saved_name, len);
+		saved_name[len] = '\0';
+		if (strcmp(saved_name, name) != 0) {
+			fatal("[ checkpoint: expected device '%s', found "
+			    "'%s' ]\n", name, saved_name);
+			ckpt.error = 1;
+			break;
+		}
+
+		machine->checkpoint_functions.f[i](&ckpt,
+		    machine->checkpoint_functions.extra[i]);
+		section_check_length(&ckpt, start, length, name);
+	}
+
+	start = section_expect(&ckpt, "DISK", &length);
+	checkpoint_disks(&ckpt, machine);
+	section_check_length(&ckpt, start, length, "disk images");
+
+	start = section_expect(&ckpt, "RAM ", &length);
+	checkpoint_restore_ram(&ckpt, machine->memory);
+	section_check_length(&ckpt, start, length, "memory");
+
+	/*  The mappings keep the RAM contents alive without the FILE:  */
+	fclose(ckpt.f);
+
+	/*  Everything cached about the old memory contents is now stale:  */
+	for (i = 0; i < machine->ncpus; i++) {
+		struct cpu *cpu = machine->cpus[i];
+		cpu->invalidate_translation_caches(cpu, 0, INVALIDATE_ALL);
+		cpu->invalidate_code_translation(cpu, 0, INVALIDATE_ALL);
+	}
+
+	if (ckpt.error) {
+		fatal("Could not restore checkpoint from %s.\n", fname);
+		return 0;
+	}
+
+	debug("checkpoint restored from %s\n", fname);
+	return 1;
+}
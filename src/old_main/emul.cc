@@ -28,6 +28,8 @@
  *  LEGACY emulation startup and misc. routines.
  */
 
+#include <pthread.h>
+#include <sched.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -382,6 +384,13 @@ void emul_machine_setup(struct machine *m, int n_load, char **load_names,
 	/*
 	 *  Create the system's memory:
 	 */
+	if (m->reserve_ram && m->random_mem_contents) {
+		/*  Filling it with random bytes would touch every page.  */
+		fatal("WARNING: not reserving RAM in one host mapping, since"
+		    " the memory contents are to be randomized.\n");
+		m->reserve_ram = 0;
+	}
+
 	debug("memory: %i MB", m->physical_ram_in_mb);
 	memory_amount = (uint64_t)m->physical_ram_in_mb * 1048576;
 	if (m->memory_offset_in_mb > 0) {
@@ -394,6 +403,12 @@ void emul_machine_setup(struct machine *m, int n_load, char **load_names,
 		memory_amount += 1048576 * m->memory_offset_in_mb;
 	}
 	m->memory = memory_new(memory_amount, m->arch);
+	if (m->reserve_ram) {
+		if (memory_reserve_ram(m->memory, memory_amount))
+			debug(", reserved in one host mapping");
+		else
+			debug(", could not be reserved in one host mapping");
+	}
 	debug("\n");
 
 	/*  Create CPUs:  */
@@ -778,6 +793,232 @@ struct emul *emul_create_from_configfile(char *fname)
 }
 
 
+/*
+ *  Machines in threads of their own:
+ *
+ *  If an emulation consists of more than one machine, each machine is run
+ *  by a host thread of its own, and the main thread only takes care of the
+ *  console, X11 and gdb events. The machines only share the network (which
+ *  has its own lock) and the console (see console_lock()).
+ *
+ *  Host events are passed on to devices, so the main thread handles them
+ *  with every machine stopped in between calls to machine_run(); see
+ *  emul_lock_machines(). (A machine with threaded cpus keeps its device
+ *  lock held there, so its cpu threads stay away from the devices too.)
+ *
+ *  The cpu threads of a machine, and its device lock, belong to the thread
+ *  which calls machine_run(). They are stopped whenever that changes: by a
+ *  machine thread when it exits, and by the main thread before the machine
+ *  threads are started.
+ *
+ *  The debugger, and instruction or function call tracing, need the machines
+ *  to run one after another, so the machine threads exit when single_step
+ *  is set, and are not used while tracing.
+ */
+#define	EMUL_MAIN_THREAD_SLEEP		1000		/*  microseconds  */
+
+struct emul_machine_thread {
+	struct emul_machine_threads *threads;
+	struct machine	*machine;
+	pthread_t	thread;
+	pthread_mutex_t	lock;		/*  Held while in machine_run()  */
+	int		alive;
+};
+
+struct emul_machine_threads {
+	struct emul_machine_thread *machine;
+	int		stop;
+	int		main_waiting;	/*  For the machine locks  */
+};
+
+
+/*
+ *  emul_machine_thread():
+ *
+ *  Runs one machine, until all its cpus have stopped or the machine threads
+ *  are being stopped.
+ */
+static void *emul_machine_thread(void *arg)
+{
+	struct emul_machine_thread *mt = (struct emul_machine_thread *) arg;
+
+	pthread_mutex_lock(&mt->lock);
+
+	while (!__atomic_load_n(&mt->threads->stop, __ATOMIC_ACQUIRE) &&
+	    single_step == NOT_SINGLE_STEPPING) {
+		if (!machine_run(mt->machine))
+			break;
+
+		/*  Let the main thread in, see emul_lock_machines():  */
+		if (__atomic_load_n(&mt->threads->main_waiting,
+		    __ATOMIC_ACQUIRE)) {
+			pthread_mutex_unlock(&mt->lock);
+			while (__atomic_load_n(&mt->threads->main_waiting,
+			    __ATOMIC_ACQUIRE))
+				sched_yield();
+			pthread_mutex_lock(&mt->lock);
+		}
+	}
+
+	/*  The cpu threads (if any) belong to this thread:  */
+	machine_stop_cpu_threads(mt->machine);
+
+	__atomic_store_n(&mt->alive, 0, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&mt->lock);
+	return NULL;
+}
+
+
+/*
+ *  emul_start_machine_threads():
+ *
+ *  Creates one host thread per machine. Signals are blocked in the new
+ *  threads, so that e.g. CTRL-C is handled by the main thread.
+ */
+static void emul_start_machine_threads(struct emul *emul)
+{
+	struct emul_machine_threads *t;
+	sigset_t all, old;
+
+	CHECK_ALLOCATION(t = (struct emul_machine_threads *)
+	    calloc(1, sizeof(struct emul_machine_threads)));
+	CHECK_ALLOCATION(t->machine = (struct emul_machine_thread *)
+	    calloc(emul->n_machines, sizeof(struct emul_machine_thread)));
+
+	/*  Cpu threads started by machine_run() in the main thread (e.g.
+	    while single-stepping) belong to it, and so does their device
+	    lock. Stop them; each machine thread starts its own.  */
+	for (int j=0; j<emul->n_machines; j++)
+		machine_stop_cpu_threads(emul->machines[j]);
+
+	emul->machine_threads = t;
+
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+
+	for (int j=0; j<emul->n_machines; j++) {
+		t->machine[j].threads = t;
+		t->machine[j].machine = emul->machines[j];
+		t->machine[j].alive = 1;
+		pthread_mutex_init(&t->machine[j].lock, NULL);
+
+		if (pthread_create(&t->machine[j].thread, NULL,
+		    emul_machine_thread, &t->machine[j]) != 0) {
+			fprintf(stderr, "emul: could not create machine "
+			    "thread\n");
+			exit(1);
+		}
+	}
+
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+}
+
+
+/*
+ *  emul_stop_machine_threads():
+ *
+ *  Stops and joins the machine threads, if they are running.
+ */
+static void emul_stop_machine_threads(struct emul *emul)
+{
+	struct emul_machine_threads *t = emul->machine_threads;
+
+	if (t == NULL)
+		return;
+
+	__atomic_store_n(&t->stop, 1, __ATOMIC_RELEASE);
+
+	for (int j=0; j<emul->n_machines; j++) {
+		pthread_join(t->machine[j].thread, NULL);
+		pthread_mutex_destroy(&t->machine[j].lock);
+	}
+
+	emul->machine_threads = NULL;
+	free(t->machine);
+	free(t);
+}
+
+
+/*
+ *  emul_lock_machines():
+ *
+ *  Waits until every machine thread is outside machine_run(), and keeps
+ *  them there until emul_unlock_machines() is called. Does nothing if the
+ *  machines are not running in threads.
+ */
+static void emul_lock_machines(struct emul *emul)
+{
+	struct emul_machine_threads *t = emul->machine_threads;
+
+	if (t == NULL)
+		return;
+
+	__atomic_store_n(&t->main_waiting, 1, __ATOMIC_RELEASE);
+	for (int j=0; j<emul->n_machines; j++)
+		pthread_mutex_lock(&t->machine[j].lock);
+}
+
+
+static void emul_unlock_machines(struct emul *emul)
+{
+	struct emul_machine_threads *t = emul->machine_threads;
+
+	if (t == NULL)
+		return;
+
+	for (int j=0; j<emul->n_machines; j++)
+		pthread_mutex_unlock(&t->machine[j].lock);
+	__atomic_store_n(&t->main_waiting, 0, __ATOMIC_RELEASE);
+}
+
+
+/*
+ *  emul_run_machine_threads():
+ *
+ *  Lets the machine threads run for a while. Returns 1 if any machine is
+ *  still running, 0 if all have stopped.
+ */
+static int emul_run_machine_threads(struct emul *emul)
+{
+	struct emul_machine_threads *t;
+
+	if (emul->machine_threads == NULL)
+		emul_start_machine_threads(emul);
+
+	usleep(EMUL_MAIN_THREAD_SLEEP);
+
+	t = emul->machine_threads;
+	for (int j=0; j<emul->n_machines; j++)
+		if (__atomic_load_n(&t->machine[j].alive, __ATOMIC_ACQUIRE))
+			return 1;
+
+	emul_stop_machine_threads(emul);
+	return 0;
+}
+
+
+/*
+ *  emul_machines_may_run_threaded():
+ *
+ *  Returns 1 if the machines may run in threads of their own right now.
+ */
+static int emul_machines_may_run_threaded(struct emul *emul)
+{
+	if (emul->n_machines < 2 || single_step != NOT_SINGLE_STEPPING ||
+	    ppc_recording != NULL)
+		return 0;
+
+	for (int j=0; j<emul->n_machines; j++) {
+		struct machine *m = emul->machines[j];
+		if (m->instruction_trace || m->show_trace_tree ||
+		    m->statistics.enabled)
+			return 0;
+	}
+
+	return 1;
+}
+
+
 /*
  *  emul_run():
  *
@@ -847,7 +1088,8 @@ void emul_run(struct emul *emul)
 	 *  MAIN LOOP:
 	 *
 	 *  Run all emulations in parallel, running instructions from each
-	 *  cpu in each machine.
+	 *  cpu in each machine. (With more than one machine, the machines
+	 *  usually run in host threads of their own.)
 	 */
 	while (go) {
 		struct cpu *bootcpu = emul->machines[0]->cpus[
@@ -855,11 +1097,21 @@ void emul_run(struct emul *emul)
 
 		go = 0;
 
-		/*  Flush X11 and serial console output every now and then:  */
+		/*  Flush X11 and serial console output every now and then,
+		    and pass on host input to devices which wait for it:  */
 		if (bootcpu->ninstrs > bootcpu->ninstrs_flush + (1<<19)) {
+			emul_lock_machines(emul);
+
 			x11_check_event(emul);
+			console_poll_input();
 			console_flush();
 			bootcpu->ninstrs_flush += (1 << 19);
+
+			/*  Handle packets (e.g. ^C) from a connected gdb:  */
+			if (GdblibHandleEvents(bootcpu))
+				single_step = ENTER_SINGLE_STEPPING;
+
+			emul_unlock_machines(emul);
 		}
 
 		/*
@@ -871,6 +1123,10 @@ void emul_run(struct emul *emul)
 		}
 		*/
 
+		/*  The debugger needs all machines to stand still:  */
+		if (single_step != NOT_SINGLE_STEPPING)
+			emul_stop_machine_threads(emul);
+
 		if (single_step == ENTER_SINGLE_STEPPING) {
 			/*  TODO: Cleanup!  */
 			old_instruction_trace =
@@ -888,6 +1144,13 @@ void emul_run(struct emul *emul)
 			debugger();
 		}
 
+		if (emul_machines_may_run_threaded(emul)) {
+			go = emul_run_machine_threads(emul);
+			continue;
+		}
+
+		emul_stop_machine_threads(emul);
+
 		go = 0;
 		for (int j=0; j<emul->n_machines; j++) {
 			go = go || machine_run(emul->machines[j]);
@@ -897,6 +1160,10 @@ void emul_run(struct emul *emul)
 	/*  Stop any running timers:  */
 	// timer_stop();
 
+	/*  Stop the cpu threads, if any (see machine_run()):  */
+	for (int j=0; j<emul->n_machines; j++)
+		machine_stop_cpu_threads(emul->machines[j]);
+
 	/*  Deinitialize all CPUs in all machines:  */
 	for (int j=0; j<emul->n_machines; j++) {
 		cpu_run_deinit(emul->machines[j]);
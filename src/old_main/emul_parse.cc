@@ -217,6 +217,8 @@ static char cur_machine_use_x11[10];
 static char cur_machine_x11_scaledown[10];
 static char cur_machine_byte_order[20];
 static char cur_machine_random_mem[10];
+static char cur_machine_reserve_ram[10];
+static char cur_machine_threaded_cpus[10];
 static char cur_machine_random_cpu[10];
 static char cur_machine_force_netboot[10];
 static char cur_machine_start_paused[10];
@@ -346,6 +348,8 @@ static void parse__emul(struct emul *e, FILE *f, int *in_emul, int *line,
 		cur_machine_x11_scaledown[0] = '\0';
 		cur_machine_byte_order[0] = '\0';
 		cur_machine_random_mem[0] = '\0';
+		cur_machine_reserve_ram[0] = '\0';
+		cur_machine_threaded_cpus[0] = '\0';
 		cur_machine_random_cpu[0] = '\0';
 		cur_machine_force_netboot[0] = '\0';
 		cur_machine_start_paused[0] = '\0';
@@ -485,6 +489,16 @@ static void parse__machine(struct emul *e, FILE *f, int *in_emul, int *line,
 		m->random_mem_contents =
 		    parse_on_off(cur_machine_random_mem);
 
+		if (!cur_machine_reserve_ram[0])
+			strlcpy(cur_machine_reserve_ram, "no",
+			    sizeof(cur_machine_reserve_ram));
+		m->reserve_ram = parse_on_off(cur_machine_reserve_ram);
+
+		if (!cur_machine_threaded_cpus[0])
+			strlcpy(cur_machine_threaded_cpus, "no",
+			    sizeof(cur_machine_threaded_cpus));
+		m->threaded_cpus = parse_on_off(cur_machine_threaded_cpus);
+
 		if (!cur_machine_random_cpu[0])
 			strlcpy(cur_machine_random_cpu, "no",
 			    sizeof(cur_machine_random_cpu));
@@ -608,6 +622,8 @@ static void parse__machine(struct emul *e, FILE *f, int *in_emul, int *line,
 	WORD("x11_scaledown", cur_machine_x11_scaledown);
 	WORD("byte_order", cur_machine_byte_order);
 	WORD("random_mem_contents", cur_machine_random_mem);
+	WORD("reserve_ram", cur_machine_reserve_ram);
+	WORD("threaded_cpus", cur_machine_threaded_cpus);
 	WORD("use_random_bootstrap_cpu", cur_machine_random_cpu);
 	WORD("force_netboot", cur_machine_force_netboot);
 	WORD("ncpus", cur_machine_ncpus);
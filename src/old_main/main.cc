@@ -36,6 +36,7 @@
 #include <unistd.h>
 #include <fcntl.h>
 
+#include "checkpoint.h"
 #include "ComponentFactory.h"
 #include "console.h"
 #include "cpu.h"
@@ -48,6 +49,7 @@
 #include "misc.h"
 #include "settings.h"
 #include "timer.h"
+#include "trace.h"
 #include "UnitTest.h"
 #include "debugger.h"
 
@@ -65,6 +67,7 @@ char *progname;
 
 size_t dyntrans_cache_size = DEFAULT_DYNTRANS_CACHE_SIZE;
 static int skip_srandom_call = 0;
+static char *checkpoint_filename = NULL;
 
 
 /*****************************************************************************
@@ -259,6 +262,8 @@ static void usage(int longusage)
 	    "with -E.)\n");
 
 	printf("\nOther options:\n");
+	printf("  -A        reserve all of the emulated RAM in one host "
+	    "mapping, using\n            hugepages if possible\n");
 	printf("  -C x      try to emulate a specific CPU. (Use -H to get a "
 	    "list of types.)\n");
 	printf("  -d fname  add fname as a disk image. You can add \"xxx:\""
@@ -280,6 +285,8 @@ static void usage(int longusage)
 	printf("                t      tape\n");
 	printf("                V      add an overlay\n");
 	printf("                0-7    force a specific ID\n");
+	printf("  -G        let the real-time clock follow the host's clock, "
+	    "instead of\n            emulated time\n");
 	printf("  -I hz     set the main cpu frequency to hz (not used by "
 	    "all combinations\n            of machines and guest OSes)\n");
 	printf("  -i        display each instruction as it is executed\n");
@@ -294,6 +301,13 @@ static void usage(int longusage)
 	printf("            For other emulation modes, if the boot disk is an"
 	    " ISO9660\n            filesystem, -j sets the name of the"
 	    " kernel to load.\n");
+	printf("  -L file   restore the machine from a checkpoint file "
+	    "(saved with the\n            debugger's \"vmstate save\" "
+	    "command)\n");
+	printf("  -l spec   record trace events in memory; spec is a comma "
+	    "separated list\n            of category[=level], e.g. "
+	    "fdc,eagle=warn (see the debugger's\n            \"tracelog\" "
+	    "command)\n");
 	printf("  -M m      emulate m MBs of physical RAM\n");
 	printf("  -N        display nr of instructions/second average, at"
 	    " regular intervals\n");
@@ -304,6 +318,8 @@ static void usage(int longusage)
 	printf("  -o arg    set the boot argument, for DEC, ARC, or SGI"
 	    " emulation\n");
 	printf("            (default arg for DEC is -a, for ARC/SGI -aN)\n");
+	printf("  -P        run each cpu in a host thread of its own (PowerPC"
+	    " SMP only)\n");
 	printf("  -p pc     add a breakpoint (remember to use the '0x' "
 	    "prefix for hex!)\n");
 	printf("  -Q        no built-in PROM emulation  (use this for "
@@ -389,7 +405,7 @@ int get_cmd_args(int argc, char *argv[], struct emul *emul,
 	struct machine *m = emul_add_machine(emul, NULL);
 
 	const char *opts =
-	    "BC:c:Dd:E:e:HhI:iJj:k:KM:Nn:Oo:p:QqRrSs:TtUVvW:@:"
+	    "ABC:c:Dd:E:e:GHhI:iJj:k:KL:l:M:Nn:Oo:Pp:QqRrSs:TtUVvW:@:"
 #ifdef WITH_X11
 	    "XxY:"
 #endif
@@ -397,6 +413,10 @@ int get_cmd_args(int argc, char *argv[], struct emul *emul,
 
 	while ((ch = getopt(argc, argv, opts)) != -1) {
 		switch (ch) {
+		case 'A':
+			m->reserve_ram = 1;
+			msopts = 1;
+			break;
 		case 'B':
 			using_switch_B = true;
 			break;
@@ -437,6 +457,10 @@ int get_cmd_args(int argc, char *argv[], struct emul *emul,
 			subtype = optarg;
 			msopts = 1;
 			break;
+		case 'G':
+			m->rtc_host_time = 1;
+			msopts = 1;
+			break;
 		case 'H':
 			GXemul::ListTemplates();
 			printf("--------------------------------------------------------------------------\n\n");
@@ -474,6 +498,13 @@ int get_cmd_args(int argc, char *argv[], struct emul *emul,
 		case 'K':
 			force_debugger_at_exit = 1;
 			break;
+		case 'L':
+			CHECK_ALLOCATION(checkpoint_filename = strdup(optarg));
+			break;
+		case 'l':
+			if (!trace_set_levels(optarg))
+				exit(1);
+			break;
 		case 'M':
 			m->physical_ram_in_mb = atoi(optarg);
 			msopts = 1;
@@ -496,6 +527,10 @@ int get_cmd_args(int argc, char *argv[], struct emul *emul,
 			    strdup(optarg));
 			msopts = 1;
 			break;
+		case 'P':
+			m->threaded_cpus = 1;
+			msopts = 1;
+			break;
 		case 'p':
 			machine_add_breakpoint_string(m, optarg);
 			msopts = 1;
@@ -600,8 +635,10 @@ int get_cmd_args(int argc, char *argv[], struct emul *emul,
 	if (single_step == ENTER_SINGLE_STEPPING)
 		quiet_mode = 0;
 
+	/*  Legacy configuration files (@configfile) are handled below.  */
 	if (type == NULL && subtype == NULL &&
-	    (single_step == ENTER_SINGLE_STEPPING || argc > 0)) {
+	    (single_step == ENTER_SINGLE_STEPPING || argc > 0) &&
+	    (argc == 0 || argv[0][0] != '@')) {
 		int res2 = 0;
 		{
 			GXemul gxemul;
@@ -910,6 +947,10 @@ int main(int argc, char *argv[])
 	device_set_exit_on_error(0);
 	console_warn_if_slaves_are_needed(1);
 
+	if (checkpoint_filename != NULL &&
+	    !machine_checkpoint_restore(emul->machines[0], checkpoint_filename))
+		exit(1);
+
 
 	/*  Run the emulation:  */
 	emul_run(emul);
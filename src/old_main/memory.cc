@@ -32,6 +32,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
+#include <sys/mman.h>
 
 #include "cpu.h"
 #include "machine.h"
@@ -165,6 +166,54 @@ struct memory *memory_new(uint64_t physical_max, int arch)
 }
 
 
+/*
+ *  memory_reserve_ram():
+ *
+ *  Reserves host address space for the first len bytes of physical memory,
+ *  in one anonymous mapping, instead of allocating memblocks on demand. The
+ *  host only allocates pages when they are touched (MAP_NORESERVE), and
+ *  transparent hugepages are requested for the whole range. The memblock
+ *  table entries are pointed into the mapping, so that code which walks the
+ *  table still works.
+ *
+ *  Should be called right after memory_new(). Returns 1 on success, 0 if the
+ *  mapping could not be made (memblocks are then allocated on demand).
+ */
+int memory_reserve_ram(struct memory *mem, uint64_t len)
+{
+	void **table = (void **) mem->pagetable;
+	const uint64_t blocksize = 1 << BITS_PER_MEMBLOCK;
+	const uint64_t hugepagesize = 2 * 1048576;
+	unsigned char *p;
+
+	len = (len + blocksize - 1) & ~(blocksize - 1);
+	if (len == 0 || len > ((uint64_t) 1 << MAX_BITS))
+		return 0;
+
+	/*  Reserve a bit extra, so that the start can be hugepage aligned:  */
+	p = (unsigned char *) mmap(NULL, len + hugepagesize,
+	    PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+	    -1, 0);
+	if (p == MAP_FAILED)
+		return 0;
+
+	p = (unsigned char *) (((size_t) p + hugepagesize - 1) &
+	    ~(size_t) (hugepagesize - 1));
+
+#ifdef MADV_HUGEPAGE
+	madvise(p, len, MADV_HUGEPAGE);
+#endif
+
+	for (uint64_t ofs = 0; ofs < len; ofs += blocksize)
+		table[ofs >> BITS_PER_MEMBLOCK] = p + ofs;
+
+	mem->ram = p;
+	mem->ram_len = len;
+
+	return 1;
+}
+
+
 /*
  *  memory_points_to_string():
  *
@@ -498,14 +547,19 @@ unsigned char *memory_paddr_to_hostaddr(struct memory *mem,
 	const int shrcount = MAX_BITS - BITS_PER_PAGETABLE;
 	unsigned char *hostptr;
 
+	hostptr = memory_ram_hostaddr(mem, paddr);
+	if (hostptr != NULL)
+		return hostptr;
+
 	table = (void **) mem->pagetable;
 	entry = (paddr >> shrcount) & mask;
 
 	/*  printf("memory_paddr_to_hostaddr(): p=%16" PRIx64
 	    " w=%i => entry=0x%x\n", (uint64_t) paddr, writeflag, entry);  */
 
-	if (table[entry] == NULL) {
+	if (__atomic_load_n(&table[entry], __ATOMIC_ACQUIRE) == NULL) {
 		size_t alloclen;
+		void *p, *expected = NULL;
 
 		/*
 		 *  Special case:  reading from a nonexistant memblock
@@ -524,11 +578,17 @@ unsigned char *memory_paddr_to_hostaddr(struct memory *mem,
 
 		/*  Anonymous mmap() should return zero-filled memory,
 		    try malloc + memset if mmap failed.  */
-		table[entry] = (void *) calloc(alloclen, 1);
-		if (table[entry] == NULL) {
-			CHECK_ALLOCATION(table[entry] = malloc(alloclen));
-			memset(table[entry], 0, alloclen);
+		p = calloc(alloclen, 1);
+		if (p == NULL) {
+			CHECK_ALLOCATION(p = malloc(alloclen));
+			memset(p, 0, alloclen);
 		}
+
+		/*  Another cpu thread may have allocated the memblock
+		    while this one was allocating:  */
+		if (!__atomic_compare_exchange_n(&table[entry], &expected, p,
+		    false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+			free(p);
 	}
 
 	hostptr = (unsigned char *) table[entry];
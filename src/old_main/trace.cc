@@ -0,0 +1,481 @@
+/*
+ *  Tracing of device and CPU events.
+ *
+ *  trace_record() is only called when a TRACE() statement's category is
+ *  enabled at that level (see trace.h). It parses the printf-style format
+ *  just enough to pick up the arguments with the right types, and stores
+ *  them as raw 64-bit values together with the format string pointer in a
+ *  ring buffer. Strings are copied into the record (and truncated if they
+ *  do not fit). Nothing is formatted until the ring is dumped.
+ *
+ *  Machines may run in threads of their own, so slots in the ring are
+ *  claimed with an atomic sequence counter. A record which is overwritten
+ *  while it is being dumped may come out garbled; that is accepted, since
+ *  the ring is a debugging aid.
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "misc.h"
+#include "trace.h"
+
+
+uint8_t trace_levels[N_TRACE_CATEGORIES];
+
+static const char *trace_category_names[N_TRACE_CATEGORIES] = {
+	"cpu", "ppc", "mem", "pci", "isa", "eagle",
+	"fdc", "vga", "kbd", "rtc", "scsi", "dev"
+};
+
+static const char *trace_level_names[] = {
+	"off", "error", "warn", "info", "debug"
+};
+
+/*  Argument types, as decided by a conversion's length modifier and
+    conversion character:  */
+#define	TRACE_ARG_NONE		0
+#define	TRACE_ARG_INT		1
+#define	TRACE_ARG_LONG		2
+#define	TRACE_ARG_LLONG		3
+#define	TRACE_ARG_SIZE		4
+#define	TRACE_ARG_DOUBLE	5
+#define	TRACE_ARG_LDOUBLE	6
+#define	TRACE_ARG_STRING	7
+#define	TRACE_ARG_POINTER	8
+
+struct trace_rec {
+	uint64_t	seq;		/*  sequence number + 1, 0 = unused  */
+	const char	*fmt;
+	uint8_t		cat;
+	uint8_t		level;
+	uint8_t		nargs;
+	uint64_t	args[TRACE_MAX_ARGS];
+
+	/*  %s arguments are copied here; their args[] hold offsets:  */
+	char		strings[TRACE_STRING_SPACE];
+};
+
+static struct trace_rec *trace_ring = NULL;
+static uint64_t trace_next_seq = 0;
+static uint64_t trace_dumped_seq = 0;
+
+
+/*
+ *  trace_parse_conversion():
+ *
+ *  Parses one printf conversion, starting at the '%' in p. The conversion
+ *  (with any '*' widths left in) is copied to spec, and the argument type
+ *  is returned in *typep. *nstarsp is set to the number of '*' (which each
+ *  take an int argument before the value itself).
+ *
+ *  Returns a pointer to the first character after the conversion.
+ */
+static const char *trace_parse_conversion(const char *p, char *spec,
+	size_t specsize, int *typep, int *nstarsp)
+{
+	const char *start = p;
+	int longs = 0, size = 0, ldouble = 0;
+	size_t len;
+
+	*nstarsp = 0;
+	p++;
+
+	while (*p && strchr("-+ #0'", *p) != NULL)
+		p++;
+	while (*p == '*' || (*p >= '0' && *p <= '9') || *p == '.') {
+		if (*p == '*')
+			(*nstarsp) ++;
+		p++;
+	}
+
+	for (;;) {
+		if (*p == 'l')
+			longs ++;
+		else if (*p == 'q' || *p == 'j')
+			longs = 2;
+		else if (*p == 'z' || *p == 't')
+			size = 1;
+		else if (*p == 'L')
+			ldouble = 1;
+		else if (*p != 'h')
+			break;
+		p++;
+	}
+
+	switch (*p) {
+	case 'd': case 'i': case 'u': case 'x': case 'X': case 'o': case 'c':
+		*typep = size? TRACE_ARG_SIZE : longs >= 2? TRACE_ARG_LLONG :
+		    longs == 1? TRACE_ARG_LONG : TRACE_ARG_INT;
+		break;
+	case 'f': case 'F': case 'e': case 'E':
+	case 'g': case 'G': case 'a': case 'A':
+		*typep = ldouble? TRACE_ARG_LDOUBLE : TRACE_ARG_DOUBLE;
+		break;
+	case 's':
+		*typep = TRACE_ARG_STRING;
+		break;
+	case 'p':
+		*typep = TRACE_ARG_POINTER;
+		break;
+	default:
+		/*  "%%", or something which is not understood.  */
+		*typep = TRACE_ARG_NONE;
+		*nstarsp = 0;
+	}
+
+	if (*p)
+		p++;
+
+	len = p - start;
+	if (len >= specsize)
+		len = specsize - 1;
+	memcpy(spec, start, len);
+	spec[len] = '\0';
+
+	return p;
+}
+
+
+/*
+ *  trace_record():
+ *
+ *  Stores one event in the trace ring. Called via the TRACE() macro.
+ */
+void trace_record(int cat, int level, const char *fmt, ...)
+{
+	struct trace_rec *rec;
+	char spec[32];
+	va_list ap;
+	uint64_t seq;
+	const char *p = fmt;
+	int nargs = 0;
+	size_t strused = 0;
+
+	if (trace_ring == NULL)
+		return;
+
+	seq = __atomic_fetch_add(&trace_next_seq, 1, __ATOMIC_RELAXED);
+	rec = &trace_ring[seq & (TRACE_RING_LEN - 1)];
+	rec->seq = 0;
+	rec->fmt = fmt;
+	rec->cat = cat;
+	rec->level = level;
+
+	va_start(ap, fmt);
+
+	while ((p = strchr(p, '%')) != NULL) {
+		int type, nstars;
+		double dv;
+
+		p = trace_parse_conversion(p, spec, sizeof(spec),
+		    &type, &nstars);
+
+		while (nstars-- > 0 && nargs < TRACE_MAX_ARGS)
+			rec->args[nargs++] = (int64_t) va_arg(ap, int);
+
+		if (type == TRACE_ARG_NONE || nargs >= TRACE_MAX_ARGS)
+			continue;
+
+		switch (type) {
+		case TRACE_ARG_INT:
+			rec->args[nargs] = (int64_t) va_arg(ap, int);
+			break;
+		case TRACE_ARG_LONG:
+			rec->args[nargs] = (int64_t) va_arg(ap, long);
+			break;
+		case TRACE_ARG_LLONG:
+			rec->args[nargs] = (int64_t) va_arg(ap, long long);
+			break;
+		case TRACE_ARG_SIZE:
+			rec->args[nargs] = va_arg(ap, size_t);
+			break;
+		case TRACE_ARG_DOUBLE:
+		case TRACE_ARG_LDOUBLE:
+			dv = type == TRACE_ARG_DOUBLE? va_arg(ap, double) :
+			    (double) va_arg(ap, long double);
+			memcpy(&rec->args[nargs], &dv, sizeof(dv));
+			break;
+		case TRACE_ARG_STRING:
+			{
+				const char *str = va_arg(ap, const char *);
+				size_t room = TRACE_STRING_SPACE - strused;
+
+				if (str == NULL)
+					str = "(null)";
+				if (room > 0) {
+					strncpy(rec->strings + strused, str,
+					    room - 1);
+					rec->strings[TRACE_STRING_SPACE-1] = '\0';
+					rec->args[nargs] = strused;
+					strused += strlen(rec->strings +
+					    strused) + 1;
+				} else {
+					rec->args[nargs] = TRACE_STRING_SPACE-1;
+				}
+			}
+			break;
+		case TRACE_ARG_POINTER:
+			rec->args[nargs] = (size_t) va_arg(ap, void *);
+			break;
+		}
+
+		nargs ++;
+	}
+
+	va_end(ap);
+
+	rec->nargs = nargs;
+	__atomic_store_n(&rec->seq, seq + 1, __ATOMIC_RELEASE);
+}
+
+
+/*
+ *  trace_format():
+ *
+ *  Turns a stored record back into text.
+ */
+static void trace_format(struct trace_rec *rec, char *buf, size_t bufsize)
+{
+	const char *p = rec->fmt;
+	size_t used = 0;
+	int argi = 0;
+
+	buf[0] = '\0';
+
+	while (*p && used + 1 < bufsize) {
+		char spec[32], spec2[64];
+		const char *q;
+		int type, nstars, j;
+		double dv;
+		int res = 0;
+
+		if (*p != '%') {
+			buf[used++] = *p++;
+			buf[used] = '\0';
+			continue;
+		}
+
+		p = trace_parse_conversion(p, spec, sizeof(spec),
+		    &type, &nstars);
+
+		if (type == TRACE_ARG_NONE) {
+			buf[used++] = spec[1] == '%'? '%' : '?';
+			buf[used] = '\0';
+			continue;
+		}
+
+		/*  Fill in '*' widths/precisions with their stored values:  */
+		for (q = spec, j = 0; *q && j < (int)sizeof(spec2) - 12; q++) {
+			if (*q == '*' && argi < rec->nargs)
+				j += snprintf(spec2 + j, sizeof(spec2) - j, "%i",
+				    (int) rec->args[argi++]);
+			else
+				spec2[j++] = *q;
+		}
+		spec2[j] = '\0';
+
+		if (argi >= rec->nargs) {
+			res = snprintf(buf + used, bufsize - used, "<?>");
+		} else {
+			uint64_t v = rec->args[argi++];
+
+			switch (type) {
+			case TRACE_ARG_INT:
+				res = snprintf(buf + used, bufsize - used,
+				    spec2, (int) v);
+				break;
+			case TRACE_ARG_LONG:
+				res = snprintf(buf + used, bufsize - used,
+				    spec2, (long) v);
+				break;
+			case TRACE_ARG_LLONG:
+				res = snprintf(buf + used, bufsize - used,
+				    spec2, (long long) v);
+				break;
+			case TRACE_ARG_SIZE:
+				res = snprintf(buf + used, bufsize - used,
+				    spec2, (size_t) v);
+				break;
+			case TRACE_ARG_DOUBLE:
+				memcpy(&dv, &v, sizeof(dv));
+				res = snprintf(buf + used, bufsize - used,
+				    spec2, dv);
+				break;
+			case TRACE_ARG_LDOUBLE:
+				memcpy(&dv, &v, sizeof(dv));
+				res = snprintf(buf + used, bufsize - used,
+				    spec2, (long double) dv);
+				break;
+			case TRACE_ARG_STRING:
+				res = snprintf(buf + used, bufsize - used,
+				    spec2, rec->strings +
+				    (v < TRACE_STRING_SPACE? v : 0));
+				break;
+			case TRACE_ARG_POINTER:
+				res = snprintf(buf + used, bufsize - used,
+				    spec2, (void *) (size_t) v);
+				break;
+			}
+		}
+
+		if (res > 0)
+			used += res;
+		if (used >= bufsize)
+			used = bufsize - 1;
+
+	}
+
+	/*  Each record is one line:  */
+	while (used > 0 && buf[used-1] == '\n')
+		buf[--used] = '\0';
+}
+
+
+/*
+ *  trace_dump():
+ *
+ *  Prints the records in the trace ring, oldest first. If only_new is set,
+ *  records that have been dumped before are skipped.
+ */
+void trace_dump(FILE *f, int only_new)
+{
+	uint64_t next = __atomic_load_n(&trace_next_seq, __ATOMIC_ACQUIRE);
+	uint64_t first = 0, seq;
+	char buf[1024];
+
+	if (trace_ring == NULL)
+		return;
+
+	if (only_new)
+		first = trace_dumped_seq;
+	if (next > TRACE_RING_LEN && first < next - TRACE_RING_LEN) {
+		fprintf(f, "[ trace: %" PRIu64" older records lost ]\n",
+		    next - TRACE_RING_LEN - first);
+		first = next - TRACE_RING_LEN;
+	}
+
+	for (seq = first; seq < next; seq++) {
+		struct trace_rec *rec = &trace_ring[seq & (TRACE_RING_LEN-1)];
+
+		if (__atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE) != seq + 1)
+			continue;
+
+		trace_format(rec, buf, sizeof(buf));
+		fprintf(f, "%8" PRIu64" %-5s %s\n", seq,
+		    trace_category_names[rec->cat], buf);
+	}
+
+	trace_dumped_seq = next;
+	fflush(f);
+}
+
+
+/*
+ *  trace_clear():
+ *
+ *  Forgets all records in the trace ring.
+ */
+void trace_clear(void)
+{
+	if (trace_ring != NULL)
+		memset(trace_ring, 0, sizeof(struct trace_rec) * TRACE_RING_LEN);
+
+	trace_dumped_seq = __atomic_load_n(&trace_next_seq, __ATOMIC_ACQUIRE);
+}
+
+
+/*
+ *  trace_at_exit():
+ *
+ *  Dumps the records which have not been dumped already to stderr.
+ */
+static void trace_at_exit(void)
+{
+	trace_dump(stderr, 1);
+}
+
+
+/*
+ *  trace_set_levels():
+ *
+ *  Parses a comma separated list of category[=level] and sets the runtime
+ *  levels. The category may be "all"; a missing level means "debug".
+ *  Returns 1 on success, 0 (after printing a message) on failure.
+ */
+int trace_set_levels(const char *spec)
+{
+	char *s, *tofree, *word;
+	int ok = 1;
+
+	CHECK_ALLOCATION(tofree = s = strdup(spec));
+
+	while (ok && (word = strsep(&s, ",")) != NULL) {
+		char *levelname = strchr(word, '=');
+		int cat, level = TRACE_DEBUG, found = 0;
+
+		if (word[0] == '\0')
+			continue;
+
+		if (levelname != NULL) {
+			*levelname++ = '\0';
+			if (levelname[0] >= '0' && levelname[0] <= '9') {
+				level = atoi(levelname);
+			} else {
+				for (level = TRACE_DEBUG; level >= TRACE_OFF;
+				    level --)
+					if (strcasecmp(levelname,
+					    trace_level_names[level]) == 0)
+						break;
+			}
+			if (level < TRACE_OFF || level > TRACE_DEBUG) {
+				printf("trace: unknown level '%s'\n",
+				    levelname);
+				ok = 0;
+				break;
+			}
+		}
+
+		for (cat = 0; cat < N_TRACE_CATEGORIES; cat++)
+			if (strcasecmp(word, "all") == 0 ||
+			    strcasecmp(word, trace_category_names[cat]) == 0) {
+				trace_levels[cat] = level;
+				found = 1;
+			}
+
+		if (!found) {
+			printf("trace: unknown category '%s'\n", word);
+			ok = 0;
+		}
+	}
+
+	free(tofree);
+
+	if (ok && trace_ring == NULL) {
+		CHECK_ALLOCATION(trace_ring = (struct trace_rec *) calloc(
+		    TRACE_RING_LEN, sizeof(struct trace_rec)));
+		atexit(trace_at_exit);
+	}
+
+	return ok;
+}
+
+
+/*
+ *  trace_show_levels():
+ *
+ *  Prints the runtime level of each category.
+ */
+void trace_show_levels(void)
+{
+	uint64_t next = __atomic_load_n(&trace_next_seq, __ATOMIC_ACQUIRE);
+
+	for (int cat = 0; cat < N_TRACE_CATEGORIES; cat++)
+		printf("  %-6s %s\n", trace_category_names[cat],
+		    trace_level_names[trace_levels[cat]]);
+
+	printf("%" PRIu64" records traced, %" PRIu64" not yet dumped\n",
+	    next, next - trace_dumped_seq);
+}
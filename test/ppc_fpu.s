@@ -0,0 +1,345 @@
+#
+#  Vector test for the PowerPC FPU arithmetic instructions, run on the
+#  testppc machine:
+#
+#	gxemul -E testppc -C PPC750 0x10000:0:0x10000:test/ppc_fpu.bin
+#
+#  Each table entry gives an operation, the rounding mode (FPSCR[RN]), two
+#  operands, and the expected result and FPSCR. FPSCR is compared under
+#  FPSCR_MASK: the exception summary bits (FX), FR and the enable and
+#  rounding control bits are not checked. Mismatches are printed as
+#
+#	FAIL <entry> <result> <fpscr>
+#
+#  and the program ends by printing PASS or FAILED and halting the machine.
+#
+#  ppc_fpu.bin is built from this file using
+#
+#	llvm-mc -triple=powerpc-unknown-linux-gnu -filetype=obj \
+#	    -o ppc_fpu.o ppc_fpu.s
+#	llvm-objcopy -O binary ppc_fpu.o ppc_fpu.bin
+#
+#  The expected values were computed with exact rational arithmetic.
+#
+
+	.set	CONSOLE, 0x1000		# putchar at 0x10000000, halt at +0x10
+	.set	FPSCR_MASK_HI, 0x7e03
+	.set	FPSCR_MASK_LO, 0xf000
+	.set	ENTRY_SIZE, 40
+
+	.text
+	.globl	_start
+_start:
+	bl	base
+base:	mflr	31
+	addi	30,31,table-base
+	lis	20,CONSOLE
+	lis	23,FPSCR_MASK_HI
+	ori	23,23,FPSCR_MASK_LO
+	li	21,0			# number of failures
+	li	22,0			# entry number
+
+	mfmsr	3			# enable the FPU
+	ori	3,3,0x2000
+	mtmsr	3
+	isync
+
+next:	lwz	3,0(30)
+	cmpwi	3,-1
+	beq	done
+
+	lfd	0,0(30)			# low word is the rounding mode
+	mtfsf	0xff,0
+	lfd	1,8(30)
+	lfd	2,16(30)
+
+	cmpwi	3,1
+	blt	do_add
+	beq	do_sub
+	cmpwi	3,3
+	blt	do_mul
+	fdiv	3,1,2
+	b	check
+do_add:	fadd	3,1,2
+	b	check
+do_sub:	fsub	3,1,2
+	b	check
+do_mul:	fmul	3,1,2
+
+check:	mffs	4
+	stfd	3,-16(1)
+	stfd	4,-8(1)
+	lwz	24,-16(1)		# result
+	lwz	25,-12(1)
+	lwz	26,-4(1)		# fpscr
+	and	26,26,23
+
+	lwz	3,24(30)
+	cmpw	3,24
+	bne	fail
+	lwz	3,28(30)
+	cmpw	3,25
+	bne	fail
+	lwz	3,32(30)
+	cmpw	3,26
+	beq	pass
+
+fail:	addi	21,21,1
+	addi	3,31,str_fail-base
+	bl	puts
+	mr	3,22
+	bl	puthex
+	li	3,' '
+	stb	3,0(20)
+	mr	3,24
+	bl	puthex
+	mr	3,25
+	bl	puthex
+	li	3,' '
+	stb	3,0(20)
+	mr	3,26
+	bl	puthex
+	li	3,'\n'
+	stb	3,0(20)
+
+pass:	addi	22,22,1
+	addi	30,30,ENTRY_SIZE
+	b	next
+
+done:	addi	3,31,str_pass-base
+	cmpwi	21,0
+	beq	1f
+	addi	3,31,str_failed-base
+1:	bl	puts
+	stw	3,0x10(20)		# halt
+	b	.
+
+#  puts: print the nul-terminated string at r3.
+puts:	lbz	4,0(3)
+	cmpwi	4,0
+	beqlr
+	stb	4,0(20)
+	addi	3,3,1
+	b	puts
+
+#  puthex: print r3 as 8 hex digits.
+puthex:	li	5,8
+	mtctr	5
+1:	rlwinm	3,3,4,0,31
+	andi.	4,3,15
+	addi	4,4,'0'
+	cmpwi	4,'9'
+	ble	2f
+	addi	4,4,'a'-'0'-10
+2:	stb	4,0(20)
+	bdnz	1b
+	blr
+
+str_fail:
+	.asciz	"FAIL "
+str_pass:
+	.asciz	"PASS\n"
+str_failed:
+	.asciz	"FAILED\n"
+
+	.balign	8
+table:
+	# 0: fadd 1 + 2^-60 (RN)
+	.long	0, 0
+	.long	0x3ff00000, 0x00000000
+	.long	0x3c300000, 0x00000000
+	.long	0x3ff00000, 0x00000000
+	.long	0x02024000, 0
+	# 1: fadd 1 + 2^-60 (RZ)
+	.long	0, 1
+	.long	0x3ff00000, 0x00000000
+	.long	0x3c300000, 0x00000000
+	.long	0x3ff00000, 0x00000000
+	.long	0x02024000, 0
+	# 2: fadd 1 + 2^-60 (RP)
+	.long	0, 2
+	.long	0x3ff00000, 0x00000000
+	.long	0x3c300000, 0x00000000
+	.long	0x3ff00000, 0x00000001
+	.long	0x02024000, 0
+	# 3: fadd 1 + 2^-60 (RM)
+	.long	0, 3
+	.long	0x3ff00000, 0x00000000
+	.long	0x3c300000, 0x00000000
+	.long	0x3ff00000, 0x00000000
+	.long	0x02024000, 0
+	# 4: fadd -1 - 2^-60 (RN)
+	.long	0, 0
+	.long	0xbff00000, 0x00000000
+	.long	0xbc300000, 0x00000000
+	.long	0xbff00000, 0x00000000
+	.long	0x02028000, 0
+	# 5: fadd -1 - 2^-60 (RZ)
+	.long	0, 1
+	.long	0xbff00000, 0x00000000
+	.long	0xbc300000, 0x00000000
+	.long	0xbff00000, 0x00000000
+	.long	0x02028000, 0
+	# 6: fadd -1 - 2^-60 (RP)
+	.long	0, 2
+	.long	0xbff00000, 0x00000000
+	.long	0xbc300000, 0x00000000
+	.long	0xbff00000, 0x00000000
+	.long	0x02028000, 0
+	# 7: fadd -1 - 2^-60 (RM)
+	.long	0, 3
+	.long	0xbff00000, 0x00000000
+	.long	0xbc300000, 0x00000000
+	.long	0xbff00000, 0x00000001
+	.long	0x02028000, 0
+	# 8: fdiv 1 / 3 (RN)
+	.long	3, 0
+	.long	0x3ff00000, 0x00000000
+	.long	0x40080000, 0x00000000
+	.long	0x3fd55555, 0x55555555
+	.long	0x02024000, 0
+	# 9: fdiv 1 / 3 (RZ)
+	.long	3, 1
+	.long	0x3ff00000, 0x00000000
+	.long	0x40080000, 0x00000000
+	.long	0x3fd55555, 0x55555555
+	.long	0x02024000, 0
+	# 10: fdiv 1 / 3 (RP)
+	.long	3, 2
+	.long	0x3ff00000, 0x00000000
+	.long	0x40080000, 0x00000000
+	.long	0x3fd55555, 0x55555556
+	.long	0x02024000, 0
+	# 11: fdiv 1 / 3 (RM)
+	.long	3, 3
+	.long	0x3ff00000, 0x00000000
+	.long	0x40080000, 0x00000000
+	.long	0x3fd55555, 0x55555555
+	.long	0x02024000, 0
+	# 12: fdiv -1 / 3 (RP)
+	.long	3, 2
+	.long	0xbff00000, 0x00000000
+	.long	0x40080000, 0x00000000
+	.long	0xbfd55555, 0x55555555
+	.long	0x02028000, 0
+	# 13: fdiv -1 / 3 (RM)
+	.long	3, 3
+	.long	0xbff00000, 0x00000000
+	.long	0x40080000, 0x00000000
+	.long	0xbfd55555, 0x55555556
+	.long	0x02028000, 0
+	# 14: fdiv 2 / 3 (RN)
+	.long	3, 0
+	.long	0x40000000, 0x00000000
+	.long	0x40080000, 0x00000000
+	.long	0x3fe55555, 0x55555555
+	.long	0x02024000, 0
+	# 15: fmul 0.1 * 0.1 (RN)
+	.long	2, 0
+	.long	0x3fb99999, 0x9999999a
+	.long	0x3fb99999, 0x9999999a
+	.long	0x3f847ae1, 0x47ae147c
+	.long	0x02024000, 0
+	# 16: fmul exact product (RN)
+	.long	2, 0
+	.long	0x3ff80000, 0x00000000
+	.long	0x40000000, 0x00000000
+	.long	0x40080000, 0x00000000
+	.long	0x00004000, 0
+	# 17: fadd exact sum (RN)
+	.long	0, 0
+	.long	0x43300000, 0x00000000
+	.long	0x3ff00000, 0x00000000
+	.long	0x43300000, 0x00000001
+	.long	0x00004000, 0
+	# 18: fsub 1 - 1 is +0 (RN)
+	.long	1, 0
+	.long	0x3ff00000, 0x00000000
+	.long	0x3ff00000, 0x00000000
+	.long	0x00000000, 0x00000000
+	.long	0x00002000, 0
+	# 19: fsub 1 - 1 is +0 (RZ)
+	.long	1, 1
+	.long	0x3ff00000, 0x00000000
+	.long	0x3ff00000, 0x00000000
+	.long	0x00000000, 0x00000000
+	.long	0x00002000, 0
+	# 20: fsub 1 - 1 is -0 when rounding towards -inf (RM)
+	.long	1, 3
+	.long	0x3ff00000, 0x00000000
+	.long	0x3ff00000, 0x00000000
+	.long	0x80000000, 0x00000000
+	.long	0x00012000, 0
+	# 21: fadd 0 + -0 is +0 (RN)
+	.long	0, 0
+	.long	0x00000000, 0x00000000
+	.long	0x80000000, 0x00000000
+	.long	0x00000000, 0x00000000
+	.long	0x00002000, 0
+	# 22: fadd 0 + -0 is -0 when rounding towards -inf (RM)
+	.long	0, 3
+	.long	0x00000000, 0x00000000
+	.long	0x80000000, 0x00000000
+	.long	0x80000000, 0x00000000
+	.long	0x00012000, 0
+	# 23: fmul 0 * -3 is -0 (RN)
+	.long	2, 0
+	.long	0x00000000, 0x00000000
+	.long	0xc0080000, 0x00000000
+	.long	0x80000000, 0x00000000
+	.long	0x00012000, 0
+	# 24: fmul overflow, truncated to the largest double (RZ)
+	.long	2, 1
+	.long	0x7fefffff, 0xffffffff
+	.long	0x40000000, 0x00000000
+	.long	0x7fefffff, 0xffffffff
+	.long	0x12024000, 0
+	# 25: fmul negative overflow, truncated (RZ)
+	.long	2, 1
+	.long	0xffefffff, 0xffffffff
+	.long	0x40000000, 0x00000000
+	.long	0xffefffff, 0xffffffff
+	.long	0x12028000, 0
+	# 26: fadd overflow, rounded down to the largest double (RM)
+	.long	0, 3
+	.long	0x7fefffff, 0xffffffff
+	.long	0x7fefffff, 0xffffffff
+	.long	0x7fefffff, 0xffffffff
+	.long	0x12024000, 0
+	# 27: fmul exact denormal result (RN)
+	.long	2, 0
+	.long	0x00300000, 0x00000000
+	.long	0x3e100000, 0x00000000
+	.long	0x00000000, 0x01000000
+	.long	0x00014000, 0
+	# 28: fmul exact negative denormal result (RN)
+	.long	2, 0
+	.long	0x80300000, 0x00000000
+	.long	0x3e100000, 0x00000000
+	.long	0x80000000, 0x01000000
+	.long	0x00018000, 0
+	# 29: fmul inexact denormal result (RN)
+	.long	2, 0
+	.long	0x1ed00000, 0x00000001
+	.long	0x1ed00000, 0x00000000
+	.long	0x00000000, 0x00004000
+	.long	0x0a034000, 0
+	# 30: fmul inexact denormal result (RP)
+	.long	2, 2
+	.long	0x1ed00000, 0x00000001
+	.long	0x1ed00000, 0x00000000
+	.long	0x00000000, 0x00004001
+	.long	0x0a034000, 0
+	# 31: fdiv inexact denormal quotient (RN)
+	.long	3, 0
+	.long	0x01700000, 0x00000000
+	.long	0x43c80000, 0x00000000
+	.long	0x00000000, 0x00001555
+	.long	0x0a034000, 0
+	# 32: fadd exact denormal difference (RN)
+	.long	0, 0
+	.long	0x00100000, 0x00000000
+	.long	0x80080000, 0x00000000
+	.long	0x00080000, 0x00000000
+	.long	0x00014000, 0
+	.long	-1, 0
@@ -0,0 +1,101 @@
+#
+#  Test program for the native code generator (cpu_ppc_native.cc), run on
+#  the testppc machine:
+#
+#	gxemul -E testppc -C PPC750 0x10000:0:0x10000:test/ppc_native.bin
+#
+#  The loop below consists of the instructions which can be compiled into
+#  native code, mixed with loads and stores, and runs often enough for its
+#  blocks to be compiled. When it is done, r3..r31 and CR are printed in
+#  hex, one per line, and the machine is halted. The output must be the
+#  same with native code off and on.
+#
+#  ppc_native.bin is built from this file using
+#
+#	llvm-mc -triple=powerpc-unknown-linux-gnu -filetype=obj \
+#	    -o ppc_native.o ppc_native.s
+#	llvm-objcopy -O binary ppc_native.o ppc_native.bin
+#
+
+	.set	CONSOLE, 0x1000		# putchar at 0x10000000, halt at +0x10
+	.set	BUFFER, 0x2		# at 0x20000
+	.set	NLOOPS, 2000
+
+	.text
+	.globl	_start
+_start:
+	bl	base
+base:	mflr	31
+	lis	20,CONSOLE
+	lis	10,BUFFER
+	li	3,0x1234
+	lis	4,0x9e37
+	ori	4,4,0x79b9
+	li	22,0
+	li	25,0
+	li	30,0
+
+loop:	add	5,3,4
+	rlwinm	6,5,7,0,31
+	xor	3,6,5
+	subf	7,3,4
+	and	8,7,5
+	or	9,8,6
+	andc	11,9,3
+	nor	12,11,7
+	neg	13,12
+	extsb	14,13
+	extsh	15,9
+	addi	16,15,-1000
+	ori	17,16,0x8001
+	xori	18,17,0x5555
+	mr	19,18
+	rlwinm	21,19,0,16,23
+	nop
+	li	0,-1
+	cmpw	3,4
+	cmplw	1,5,6
+	cmpwi	2,7,0
+	cmplwi	3,8,0x8000
+	blt	2,1f
+	addi	22,22,1
+1:	bgt	1,2f
+	xor	4,4,21
+2:	rlwinm	23,30,2,20,29
+	stwx	3,10,23
+	lwz	24,0(10)
+	add	25,25,24
+	addi	30,30,1
+	cmplwi	30,NLOOPS
+	blt	loop
+
+	stmw	3,0x1000(10)		# r3..r31
+	mfcr	3
+	stw	3,0x1074(10)
+
+	addi	26,10,0x1000
+	li	27,30
+next:	lwz	3,0(26)
+	bl	puthex
+	addi	26,26,4
+	addi	27,27,-1
+	cmpwi	27,0
+	bgt	next
+
+	stw	3,0x10(20)		# halt
+	b	.
+
+#  puthex: print r3 as 8 hex digits and a newline.
+puthex:	li	5,8
+	mtctr	5
+1:	rlwinm	3,3,4,0,31
+	andi.	4,3,15
+	addi	4,4,'0'
+	cmpwi	4,'9'
+	ble	2f
+	addi	4,4,'a'-'0'-10
+2:	stb	4,0(20)
+	bdnz	1b
+	li	4,'\n'
+	stb	4,0(20)
+	blr
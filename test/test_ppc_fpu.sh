@@ -0,0 +1,45 @@
+#!/bin/sh
+#
+#  Regression test: PowerPC FPU results and FPSCR bits, checked against
+#  the vectors in test/ppc_fpu.s. Start using:
+#
+#	test/test_ppc_fpu.sh [path to gxemul]
+#
+#  The vectors are run twice; the second time with fpu_debug = 2, which
+#  also compares every result computed on the host FPU with softfloat.
+#
+
+GXEMUL=${1:-./gxemul}
+TESTDIR=`dirname $0`
+TMP=`mktemp -d /tmp/gxemul_test.XXXXXX` || exit 1
+trap 'rm -rf "$TMP"' 0
+
+#  The emulator's console reads stdin; keep it open but silent.
+mkfifo "$TMP/stdin" || exit 1
+exec 3<>"$TMP/stdin"
+
+ANYERRORS=0
+
+run()
+{
+	"$GXEMUL" -q "$@" -E testppc -C PPC750 \
+	    0x10000:0:0x10000:$TESTDIR/ppc_fpu.bin <&3 > "$TMP/out" 2> "$TMP/err"
+
+	if ! grep -q "^PASS" "$TMP/out"; then
+		printf "\nError: ppc_fpu.bin did not pass ($*):\n"
+		cat "$TMP/out"
+		ANYERRORS=1
+	fi
+	if grep "host FPU result" "$TMP/err"; then
+		printf "\nError: host FPU and softfloat results differ\n"
+		ANYERRORS=1
+	fi
+}
+
+run
+run -V -c "fpu_debug = 2" -c continue
+
+if [ z$ANYERRORS = z1 ]; then
+	printf "\n\n"
+	false
+fi
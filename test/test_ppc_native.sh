@@ -0,0 +1,55 @@
+#!/bin/sh
+#
+#  Regression test: Native code for hot PowerPC instruction runs must give
+#  the same register and memory state as the normal instruction functions.
+#  Start using:
+#
+#	test/test_ppc_native.sh [path to gxemul]
+#
+#  test/ppc_native.s is run with native code off, on, and in checking mode
+#  (native = 2, where every native block is also run using the normal
+#  functions, and any difference aborts the emulator).
+#
+
+GXEMUL=${1:-./gxemul}
+TESTDIR=`dirname $0`
+TMP=`mktemp -d /tmp/gxemul_test.XXXXXX` || exit 1
+trap 'rm -rf "$TMP"' 0
+
+#  The emulator's console reads stdin; keep it open but silent.
+mkfifo "$TMP/stdin" || exit 1
+exec 3<>"$TMP/stdin"
+
+ANYERRORS=0
+
+for NATIVE in 0 1 2; do
+	"$GXEMUL" -q -V -c "native = $NATIVE" -c continue -E testppc \
+	    -C PPC750 0x10000:0:0x10000:$TESTDIR/ppc_native.bin <&3 \
+	    > "$TMP/out" 2> "$TMP/err"
+
+	if [ $? != 0 ] || grep "ppc_native:" "$TMP/err"; then
+		printf "\nError: native = $NATIVE failed\n"
+		ANYERRORS=1
+	fi
+
+	#  Only the register dump; the debugger also echoes the assignment.
+	grep -E '^[0-9a-f]{8}$' "$TMP/out" > "$TMP/regs.$NATIVE"
+	if [ `wc -l < "$TMP/regs.$NATIVE"` != 30 ]; then
+		printf "\nError: native = $NATIVE: no register dump\n"
+		cat "$TMP/out"
+		ANYERRORS=1
+	fi
+done
+
+for NATIVE in 1 2; do
+	if ! cmp -s "$TMP/regs.0" "$TMP/regs.$NATIVE"; then
+		printf "\nError: native = $NATIVE gives a different result:\n"
+		diff "$TMP/regs.0" "$TMP/regs.$NATIVE"
+		ANYERRORS=1
+	fi
+done
+
+if [ z$ANYERRORS = z1 ]; then
+	printf "\n\n"
+	false
+fi
@@ -0,0 +1,48 @@
+#!/bin/sh
+#
+#  Regression test: Single-stepping, and then continuing, an emulation of
+#  two machines with threaded cpus must not hang. Start using:
+#
+#	test/test_threaded_step.sh [path to gxemul]
+#
+#  The step runs the cpus of both machines from the main thread, and the
+#  continue hands them over to the machine threads. test/ppc_native.bin
+#  halts the emulator (with exit status 0) when it is done.
+#
+
+GXEMUL=${1:-./gxemul}
+TESTDIR=`cd \`dirname $0\` && pwd`
+TMP=`mktemp -d /tmp/gxemul_test.XXXXXX` || exit 1
+trap 'rm -rf "$TMP"' 0
+
+#  The emulator's console reads stdin; keep it open but silent.
+mkfifo "$TMP/stdin" || exit 1
+exec 3<>"$TMP/stdin"
+
+for M in 1 2; do
+	cat >> "$TMP/config" << EOF
+machine(
+	name("machine $M")
+	type("testppc")
+	cpu("PPC750")
+	ncpus(2)
+	threaded_cpus(yes)
+	load("0x10000:0:0x10000:$TESTDIR/ppc_native.bin")
+)
+EOF
+done
+
+timeout 60 "$GXEMUL" -q -V -c step -c continue @"$TMP/config" <&3 \
+    > "$TMP/out" 2> "$TMP/err"
+STATUS=$?
+
+if [ $STATUS = 124 ]; then
+	printf "\nError: the emulator hung after step and continue\n"
+	exit 1
+fi
+
+if [ $STATUS != 0 ]; then
+	printf "\nError: exit status $STATUS\n"
+	cat "$TMP/err"
+	exit 1
+fi